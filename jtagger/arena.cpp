@@ -0,0 +1,37 @@
+/* --------------------------------------------------------------------------------------- */
+/* ------------------------- Fixed memory arena for the scan registers --------------------*/
+/* --------------------------------------------------------------------------------------- */
+
+#include "arena.h"
+
+static reg_t arena[ARENA_WORDS];
+static uint16_t arena_top = 0;
+
+reg_t* arena_alloc(uint16_t bits)
+{
+    reg_t* reg = NULL;
+
+    if (arena_top + REG_WORDS(bits) > ARENA_WORDS)
+        return NULL;
+
+    reg = &arena[arena_top];
+    arena_top += REG_WORDS(bits);
+    clear_reg(reg, bits);
+    return reg;
+}
+
+uint16_t arena_mark()
+{
+    return arena_top;
+}
+
+void arena_release(uint16_t mark)
+{
+    if (mark < arena_top)
+        arena_top = mark;
+}
+
+uint16_t arena_used()
+{
+    return arena_top;
+}
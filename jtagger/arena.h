@@ -0,0 +1,43 @@
+/** @file arena.h
+ *
+ * @brief Fixed memory arena for the scan registers.
+ *
+ * Every register buffer of the sketch is carved out of a single static array,
+ * so the SRAM budget is known at compile time and nothing comes from the heap.
+ * Buffers are taken in order and given back all at once, by rolling the arena
+ * back to a mark: the session registers are taken once by regs_init(), the
+ * per-TAP IR registers every time the chain is detected.
+ */
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include "Arduino.h"
+#include "jtagger.h"
+
+// the session DR and IR registers, then an IR register pair for every TAP
+#define ARENA_WORDS (2 * REG_WORDS(MAX_DR_LEN) + 2 * REG_WORDS(MAX_IR_LEN) + \
+                     2 * MAX_ALLOWED_TAPS * REG_WORDS(MAX_IR_LEN))
+
+/**
+ * @brief Take a zeroed register out of the arena.
+ * @param bits Size of the register in bits.
+ * @return The register, or NULL if the arena is full.
+ */
+reg_t* arena_alloc(uint16_t bits);
+
+/**
+ * @return A mark to roll the arena back to with arena_release().
+ */
+uint16_t arena_mark();
+
+/**
+ * @brief Give back every register taken after a mark.
+ */
+void arena_release(uint16_t mark);
+
+/**
+ * @return Number of words in use.
+ */
+uint16_t arena_used();
+
+#endif /* __ARENA_H__ */
@@ -0,0 +1,396 @@
+/* --------------------------------------------------------------------------------------- */
+/* ------------------- ARM JTAG-DP and MEM-AP memory access (ADIv5) -----------------------*/
+/* --------------------------------------------------------------------------------------- */
+
+#include "jtagger.h"
+#include "arm_dp.h"
+#include "binproto.h"
+
+arm_dp_t dp = { NULL, 0, DP_SELECT_UNKNOWN, 0, 0, 0 };
+
+int dp_attach(tap_t* tap)
+{
+    if (tap == NULL || tap->ir_len != 4)
+        return -ERR_OUT_OF_BOUNDS;
+
+    // the idle cycles that avoid WAIT belong to the target
+    if (dp.tap != tap)
+        dp.idle = 0;
+
+    // another scan may have changed the IR since the last access
+    dp.tap = tap;
+    dp.ir = 0;
+    dp.select = DP_SELECT_UNKNOWN;
+    dp.csw = 0;
+    return OK;
+}
+
+/**
+ * @brief Load an instruction into the DP, unless it is already there.
+ */
+static void dp_set_ir(uint8_t ir)
+{
+    if (dp.ir == ir)
+        return;
+
+    intToBinArray(dp.tap->ir_in, ir, dp.tap->ir_len);
+    insert_ir_tap(dp.tap, dp.tap->ir_in, RUN_TEST_IDLE, dp.tap->ir_out);
+    dp.ir = ir;
+}
+
+/**
+ * @brief A DPACC or APACC scan, repeated while the DP answers WAIT.
+ * @param ir DP_IR_DPACC or DP_IR_APACC.
+ * @param addr Register address, only A[3:2] are shifted.
+ * @param read true for a read, false for a write of value.
+ * @param value Value to write.
+ * @param result Receives the result of the previous read, may be NULL.
+ * @return OK, -ERR_DP_WAIT, or -ERR_DP_FAULT for an ACK that isn't OK/FAULT.
+ */
+static int dp_scan(uint8_t ir, uint8_t addr, bool read, uint32_t value, uint32_t* result)
+{
+    reg_t in[REG_WORDS(DP_ACC_LEN)];
+    reg_t out[REG_WORDS(DP_ACC_LEN)];
+    uint16_t retry = 0;
+    uint8_t ack = 0;
+
+    dp_set_ir(ir);
+
+    // RnW, A[3:2], then the data
+    in[0] = (read ? 1 : 0) | ((addr >> 1) & 0x6) | (value << 3);
+    in[1] = value >> 29;
+
+    while (true)
+    {
+        insert_dr_tap(dp.tap, in, DP_ACC_LEN, RUN_TEST_IDLE, out);
+        ack = out[0] & 0x7;
+        if (ack != DP_ACK_WAIT)
+            break;
+
+        // the scan was ignored, give the AP more time from now on
+        dp.waits++;
+        if (++retry == DP_WAIT_RETRIES) {
+            dp_abort();
+            return -ERR_DP_WAIT;
+        }
+        if (dp.idle < DP_MAX_IDLE)
+            dp.idle++;
+        run_test_idle(dp.idle);
+    }
+
+    if (ack != DP_ACK_OK_FAULT)
+        return -ERR_DP_FAULT;
+
+    if (result != NULL)
+        *result = (out[0] >> 3) | ((out[1] & 0x7) << 29);
+
+    if (ir == DP_IR_APACC && dp.idle != 0)
+        run_test_idle(dp.idle);
+
+    return OK;
+}
+
+void dp_abort()
+{
+    reg_t in[REG_WORDS(DP_ACC_LEN)] = { 1 << 3, 0 }; // DAPABORT
+    reg_t out[REG_WORDS(DP_ACC_LEN)];
+
+    dp_set_ir(DP_IR_ABORT);
+    insert_dr_tap(dp.tap, in, DP_ACC_LEN, RUN_TEST_IDLE, out);
+}
+
+int dp_read(uint8_t addr, uint32_t* value)
+{
+    int rc = dp_scan(DP_IR_DPACC, addr, true, 0, NULL);
+
+    // DP reads are pipelined too
+    if (rc == OK)
+        rc = dp_scan(DP_IR_DPACC, DP_RDBUFF, true, 0, value);
+    return rc;
+}
+
+int dp_write(uint8_t addr, uint32_t value)
+{
+    int rc = dp_scan(DP_IR_DPACC, addr, false, value, NULL);
+
+    if (addr == DP_SELECT)
+        dp.select = rc == OK ? value : DP_SELECT_UNKNOWN;
+    return rc;
+}
+
+/**
+ * @brief Select an AP and the bank of one of its registers.
+ */
+static int dp_select_ap(uint8_t ap, uint8_t addr)
+{
+    uint32_t select = ((uint32_t)ap << 24) | (addr & 0xF0);
+
+    if (dp.select == select)
+        return OK;
+
+    // the cached CSW belongs to the previous AP
+    if (dp.select == DP_SELECT_UNKNOWN || (dp.select >> 24) != ap)
+        dp.csw = 0;
+    return dp_write(DP_SELECT, select);
+}
+
+int ap_read(uint8_t ap, uint8_t addr, uint32_t* value)
+{
+    int rc = dp_select_ap(ap, addr);
+
+    if (rc == OK)
+        rc = dp_scan(DP_IR_APACC, addr, true, 0, NULL);
+    if (rc == OK)
+        rc = dp_scan(DP_IR_DPACC, DP_RDBUFF, true, 0, value);
+    return rc;
+}
+
+int ap_write(uint8_t ap, uint8_t addr, uint32_t value)
+{
+    int rc = dp_select_ap(ap, addr);
+
+    if (rc == OK)
+        rc = dp_scan(DP_IR_APACC, addr, false, value, NULL);
+    if (addr == AP_CSW)
+        dp.csw = rc == OK ? value : 0;
+    return rc;
+}
+
+/**
+ * @brief Clear the sticky errors flagged in a CTRL/STAT value.
+ * @return OK or -ERR_DP_FAULT if there were any.
+ */
+static int dp_clear_errors(uint32_t stat)
+{
+    const uint32_t sticky = DP_STICKYORUN | DP_STICKYCMP | DP_STICKYERR | DP_WDATAERR;
+
+    if ((stat & (DP_STICKYORUN | DP_STICKYERR | DP_WDATAERR)) == 0)
+        return OK;
+
+    // on a JTAG-DP, writing 1 to a sticky flag clears it
+    dp_write(DP_CTRL_STAT, (stat & (DP_CDBGPWRUPREQ | DP_CSYSPWRUPREQ)) | sticky);
+    return -ERR_DP_FAULT;
+}
+
+int dp_check_errors()
+{
+    uint32_t stat = 0;
+    int rc = dp_read(DP_CTRL_STAT, &stat);
+
+    if (rc == OK)
+        rc = dp_clear_errors(stat);
+    return rc;
+}
+
+int dp_power_up()
+{
+    const uint32_t acks = DP_CDBGPWRUPACK | DP_CSYSPWRUPACK;
+    uint32_t stat = 0;
+    int rc = OK;
+
+    rc = dp_write(DP_CTRL_STAT, DP_CDBGPWRUPREQ | DP_CSYSPWRUPREQ |
+                  DP_STICKYORUN | DP_STICKYCMP | DP_STICKYERR | DP_WDATAERR);
+
+    for (uint8_t i = 0; i < DP_POWERUP_TRIES && rc == OK; i++)
+    {
+        rc = dp_read(DP_CTRL_STAT, &stat);
+        if (rc == OK && (stat & acks) == acks)
+            return OK;
+    }
+    return rc != OK ? rc : -ERR_DP_FAULT;
+}
+
+/**
+ * @brief Select a MEM-AP for 32 bit accesses with auto-increment.
+ */
+static int mem_begin(uint8_t ap)
+{
+    int rc = dp_select_ap(ap, AP_CSW);
+
+    if (rc == OK && dp.csw != AP_CSW_WORD_INC)
+        rc = ap_write(ap, AP_CSW, AP_CSW_WORD_INC);
+    return rc;
+}
+
+/**
+ * @brief Read CTRL/STAT after a block, the first scan returns the last result of the block.
+ * @param last Receives the last result, may be NULL.
+ */
+static int mem_end(uint32_t* last)
+{
+    uint32_t stat = 0;
+    int rc = dp_scan(DP_IR_DPACC, DP_CTRL_STAT, true, 0, last);
+
+    if (rc == OK)
+        rc = dp_scan(DP_IR_DPACC, DP_RDBUFF, true, 0, &stat);
+    if (rc == OK)
+        rc = dp_clear_errors(stat);
+    return rc;
+}
+
+int mem_read(uint8_t ap, uint32_t addr, uint32_t* buf, uint32_t num)
+{
+    uint32_t* pending = NULL; // the word whose read is in the pipeline
+    uint32_t i = 0;
+    int rc = OK;
+
+    if (num == 0)
+        return OK;
+
+    rc = mem_begin(ap);
+
+    for (i = 0; i < num && rc == OK; i++)
+    {
+        // TAR at the start and at every boundary, its scan still returns the previous word
+        if (i == 0 || (addr + 4 * i) % AP_TAR_WRAP == 0) {
+            rc = dp_scan(DP_IR_APACC, AP_TAR, false, addr + 4 * i, pending);
+            pending = NULL;
+        }
+
+        // every read returns the one before it
+        if (rc == OK)
+            rc = dp_scan(DP_IR_APACC, AP_DRW, true, 0, pending);
+        pending = &buf[i];
+    }
+
+    if (rc == OK)
+        rc = mem_end(pending);
+    return rc;
+}
+
+int mem_write(uint8_t ap, uint32_t addr, const uint8_t* data, uint32_t num)
+{
+    uint32_t word = 0;
+    uint32_t i = 0;
+    int rc = OK;
+
+    if (num == 0)
+        return OK;
+
+    rc = mem_begin(ap);
+
+    for (i = 0; i < num && rc == OK; i++)
+    {
+        if (i == 0 || (addr + 4 * i) % AP_TAR_WRAP == 0)
+            rc = dp_scan(DP_IR_APACC, AP_TAR, false, addr + 4 * i, NULL);
+
+        memcpy(&word, &data[4 * i], 4);
+        if (rc == OK)
+            rc = dp_scan(DP_IR_APACC, AP_DRW, false, word, NULL);
+    }
+
+    // a write error shows in CTRL/STAT once the last write is done
+    if (rc == OK)
+        rc = mem_end(NULL);
+    return rc;
+}
+
+void mem_dump_stream(uint8_t ap, uint32_t addr, uint32_t num)
+{
+    binproto_blocks_t blocks;
+    uint32_t done = 0;
+    uint32_t n = 0;
+    int rc = OK;
+
+    binproto_blocks_begin(&blocks, BIN_CMD_MEM_BLOCK, addr);
+    while (done < num)
+    {
+        n = num - done;
+        if (n > binproto_blocks_room(&blocks))
+            n = binproto_blocks_room(&blocks);
+
+        // the previous block drains from the serial ring while this one is read
+        rc = mem_read(ap, addr + 4 * done, binproto_blocks_buf(&blocks), n);
+        if (rc != OK)
+            break;
+
+        binproto_blocks_add(&blocks, n);
+        done += n;
+    }
+
+    binproto_blocks_end(&blocks);
+
+    binproto_send_reply(BIN_CMD_MEM_READ, -rc, (uint8_t*)&done, 4);
+}
+
+/**
+ * @brief Prints the menu of the memory accesses.
+ */
+static void arm_print_menu()
+{
+    Host.print(F("\n\nARM Debug Port Menu\n"));
+    Host.print(F("a - Read memory words\n"));
+    Host.print(F("b - Write a memory word\n"));
+    Host.print(F("c - Read the IDR of an AP\n"));
+    Host.print(F("z - Exit\n"));
+}
+
+void arm_main(tap_t* tap)
+{
+    uint32_t addr = 0;
+    uint32_t num = 0;
+    uint32_t word = 0;
+    int rc = dp_attach(tap);
+
+    if (rc != OK) {
+        Host.print(F("\nSelect the TAP of the JTAG-DP first (4 bit IR)"));
+        return;
+    }
+
+    arm_print_menu();
+    char command = getCharacter(F("\narm > "));
+
+    if (command == 'z') {
+        Host.print(F("\nGoing back to main menu..."));
+        return;
+    }
+
+    rc = dp_power_up();
+    if (rc != OK) {
+        Host.print(F("\nThe debug domains didn't power up"));
+        return;
+    }
+
+    switch (command)
+    {
+    case 'a':
+        // memory words through AP 0
+        rc = parseNumber(NULL, 32, F("\nAddress > "), &addr);
+        if (rc != OK) break;
+        rc = parseNumber(NULL, 16, F("\nNumber of words > "), &num);
+        if (rc != OK) break;
+
+        for (uint32_t i = 0; i < num && rc == OK; i++)
+        {
+            rc = mem_read(0, addr + 4 * i, &word, 1);
+            if (i % 4 == 0) {
+                Host.print(F("\n0x")); Host.print(addr + 4 * i, HEX); Host.print(':');
+            }
+            Host.print(F(" 0x")); Host.print(word, HEX);
+        }
+        break;
+
+    case 'b':
+        rc = parseNumber(NULL, 32, F("\nAddress > "), &addr);
+        if (rc != OK) break;
+        rc = parseNumber(NULL, 32, F("\nWord > "), &word);
+        if (rc != OK) break;
+        rc = mem_write(0, addr, (uint8_t*)&word, 1);
+        break;
+
+    case 'c':
+        rc = parseNumber(NULL, 8, F("\nAP > "), &num);
+        if (rc != OK) break;
+        rc = ap_read(num, AP_IDR, &word);
+        Host.print(F("\nIDR: 0x")); Host.print(word, HEX);
+        break;
+
+    default:
+        break;
+    }
+
+    if (rc == -ERR_DP_FAULT)
+        Host.print(F("\nFAULT: the access was refused, or the bus returned an error"));
+    else if (rc == -ERR_DP_WAIT)
+        Host.print(F("\nThe access never finished (WAIT), aborted"));
+}
@@ -0,0 +1,177 @@
+/** @file arm_dp.h
+ *
+ * @brief ARM debug access through a JTAG-DP (ADIv5), e.g. the Cortex-M4 TAP of the STM32F405.
+ *
+ * DPACC and APACC scans are 35 bits: RnW, A[3:2] and 32 data bits go in,
+ * a 3 bit ACK and 32 data bits come out. The data that comes out is the
+ * result of the previous read, so a block read through DRW is pipelined:
+ * every scan starts the next read and returns the one before it, and the
+ * last result is picked up with a read of RDBUFF.
+ *
+ * A WAIT ACK means the previous AP access hasn't finished; the scan had no
+ * effect and is repeated here, and every WAIT adds a RUN_TEST_IDLE cycle
+ * after the AP scans so a slow bus stops answering WAIT at all.
+ *
+ * Memory is accessed in 32 bit words through a MEM-AP with TAR auto-increment.
+ * TAR only increments within a 1 KB block, so it is rewritten at every boundary.
+ */
+#ifndef __ARM_DP_H__
+#define __ARM_DP_H__
+
+#include "Arduino.h"
+#include "jtagger.h"
+
+// JTAG-DP instructions (4 bit IR)
+#define DP_IR_ABORT     0x8
+#define DP_IR_DPACC     0xA
+#define DP_IR_APACC     0xB
+#define DP_IR_IDCODE    0xE
+#define DP_IR_BYPASS    0xF
+
+#define DP_ACC_LEN      35
+
+// ACK of a DPACC/APACC scan
+#define DP_ACK_WAIT     0x1
+#define DP_ACK_OK_FAULT 0x2
+
+// DP registers
+#define DP_CTRL_STAT    0x4
+#define DP_SELECT       0x8
+#define DP_RDBUFF       0xC
+
+// CTRL/STAT bits
+#define DP_STICKYORUN   (1UL << 1)
+#define DP_STICKYCMP    (1UL << 4)
+#define DP_STICKYERR    (1UL << 5)
+#define DP_WDATAERR     (1UL << 7)
+#define DP_CDBGPWRUPREQ (1UL << 28)
+#define DP_CDBGPWRUPACK (1UL << 29)
+#define DP_CSYSPWRUPREQ (1UL << 30)
+#define DP_CSYSPWRUPACK (1UL << 31)
+
+// MEM-AP registers
+#define AP_CSW          0x00
+#define AP_TAR          0x04
+#define AP_DRW          0x0C
+#define AP_IDR          0xFC
+
+// CSW: 32 bit accesses, single auto-increment, privileged debugger accesses
+#define AP_CSW_WORD_INC 0xA2000012
+
+// TAR auto-increment stops at these boundaries
+#define AP_TAR_WRAP     1024
+
+// WAIT answers of a single scan before the access is aborted
+#define DP_WAIT_RETRIES 100
+
+// most RUN_TEST_IDLE cycles added after AP scans
+#define DP_MAX_IDLE     64
+
+// CTRL/STAT reads while waiting for the debug power up
+#define DP_POWERUP_TRIES 100
+
+typedef struct
+{
+    tap_t* tap;         // the JTAG-DP
+    uint8_t ir;         // instruction in its IR, 0 if unknown
+    uint32_t select;    // value of SELECT, or DP_SELECT_UNKNOWN
+    uint32_t csw;       // CSW of the selected AP, 0 if unknown
+    uint8_t idle;       // RUN_TEST_IDLE cycles after every AP scan
+    uint32_t waits;     // WAIT answers so far
+} arm_dp_t;
+
+#define DP_SELECT_UNKNOWN 0xFFFFFFFF
+
+extern arm_dp_t dp;
+
+/**
+ * @brief Use a TAP of the chain as the JTAG-DP. Forgets what is known
+ * about its registers, the next accesses set them again.
+ * @return OK or -ERR_OUT_OF_BOUNDS if it isn't a 4 bit IR TAP.
+ */
+int dp_attach(tap_t* tap);
+
+/**
+ * @brief Power up the debug and system domains and clear the sticky errors.
+ * @return OK, -ERR_DP_FAULT if the domains don't come up, or -ERR_DP_WAIT.
+ */
+int dp_power_up();
+
+/**
+ * @brief Write an ABORT with DAPABORT set, ending an AP access that never finishes.
+ */
+void dp_abort();
+
+/**
+ * @brief Read a DP register.
+ * @param addr Register address (0x0, 0x4, 0x8 or 0xC).
+ * @param value Receives the value read.
+ * @return OK, -ERR_DP_WAIT, or -ERR_DP_FAULT for an ACK that isn't OK/FAULT.
+ */
+int dp_read(uint8_t addr, uint32_t* value);
+
+/**
+ * @brief Write a DP register.
+ * @return As dp_read().
+ */
+int dp_write(uint8_t addr, uint32_t value);
+
+/**
+ * @brief Read a register of an access port, selecting it (and its bank) first.
+ * @param ap Access port number.
+ * @param addr Register address in the AP.
+ * @param value Receives the value read.
+ * @return As dp_read(). An AP error only shows in CTRL/STAT, see dp_check_errors().
+ */
+int ap_read(uint8_t ap, uint8_t addr, uint32_t* value);
+
+/**
+ * @brief Write a register of an access port, selecting it (and its bank) first.
+ * @return As ap_read().
+ */
+int ap_write(uint8_t ap, uint8_t addr, uint32_t value);
+
+/**
+ * @brief Check (and clear) the sticky errors of the AP accesses since the last check.
+ * @return OK or -ERR_DP_FAULT.
+ */
+int dp_check_errors();
+
+/**
+ * @brief Read words from memory through a MEM-AP, pipelined.
+ * @param ap MEM-AP number.
+ * @param addr Word aligned address.
+ * @param buf Receives the words.
+ * @param num Number of 32 bit words.
+ * @return OK, -ERR_DP_FAULT (bus error, the words are invalid) or -ERR_DP_WAIT.
+ */
+int mem_read(uint8_t ap, uint32_t addr, uint32_t* buf, uint32_t num);
+
+/**
+ * @brief Write words to memory through a MEM-AP.
+ * @param ap MEM-AP number.
+ * @param addr Word aligned address.
+ * @param data The words, little endian. (no alignment needed)
+ * @param num Number of 32 bit words.
+ * @return As mem_read().
+ */
+int mem_write(uint8_t ap, uint32_t addr, const uint8_t* data, uint32_t num);
+
+/**
+ * @brief Stream memory words to the host as BIN_CMD_MEM_BLOCK frames.
+ * While one block is being sent, the next one is read. Every block frame
+ * starts with the address of its first word, and the stream ends with a
+ * BIN_CMD_MEM_READ reply that holds the number of words sent.
+ * @param ap MEM-AP number.
+ * @param addr Word aligned address to start from.
+ * @param num Number of 32 bit words.
+ */
+void mem_dump_stream(uint8_t ap, uint32_t addr, uint32_t num);
+
+/**
+ * @brief User interface for the memory accesses through a JTAG-DP.
+ * @param tap The JTAG-DP.
+ */
+void arm_main(tap_t* tap);
+
+#endif /* __ARM_DP_H__ */
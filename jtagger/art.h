@@ -2,15 +2,15 @@
 #define __ART__H__
 
 // "Arduino Jtagger"
-char art0[] = {' ','_', '_', '_', '_', '_', '_', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', '_', '_', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', '_', '_', '_', '_', '_', ' ', ' ', '_', '_', ' ','\n'};
-char art1[] = {'/', '\\', ' ', ' ', '_', ' ', ' ', '\\', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', '/', '\\', ' ', '\\', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', '_', '_', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', '/', '\\', '_', '_', '_', ' ', '\\', '/', '\\', ' ', '\\', '_', '_','\n'};
-char art2[] = {'\\', ' ', '\\', ' ', '\\', 'L', '\\', ' ', '\\', ' ', ' ', '_', ' ', '_', '_', ' ', ' ', '\\', '_', '\\', ' ', '\\', ' ', ' ', '_', '_', ' ', ' ', '_', '_', '/', '\\', '_', '\\', ' ', ' ', ' ', ' ', '_', '_', '_', ' ', ' ', ' ', ' ', ' ', '_', '_', '_', ' ', ' ', ' ', ' ', ' ', '\\', '/', '_', '_', '/', '\\', ' ', '\\', ' ', '\\', ' ', ',', '_', '\\', ' ', ' ', ' ', ' ', '_', '_', ' ', ' ', ' ', ' ', ' ', ' ', ' ', '_', '_', ' ', ' ', ' ', ' ', ' ', ' ', '_', '_', ' ', ' ', ' ', ' ', ' ', ' ', '_', '_', ' ', ' ', ' ', '_', ' ', '_', '_', ' ', ' ','\n'};
-char art3[] = {' ', '\\', ' ', '\\', ' ', ' ', '_', '_', ' ', '\\', '/', '\\', '`', ' ', '_', '_', '\\', '/', ' ', '_', '`', ' ', '\\', '/', '\\', ' ', '\\', '/', '\\', ' ', '\\', '/', '\\', ' ', '\\', ' ', '/', ' ', ' ', '_', ' ', '`', '\\', ' ', ' ', '/', ' ', '_', '_', '`', '\\', ' ', ' ', ' ', ' ', ' ', ' ', '_', '\\', ' ', '\\', ' ', '\\', ' ', '\\', ' ', '\\', '/', ' ', ' ', '/', ' ', '_', '_', '`', '\\', ' ', ' ', ' ', '/', ' ', '_', ' ', '`', '\\', ' ', ' ', '/', ' ', '_', ' ', '`', '\\', ' ', ' ', '/', ' ', '_', '_', '`', '\\', '/', '\\', '`', ' ', '_', '_', '\\', ' ','\n'};
-char art4[] = {' ', ' ', '\\', ' ', '\\', ' ', '\\', '/', '\\', ' ', '\\', ' ', '\\', ' ', '\\', '/', '/', '\\', ' ', '\\', 'L', '\\', ' ', '\\', ' ', '\\', ' ', '\\', '_', '\\', ' ', '\\', ' ', '\\', ' ', '\\', '/', '\\', ' ', '\\', '/', '\\', ' ', '\\', '/', '\\', ' ', '\\', 'L', '\\', ' ', '\\', ' ', ' ', ' ', ' ', '/', '\\', ' ', '\\', '_', '\\', ' ', '\\', ' ', '\\', ' ', '\\', '_', '/', '\\', ' ', '\\', 'L', '\\', '.', '\\', '_', '/', '\\', ' ', '\\', 'L', '\\', ' ', '\\', '/', '\\', ' ', '\\', 'L', '\\', ' ', '\\', '/', '\\', ' ', ' ', '_', '_', '/', '\\', ' ', '\\', ' ', '\\', '/', ' ','\n'};
-char art5[] = {' ', ' ', ' ', '\\', ' ', '\\', '_', '\\', ' ', '\\', '_', '\\', ' ', '\\', '_', '\\', ' ', '\\', '_', '_', '_', ',', '_', '_', '\\', ' ', '\\', '_', '_', '_', '_', '/', '\\', ' ', '\\', '_', '\\', ' ', '\\', '_', '\\', ' ', '\\', '_', '\\', ' ', '\\', '_', '_', '_', '_', '/', ' ', ' ', ' ',' ', '\\', ' ', '\\', '_', '_', '_', '_', '/', '\\', ' ', '\\', '_', '_', '\\', ' ', '\\', '_', '_', '/', '.', '\\', '_', '\\', ' ', '\\', '_', '_', '_', '_', ' ', '\\', ' ', '\\', '_', '_', '_', '_', ' ', '\\', ' ', '\\', '_', '_', '_', '_', '\\', ' ', '\\', '_', '\\', ' ','\n'};
-char art6[] = {' ', ' ', ' ', ' ', '\\', '/', '_', '/', '\\', '/', '_', '/', '\\', '/', '_', '/', ' ', '\\', '/', '_', '_', ',', '_', ' ', '/', '\\', '/', '_', '_', '_', '/', ' ', ' ', '\\', '/', '_', '/', '\\', '/', '_', '/', '\\', '/', '_', '/', '\\', '/', '_', '_', '_', '/', ' ', ' ', ' ', ' ', ' ', ' ', '\\', '/', '_', '_', '_', '/', ' ', ' ', '\\', '/', '_', '_', '/', '\\', '/', '_', '_', '/', '\\', '/', '_', '/', '\\', '/', '_', '_', '_', 'L', '\\', ' ', '\\', '/', '_', '_', '_', 'L', '\\', ' ', '\\', '/', '_', '_', '_', '_', '/', ' ', '\\', '/', '_', '/', ' ','\n'};
-char art7[] = {' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', '/', '\\', '_', '_', '_', '_', '/', ' ', '/', '\\', '_', '_', '_', '_', '/', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ','\n'};
-char art8[] = {' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', '\\', '_', '/', '_', '_', '/', ' ', ' ', '\\', '_', '/', '_', '_', '/', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ','\n'};
+const char art0[] PROGMEM = {' ','_', '_', '_', '_', '_', '_', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', '_', '_', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', '_', '_', '_', '_', '_', ' ', ' ', '_', '_', ' ','\n'};
+const char art1[] PROGMEM = {'/', '\\', ' ', ' ', '_', ' ', ' ', '\\', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', '/', '\\', ' ', '\\', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', '_', '_', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', '/', '\\', '_', '_', '_', ' ', '\\', '/', '\\', ' ', '\\', '_', '_','\n'};
+const char art2[] PROGMEM = {'\\', ' ', '\\', ' ', '\\', 'L', '\\', ' ', '\\', ' ', ' ', '_', ' ', '_', '_', ' ', ' ', '\\', '_', '\\', ' ', '\\', ' ', ' ', '_', '_', ' ', ' ', '_', '_', '/', '\\', '_', '\\', ' ', ' ', ' ', ' ', '_', '_', '_', ' ', ' ', ' ', ' ', ' ', '_', '_', '_', ' ', ' ', ' ', ' ', ' ', '\\', '/', '_', '_', '/', '\\', ' ', '\\', ' ', '\\', ' ', ',', '_', '\\', ' ', ' ', ' ', ' ', '_', '_', ' ', ' ', ' ', ' ', ' ', ' ', ' ', '_', '_', ' ', ' ', ' ', ' ', ' ', ' ', '_', '_', ' ', ' ', ' ', ' ', ' ', ' ', '_', '_', ' ', ' ', ' ', '_', ' ', '_', '_', ' ', ' ','\n'};
+const char art3[] PROGMEM = {' ', '\\', ' ', '\\', ' ', ' ', '_', '_', ' ', '\\', '/', '\\', '`', ' ', '_', '_', '\\', '/', ' ', '_', '`', ' ', '\\', '/', '\\', ' ', '\\', '/', '\\', ' ', '\\', '/', '\\', ' ', '\\', ' ', '/', ' ', ' ', '_', ' ', '`', '\\', ' ', ' ', '/', ' ', '_', '_', '`', '\\', ' ', ' ', ' ', ' ', ' ', ' ', '_', '\\', ' ', '\\', ' ', '\\', ' ', '\\', ' ', '\\', '/', ' ', ' ', '/', ' ', '_', '_', '`', '\\', ' ', ' ', ' ', '/', ' ', '_', ' ', '`', '\\', ' ', ' ', '/', ' ', '_', ' ', '`', '\\', ' ', ' ', '/', ' ', '_', '_', '`', '\\', '/', '\\', '`', ' ', '_', '_', '\\', ' ','\n'};
+const char art4[] PROGMEM = {' ', ' ', '\\', ' ', '\\', ' ', '\\', '/', '\\', ' ', '\\', ' ', '\\', ' ', '\\', '/', '/', '\\', ' ', '\\', 'L', '\\', ' ', '\\', ' ', '\\', ' ', '\\', '_', '\\', ' ', '\\', ' ', '\\', ' ', '\\', '/', '\\', ' ', '\\', '/', '\\', ' ', '\\', '/', '\\', ' ', '\\', 'L', '\\', ' ', '\\', ' ', ' ', ' ', ' ', '/', '\\', ' ', '\\', '_', '\\', ' ', '\\', ' ', '\\', ' ', '\\', '_', '/', '\\', ' ', '\\', 'L', '\\', '.', '\\', '_', '/', '\\', ' ', '\\', 'L', '\\', ' ', '\\', '/', '\\', ' ', '\\', 'L', '\\', ' ', '\\', '/', '\\', ' ', ' ', '_', '_', '/', '\\', ' ', '\\', ' ', '\\', '/', ' ','\n'};
+const char art5[] PROGMEM = {' ', ' ', ' ', '\\', ' ', '\\', '_', '\\', ' ', '\\', '_', '\\', ' ', '\\', '_', '\\', ' ', '\\', '_', '_', '_', ',', '_', '_', '\\', ' ', '\\', '_', '_', '_', '_', '/', '\\', ' ', '\\', '_', '\\', ' ', '\\', '_', '\\', ' ', '\\', '_', '\\', ' ', '\\', '_', '_', '_', '_', '/', ' ', ' ', ' ',' ', '\\', ' ', '\\', '_', '_', '_', '_', '/', '\\', ' ', '\\', '_', '_', '\\', ' ', '\\', '_', '_', '/', '.', '\\', '_', '\\', ' ', '\\', '_', '_', '_', '_', ' ', '\\', ' ', '\\', '_', '_', '_', '_', ' ', '\\', ' ', '\\', '_', '_', '_', '_', '\\', ' ', '\\', '_', '\\', ' ','\n'};
+const char art6[] PROGMEM = {' ', ' ', ' ', ' ', '\\', '/', '_', '/', '\\', '/', '_', '/', '\\', '/', '_', '/', ' ', '\\', '/', '_', '_', ',', '_', ' ', '/', '\\', '/', '_', '_', '_', '/', ' ', ' ', '\\', '/', '_', '/', '\\', '/', '_', '/', '\\', '/', '_', '/', '\\', '/', '_', '_', '_', '/', ' ', ' ', ' ', ' ', ' ', ' ', '\\', '/', '_', '_', '_', '/', ' ', ' ', '\\', '/', '_', '_', '/', '\\', '/', '_', '_', '/', '\\', '/', '_', '/', '\\', '/', '_', '_', '_', 'L', '\\', ' ', '\\', '/', '_', '_', '_', 'L', '\\', ' ', '\\', '/', '_', '_', '_', '_', '/', ' ', '\\', '/', '_', '/', ' ','\n'};
+const char art7[] PROGMEM = {' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', '/', '\\', '_', '_', '_', '_', '/', ' ', '/', '\\', '_', '_', '_', '_', '/', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ','\n'};
+const char art8[] PROGMEM = {' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', '\\', '_', '/', '_', '_', '/', ' ', ' ', '\\', '_', '/', '_', '_', '/', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ','\n'};
 /*
                                                                                  
   ___        __  __ _    _             _  __   ___         _            _    _ _   
@@ -0,0 +1,1303 @@
+/* --------------------------------------------------------------------------------------- */
+/* ----------------------- Binary framed command mode for the host ------------------------*/
+/* --------------------------------------------------------------------------------------- */
+
+#include "binproto.h"
+#include "max10_funcs.h"
+#include "bsdl_table.h"
+#include "arm_dp.h"
+#include "tap_trace.h"
+#include "gang.h"
+
+/**
+ * Incremental frame receiver. It consumes whatever bytes are available
+ * without blocking, so a frame can be received while a batch is running.
+ */
+typedef enum RxState
+{
+    RX_SOF, RX_HDR, RX_PAYLOAD, RX_CRC, RX_DONE
+} rx_state;
+
+typedef struct
+{
+    rx_state state;
+    uint8_t hdr[3];
+    uint8_t tail[2];
+    uint8_t* payload;
+    uint16_t len;
+    uint16_t pos;
+    uint32_t last_ms;
+    int rc;
+} frame_rx_t;
+
+// two frame buffers: one being executed, one being received
+static uint8_t frame_bufs[2][BIN_MAX_PAYLOAD];
+static frame_rx_t rx;
+
+uint16_t crc16_update(uint16_t crc, const uint8_t* data, uint16_t len)
+{
+    for (uint16_t i = 0; i < len; i++)
+    {
+        crc ^= (uint16_t)data[i] << 8;
+        for (uint8_t b = 0; b < 8; b++)
+        {
+            if (crc & 0x8000)
+                crc = (crc << 1) ^ 0x1021;
+            else
+                crc <<= 1;
+        }
+    }
+    return crc;
+}
+
+// CRC-32 of every nibble value, reflected poly 0xEDB88320
+static const uint32_t crc32_nibbles[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+};
+
+uint32_t crc32_update(uint32_t crc, const uint8_t* data, uint16_t len)
+{
+    for (uint16_t i = 0; i < len; i++)
+    {
+        crc ^= data[i];
+        crc = (crc >> 4) ^ crc32_nibbles[crc & 0xF];
+        crc = (crc >> 4) ^ crc32_nibbles[crc & 0xF];
+    }
+    return crc;
+}
+
+/**
+ * @brief Start receiving a new frame into the given payload buffer.
+ */
+static void frame_rx_start(frame_rx_t* f, uint8_t* payload)
+{
+    f->state = RX_SOF;
+    f->payload = payload;
+    f->len = 0;
+    f->pos = 0;
+    f->rc = OK;
+}
+
+/**
+ * @brief Consume the available serial bytes into the frame being received.
+ * @return true when the frame is complete (check f->rc for errors).
+ */
+static bool frame_rx_poll(frame_rx_t* f)
+{
+    uint16_t crc = 0;
+    int c = 0;
+
+    while (f->state != RX_DONE && Host.available() > 0)
+    {
+        c = Host.read();
+        f->last_ms = millis();
+        stats.serial_rx++;
+
+        switch (f->state)
+        {
+        case RX_SOF:
+            // hunt for the start of a frame
+            if (c == BIN_SOF) {
+                f->state = RX_HDR;
+                f->pos = 0;
+            }
+            break;
+
+        case RX_HDR:
+            f->hdr[f->pos++] = c;
+            if (f->pos == sizeof(f->hdr)) {
+                f->len = f->hdr[1] | (f->hdr[2] << 8);
+                f->pos = 0;
+                if (f->len > BIN_MAX_PAYLOAD) {
+                    f->rc = -ERR_BAD_FRAME;
+                    f->state = RX_DONE;
+                }
+                else {
+                    f->state = f->len ? RX_PAYLOAD : RX_CRC;
+                }
+            }
+            break;
+
+        case RX_PAYLOAD:
+            f->payload[f->pos++] = c;
+            if (f->pos == f->len) {
+                f->pos = 0;
+                f->state = RX_CRC;
+            }
+            break;
+
+        case RX_CRC:
+            f->tail[f->pos++] = c;
+            if (f->pos == sizeof(f->tail)) {
+                crc = crc16_update(0xFFFF, f->hdr, sizeof(f->hdr));
+                crc = crc16_update(crc, f->payload, f->len);
+                if (crc != (f->tail[0] | (f->tail[1] << 8)))
+                    f->rc = -ERR_BAD_CRC;
+                f->state = RX_DONE;
+            }
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    // drop a frame that stopped arriving midway
+    if (f->state != RX_SOF && f->state != RX_DONE && millis() - f->last_ms > BIN_TIMEOUT_MS) {
+        f->rc = -ERR_BAD_FRAME;
+        f->state = RX_DONE;
+    }
+
+    return f->state == RX_DONE;
+}
+
+int binproto_read_frame(uint8_t* cmd, uint8_t* payload, uint16_t* len)
+{
+    frame_rx_t f;
+
+    frame_rx_start(&f, payload);
+    while (!frame_rx_poll(&f)) {}
+
+    *cmd = f.hdr[0];
+    *len = f.len;
+    return f.rc;
+}
+
+void binproto_send_reply_parts(uint8_t cmd, uint8_t status, const uint8_t* hdr, uint16_t hdr_len,
+                               const uint8_t* data, uint16_t len)
+{
+    uint8_t head[5];
+    uint16_t total = 1 + hdr_len + len;
+    uint16_t crc = 0xFFFF;
+
+    head[0] = BIN_SOF;
+    head[1] = cmd | BIN_REPLY;
+    head[2] = total & 0xff;
+    head[3] = total >> 8;
+    head[4] = status;
+
+    crc = crc16_update(crc, &head[1], sizeof(head) - 1);
+    if (hdr != NULL)
+        crc = crc16_update(crc, hdr, hdr_len);
+    if (data != NULL)
+        crc = crc16_update(crc, data, len);
+
+    // queued in the TX ring, only blocks (and counts flush_us) while it is full
+    Host.write(head, sizeof(head));
+    if (hdr != NULL)
+        Host.write(hdr, hdr_len);
+    if (data != NULL)
+        Host.write(data, len);
+    Host.write((uint8_t)(crc & 0xff));
+    Host.write((uint8_t)(crc >> 8));
+    stats.serial_tx += sizeof(head) + total - 1 + 2;
+}
+
+void binproto_send_reply(uint8_t cmd, uint8_t status, const uint8_t* data, uint16_t len)
+{
+    binproto_send_reply_parts(cmd, status, NULL, 0, data, data ? len : 0);
+}
+
+void binproto_tx_begin(binproto_tx_t* tx, uint8_t cmd, uint8_t status, const uint8_t* hdr, uint8_t hdr_len,
+                       const uint8_t* data, uint16_t len)
+{
+    uint16_t total = 1 + hdr_len + len;
+    uint16_t crc = 0xFFFF;
+
+    tx->head[0] = BIN_SOF;
+    tx->head[1] = cmd | BIN_REPLY;
+    tx->head[2] = total & 0xff;
+    tx->head[3] = total >> 8;
+    tx->head[4] = status;
+    if (hdr != NULL)
+        memcpy(&tx->head[5], hdr, hdr_len);
+    tx->head_len = 5 + hdr_len;
+    tx->data = data;
+    tx->data_len = len;
+    tx->pos = 0;
+
+    crc = crc16_update(crc, &tx->head[1], tx->head_len - 1);
+    crc = crc16_update(crc, data, len);
+    tx->tail[0] = crc & 0xff;
+    tx->tail[1] = crc >> 8;
+}
+
+bool binproto_tx_pump(binproto_tx_t* tx, bool block)
+{
+    uint16_t total = tx->head_len + tx->data_len + sizeof(tx->tail);
+    uint16_t room = 0;
+    uint16_t pos = tx->pos;
+    uint16_t n = 0;
+    uint32_t start = micros();
+    const uint8_t* p = NULL;
+
+    while (tx->pos < total)
+    {
+        room = Host.availableForWrite();
+        if (room == 0) {
+            if (!block) {
+                stats.serial_tx += tx->pos - pos;
+                return false;
+            }
+            continue;
+        }
+
+        // write the rest of whichever part of the frame is next
+        while (room > 0 && tx->pos < total)
+        {
+            if (tx->pos < tx->head_len) {
+                p = &tx->head[tx->pos];
+                n = tx->head_len - tx->pos;
+            }
+            else if (tx->pos < tx->head_len + tx->data_len) {
+                p = &tx->data[tx->pos - tx->head_len];
+                n = tx->head_len + tx->data_len - tx->pos;
+            }
+            else {
+                p = &tx->tail[tx->pos - tx->head_len - tx->data_len];
+                n = total - tx->pos;
+            }
+            if (n > room)
+                n = room;
+            Host.write(p, n);
+            tx->pos += n;
+            room -= n;
+        }
+    }
+
+    stats.serial_tx += tx->pos - pos;
+    if (block)
+        stats.flush_us += micros() - start;
+    return true;
+}
+
+// the blocks of the open block stream
+static uint32_t block_bufs[2][BIN_BLOCK_WORDS];
+
+void binproto_blocks_begin(binproto_blocks_t* s, uint8_t cmd, uint32_t addr)
+{
+    s->cmd = cmd;
+    s->cur = 0;
+    s->n = 0;
+    s->addr = addr;
+    s->sending = false;
+}
+
+uint32_t* binproto_blocks_buf(binproto_blocks_t* s)
+{
+    return &block_bufs[s->cur][s->n];
+}
+
+/**
+ * @brief Start sending the block being filled, once the previous one is fully
+ * written: its buffer is filled next.
+ */
+static void binproto_blocks_send(binproto_blocks_t* s)
+{
+    if (s->sending)
+        binproto_tx_pump(&s->tx, true);
+
+    binproto_tx_begin(&s->tx, s->cmd, OK, (uint8_t*)&s->addr, 4, (uint8_t*)block_bufs[s->cur], s->n * 4);
+    s->sending = true;
+
+    s->addr += s->n * 4;
+    s->cur ^= 1;
+    s->n = 0;
+}
+
+void binproto_blocks_add(binproto_blocks_t* s, uint16_t words)
+{
+    s->n += words;
+
+    if (s->sending)
+        s->sending = !binproto_tx_pump(&s->tx, false);
+
+    if (s->n == BIN_BLOCK_WORDS)
+        binproto_blocks_send(s);
+}
+
+void binproto_blocks_end(binproto_blocks_t* s)
+{
+    if (s->n > 0)
+        binproto_blocks_send(s);
+    if (s->sending)
+        binproto_tx_pump(&s->tx, true);
+    s->sending = false;
+}
+
+/**
+ * @brief Load the tdi bits of a scan into a register and shift them into the IR or DR.
+ * @param is_ir True for an IR scan, false for a DR scan.
+ * @param payload Scan description: len (2), end state (1), tdi bytes.
+ * @param avail Number of payload bytes available.
+ * @param in Register to load the tdi bits into.
+ * @param out Register that receives the tdo bits.
+ * @param max_len Size of the in/out registers in bits.
+ * @param used Number of payload bytes that the scan description takes.
+ * @return OK or a positive ERR_* code.
+ */
+static uint8_t binproto_do_scan(bool is_ir, const uint8_t* payload, uint16_t avail,
+                                reg_t* in, reg_t* out, uint16_t max_len, uint16_t* used)
+{
+    uint16_t nbits = 0;
+    uint16_t nbytes = 0;
+    uint8_t end_state = 0;
+
+    if (avail < 3)
+        return ERR_BAD_FRAME;
+
+    nbits = payload[0] | (payload[1] << 8);
+    end_state = payload[2];
+    nbytes = (nbits + 7) / 8;
+    *used = 3 + nbytes;
+
+    if (nbits == 0 || nbits > max_len || avail < *used)
+        return ERR_UNVALID_IR_OR_DR_LEN;
+    if (end_state > UPDATE_IR)
+        return ERR_BAD_TAP_STATE;
+
+    // registers are little endian words, so the bytes map directly
+    clear_reg(in, nbits);
+    memcpy((uint8_t*)in, &payload[3], nbytes);
+
+    // a selected TAP is scanned alone, the rest of the chain is padded
+    if (active_tap != NULL && is_ir && nbits != active_tap->ir_len)
+        return ERR_UNVALID_IR_OR_DR_LEN;
+
+    if (active_tap != NULL && is_ir)
+        insert_ir_tap(active_tap, in, end_state, out);
+    else if (active_tap != NULL)
+        insert_dr_tap(active_tap, in, nbits, end_state, out);
+    else if (is_ir)
+        insert_ir(in, nbits, end_state, out);
+    else
+        insert_dr(in, nbits, end_state, out);
+
+    return OK;
+}
+
+/**
+ * @brief Run a CHECK op: scan, then compare the captured bits with the expected ones.
+ * @param is_ir True for an IR scan, false for a DR scan.
+ * @param has_mask True if mask bytes follow the expected tdo bytes.
+ * @param payload Op description: len (2), end state (1), tdi, tdo [, mask] bytes.
+ * @param avail Number of payload bytes available.
+ * @param used Number of payload bytes that the op takes.
+ * @param mismatch Set to true if a checked bit differs.
+ * @return OK or a positive ERR_* code.
+ */
+static uint8_t binproto_do_check(bool is_ir, bool has_mask, const uint8_t* payload, uint16_t avail,
+                                 reg_t* in, reg_t* out, uint16_t max_len, uint16_t* used, bool* mismatch)
+{
+    const uint8_t* tdo = NULL;
+    const uint8_t* mask = NULL;
+    uint8_t* captured = (uint8_t*)out;
+    uint16_t nbits = 0;
+    uint16_t nbytes = 0;
+    uint16_t i = 0;
+    uint8_t m = 0;
+    uint8_t status = OK;
+
+    // the length is validated by the scan, check the expected bytes are there first
+    if (avail < 3)
+        return ERR_BAD_FRAME;
+    nbits = payload[0] | (payload[1] << 8);
+    nbytes = (nbits + 7) / 8;
+    if (avail < 3 + nbytes * (has_mask ? 3 : 2))
+        return ERR_BAD_FRAME;
+
+    status = binproto_do_scan(is_ir, payload, avail, in, out, max_len, used);
+    if (status != OK)
+        return status;
+
+    tdo = &payload[*used];
+    mask = has_mask ? tdo + nbytes : NULL;
+    *used += nbytes * (has_mask ? 2 : 1);
+
+    *mismatch = false;
+    for (i = 0; i < nbytes; i++)
+    {
+        m = mask != NULL ? mask[i] : 0xFF;
+        // bits past the end of the scan are never checked
+        if (i == nbytes - 1 && (nbits % 8) != 0)
+            m &= (1 << (nbits % 8)) - 1;
+        if ((captured[i] ^ tdo[i]) & m)
+            *mismatch = true;
+    }
+
+    return OK;
+}
+
+/**
+ * @brief Run a SCAN_IR or SCAN_DR request and reply with the captured bits.
+ */
+static void binproto_scan(uint8_t cmd, uint8_t* payload, uint16_t len, reg_t* in, reg_t* out, uint16_t max_len)
+{
+    uint16_t used = 0;
+    uint8_t status = binproto_do_scan(cmd == BIN_CMD_SCAN_IR, payload, len, in, out, max_len, &used);
+
+    if (status == OK && used != len)
+        status = ERR_BAD_FRAME;
+
+    if (status != OK)
+        binproto_send_reply(cmd, status, NULL, 0);
+    else
+        binproto_send_reply(cmd, OK, (uint8_t*)out, (used - 3));
+}
+
+/**
+ * @brief Receive the next frame in the background while a batch is running.
+ */
+static void binproto_poll()
+{
+    frame_rx_poll(&rx);
+}
+
+// the scan opened by BIN_CMD_SCAN_BEGIN
+static scan_stream_t stream;
+
+/**
+ * @brief Open a streamed scan, or shift its next chunk and reply with the bits shifted out.
+ * @param payload ir (1), len (4), end state (1) for BIN_CMD_SCAN_BEGIN, tdi bytes for BIN_CMD_SCAN_CHUNK.
+ */
+static void binproto_stream(uint8_t cmd, uint8_t* payload, uint16_t len, reg_t* in, reg_t* out)
+{
+    uint32_t nbits = 0;
+    int rc = OK;
+
+    if (cmd == BIN_CMD_SCAN_BEGIN) {
+        if (len != 6) {
+            binproto_send_reply(cmd, ERR_BAD_FRAME, NULL, 0);
+            return;
+        }
+        memcpy(&nbits, &payload[1], 4);
+        rc = scan_stream_begin(&stream, payload[0] != 0, nbits, payload[5], active_tap);
+        binproto_send_reply(cmd, -rc, NULL, 0);
+        return;
+    }
+
+    // a whole number of bytes, except for the last bits of the scan
+    nbits = (uint32_t)len * 8;
+    if (nbits > stream.left && (stream.left + 7) / 8 == len)
+        nbits = stream.left;
+    if (len == 0 || nbits > BIN_STREAM_CHUNK || nbits > stream.left) {
+        binproto_send_reply(cmd, ERR_UNVALID_IR_OR_DR_LEN, NULL, 0);
+        return;
+    }
+
+    clear_reg(in, nbits);
+    memcpy((uint8_t*)in, payload, len);
+
+    scan_poll_hook = binproto_poll;
+    rc = scan_stream_shift(&stream, in, nbits, out);
+    scan_poll_hook = NULL;
+
+    binproto_send_reply(cmd, -rc, (uint8_t*)out, rc == OK ? len : 0);
+}
+
+/**
+ * @brief Run a batch of queued operations back to back.
+ * Captured bits are streamed back after every IR/DR op, and the frame
+ * receiver is serviced between (and during) ops.
+ * @param payload Batch: tag (1) followed by the ops.
+ * @param len Batch length in bytes.
+ */
+static void binproto_queue(uint8_t* payload, uint16_t len, reg_t* ir_in, reg_t* ir_out, reg_t* dr_in, reg_t* dr_out)
+{
+    uint8_t hdr[3];
+    uint16_t pos = 1;
+    uint16_t index = 0;
+    uint16_t used = 0;
+    uint32_t cycles = 0;
+    uint32_t us = 0;
+    uint8_t op = 0;
+    uint8_t status = OK;
+    bool is_ir = false;
+    bool mismatch = false;
+
+    if (len < 1) {
+        binproto_send_reply(BIN_CMD_QUEUE, ERR_BAD_FRAME, NULL, 0);
+        return;
+    }
+    hdr[0] = payload[0];
+
+    scan_poll_hook = binproto_poll;
+
+    while (pos < len && status == OK)
+    {
+        op = payload[pos++];
+
+        switch (op & BIN_OP_CODE)
+        {
+        case BIN_OP_IR:
+        case BIN_OP_DR:
+            is_ir = (op & BIN_OP_CODE) == BIN_OP_IR;
+            status = binproto_do_scan(is_ir, &payload[pos], len - pos,
+                                      is_ir ? ir_in : dr_in, is_ir ? ir_out : dr_out,
+                                      is_ir ? MAX_IR_LEN : MAX_DR_LEN, &used);
+            if (status != OK)
+                break;
+
+            if (!(op & BIN_OP_NO_TDO)) {
+                hdr[1] = index & 0xff;
+                hdr[2] = index >> 8;
+                binproto_send_reply_parts(BIN_CMD_QUEUE_TDO, OK, hdr, sizeof(hdr),
+                                          (uint8_t*)(is_ir ? ir_out : dr_out), used - 3);
+            }
+            pos += used;
+            break;
+
+        case BIN_OP_RTI:
+            if (len - pos < 4) {
+                status = ERR_BAD_FRAME;
+                break;
+            }
+            memcpy(&cycles, &payload[pos], 4);
+            run_test_idle(cycles);
+            pos += 4;
+            break;
+
+        case BIN_OP_STATE:
+            if (len - pos < 1 || payload[pos] > UPDATE_IR) {
+                status = ERR_BAD_TAP_STATE;
+                break;
+            }
+            goto_state(payload[pos]);
+            pos += 1;
+            break;
+
+        case BIN_OP_RESET:
+            reset_tap();
+            break;
+
+        case BIN_OP_IR_CHECK:
+        case BIN_OP_DR_CHECK:
+            is_ir = (op & BIN_OP_CODE) == BIN_OP_IR_CHECK;
+            status = binproto_do_check(is_ir, op & BIN_OP_MASK, &payload[pos], len - pos,
+                                       is_ir ? ir_in : dr_in, is_ir ? ir_out : dr_out,
+                                       is_ir ? MAX_IR_LEN : MAX_DR_LEN, &used, &mismatch);
+            if (status != OK)
+                break;
+
+            // only the mismatches travel back to the host
+            if (mismatch) {
+                hdr[1] = index & 0xff;
+                hdr[2] = index >> 8;
+                binproto_send_reply_parts(BIN_CMD_QUEUE_TDO, ERR_TDO_MISMATCH, hdr, sizeof(hdr),
+                                          (uint8_t*)(is_ir ? ir_out : dr_out),
+                                          ((payload[pos] | (payload[pos + 1] << 8)) + 7) / 8);
+            }
+            pos += used;
+            break;
+
+        case BIN_OP_CLOCK:
+            if (len - pos < 8) {
+                status = ERR_BAD_FRAME;
+                break;
+            }
+            memcpy(&cycles, &payload[pos], 4);
+            memcpy(&us, &payload[pos + 4], 4);
+            status = -clock_state(cycles, us);
+            pos += 8;
+            break;
+
+        case BIN_OP_TCK:
+            if (len - pos < 4) {
+                status = ERR_BAD_FRAME;
+                break;
+            }
+            memcpy(&cycles, &payload[pos], 4);
+            set_tck_khz(cycles);
+            pos += 4;
+            break;
+
+        case BIN_OP_TRST:
+            if (len - pos < 1) {
+                status = ERR_BAD_FRAME;
+                break;
+            }
+            digitalWrite(TRST, payload[pos] ? 1 : 0);
+            pos += 1;
+            break;
+
+        default:
+            status = ERR_GENERAL;
+            break;
+        }
+
+        if (status == OK)
+            index++;
+        binproto_poll();
+    }
+
+    scan_poll_hook = NULL;
+
+    // number of ops that ran
+    hdr[1] = index & 0xff;
+    hdr[2] = index >> 8;
+    binproto_send_reply(BIN_CMD_QUEUE, status, hdr, sizeof(hdr));
+}
+
+/**
+ * Discovery results being collected and streamed back.
+ */
+static struct
+{
+    uint16_t lens[2][BIN_DISC_BLOCK];
+    uint32_t first[2];
+    uint8_t cur;
+    uint8_t n;
+    binproto_tx_t tx;
+    bool sending;
+} disc;
+
+/**
+ * @brief Send the collected discovery results, double buffered.
+ */
+static void binproto_disc_flush()
+{
+    if (disc.n == 0)
+        return;
+
+    // the other buffer is reused next, its block must be fully sent
+    if (disc.sending)
+        binproto_tx_pump(&disc.tx, true);
+
+    binproto_tx_begin(&disc.tx, BIN_CMD_DISC_BLOCK, OK, (uint8_t*)&disc.first[disc.cur], 4,
+                      (uint8_t*)disc.lens[disc.cur], disc.n * 2);
+    disc.sending = true;
+    disc.cur ^= 1;
+    disc.n = 0;
+}
+
+/**
+ * @brief discovery_report_t that collects the results into blocks.
+ * Stops the sweep as soon as a frame from the host is complete.
+ */
+static bool binproto_disc_report(uint32_t instruction, uint16_t dr_len)
+{
+    if (disc.n == 0)
+        disc.first[disc.cur] = instruction;
+    disc.lens[disc.cur][disc.n++] = dr_len;
+
+    if (disc.sending)
+        disc.sending = !binproto_tx_pump(&disc.tx, false);
+
+    if (disc.n == BIN_DISC_BLOCK)
+        binproto_disc_flush();
+
+    return !frame_rx_poll(&rx);
+}
+
+/**
+ * @brief Run a discovery sweep and stream the DR lengths back.
+ * @param payload ir len (1), first (4), last (4), max dr len (2).
+ */
+static void binproto_discovery(uint8_t* payload, uint16_t len, reg_t* ir_in)
+{
+    uint32_t first = 0;
+    uint32_t last = 0;
+    uint32_t next = 0;
+    uint16_t max_dr_len = 0;
+    int rc = OK;
+
+    if (len != 11 || payload[0] == 0 || payload[0] > MAX_IR_LEN) {
+        binproto_send_reply(BIN_CMD_DISCOVERY, ERR_BAD_FRAME, NULL, 0);
+        return;
+    }
+    memcpy(&first, &payload[1], 4);
+    memcpy(&last, &payload[5], 4);
+    memcpy(&max_dr_len, &payload[9], 2);
+
+    disc.cur = 0;
+    disc.n = 0;
+    disc.sending = false;
+
+    scan_poll_hook = binproto_poll;
+    rc = discovery_sweep(first, last, max_dr_len, payload[0], ir_in, binproto_disc_report, &next);
+    scan_poll_hook = NULL;
+
+    binproto_disc_flush();
+    if (disc.sending)
+        binproto_tx_pump(&disc.tx, true);
+
+    binproto_send_reply(BIN_CMD_DISCOVERY, -rc, (uint8_t*)&next, 4);
+}
+
+/**
+ * @brief Reply with the TAPs found by detect_chain.
+ */
+static void binproto_chain_info(uint8_t cmd)
+{
+    uint8_t info[1 + MAX_ALLOWED_TAPS * 5];
+    uint8_t k = 0;
+
+    info[0] = tap_count;
+    for (k = 0; k < tap_count; k++)
+    {
+        memcpy(&info[1 + k * 5], &taps[k].idcode, 4);
+        info[1 + k * 5 + 4] = taps[k].ir_len;
+    }
+
+    binproto_send_reply(cmd, OK, info, 1 + tap_count * 5);
+}
+
+/**
+ * @brief Sample the pins, or drive them with EXTEST, and reply with their values.
+ * @param payload Nothing for BIN_CMD_PINS_SAMPLE, count (2) and per pin index (2), value (1) for BIN_CMD_PINS_DRIVE.
+ */
+static void binproto_pins(uint8_t cmd, uint8_t* payload, uint16_t len, reg_t* ir_in, reg_t* ir_out, reg_t* dr_out)
+{
+    reg_t pins[REG_WORDS(BSDL_MAX_PINS)];
+    uint16_t count = 0;
+    uint16_t pin = 0;
+    int rc = OK;
+
+    if (cmd == BIN_CMD_PINS_SAMPLE) {
+        rc = bsdl_sample(ir_in, ir_out, dr_out);
+    }
+    else {
+        if (len < 2)
+            rc = -ERR_BAD_FRAME;
+        else
+            memcpy(&count, payload, 2);
+        if (rc == OK && len != 2 + count * 3)
+            rc = -ERR_BAD_FRAME;
+
+        for (uint16_t i = 0; rc == OK && i < count; i++)
+        {
+            memcpy(&pin, &payload[2 + i * 3], 2);
+            rc = bsdl_drive(pin, payload[2 + i * 3 + 2]);
+        }
+        if (rc == OK)
+            rc = bsdl_extest(ir_in, ir_out, dr_out);
+    }
+
+    if (rc != OK) {
+        binproto_send_reply(cmd, -rc, NULL, 0);
+        return;
+    }
+
+    bsdl_pack_pins(dr_out, pins);
+    binproto_send_reply(cmd, OK, (uint8_t*)pins, (bsdl.pin_count + 7) / 8);
+}
+
+/**
+ * Boundary register changes being collected and streamed back.
+ */
+static struct
+{
+    reg_t prev[REG_WORDS(BSDL_MAX_CELLS)];
+    uint8_t buf[2][BIN_WATCH_BLOCK];
+    uint16_t n;
+    uint8_t cur;
+    uint32_t samples;
+    uint32_t sent_ms;
+    binproto_tx_t tx;
+    bool sending;
+} watch;
+
+/**
+ * @brief Send the collected change records, double buffered.
+ */
+static void binproto_watch_flush()
+{
+    if (watch.sending)
+        binproto_tx_pump(&watch.tx, true);
+
+    binproto_tx_begin(&watch.tx, BIN_CMD_WATCH_BLOCK, OK, (uint8_t*)&watch.samples, 4,
+                      watch.buf[watch.cur], watch.n);
+    watch.sending = true;
+    watch.sent_ms = millis();
+    watch.cur ^= 1;
+    watch.n = 0;
+}
+
+/**
+ * @brief Append a LEB128 varint to the change records.
+ */
+static void binproto_watch_put(uint32_t value)
+{
+    uint8_t b = 0;
+
+    do {
+        b = value & 0x7F;
+        value >>= 7;
+        watch.buf[watch.cur][watch.n++] = value ? b | 0x80 : b;
+        if (watch.n == BIN_WATCH_BLOCK)
+            binproto_watch_flush();
+    } while (value);
+}
+
+/**
+ * @brief Sample the boundary register continuously and stream the toggled cells.
+ * @param payload samples (4), 0 to run until the next frame.
+ */
+static void binproto_watch(uint8_t* payload, uint16_t len, reg_t* ir_in, reg_t* ir_out, reg_t* dr_out)
+{
+    uint32_t max = 0;
+    uint32_t start = 0;
+    uint32_t last = 0;
+    uint32_t now = 0;
+    uint32_t diff = 0;
+    uint16_t words = REG_WORDS(bsdl.boundary_len);
+    uint16_t count = 0;
+    uint16_t cell = 0;
+    uint16_t prev_cell = 0;
+    uint16_t w = 0;
+    int rc = OK;
+    uint32_t result[2];
+
+    if (len != 4) {
+        binproto_send_reply(BIN_CMD_PINS_WATCH, ERR_BAD_FRAME, NULL, 0);
+        return;
+    }
+    memcpy(&max, payload, 4);
+
+    // SAMPLE stays in the IR, every pass after the first is a DR scan only
+    rc = bsdl_sample(ir_in, ir_out, dr_out);
+    if (rc != OK) {
+        binproto_send_reply(BIN_CMD_PINS_WATCH, -rc, NULL, 0);
+        return;
+    }
+
+    clear_reg(watch.prev, bsdl.boundary_len);
+    watch.n = 0;
+    watch.cur = 0;
+    watch.samples = 0;
+    watch.sending = false;
+    watch.sent_ms = millis();
+    start = last = micros();
+
+    scan_poll_hook = binproto_poll;
+    do {
+        if (watch.samples > 0)
+            bsdl_capture(dr_out);
+        now = micros();
+        watch.samples++;
+
+        // ignore whatever is above the register in its last word
+        if (bsdl.boundary_len % 32)
+            dr_out[words - 1] &= ((reg_t)1 << (bsdl.boundary_len % 32)) - 1;
+
+        count = 0;
+        for (w = 0; w < words; w++)
+            count += __builtin_popcountl(dr_out[w] ^ watch.prev[w]);
+
+        if (count > 0) {
+            binproto_watch_put(now - last);
+            binproto_watch_put(count);
+            last = now;
+            prev_cell = 0;
+            for (w = 0; w < words; w++)
+            {
+                diff = dr_out[w] ^ watch.prev[w];
+                while (diff)
+                {
+                    cell = w * 32 + __builtin_ctzl(diff);
+                    binproto_watch_put(cell - prev_cell);
+                    prev_cell = cell;
+                    diff &= diff - 1;
+                }
+                watch.prev[w] = dr_out[w];
+            }
+        }
+
+        if (watch.sending)
+            watch.sending = !binproto_tx_pump(&watch.tx, false);
+        if (!watch.sending && (watch.n > 0 || millis() - watch.sent_ms > BIN_WATCH_IDLE_MS))
+            binproto_watch_flush();
+    } while ((max == 0 || watch.samples < max) && !frame_rx_poll(&rx));
+    scan_poll_hook = NULL;
+
+    if (watch.n > 0)
+        binproto_watch_flush();
+    if (watch.sending)
+        binproto_tx_pump(&watch.tx, true);
+
+    result[0] = watch.samples;
+    result[1] = micros() - start;
+    binproto_send_reply(BIN_CMD_PINS_WATCH, OK, (uint8_t*)result, 8);
+}
+
+/**
+ * @brief Reply with the performance counters and the time since they were cleared.
+ * @param clear If not 0, clear the counters after the reply.
+ */
+static void binproto_stats(uint8_t cmd, uint8_t clear)
+{
+    uint32_t counters[STATS_FIELDS + 1];
+
+    memcpy(counters, &stats, STATS_FIELDS * 4);
+    counters[STATS_FIELDS] = micros() - stats.since_us;
+    binproto_send_reply(cmd, OK, (uint8_t*)counters, sizeof(counters));
+
+    if (clear)
+        stats_clear();
+}
+
+/**
+ * @brief Start, stop or dump the TAP trace.
+ * @param op BIN_TRACE_STOP, BIN_TRACE_START or BIN_TRACE_DUMP.
+ */
+static void binproto_trace(uint8_t cmd, uint8_t op)
+{
+    uint32_t hdr[2];
+    uint16_t events = 0;
+
+    if (op == BIN_TRACE_START)
+        trace_start();
+    else if (op == BIN_TRACE_STOP)
+        trace_stop();
+    else if (op == BIN_TRACE_DUMP)
+        events = trace_count < TRACE_EVENTS ? trace_count : TRACE_EVENTS;
+    else {
+        binproto_send_reply(cmd, ERR_BAD_FRAME, NULL, 0);
+        return;
+    }
+
+    hdr[0] = trace_count;
+    hdr[1] = trace_cycle;
+    binproto_send_reply_parts(cmd, OK, (uint8_t*)hdr, sizeof(hdr), (uint8_t*)trace_ring, events * 4);
+}
+
+/**
+ * @brief Enter, leave or query gang mode.
+ * @param chains Number of chains, 0 to leave gang mode or BIN_GANG_QUERY.
+ */
+static void binproto_gang(uint8_t cmd, uint8_t chains)
+{
+    uint8_t reply[2 + 4 * GANG_SLOTS];
+    uint32_t idcodes[GANG_SLOTS];
+    uint16_t len = 2;
+    int rc = OK;
+
+    reply[1] = gang_diff;
+    gang_diff = 0;
+    if (chains == 0)
+        gang_end();
+    else if (chains != BIN_GANG_QUERY && (rc = gang_begin(chains, idcodes)) == OK) {
+        memcpy(&reply[2], idcodes, 4 * gang_chains);
+        len += 4 * gang_chains;
+    }
+
+    reply[0] = gang_chains;
+    binproto_send_reply(cmd, -rc, reply, len);
+}
+
+/**
+ * @brief Register and memory accesses through the JTAG-DP of a TAP.
+ * @param payload tap (1), then the arguments of the command.
+ */
+static void binproto_arm(uint8_t cmd, uint8_t* payload, uint16_t len)
+{
+    uint32_t addr = 0;
+    uint32_t value = 0;
+    int rc = OK;
+
+    if (len < 1 || (cmd == BIN_CMD_DP_ACCESS && len != 8) || (cmd == BIN_CMD_MEM_READ && len != 10) ||
+        (cmd == BIN_CMD_MEM_WRITE && (len < 6 || (len - 6) % 4 != 0))) {
+        binproto_send_reply(cmd, ERR_BAD_FRAME, NULL, 0);
+        return;
+    }
+
+    rc = dp_attach(tap_selector(taps, payload[0]));
+    if (rc != OK) {
+        binproto_send_reply(cmd, -rc, NULL, 0);
+        return;
+    }
+
+    switch (cmd)
+    {
+    case BIN_CMD_DP_ACCESS:
+        // a single register, for scripts. The caller powers up the DP if needed
+        memcpy(&value, &payload[4], 4);
+        if (payload[1] & BIN_DP_AP)
+            rc = (payload[1] & BIN_DP_READ) ? ap_read(payload[2], payload[3], &value)
+                                            : ap_write(payload[2], payload[3], value);
+        else
+            rc = (payload[1] & BIN_DP_READ) ? dp_read(payload[3], &value)
+                                            : dp_write(payload[3], value);
+        binproto_send_reply(cmd, -rc, (uint8_t*)&value, 4);
+        break;
+
+    case BIN_CMD_MEM_READ:
+        memcpy(&addr, &payload[2], 4);
+        memcpy(&value, &payload[6], 4);
+        rc = dp_power_up();
+        if (rc != OK) {
+            binproto_send_reply(cmd, -rc, NULL, 0);
+            break;
+        }
+        mem_dump_stream(payload[1], addr, value);
+        break;
+
+    case BIN_CMD_MEM_WRITE:
+        // the next block is received while this one is written
+        memcpy(&addr, &payload[2], 4);
+        rc = dp_power_up();
+        scan_poll_hook = binproto_poll;
+        if (rc == OK)
+            rc = mem_write(payload[1], addr, &payload[6], (len - 6) / 4);
+        scan_poll_hook = NULL;
+        binproto_send_reply(cmd, -rc, (uint8_t*)&addr, 4);
+        break;
+
+    default:
+        break;
+    }
+}
+
+void binproto_main(reg_t* ir_in, reg_t* ir_out, reg_t* dr_in, reg_t* dr_out)
+{
+    uint32_t start = 0;
+    uint32_t num = 0;
+    uint8_t* payload = NULL;
+    uint8_t cur = 0;
+    uint8_t i = 0;
+    uint8_t cmd = 0;
+    uint16_t len = 0;
+    uint32_t khz = 0;
+    uint32_t idle_us = 0;
+    uint32_t crcs[GANG_SLOTS];
+    const uint8_t ping[3] = { BIN_VERSION, BIN_MAX_PAYLOAD & 0xFF, BIN_MAX_PAYLOAD >> 8 };
+    int rc = OK;
+
+    frame_rx_start(&rx, frame_bufs[cur]);
+
+    while (true)
+    {
+        // the frame may have been completed already while the last command ran
+        idle_us = micros();
+        while (!frame_rx_poll(&rx)) {}
+        stats.wait_us += micros() - idle_us;
+
+        cmd = rx.hdr[0];
+        len = rx.len;
+        rc = rx.rc;
+        payload = rx.payload;
+
+        // receive the next frame into the other buffer while this one runs
+        cur ^= 1;
+        frame_rx_start(&rx, frame_bufs[cur]);
+
+        if (rc != OK) {
+            binproto_send_reply(BIN_CMD_NAK, -rc, NULL, 0);
+            continue;
+        }
+
+        switch (cmd)
+        {
+        case BIN_CMD_PING:
+            binproto_send_reply(cmd, OK, ping, sizeof(ping));
+            break;
+
+        case BIN_CMD_RESET_TAP:
+            reset_tap();
+            binproto_send_reply(cmd, OK, NULL, 0);
+            break;
+
+        case BIN_CMD_GOTO_STATE:
+            if (len != 1) {
+                binproto_send_reply(cmd, ERR_BAD_FRAME, NULL, 0);
+                break;
+            }
+            rc = goto_state(payload[0]);
+            binproto_send_reply(cmd, -rc, NULL, 0);
+            break;
+
+        case BIN_CMD_SCAN_IR:
+            binproto_scan(cmd, payload, len, ir_in, ir_out, MAX_IR_LEN);
+            break;
+
+        case BIN_CMD_SCAN_DR:
+            binproto_scan(cmd, payload, len, dr_in, dr_out, MAX_DR_LEN);
+            break;
+
+        case BIN_CMD_SCAN_BEGIN:
+        case BIN_CMD_SCAN_CHUNK:
+            binproto_stream(cmd, payload, len, dr_in, dr_out);
+            break;
+
+        case BIN_CMD_SET_TCK:
+            if (len != 4) {
+                binproto_send_reply(cmd, ERR_BAD_FRAME, NULL, 0);
+                break;
+            }
+            memcpy(&khz, payload, 4);
+            khz = set_tck_khz(khz);
+            binproto_send_reply(cmd, OK, (uint8_t*)&khz, 4);
+            break;
+
+        case BIN_CMD_QUEUE:
+            binproto_queue(payload, len, ir_in, ir_out, dr_in, dr_out);
+            break;
+
+        case BIN_CMD_UFM_DUMP:
+            if (len != 9) {
+                binproto_send_reply(cmd, ERR_BAD_FRAME, NULL, 0);
+                break;
+            }
+            memcpy(&start, &payload[1], 4);
+            memcpy(&num, &payload[5], 4);
+            max10_dump_ufm_stream(payload[0], ir_in, ir_out, dr_in, dr_out, start, num);
+            break;
+
+        case BIN_CMD_UFM_CRC:
+            // only the digest of the range travels back
+            if (len != 9) {
+                binproto_send_reply(cmd, ERR_BAD_FRAME, NULL, 0);
+                break;
+            }
+            memcpy(&start, &payload[1], 4);
+            memcpy(&num, &payload[5], 4);
+            scan_poll_hook = binproto_poll;
+            num = max10_crc_ufm_range(payload[0], ir_in, ir_out, dr_in, dr_out, start, num, crcs);
+            scan_poll_hook = NULL;
+            if (gang_chains)
+                binproto_send_reply(cmd, OK, (uint8_t*)crcs, 4 * gang_chains);
+            else
+                binproto_send_reply(cmd, OK, (uint8_t*)&num, 4);
+            break;
+
+        case BIN_CMD_UFM_PROGRAM:
+            // the next block is received while this one is programmed
+            if (len < 5 || (len - 5) % 4 != 0) {
+                binproto_send_reply(cmd, ERR_BAD_FRAME, NULL, 0);
+                break;
+            }
+            memcpy(&start, &payload[1], 4);
+            scan_poll_hook = binproto_poll;
+            rc = max10_program_block(payload[0], ir_in, ir_out, dr_in, dr_out, start, &payload[5], (len - 5) / 4);
+            scan_poll_hook = NULL;
+            binproto_send_reply(cmd, -rc, &payload[1], 4);
+            break;
+
+        case BIN_CMD_UFM_ERASE:
+        case BIN_CMD_UFM_END:
+            if (len != 1) {
+                binproto_send_reply(cmd, ERR_BAD_FRAME, NULL, 0);
+                break;
+            }
+            rc = OK;
+            if (cmd == BIN_CMD_UFM_ERASE)
+                rc = max10_erase(payload[0], ir_in, ir_out, dr_in, dr_out, NULL);
+            else
+                max10_isc_disable(payload[0], ir_in, ir_out);
+            // the erase check is still in the capture of every chain
+            payload[0] = gang_match(0xFFFFFFFF, 0xFFFFFFFF);
+            binproto_send_reply(cmd, -rc, payload, cmd == BIN_CMD_UFM_ERASE && gang_chains ? 1 : 0);
+            break;
+
+        case BIN_CMD_STATS:
+            if (len != 1) {
+                binproto_send_reply(cmd, ERR_BAD_FRAME, NULL, 0);
+                break;
+            }
+            binproto_stats(cmd, payload[0]);
+            break;
+
+        case BIN_CMD_GANG:
+            if (len != 1) {
+                binproto_send_reply(cmd, ERR_BAD_FRAME, NULL, 0);
+                break;
+            }
+            binproto_gang(cmd, payload[0]);
+            break;
+
+        case BIN_CMD_TRACE:
+            if (len != 1) {
+                binproto_send_reply(cmd, ERR_BAD_FRAME, NULL, 0);
+                break;
+            }
+            binproto_trace(cmd, payload[0]);
+            break;
+
+        case BIN_CMD_CALIBRATE:
+            if (len != 1) {
+                binproto_send_reply(cmd, ERR_BAD_FRAME, NULL, 0);
+                break;
+            }
+            rc = calibrate_tck(payload[0] != 0, &khz);
+            memcpy(payload, &khz, 4);
+            payload[4] = tck_rtck;
+            for (i = 0; i < tap_count; i++)
+                memcpy(&payload[5 + 4 * i], &taps[i].tck_khz, 4);
+            binproto_send_reply(cmd, -rc, payload, 5 + 4 * tap_count);
+            break;
+
+        case BIN_CMD_SELECT_TAP:
+            if (len != 1) {
+                binproto_send_reply(cmd, ERR_BAD_FRAME, NULL, 0);
+                break;
+            }
+            if (payload[0] == BIN_TAP_CHAIN) {
+                active_tap = NULL;
+            }
+            else if (tap_selector(taps, payload[0]) != NULL) {
+                active_tap = tap_selector(taps, payload[0]);
+            }
+            else {
+                binproto_send_reply(cmd, ERR_OUT_OF_BOUNDS, NULL, 0);
+                break;
+            }
+            binproto_send_reply(cmd, OK, NULL, 0);
+            break;
+
+        case BIN_CMD_CHAIN_INFO:
+            binproto_chain_info(cmd);
+            break;
+
+        case BIN_CMD_DISCOVERY:
+            binproto_discovery(payload, len, ir_in);
+            break;
+
+        case BIN_CMD_BSDL_LOAD:
+            if (len < 2) {
+                binproto_send_reply(cmd, ERR_BAD_FRAME, NULL, 0);
+                break;
+            }
+            rc = bsdl_load(payload[0] | (payload[1] << 8), &payload[2], len - 2);
+            binproto_send_reply(cmd, -rc, NULL, 0);
+            break;
+
+        case BIN_CMD_BSDL_COMMIT:
+            if (len != 2) {
+                binproto_send_reply(cmd, ERR_BAD_FRAME, NULL, 0);
+                break;
+            }
+            rc = bsdl_commit(payload[0] | (payload[1] << 8));
+            payload[0] = bsdl.ir_len;
+            memcpy(&payload[1], &bsdl.boundary_len, 2);
+            memcpy(&payload[3], &bsdl.pin_count, 2);
+            binproto_send_reply(cmd, -rc, payload, rc == OK ? 5 : 0);
+            break;
+
+        case BIN_CMD_PINS_SAMPLE:
+        case BIN_CMD_PINS_DRIVE:
+            binproto_pins(cmd, payload, len, ir_in, ir_out, dr_out);
+            break;
+
+        case BIN_CMD_PINS_WATCH:
+            binproto_watch(payload, len, ir_in, ir_out, dr_out);
+            break;
+
+        case BIN_CMD_DP_ACCESS:
+        case BIN_CMD_MEM_READ:
+        case BIN_CMD_MEM_WRITE:
+            binproto_arm(cmd, payload, len);
+            break;
+
+        case BIN_CMD_EXIT:
+            // back to the ASCII menu with the last reply on the wire
+            binproto_send_reply(cmd, OK, NULL, 0);
+            Host.flush();
+            return;
+
+        default:
+            binproto_send_reply(cmd, ERR_GENERAL, NULL, 0);
+            break;
+        }
+    }
+}
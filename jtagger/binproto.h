@@ -0,0 +1,304 @@
+/** @file binproto.h
+ *
+ * @brief Compact binary command mode for automated use from the host.
+ *
+ * Every frame, in both directions, is:
+ *
+ *   SOF (0xA5) | cmd (1) | len (2, LE) | payload (len) | crc16 (2, LE)
+ *
+ * The CRC is CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF) over cmd, len
+ * and payload. A reply carries the request cmd with BIN_REPLY set, and its
+ * payload starts with a status byte (OK or a positive ERR_* code).
+ * Scan vectors are packed LSB first, 8 bits per byte, exactly like the
+ * bytes of a reg_t register on the (little endian) Due and Mega.
+ */
+#ifndef __BINPROTO_H__
+#define __BINPROTO_H__
+
+#include "Arduino.h"
+#include "jtagger.h"
+
+#define BIN_SOF         0xA5
+#define BIN_VERSION     2
+#define BIN_REPLY       0x80
+
+// largest payload: a queue op (1), scan length (2), end state (1) and a full DR
+#define BIN_MAX_PAYLOAD (4 + MAX_DR_LEN / 8)
+
+// a partially received frame is dropped after this many ms without a byte
+#define BIN_TIMEOUT_MS  500
+
+/**
+ * Command codes and their payloads (request -> reply data after status)
+ */
+#define BIN_CMD_PING        0x01 // -> version (1), max payload (2)
+#define BIN_CMD_RESET_TAP   0x02 // -> nothing
+#define BIN_CMD_GOTO_STATE  0x03 // state (1) -> nothing
+#define BIN_CMD_SCAN_IR     0x04 // len (2), end state (1), tdi bytes -> tdo bytes
+#define BIN_CMD_SCAN_DR     0x05 // len (2), end state (1), tdi bytes -> tdo bytes
+#define BIN_CMD_SET_TCK     0x06 // khz (4) -> measured khz (4)
+#define BIN_CMD_QUEUE       0x07 // tag (1), ops -> tag (1), ops executed (2)
+#define BIN_CMD_QUEUE_TDO   0x08 // (device only) -> tag (1), op index (2), tdo bytes
+#define BIN_CMD_UFM_DUMP    0x09 // ir len (1), start addr (4), words (4) -> words sent (4)
+#define BIN_CMD_UFM_BLOCK   0x0A // (device only) -> block addr (4), words
+#define BIN_CMD_SELECT_TAP  0x0B // tap index (1) -> nothing
+#define BIN_CMD_CHAIN_INFO  0x0C // -> count (1), per TAP: idcode (4), ir len (1)
+#define BIN_CMD_DISCOVERY   0x0D // ir len (1), first (4), last (4), max dr len (2) -> next ir (4)
+#define BIN_CMD_DISC_BLOCK  0x0E // (device only) -> first ir (4), dr len (2) per ir
+#define BIN_CMD_BSDL_LOAD   0x0F // offset (2), table bytes -> nothing
+#define BIN_CMD_BSDL_COMMIT 0x10 // table len (2) -> ir len (1), boundary len (2), pins (2)
+#define BIN_CMD_PINS_SAMPLE 0x11 // -> pin values, 1 bit per pin
+#define BIN_CMD_PINS_DRIVE  0x12 // count (2), per pin: index (2), value (1) -> pin values read back
+#define BIN_CMD_PINS_WATCH  0x13 // samples (4, 0 until the next frame) -> samples (4), elapsed usec (4)
+#define BIN_CMD_WATCH_BLOCK 0x14 // (device only) -> samples so far (4), change records
+#define BIN_CMD_UFM_PROGRAM 0x15 // ir len (1), addr (4), words -> addr (4), ERR_VERIFY if the readback differs
+#define BIN_CMD_UFM_ERASE   0x16 // ir len (1) -> nothing or erased chains (1) in gang mode, ERR_TIMEOUT if not erased
+#define BIN_CMD_UFM_END     0x17 // ir len (1) -> nothing, leaves ISC mode
+#define BIN_CMD_STATS       0x18 // clear (1) -> jtag_stats_t counters (4 each), usec since cleared (4)
+#define BIN_CMD_CALIBRATE   0x19 // use rtck (1) -> khz (4), rtck (1), per TAP: fastest khz with its IDCODE intact (4)
+#define BIN_CMD_DP_ACCESS   0x1A // tap (1), flags (1), ap (1), addr (1), value (4) -> value (4)
+#define BIN_CMD_MEM_READ    0x1B // tap (1), ap (1), addr (4), words (4) -> words sent (4)
+#define BIN_CMD_MEM_BLOCK   0x1C // (device only) -> block addr (4), words
+#define BIN_CMD_MEM_WRITE   0x1D // tap (1), ap (1), addr (4), words -> addr (4)
+#define BIN_CMD_UFM_CRC     0x1E // ir len (1), start addr (4), words (4) -> crc32 (4) per chain
+#define BIN_CMD_SCAN_BEGIN  0x1F // ir (1), len (4), end state (1) -> nothing
+#define BIN_CMD_SCAN_CHUNK  0x20 // tdi bytes -> tdo bytes
+#define BIN_CMD_TRACE       0x21 // op (1) -> events recorded (4), cycles (4), ring (dump only)
+#define BIN_CMD_GANG        0x22 // chains (1) -> chains (1), mismatch mask (1), per chain: idcode (4)
+#define BIN_CMD_EXIT        0x7F // -> nothing, back to the ASCII menu
+#define BIN_CMD_NAK         0x7E // reply to a frame that could not be read
+
+// BIN_CMD_SELECT_TAP index that addresses the whole chain again
+#define BIN_TAP_CHAIN       0xFF
+
+// flags of BIN_CMD_DP_ACCESS: a read (else a write), of an AP register (else a DP register)
+#define BIN_DP_READ         0x01
+#define BIN_DP_AP           0x02
+
+// BIN_CMD_PINS_DRIVE value that releases a pin
+#define BIN_PIN_Z           2
+
+// DR lengths per BIN_CMD_DISC_BLOCK. Any frame from the host stops a discovery.
+#define BIN_DISC_BLOCK      32
+
+/**
+ * A scan longer than a register is shifted in chunks of up to BIN_STREAM_CHUNK
+ * bits: BIN_CMD_SCAN_BEGIN opens it (for the selected TAP, if any), then every
+ * BIN_CMD_SCAN_CHUNK shifts the next bits and replies with the bits shifted out.
+ * All chunks but the last are whole bytes. Between chunks the TAP waits in
+ * PAUSE_DR/PAUSE_IR, so the host can take its time, and the next chunk is
+ * received while the current one is shifted.
+ */
+#define BIN_STREAM_CHUNK    MAX_DR_LEN
+
+/**
+ * Operations of BIN_CMD_TRACE on the TAP trace (see tap_trace.h). Every reply
+ * carries the number of events recorded and TCK cycles seen since the start,
+ * a dump adds the first min(events, TRACE_EVENTS) 32 bit events of the ring
+ * as they lie in memory: once it wrapped, the oldest event is at events % TRACE_EVENTS.
+ */
+#define BIN_TRACE_STOP      0x00
+#define BIN_TRACE_START     0x01
+#define BIN_TRACE_DUMP      0x02
+
+/**
+ * BIN_CMD_GANG switches gang mode (see gang.h): with 1 to GANG_MAX_CHAINS chains
+ * every following command runs on all of them at once, 0 goes back to the single
+ * chain and BIN_GANG_QUERY only reports. The reply has the chains in use and the
+ * mask of the chains that shifted out other bits than chain 0 since the last
+ * BIN_CMD_GANG, then when starting the IDCODE of the first TAP of every chain.
+ * Gang mode drives whole chains, select BIN_TAP_CHAIN first.
+ * The MAX10 commands report per chain: BIN_CMD_UFM_CRC replies with the CRC of
+ * every chain, BIN_CMD_UFM_ERASE with the mask of the chains that read erased.
+ */
+#define BIN_GANG_QUERY      0xFF
+
+/**
+ * BIN_CMD_PINS_WATCH captures the boundary register with SAMPLE over and over,
+ * and streams only the cells that toggled. The records of all BIN_CMD_WATCH_BLOCK
+ * frames form a single byte stream of LEB128 varints, per sample with a change:
+ *   usec since the previous record, number of toggled cells, cell numbers
+ * where every cell number is sent as the difference to the previous one.
+ * The register starts as all zeros, so the first record holds the cells at 1.
+ * A block goes out whenever the serial port is free, or every BIN_WATCH_IDLE_MS
+ * (possibly empty) so the host sees the sample count. Any frame from the host stops it.
+ */
+#define BIN_WATCH_BLOCK     128
+#define BIN_WATCH_IDLE_MS   250
+
+/**
+ * Operations of a BIN_CMD_QUEUE batch. A batch runs back to back on the device.
+ * The captured bits of every IR/DR op are streamed back in a BIN_CMD_QUEUE_TDO
+ * reply as soon as the op is done, unless BIN_OP_NO_TDO is set in its op code.
+ * The CHECK ops compare the captured bits on the device instead, and only a
+ * mismatch is streamed back, as a BIN_CMD_QUEUE_TDO reply with status
+ * ERR_TDO_MISMATCH. The batch goes on after a mismatch.
+ * While a batch runs the next frame is already being received, so the host
+ * can upload the next batch before the current one ends.
+ */
+#define BIN_OP_IR           0x01 // len (2), end state (1), tdi bytes
+#define BIN_OP_DR           0x02 // len (2), end state (1), tdi bytes
+#define BIN_OP_RTI          0x03 // cycles (4)
+#define BIN_OP_STATE        0x04 // state (1)
+#define BIN_OP_RESET        0x05 // nothing
+#define BIN_OP_IR_CHECK     0x06 // len (2), end state (1), tdi bytes, tdo bytes [, mask bytes]
+#define BIN_OP_DR_CHECK     0x07 // len (2), end state (1), tdi bytes, tdo bytes [, mask bytes]
+#define BIN_OP_CLOCK        0x08 // cycles (4), usec (4): keep clocking in the current stable state
+#define BIN_OP_TCK          0x09 // khz (4)
+#define BIN_OP_TRST         0x0A // level (1)
+#define BIN_OP_CODE         0x3F // op code bits
+#define BIN_OP_MASK         0x40 // flag of the CHECK ops: mask bytes follow, else all bits are checked
+#define BIN_OP_NO_TDO       0x80 // flag: don't send back the captured bits
+
+/**
+ * @brief Update a CRC-16/CCITT-FALSE with more bytes.
+ * @param crc Current CRC value (0xFFFF to start).
+ * @param data Pointer to the bytes.
+ * @param len Number of bytes.
+ * @return The updated CRC.
+ */
+uint16_t crc16_update(uint16_t crc, const uint8_t* data, uint16_t len);
+
+/**
+ * @brief Update a CRC-32 (the one of zlib, reflected poly 0xEDB88320) with more bytes.
+ * Table driven, a nibble at a time, so the table is only 16 words.
+ * @param crc Current CRC value (0xFFFFFFFF to start, inverted at the end).
+ * @param data Pointer to the bytes.
+ * @param len Number of bytes.
+ * @return The updated CRC.
+ */
+uint32_t crc32_update(uint32_t crc, const uint8_t* data, uint16_t len);
+
+/**
+ * @brief Receive a single frame from the host, blocking until it is complete.
+ * Bytes before the SOF byte are skipped.
+ * @param cmd Received command code.
+ * @param payload Buffer of at least BIN_MAX_PAYLOAD bytes for the payload.
+ * @param len Received payload length.
+ * @return OK, -ERR_BAD_FRAME on a timeout or a bad length, or -ERR_BAD_CRC.
+ */
+int binproto_read_frame(uint8_t* cmd, uint8_t* payload, uint16_t* len);
+
+/**
+ * @brief Send a reply frame to the host.
+ * @param cmd The command being replied to (BIN_REPLY is added).
+ * @param status OK or a positive ERR_* code.
+ * @param data Reply data following the status byte, may be NULL.
+ * @param len Number of data bytes.
+ */
+void binproto_send_reply(uint8_t cmd, uint8_t status, const uint8_t* data, uint16_t len);
+
+/**
+ * @brief Send a reply frame whose data is made of a small header followed by a body.
+ * @param cmd The command being replied to (BIN_REPLY is added).
+ * @param status OK or a positive ERR_* code.
+ * @param hdr First part of the reply data, may be NULL.
+ * @param hdr_len Number of header bytes.
+ * @param data Second part of the reply data, may be NULL.
+ * @param len Number of data bytes.
+ */
+void binproto_send_reply_parts(uint8_t cmd, uint8_t status, const uint8_t* hdr, uint16_t hdr_len,
+                               const uint8_t* data, uint16_t len);
+
+/**
+ * A reply frame that is written out piece by piece, only as fast as the
+ * serial TX buffer has room, so the caller can keep shifting meanwhile.
+ */
+#define BIN_TX_HDR_MAX 8
+
+typedef struct
+{
+    uint8_t head[5 + BIN_TX_HDR_MAX];
+    uint8_t head_len;
+    const uint8_t* data;
+    uint16_t data_len;
+    uint8_t tail[2];
+    uint16_t pos;
+} binproto_tx_t;
+
+/**
+ * @brief Prepare a reply frame for non blocking transmission.
+ * The data buffer must stay untouched until binproto_tx_pump() reports completion.
+ * @param tx The frame writer.
+ * @param cmd The command being replied to (BIN_REPLY is added).
+ * @param status OK or a positive ERR_* code.
+ * @param hdr Up to BIN_TX_HDR_MAX header bytes (copied), may be NULL.
+ * @param hdr_len Number of header bytes.
+ * @param data Reply data following the header.
+ * @param len Number of data bytes.
+ */
+void binproto_tx_begin(binproto_tx_t* tx, uint8_t cmd, uint8_t status, const uint8_t* hdr, uint8_t hdr_len,
+                       const uint8_t* data, uint16_t len);
+
+/**
+ * @brief Write as much of the frame as the serial TX buffer accepts.
+ * @param tx The frame writer.
+ * @param block If true, wait until the whole frame is written.
+ * @return true when the whole frame has been written.
+ */
+bool binproto_tx_pump(binproto_tx_t* tx, bool block);
+
+/**
+ * 32 bit words streamed to the host as they are produced (UFM and memory
+ * dumps), in blocks of up to BIN_BLOCK_WORDS. Every block frame starts with the
+ * address of its first word. The blocks are double buffered: one is filled
+ * while the previous one drains from the serial ring. There is a single pair
+ * of buffers, so only one stream may be open at a time.
+ */
+#if defined(ARDUINO_AVR_MEGA2560)
+#define BIN_BLOCK_WORDS 32
+#else
+#define BIN_BLOCK_WORDS 64
+#endif
+
+typedef struct
+{
+    binproto_tx_t tx;
+    uint8_t cmd;
+    uint8_t cur;
+    uint16_t n;        // words in the block being filled
+    uint32_t addr;     // address of its first word
+    bool sending;
+} binproto_blocks_t;
+
+/**
+ * @brief Open a block stream.
+ * @param s The stream.
+ * @param cmd Command code of the block frames.
+ * @param addr Address of the first word.
+ */
+void binproto_blocks_begin(binproto_blocks_t* s, uint8_t cmd, uint32_t addr);
+
+/**
+ * @brief Free space of the block being filled, binproto_blocks_room() words.
+ */
+uint32_t* binproto_blocks_buf(binproto_blocks_t* s);
+
+static inline uint16_t binproto_blocks_room(const binproto_blocks_t* s)
+{
+    return BIN_BLOCK_WORDS - s->n;
+}
+
+/**
+ * @brief Account for words written at binproto_blocks_buf(), send the block
+ * once it is full, and keep the previous block draining.
+ * @param s The stream.
+ * @param words Number of words written, up to binproto_blocks_room().
+ */
+void binproto_blocks_add(binproto_blocks_t* s, uint16_t words);
+
+/**
+ * @brief Send the last, partial block and wait until every block is written.
+ */
+void binproto_blocks_end(binproto_blocks_t* s);
+
+/**
+ * @brief Serve binary frames until the host sends BIN_CMD_EXIT.
+ * @param ir_in Pointer to ir_in register.
+ * @param ir_out Pointer to ir_out register.
+ * @param dr_in Pointer to dr_in register.
+ * @param dr_out Pointer to dr_out register.
+ */
+void binproto_main(reg_t* ir_in, reg_t* ir_out, reg_t* dr_in, reg_t* dr_out);
+
+#endif /* __BINPROTO_H__ */
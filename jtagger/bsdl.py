@@ -0,0 +1,200 @@
+"""
+BSDL compiler for jtagger.
+
+Reads a BSDL file and compiles the parts needed for boundary scan into the
+compact binary table that the firmware loads (see bsdl_table.h), so pins are
+read and driven with array lookups on the Arduino.
+
+Table layout, little endian:
+
+    header (16 bytes)
+        magic (1) = 0xB5, version (1), ir_len (1), reserved (1)
+        boundary_len (2), pin count (2), idcode (4),
+        reserved (4)
+    opcodes: EXTEST, SAMPLE, PRELOAD, IDCODE, BYPASS, 2 bytes each (0xFFFF if missing)
+    cells: boundary_len records of 4 bytes, indexed by cell number (0 is nearest to TDO)
+        function (1), flags (1): safe value (bits 0-1, 2 = X), disable value (bit 2),
+        control cell (2, 0xFFFF if none)
+    pins: pin count records of 6 bytes
+        input cell (2), output cell (2), control cell (2), 0xFFFF if none
+
+Usage: python3 bsdl.py FILE [-o TABLE] prints the pins and their cells.
+"""
+import argparse
+import re
+import struct
+
+BSDL_MAGIC = 0xB5
+BSDL_VERSION = 1
+BSDL_NONE = 0xFFFF
+
+# cell functions, as numbered by the firmware
+CELL_FUNCTIONS = ["INPUT", "OUTPUT2", "OUTPUT3", "BIDIR", "CONTROL", "CONTROLR",
+                  "INTERNAL", "CLOCK", "OBSERVE_ONLY"]
+
+TABLE_OPCODES = ["EXTEST", "SAMPLE", "PRELOAD", "IDCODE", "BYPASS"]
+
+
+class BsdlError(Exception):
+    pass
+
+
+class Cell():
+    def __init__(self, num: int, port: str, function: str, safe: str,
+                 ccell: int = None, disval: int = 0) -> None:
+        self.num = num
+        self.port = port
+        self.function = function
+        self.safe = safe
+        self.ccell = ccell
+        self.disval = disval
+
+
+class Pin():
+    def __init__(self, name: str) -> None:
+        self.name = name
+        self.input = None
+        self.output = None
+        self.control = None
+        self.disval = 0
+
+
+class Bsdl():
+    """The boundary scan description of a single device"""
+    def __init__(self) -> None:
+        self.entity = ""
+        self.ir_len = 0
+        self.boundary_len = 0
+        self.idcode = 0
+        self.opcodes = dict()
+        self.cells = []
+        self.pins = []
+
+    def pin(self, name: str) -> int:
+        """Index of a pin in the table, by its port name"""
+        for i, p in enumerate(self.pins):
+            if p.name == name.upper():
+                return i
+        raise BsdlError(f"No boundary scan cell for pin {name}")
+
+    def compile(self) -> bytes:
+        """The binary table loaded by the firmware"""
+        table = struct.pack("<BBBBHHII", BSDL_MAGIC, BSDL_VERSION, self.ir_len, 0,
+                            self.boundary_len, len(self.pins), self.idcode, 0)
+        for name in TABLE_OPCODES:
+            table += struct.pack("<H", self.opcodes.get(name, BSDL_NONE))
+
+        cells = [None] * self.boundary_len
+        for cell in self.cells:
+            cells[cell.num] = cell
+        for cell in cells:
+            if cell is None:
+                table += struct.pack("<BBH", CELL_FUNCTIONS.index("INTERNAL"), 2, BSDL_NONE)
+                continue
+            safe = {"0": 0, "1": 1}.get(cell.safe, 2)
+            flags = safe | (cell.disval << 2)
+            table += struct.pack("<BBH", CELL_FUNCTIONS.index(cell.function), flags,
+                                 BSDL_NONE if cell.ccell is None else cell.ccell)
+
+        for pin in self.pins:
+            table += struct.pack("<HHH", *(BSDL_NONE if c is None else c
+                                           for c in (pin.input, pin.output, pin.control)))
+        return table
+
+
+def _attribute(text: str, name: str) -> str:
+    """The strings of a BSDL attribute concatenated, or its bare value"""
+    m = re.search(r"attribute\s+" + name + r"\s+of\s+\w+\s*:\s*entity\s+is\s+([^;]*);", text, re.I)
+    if not m:
+        return ""
+    strings = re.findall(r'"([^"]*)"', m.group(1))
+    return "".join(strings) if strings else m.group(1).strip()
+
+
+def _pattern(bits: str) -> int:
+    """A binary pattern written MSB first, X bits read as 0"""
+    return int(re.sub(r"[^01X]", "", bits.upper()).replace("X", "0") or "0", 2)
+
+
+def parse_bsdl(text: str) -> Bsdl:
+    # drop the comments
+    text = "\n".join(line.split("--", 1)[0] for line in text.splitlines())
+    b = Bsdl()
+
+    m = re.search(r"entity\s+(\w+)\s+is", text, re.I)
+    if not m:
+        raise BsdlError("No entity")
+    b.entity = m.group(1)
+
+    b.ir_len = int(_attribute(text, "INSTRUCTION_LENGTH") or 0)
+    b.boundary_len = int(_attribute(text, "BOUNDARY_LENGTH") or 0)
+    if not b.ir_len or not b.boundary_len:
+        raise BsdlError("INSTRUCTION_LENGTH and BOUNDARY_LENGTH are required")
+
+    for name, codes in re.findall(r"(\w+)\s*\(([^)]*)\)", _attribute(text, "INSTRUCTION_OPCODE")):
+        # the first opcode of an instruction is used
+        b.opcodes[name.upper()] = _pattern(codes.split(",")[0])
+
+    b.idcode = _pattern(_attribute(text, "IDCODE_REGISTER"))
+
+    pins = dict()
+    for num, fields in re.findall(r"(\d+)\s*\(([^)]*)\)", _attribute(text, "BOUNDARY_REGISTER")):
+        f = [x.strip().upper() for x in fields.split(",")]
+        if len(f) < 4:
+            raise BsdlError(f"Bad boundary cell {num}")
+        function = f[2]
+        if function not in CELL_FUNCTIONS:
+            raise BsdlError(f"Unknown function {function} of cell {num}")
+        cell = Cell(int(num), f[1], function, f[3])
+        if len(f) >= 6:
+            cell.ccell = int(f[4])
+            cell.disval = int(f[5])
+        if cell.num >= b.boundary_len:
+            raise BsdlError(f"Cell {num} is out of the boundary register")
+        b.cells.append(cell)
+
+        if cell.port == "*":
+            continue
+        # a port may be listed like PA0 or PA0(1), keep the name
+        name = re.sub(r"\(.*", "", cell.port)
+        if name not in pins:
+            pins[name] = Pin(name)
+            b.pins.append(pins[name])
+        pin = pins[name]
+        if function in ("INPUT", "CLOCK", "OBSERVE_ONLY", "BIDIR"):
+            pin.input = cell.num
+        if function in ("OUTPUT2", "OUTPUT3", "BIDIR"):
+            pin.output = cell.num
+            pin.control = cell.ccell
+            pin.disval = cell.disval
+
+    return b
+
+
+def load_bsdl(path: str) -> Bsdl:
+    with open(path) as f:
+        return parse_bsdl(f.read())
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Compile a BSDL file into a jtagger boundary scan table")
+    parser.add_argument("bsdl", help="BSDL file")
+    parser.add_argument("-o", "--output", help="write the binary table to this file")
+    args = parser.parse_args()
+
+    b = load_bsdl(args.bsdl)
+    table = b.compile()
+    print(f"{b.entity}: IR length {b.ir_len}, boundary length {b.boundary_len}, "
+          f"IDCODE 0x{b.idcode:08x}, {len(b.pins)} pins, table {len(table)} bytes")
+    for name in TABLE_OPCODES:
+        if name in b.opcodes:
+            print(f"  {name:8} 0b{b.opcodes[name]:0{b.ir_len}b}")
+    for i, p in enumerate(b.pins):
+        print(f"  {i:3} {p.name:10} in {p.input!s:>4}  out {p.output!s:>4}  ctrl {p.control!s:>4}")
+    if args.output:
+        with open(args.output, "wb") as f:
+            f.write(table)
+
+
+if __name__ == "__main__":
+    main()
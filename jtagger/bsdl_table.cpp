@@ -0,0 +1,201 @@
+/* --------------------------------------------------------------------------------------- */
+/* ------------------------- Boundary scan with a compiled BSDL table ---------------------*/
+/* --------------------------------------------------------------------------------------- */
+
+#include "bsdl_table.h"
+
+bsdl_info_t bsdl;
+bsdl_cell_t bsdl_cells[BSDL_MAX_CELLS];
+bsdl_pin_t bsdl_pins[BSDL_MAX_PINS];
+
+// header as received, decoded into bsdl by bsdl_commit
+static uint8_t bsdl_hdr[BSDL_HDR_LEN];
+static uint16_t bsdl_received = 0;
+static bool bsdl_valid = false;
+
+// values shifted into the boundary register by SAMPLE/PRELOAD and EXTEST
+static reg_t bsdl_bsr[REG_WORDS(BSDL_MAX_CELLS)];
+
+/**
+ * @brief Little endian 16 bit field of the received header.
+ */
+static uint16_t hdr16(uint8_t offset)
+{
+    return bsdl_hdr[offset] | (bsdl_hdr[offset + 1] << 8);
+}
+
+int bsdl_load(uint16_t offset, const uint8_t* data, uint16_t len)
+{
+    uint32_t pos = 0;
+    uint32_t cells_end = 0;
+    uint32_t pins_end = 0;
+
+    if (offset == 0) {
+        bsdl_received = 0;
+        bsdl_valid = false;
+    }
+    if (offset != bsdl_received)
+        return -ERR_BAD_FRAME;
+
+    for (uint16_t i = 0; i < len; i++)
+    {
+        pos = (uint32_t)offset + i;
+
+        // the header comes first and tells where the cells end
+        if (pos < BSDL_HDR_LEN) {
+            bsdl_hdr[pos] = data[i];
+            continue;
+        }
+
+        cells_end = BSDL_HDR_LEN + (uint32_t)hdr16(4) * sizeof(bsdl_cell_t);
+        pins_end = cells_end + (uint32_t)hdr16(6) * sizeof(bsdl_pin_t);
+
+        if (hdr16(4) > BSDL_MAX_CELLS || hdr16(6) > BSDL_MAX_PINS || pos >= pins_end)
+            return -ERR_OUT_OF_BOUNDS;
+
+        if (pos < cells_end)
+            ((uint8_t*)bsdl_cells)[pos - BSDL_HDR_LEN] = data[i];
+        else
+            ((uint8_t*)bsdl_pins)[pos - cells_end] = data[i];
+    }
+
+    bsdl_received += len;
+    return OK;
+}
+
+int bsdl_commit(uint16_t len)
+{
+    uint16_t i = 0;
+
+    bsdl_valid = false;
+
+    if (len != bsdl_received || len < BSDL_HDR_LEN ||
+        bsdl_hdr[0] != BSDL_MAGIC || bsdl_hdr[1] != BSDL_VERSION)
+        return -ERR_BAD_FRAME;
+
+    bsdl.ir_len = bsdl_hdr[2];
+    bsdl.boundary_len = hdr16(4);
+    bsdl.pin_count = hdr16(6);
+    memcpy(&bsdl.idcode, &bsdl_hdr[8], 4);
+    for (i = 0; i < BSDL_OPCODES; i++)
+        bsdl.opcodes[i] = hdr16(16 + 2 * i);
+
+    if (len != BSDL_HDR_LEN + bsdl.boundary_len * sizeof(bsdl_cell_t) + bsdl.pin_count * sizeof(bsdl_pin_t) ||
+        bsdl.ir_len == 0 || bsdl.ir_len > MAX_IR_LEN || bsdl.boundary_len == 0 ||
+        bsdl.opcodes[BSDL_SAMPLE] == BSDL_NONE || bsdl.opcodes[BSDL_EXTEST] == BSDL_NONE)
+        return -ERR_BAD_FRAME;
+
+    // every pin starts with its safe value
+    for (i = 0; i < bsdl.boundary_len; i++)
+        reg_set_bit(bsdl_bsr, i, BSDL_SAFE(bsdl_cells[i]) == BSDL_HIGH);
+
+    bsdl_valid = true;
+    return OK;
+}
+
+bool bsdl_ready()
+{
+    return bsdl_valid;
+}
+
+int bsdl_drive(uint16_t pin, uint8_t value)
+{
+    bsdl_pin_t* p = NULL;
+
+    if (!bsdl_valid || pin >= bsdl.pin_count)
+        return -ERR_OUT_OF_BOUNDS;
+
+    p = &bsdl_pins[pin];
+    if (p->output == BSDL_NONE)
+        return -ERR_OUT_OF_BOUNDS;
+
+    if (value != BSDL_Z)
+        reg_set_bit(bsdl_bsr, p->output, value == BSDL_HIGH);
+
+    // the control cell enables the output, unless it is always driven (OUTPUT2)
+    if (p->control != BSDL_NONE) {
+        if (value == BSDL_Z)
+            reg_set_bit(bsdl_bsr, p->control, BSDL_DISVAL(bsdl_cells[p->output]));
+        else
+            reg_set_bit(bsdl_bsr, p->control, !BSDL_DISVAL(bsdl_cells[p->output]));
+    }
+    else if (value == BSDL_Z) {
+        return -ERR_OUT_OF_BOUNDS;
+    }
+
+    return OK;
+}
+
+/**
+ * @brief The TAP that the table describes: active_tap, or the single TAP of the chain.
+ */
+static tap_t* bsdl_tap()
+{
+    tap_t* tap = active_tap;
+
+    if (tap == NULL && tap_count == 1)
+        tap = &taps[0];
+    if (tap == NULL || tap->ir_len != bsdl.ir_len)
+        return NULL;
+
+    return tap;
+}
+
+/**
+ * @brief Load an instruction (unless ir_in is NULL) and shift the drive image through the boundary register.
+ */
+static int bsdl_scan(uint16_t opcode, reg_t* ir_in, reg_t* ir_out, reg_t* dr_out)
+{
+    tap_t* tap = bsdl_tap();
+
+    if (!bsdl_valid)
+        return -ERR_GENERAL;
+    if (tap == NULL)
+        return -ERR_UNVALID_IR_OR_DR_LEN;
+
+    if (ir_in != NULL) {
+        intToBinArray(ir_in, opcode, bsdl.ir_len);
+        insert_ir_tap(tap, ir_in, RUN_TEST_IDLE, ir_out);
+    }
+    insert_dr_tap(tap, bsdl_bsr, bsdl.boundary_len, RUN_TEST_IDLE, dr_out);
+
+    return OK;
+}
+
+int bsdl_sample(reg_t* ir_in, reg_t* ir_out, reg_t* dr_out)
+{
+    return bsdl_scan(bsdl.opcodes[BSDL_SAMPLE], ir_in, ir_out, dr_out);
+}
+
+int bsdl_capture(reg_t* dr_out)
+{
+    return bsdl_scan(0, NULL, NULL, dr_out);
+}
+
+int bsdl_extest(reg_t* ir_in, reg_t* ir_out, reg_t* dr_out)
+{
+    uint16_t preload = bsdl.opcodes[BSDL_PRELOAD];
+    int rc = OK;
+
+    // preload, so the pins don't glitch through old values when EXTEST takes over
+    rc = bsdl_scan(preload != BSDL_NONE ? preload : bsdl.opcodes[BSDL_SAMPLE], ir_in, ir_out, dr_out);
+    if (rc != OK)
+        return rc;
+
+    return bsdl_scan(bsdl.opcodes[BSDL_EXTEST], ir_in, ir_out, dr_out);
+}
+
+uint8_t bsdl_pin_value(const reg_t* captured, uint16_t pin)
+{
+    if (pin >= bsdl.pin_count || bsdl_pins[pin].input == BSDL_NONE)
+        return BSDL_Z;
+
+    return reg_get_bit(captured, bsdl_pins[pin].input);
+}
+
+void bsdl_pack_pins(const reg_t* captured, reg_t* out)
+{
+    clear_reg(out, bsdl.pin_count);
+    for (uint16_t i = 0; i < bsdl.pin_count; i++)
+        reg_set_bit(out, i, bsdl_pin_value(captured, i) == BSDL_HIGH);
+}
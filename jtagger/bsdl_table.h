@@ -0,0 +1,149 @@
+/** @file bsdl_table.h
+ *
+ * @brief Boundary scan with a BSDL table compiled on the host (bsdl.py).
+ *
+ * The table is uploaded in chunks with BIN_CMD_BSDL_LOAD and holds the
+ * opcodes, the boundary register cells and the cells of every pin, so pin
+ * reads and drives are plain array lookups. Pins are addressed by their
+ * index in the table, the host keeps their names.
+ *
+ * Table layout (little endian), see bsdl.py:
+ *   header (16): magic, version, ir_len, reserved, boundary_len (2), pin count (2), idcode (4), reserved (4)
+ *   opcodes (10): EXTEST, SAMPLE, PRELOAD, IDCODE, BYPASS
+ *   cells: boundary_len x bsdl_cell_t
+ *   pins: pin count x bsdl_pin_t
+ */
+#ifndef __BSDL_TABLE_H__
+#define __BSDL_TABLE_H__
+
+#include "Arduino.h"
+#include "jtagger.h"
+
+#define BSDL_MAGIC      0xB5
+#define BSDL_VERSION    1
+#define BSDL_NONE       0xFFFF
+#define BSDL_HDR_LEN    26
+
+#if defined(ARDUINO_AVR_MEGA2560)
+#define BSDL_MAX_CELLS  512
+#define BSDL_MAX_PINS   64
+#else
+#define BSDL_MAX_CELLS  2048
+#define BSDL_MAX_PINS   512
+#endif
+
+// pin values
+#define BSDL_LOW        0
+#define BSDL_HIGH       1
+#define BSDL_Z          2
+
+typedef enum BsdlFunction
+{
+    BSC_INPUT, BSC_OUTPUT2, BSC_OUTPUT3, BSC_BIDIR, BSC_CONTROL, BSC_CONTROLR,
+    BSC_INTERNAL, BSC_CLOCK, BSC_OBSERVE_ONLY
+} bsdl_function;
+
+typedef enum BsdlOpcode
+{
+    BSDL_EXTEST, BSDL_SAMPLE, BSDL_PRELOAD, BSDL_IDCODE, BSDL_BYPASS, BSDL_OPCODES
+} bsdl_opcode;
+
+typedef struct
+{
+    uint8_t function;   // bsdl_function
+    uint8_t flags;      // safe value (bits 0-1, BSDL_Z for X), disable value (bit 2)
+    uint16_t ccell;     // control cell, or BSDL_NONE
+} bsdl_cell_t;
+
+typedef struct
+{
+    uint16_t input;     // cells of the pin, or BSDL_NONE
+    uint16_t output;
+    uint16_t control;
+} bsdl_pin_t;
+
+typedef struct
+{
+    uint8_t ir_len;
+    uint16_t boundary_len;
+    uint16_t pin_count;
+    uint32_t idcode;
+    uint16_t opcodes[BSDL_OPCODES];
+} bsdl_info_t;
+
+#define BSDL_SAFE(cell)   ((cell).flags & 0x3)
+#define BSDL_DISVAL(cell) (((cell).flags >> 2) & 1)
+
+extern bsdl_info_t bsdl;
+extern bsdl_cell_t bsdl_cells[];
+extern bsdl_pin_t bsdl_pins[];
+
+/**
+ * @brief Store a chunk of the table. Offset 0 starts a new table,
+ * and the chunks must come in order.
+ * @return OK, -ERR_BAD_FRAME if a chunk is missing or -ERR_OUT_OF_BOUNDS if the table is too large.
+ */
+int bsdl_load(uint16_t offset, const uint8_t* data, uint16_t len);
+
+/**
+ * @brief Check the loaded table and reset the drive image to the safe values.
+ * @param len Total length of the table.
+ * @return OK or -ERR_BAD_FRAME.
+ */
+int bsdl_commit(uint16_t len);
+
+/**
+ * @return true when a table is loaded and committed.
+ */
+bool bsdl_ready();
+
+/**
+ * @brief Set the value a pin is driven with by bsdl_extest().
+ * @param pin Pin index in the table.
+ * @param value BSDL_LOW, BSDL_HIGH or BSDL_Z.
+ * @return OK or -ERR_OUT_OF_BOUNDS if the pin can't be driven.
+ */
+int bsdl_drive(uint16_t pin, uint8_t value);
+
+/**
+ * @brief Capture the pins with SAMPLE. The drive image is preloaded at the same time.
+ * The scan goes to active_tap, or to the single TAP of the chain.
+ * @param ir_in Pointer to ir_in register.
+ * @param ir_out Pointer to ir_out register.
+ * @param dr_out Receives the captured boundary register.
+ * @return OK, -ERR_GENERAL without a table or -ERR_UNVALID_IR_OR_DR_LEN if the TAP doesn't match it.
+ */
+int bsdl_sample(reg_t* ir_in, reg_t* ir_out, reg_t* dr_out);
+
+/**
+ * @brief Capture the pins again, without reloading the IR.
+ * Only valid right after bsdl_sample(), while the IR still holds SAMPLE.
+ * @param dr_out Receives the captured boundary register.
+ * @return Same as bsdl_sample().
+ */
+int bsdl_capture(reg_t* dr_out);
+
+/**
+ * @brief Drive the pins from the drive image with EXTEST, and capture them.
+ * The image is preloaded first, so the pins switch straight to their values.
+ * @param ir_in Pointer to ir_in register.
+ * @param ir_out Pointer to ir_out register.
+ * @param dr_out Receives the captured boundary register.
+ * @return Same as bsdl_sample().
+ */
+int bsdl_extest(reg_t* ir_in, reg_t* ir_out, reg_t* dr_out);
+
+/**
+ * @brief Value of a pin in a captured boundary register.
+ * @return BSDL_LOW, BSDL_HIGH or BSDL_Z if the pin has no input cell.
+ */
+uint8_t bsdl_pin_value(const reg_t* captured, uint16_t pin);
+
+/**
+ * @brief Pack the values of all pins, one bit per pin (0 for pins without input cell).
+ * @param captured A captured boundary register.
+ * @param out Receives bsdl.pin_count bits.
+ */
+void bsdl_pack_pins(const reg_t* captured, reg_t* out);
+
+#endif /* __BSDL_TABLE_H__ */
@@ -7,9 +7,16 @@
 @author Michael Vigdorchik
 """
 
+import argparse
+import binascii
+import os
+import signal
 import serial
+import struct
 import sys
 import time
+import bsdl
+import svf
 from serial.tools import list_ports
 
 
@@ -103,17 +110,1245 @@ class Communicator():
         return True
 
 
-def main():
-    ports = list_available_ports()
-    if not ports:
+# binary command mode (see binproto.h)
+BIN_SOF = 0xA5
+BIN_REPLY = 0x80
+BIN_CMD_PING = 0x01
+BIN_CMD_RESET_TAP = 0x02
+BIN_CMD_GOTO_STATE = 0x03
+BIN_CMD_SCAN_IR = 0x04
+BIN_CMD_SCAN_DR = 0x05
+BIN_CMD_SET_TCK = 0x06
+BIN_CMD_QUEUE = 0x07
+BIN_CMD_QUEUE_TDO = 0x08
+BIN_CMD_UFM_DUMP = 0x09
+BIN_CMD_UFM_BLOCK = 0x0A
+BIN_CMD_SELECT_TAP = 0x0B
+BIN_CMD_CHAIN_INFO = 0x0C
+BIN_CMD_DISCOVERY = 0x0D
+BIN_CMD_DISC_BLOCK = 0x0E
+BIN_CMD_BSDL_LOAD = 0x0F
+BIN_CMD_BSDL_COMMIT = 0x10
+BIN_CMD_PINS_SAMPLE = 0x11
+BIN_CMD_PINS_DRIVE = 0x12
+BIN_CMD_PINS_WATCH = 0x13
+BIN_CMD_WATCH_BLOCK = 0x14
+BIN_CMD_UFM_PROGRAM = 0x15
+BIN_CMD_UFM_ERASE = 0x16
+BIN_CMD_UFM_END = 0x17
+BIN_CMD_STATS = 0x18
+BIN_CMD_CALIBRATE = 0x19
+BIN_CMD_DP_ACCESS = 0x1A
+BIN_CMD_MEM_READ = 0x1B
+BIN_CMD_MEM_BLOCK = 0x1C
+BIN_CMD_MEM_WRITE = 0x1D
+BIN_CMD_UFM_CRC = 0x1E
+BIN_CMD_SCAN_BEGIN = 0x1F
+BIN_CMD_SCAN_CHUNK = 0x20
+BIN_CMD_TRACE = 0x21
+BIN_CMD_GANG = 0x22
+BIN_CMD_EXIT = 0x7F
+BIN_CMD_NAK = 0x7E
+BIN_TAP_CHAIN = 0xFF
+BIN_PIN_Z = 2
+BIN_DP_READ = 0x01
+BIN_DP_AP = 0x02
+BIN_TRACE_STOP = 0x00
+BIN_TRACE_START = 0x01
+BIN_TRACE_DUMP = 0x02
+BIN_GANG_QUERY = 0xFF
+BIN_BANNER = b"Entering binary mode\n"
+BIN_MAX_PAYLOAD = 4 + 4096 // 8  # until PING tells the firmware's BIN_MAX_PAYLOAD (smaller on a Mega)
+
+# ops of a queued batch
+BIN_OP_IR = 0x01
+BIN_OP_DR = 0x02
+BIN_OP_RTI = 0x03
+BIN_OP_STATE = 0x04
+BIN_OP_RESET = 0x05
+BIN_OP_IR_CHECK = 0x06
+BIN_OP_DR_CHECK = 0x07
+BIN_OP_CLOCK = 0x08
+BIN_OP_TCK = 0x09
+BIN_OP_TRST = 0x0A
+BIN_OP_MASK = 0x40
+BIN_OP_NO_TDO = 0x80
+
+ERR_TDO_MISMATCH = 12
+ERR_VERIFY = 13
+ERR_DP_WAIT = 14
+ERR_DP_FAULT = 15
+
+# counters of BIN_CMD_STATS, in the order of jtag_stats_t
+STATS_FIELDS = ["tck_cycles", "tms_cycles", "bits_shifted", "ir_scans", "dr_scans",
+                "serial_rx", "serial_tx", "wait_us", "flush_us", "ready_us", "elapsed_us"]
+
+MAX10_IR_LEN = 10
+# largest blocks of programmed or written words, smaller when they don't fit in a frame
+MAX10_PROGRAM_BLOCK_WORDS = 64
+MEM_WRITE_BLOCK_WORDS = 64
+
+# TAP states, in the order of the tap_state enum
+TAP_STATES = [
+    "TEST_LOGIC_RESET", "RUN_TEST_IDLE",
+    "SELECT_DR", "CAPTURE_DR", "SHIFT_DR", "EXIT1_DR", "PAUSE_DR", "EXIT2_DR", "UPDATE_DR",
+    "SELECT_IR", "CAPTURE_IR", "SHIFT_IR", "EXIT1_IR", "PAUSE_IR", "EXIT2_IR", "UPDATE_IR",
+]
+RUN_TEST_IDLE = TAP_STATES.index("RUN_TEST_IDLE")
+
+# bits of a TAP trace event (see tap_trace.h), the cycle counter is above them
+TRACE_TMS = 0x10
+TRACE_TDI = 0x20
+TRACE_TDO = 0x40
+TRACE_RUN = 0x80
+
+
+def crc16(data: bytes) -> int:
+    """CRC-16/CCITT-FALSE, as computed by crc16_update() on the Arduino"""
+    return binascii.crc_hqx(data, 0xFFFF)
+
+
+def block_words(max_payload: int, overhead: int, words: int) -> int:
+    """Halve a block of words until it fits in a payload after overhead bytes"""
+    while words > 1 and overhead + 4 * words > max_payload:
+        words //= 2
+    return words
+
+
+class BinaryError(Exception):
+    pass
+
+
+class ScanBatch():
+    """
+    A batch of IR scans, DR scans, Run-Test/Idle waits and state moves
+    that runs back to back on the Arduino (see BIN_CMD_QUEUE).
+    """
+    def __init__(self, max_payload: int = BIN_MAX_PAYLOAD) -> None:
+        self.max_payload = max_payload
+        self.ops = bytearray()
+        self.count = 0
+        self.scans = []  # op index of every scan that returns its tdo bits
+
+    def _state(self, state) -> int:
+        return TAP_STATES.index(state) if isinstance(state, str) else state
+
+    def _add(self, op: bytes) -> int:
+        if 1 + len(self.ops) + len(op) > self.max_payload:
+            raise BinaryError("Batch does not fit in a single frame")
+        self.ops += op
+        self.count += 1
+        return self.count - 1
+
+    def _scan(self, op: int, tdi: int, length: int, end_state, want_tdo: bool) -> None:
+        nbytes = (length + 7) // 8
+        if not want_tdo:
+            op |= BIN_OP_NO_TDO
+        index = self._add(struct.pack("<BHB", op, length, self._state(end_state))
+                          + tdi.to_bytes(nbytes, "little"))
+        if want_tdo:
+            self.scans.append(index)
+
+    def ir(self, tdi: int, length: int, end_state=RUN_TEST_IDLE, want_tdo=True) -> "ScanBatch":
+        self._scan(BIN_OP_IR, tdi, length, end_state, want_tdo)
+        return self
+
+    def dr(self, tdi: int, length: int, end_state=RUN_TEST_IDLE, want_tdo=True) -> "ScanBatch":
+        self._scan(BIN_OP_DR, tdi, length, end_state, want_tdo)
+        return self
+
+    def rti(self, cycles: int) -> "ScanBatch":
+        self._add(struct.pack("<BI", BIN_OP_RTI, cycles))
+        return self
+
+    def state(self, state) -> "ScanBatch":
+        self._add(struct.pack("<BB", BIN_OP_STATE, self._state(state)))
+        return self
+
+    def reset(self) -> "ScanBatch":
+        self._add(bytes([BIN_OP_RESET]))
+        return self
+
+    def check(self, is_ir: bool, tdi: int, length: int, tdo: int, mask: int = None,
+              end_state=RUN_TEST_IDLE) -> int:
+        """Scan and compare the captured bits on the Arduino, only a mismatch is sent back"""
+        nbytes = (length + 7) // 8
+        op = (BIN_OP_IR_CHECK if is_ir else BIN_OP_DR_CHECK) | BIN_OP_NO_TDO
+        body = tdi.to_bytes(nbytes, "little") + tdo.to_bytes(nbytes, "little")
+        if mask is not None and mask != (1 << length) - 1:
+            op |= BIN_OP_MASK
+            body += mask.to_bytes(nbytes, "little")
+        return self._add(struct.pack("<BHB", op, length, self._state(end_state)) + body)
+
+    def clock(self, cycles: int, usec: int = 0) -> "ScanBatch":
+        self._add(struct.pack("<BII", BIN_OP_CLOCK, cycles, usec))
+        return self
+
+    def tck(self, khz: int) -> "ScanBatch":
+        self._add(struct.pack("<BI", BIN_OP_TCK, khz))
+        return self
+
+    def trst(self, level: int) -> "ScanBatch":
+        self._add(struct.pack("<BB", BIN_OP_TRST, level))
+        return self
+
+    def add(self, op: tuple) -> int:
+        """Add an operation of svf.parse_svf()/parse_xsvf(). Return its op index"""
+        kind = op[0]
+        if kind == "scan":
+            _, is_ir, length, tdi, tdo, mask, end_state, _ = op
+            if tdo is not None:
+                return self.check(is_ir, tdi, length, tdo, mask, end_state)
+            self._scan(BIN_OP_IR if is_ir else BIN_OP_DR, tdi, length, end_state, False)
+        elif kind == "state":
+            self.state(op[1])
+        elif kind == "clock":
+            self.clock(op[1], op[2])
+        elif kind == "tck":
+            self.tck(op[1])
+        elif kind == "trst":
+            self.trst(op[1])
+        return self.count - 1
+
+
+class BinaryClient():
+    """
+    Client of the binary command mode of the Arduino.
+    Scan vectors are passed as python integers, bit 0 is the first bit shifted.
+    """
+    def __init__(self, s: serial.Serial) -> None:
+        self.s = s
+        self.tx_bytes = 0
+        self.rx_bytes = 0
+        self.started = 0.0
+        self.max_payload = BIN_MAX_PAYLOAD
+
+    @property
+    def stream_chunk(self) -> int:
+        """Longest single scan (the firmware's MAX_DR_LEN), longer ones are streamed in chunks of this many bits"""
+        return 8 * (self.max_payload - 4)
+
+    def enter(self) -> None:
+        """Switch from the ASCII main menu (at the 'cmd >' prompt) to binary mode"""
+        self.s.reset_input_buffer()
+        self.s.write(b"b\n")
+        if not self.s.read_until(BIN_BANNER).endswith(BIN_BANNER):
+            raise BinaryError("Arduino did not enter binary mode")
+        self.ping()
+
+    def send(self, cmd: int, payload: bytes = b"") -> None:
+        body = struct.pack("<BH", cmd, len(payload)) + payload
+        self.s.write(bytes([BIN_SOF]) + body + struct.pack("<H", crc16(body)))
+        self.tx_bytes += len(body) + 3
+
+    def receive(self) -> tuple:
+        """Read a single reply frame. Return (cmd, status, data)"""
+        while True:
+            sof = self.s.read(1)
+            if not sof:
+                raise BinaryError("Timeout waiting for a reply")
+            if sof[0] == BIN_SOF:
+                break
+        hdr = self.s.read(3)
+        if len(hdr) != 3:
+            raise BinaryError("Truncated reply header")
+        cmd, length = struct.unpack("<BH", hdr)
+        payload = self.s.read(length)
+        tail = self.s.read(2)
+        if len(payload) != length or len(tail) != 2:
+            raise BinaryError("Truncated reply")
+        self.rx_bytes += len(payload) + 6
+        if struct.unpack("<H", tail)[0] != crc16(hdr + payload):
+            raise BinaryError("Bad reply CRC")
+        return cmd & ~BIN_REPLY, payload[0], payload[1:]
+
+    def transact(self, cmd: int, payload: bytes = b"") -> bytes:
+        """Send a request and return the data of its reply"""
+        self.send(cmd, payload)
+        rcmd, status, data = self.receive()
+        if rcmd != cmd:
+            raise BinaryError(f"Reply to command 0x{rcmd:x}, status {status}")
+        if status != 0:
+            raise BinaryError(f"Command 0x{cmd:x} failed with error {status}")
+        return data
+
+    def ping(self) -> int:
+        """Return the protocol version, and learn the largest payload the Arduino takes"""
+        data = self.transact(BIN_CMD_PING)
+        if len(data) >= 3:
+            self.max_payload = struct.unpack_from("<H", data, 1)[0]
+        return data[0]
+
+    def reset_tap(self) -> None:
+        self.transact(BIN_CMD_RESET_TAP)
+
+    def goto_state(self, state) -> None:
+        if isinstance(state, str):
+            state = TAP_STATES.index(state)
+        self.transact(BIN_CMD_GOTO_STATE, bytes([state]))
+
+    def _scan(self, cmd: int, tdi: int, length: int, end_state) -> int:
+        if isinstance(end_state, str):
+            end_state = TAP_STATES.index(end_state)
+        if length > self.stream_chunk:
+            return self.scan_stream(cmd == BIN_CMD_SCAN_IR, tdi, length, end_state)
+        nbytes = (length + 7) // 8
+        payload = struct.pack("<HB", length, end_state) + tdi.to_bytes(nbytes, "little")
+        return int.from_bytes(self.transact(cmd, payload), "little")
+
+    def scan_stream(self, is_ir: bool, tdi: int, length: int, end_state=RUN_TEST_IDLE,
+                    chunk: int = 0, window: int = 2) -> int:
+        """
+        Shift a scan of any length in chunks of chunk bits (a multiple of 8, by default
+        the longest single scan). Between
+        chunks the TAP waits in PAUSE_DR/PAUSE_IR. Up to window chunks are outstanding,
+        so the next chunk is received while the Arduino shifts the current one.
+        Return the bits shifted out.
+        """
+        if isinstance(end_state, str):
+            end_state = TAP_STATES.index(end_state)
+        chunk = chunk or self.stream_chunk
+        if chunk % 8 or not 0 < chunk <= self.stream_chunk:
+            raise BinaryError(f"Chunks of {chunk} bits can't be streamed")
+        data = tdi.to_bytes((length + 7) // 8, "little")
+        step = chunk // 8
+        chunks = [data[i:i + step] for i in range(0, len(data), step)]
+        self.transact(BIN_CMD_SCAN_BEGIN, struct.pack("<BIB", is_ir, length, end_state))
+        tdo = bytearray()
+        sent = 0
+        while len(tdo) < len(data):
+            while sent < len(chunks) and sent * step - len(tdo) < window * step:
+                self.send(BIN_CMD_SCAN_CHUNK, chunks[sent])
+                sent += 1
+            cmd, status, reply = self.receive()
+            if cmd != BIN_CMD_SCAN_CHUNK:
+                raise BinaryError(f"Unexpected reply to command 0x{cmd:x}")
+            if status != 0:
+                raise BinaryError(f"Streamed scan failed at bit {8 * len(tdo)} with error {status}")
+            tdo += reply
+        return int.from_bytes(tdo, "little")
+
+    def scan_ir(self, tdi: int, length: int, end_state=RUN_TEST_IDLE) -> int:
+        """Shift length bits into the IR and return the bits shifted out, streamed if longer than a chunk"""
+        return self._scan(BIN_CMD_SCAN_IR, tdi, length, end_state)
+
+    def scan_dr(self, tdi: int, length: int, end_state=RUN_TEST_IDLE) -> int:
+        """Shift length bits into the DR and return the bits shifted out, streamed if longer than a chunk"""
+        return self._scan(BIN_CMD_SCAN_DR, tdi, length, end_state)
+
+    def set_tck(self, khz: int) -> int:
+        """Select the TCK frequency (0 for max) and return the kHz achieved, the TAP state is kept"""
+        return struct.unpack("<I", self.transact(BIN_CMD_SET_TCK, struct.pack("<I", khz)))[0]
+
+    def calibrate(self, rtck: bool = True) -> tuple:
+        """
+        Find the fastest TCK the chain passes the integrity checks at, and keep it.
+        Return (khz, rtck, list of the fastest kHz of every TAP, nearest to TDO first).
+        """
+        self.send(BIN_CMD_CALIBRATE, bytes([rtck]))
+        rcmd, status, data = self.receive()
+        if rcmd != BIN_CMD_CALIBRATE:
+            raise BinaryError(f"Reply to command 0x{rcmd:x}, status {status}")
+        if status != 0:
+            raise BinaryError(f"The chain fails the integrity check even at the slowest TCK (error {status})")
+        khz, adaptive = struct.unpack_from("<IB", data)
+        return khz, bool(adaptive), list(struct.unpack_from(f"<{(len(data) - 5) // 4}I", data, 5))
+
+    def select_tap(self, index=None) -> None:
+        """Address a single TAP of the chain (0 is nearest to TDO), or the whole chain with None."""
+        self.transact(BIN_CMD_SELECT_TAP, bytes([BIN_TAP_CHAIN if index is None else index]))
+
+    def chain_info(self) -> list:
+        """List of (idcode, ir_len) of the TAPs found by the Arduino, nearest to TDO first."""
+        data = self.transact(BIN_CMD_CHAIN_INFO)
+        return [struct.unpack_from("<IB", data, 1 + i * 5) for i in range(data[0])]
+
+    def run_batch(self, batch: ScanBatch) -> dict:
+        """Run a single batch. Return a dict of op index -> tdo bits"""
+        return self.run_batches([batch])[0]
+
+    def run_batches(self, batches, window: int = 2) -> list:
+        """
+        Run batches back to back. Up to window batches are outstanding at once,
+        so the next batch is uploaded while the Arduino shifts the current one.
+        Return a list with a dict of op index -> tdo bits for every batch.
+        """
+        results = [dict() for _ in batches]
+        sent = 0
+        done = 0
+        while done < len(batches):
+            while sent < len(batches) and sent - done < window:
+                self.send(BIN_CMD_QUEUE, bytes([sent & 0xff]) + bytes(batches[sent].ops))
+                sent += 1
+            cmd, status, data = self.receive()
+            if status != 0:
+                raise BinaryError(f"Batch {done} failed with error {status} "
+                                  f"after {struct.unpack_from('<H', data, 1)[0] if len(data) >= 3 else '?'} ops")
+            if data[0] != done & 0xff:
+                raise BinaryError(f"Reply for batch tag {data[0]} while waiting for {done}")
+            if cmd == BIN_CMD_QUEUE_TDO:
+                index = struct.unpack_from("<H", data, 1)[0]
+                results[done][index] = int.from_bytes(data[3:], "little")
+            elif cmd == BIN_CMD_QUEUE:
+                done += 1
+            else:
+                raise BinaryError(f"Unexpected reply to command 0x{cmd:x}")
+        return results
+
+    def play(self, ops: list, window: int = 2) -> list:
+        """
+        Play the operations of an SVF/XSVF file. Operations are packed into batches
+        that are uploaded while the previous ones run, so TCK never waits for the host.
+        TDO is checked on the Arduino. A scan too long for a batch is streamed once the
+        batches before it are done (see scan_stream()), and checked here.
+        Return a list of (line, expected, mask, captured) for every mismatch.
+        Playback stops after the batch (or streamed scan) of the first mismatch.
+        """
+        mismatches = []
+        batches = []  # (batch, op index -> svf op)
+        sent = 0
+        done = 0
+        pos = 0
+        long_op = None  # scan that waits for the batches before it
+
+        def next_batch():
+            nonlocal pos
+            batch = ScanBatch(self.max_payload)
+            where = dict()
+            while pos < len(ops):
+                try:
+                    where[batch.add(ops[pos])] = ops[pos]
+                except BinaryError:
+                    if batch.count == 0:
+                        pos += 1
+                        return None, ops[pos - 1]
+                    break
+                pos += 1
+            return batch, where
+
+        while True:
+            while pos < len(ops) and long_op is None and sent - done < window and not mismatches:
+                batch, where = next_batch()
+                if batch is None:
+                    long_op = where
+                    break
+                batches.append((batch, where))
+                self.send(BIN_CMD_QUEUE, bytes([sent & 0xff]) + bytes(batch.ops))
+                sent += 1
+            if done == sent:
+                if long_op is None and (pos == len(ops) or mismatches):
+                    break
+                if long_op is not None and not mismatches:
+                    mismatches += self._play_stream(long_op)
+                long_op = None
+                continue
+            cmd, status, data = self.receive()
+            if data[0] != done & 0xff:
+                raise BinaryError(f"Reply for batch tag {data[0]} while waiting for {done}")
+            if cmd == BIN_CMD_QUEUE_TDO and status == ERR_TDO_MISMATCH:
+                op = batches[done][1][struct.unpack_from("<H", data, 1)[0]]
+                mismatches.append((op[-1], op[4], op[5], int.from_bytes(data[3:], "little")))
+            elif cmd == BIN_CMD_QUEUE:
+                if status != 0:
+                    raise BinaryError(f"Batch {done} failed with error {status}")
+                done += 1
+            else:
+                raise BinaryError(f"Unexpected reply to command 0x{cmd:x}")
+        return mismatches
+
+    def _play_stream(self, op: tuple) -> list:
+        """Stream a single scan op of play(), return its mismatch if any"""
+        _, is_ir, length, tdi, tdo, mask, end_state, line = op
+        captured = self.scan_stream(is_ir, tdi, length, end_state)
+        if tdo is None:
+            return []
+        if (captured ^ tdo) & (mask if mask is not None else (1 << length) - 1):
+            return [(line, tdo, mask, captured)]
+        return []
+
+    def drain(self) -> None:
+        """Discard incoming bytes until the Arduino stays quiet for a timeout"""
+        while self.s.read(4096):
+            pass
+
+    def dump_ufm(self, path: str, start: int, words: int, resume: bool = False,
+                 retries: int = 5, progress=None) -> None:
+        """
+        Stream words 32 bit words of the MAX10 UFM, from address start, into the file path.
+        Addresses advance by 4 per word. The file only ever holds verified blocks,
+        so after an interruption the dump resumes from the last good address,
+        both within this call and, with resume=True, across runs.
+        """
+        done = 0
+        if resume and os.path.exists(path):
+            done = min(os.path.getsize(path) // 4, words)
+        with open(path, "r+b" if done else "wb") as f:
+            f.seek(done * 4)
+            f.truncate()
+            while done < words:
+                addr = start + 4 * done
+                try:
+                    self.send(BIN_CMD_UFM_DUMP, struct.pack("<BII", MAX10_IR_LEN, addr, words - done))
+                    while True:
+                        cmd, status, data = self.receive()
+                        if status != 0:
+                            raise BinaryError(f"UFM dump failed with error {status}")
+                        if cmd == BIN_CMD_UFM_DUMP:
+                            break
+                        if cmd != BIN_CMD_UFM_BLOCK:
+                            raise BinaryError(f"Unexpected reply to command 0x{cmd:x}")
+                        block_addr = struct.unpack_from("<I", data)[0]
+                        if block_addr != start + 4 * done:
+                            raise BinaryError(f"Block at 0x{block_addr:x}, expected 0x{start + 4 * done:x}")
+                        f.write(data[4:])
+                        f.flush()
+                        done += (len(data) - 4) // 4
+                        if progress:
+                            progress(done, words)
+                except BinaryError as error:
+                    if retries == 0:
+                        raise
+                    retries -= 1
+                    print(f"\n{error}, resuming from 0x{start + 4 * done:x}")
+                    self.drain()
+
+    def program_ufm(self, image: bytes, start: int, erase: bool = True, window: int = 2,
+                    progress=None) -> list:
+        """
+        Program an image into the MAX10 UFM from address start, block by block.
+        Up to window blocks are outstanding, so the next block is received while
+        the Arduino programs the current one. Every block is verified by readback
+        on the Arduino, and only its pass/fail comes back.
+        Return the addresses of the blocks that failed verification.
+        """
+        image += b"\xff" * (-len(image) % 4)
+        words = len(image) // 4
+        step = block_words(self.max_payload, 5, MAX10_PROGRAM_BLOCK_WORDS)
+        blocks = [(start + 4 * i, image[4 * i:4 * (i + step)]) for i in range(0, words, step)]
+        if erase:
+            status, erased = self.erase_ufm()
+            if status != 0:
+                raise BinaryError(f"Erase failed with error {status}" +
+                                  (f", erased chains mask 0x{erased:x}" if erased is not None else ""))
+        failed = []
+        sent = 0
+        done = 0
+        while done < len(blocks):
+            while sent < len(blocks) and sent - done < window:
+                addr, data = blocks[sent]
+                self.send(BIN_CMD_UFM_PROGRAM, struct.pack("<BI", MAX10_IR_LEN, addr) + data)
+                sent += 1
+            cmd, status, data = self.receive()
+            if cmd != BIN_CMD_UFM_PROGRAM:
+                raise BinaryError(f"Unexpected reply to command 0x{cmd:x}")
+            addr = struct.unpack_from("<I", data)[0]
+            if addr != blocks[done][0]:
+                raise BinaryError(f"Reply for block 0x{addr:x} while waiting for 0x{blocks[done][0]:x}")
+            if status == ERR_VERIFY:
+                failed.append(addr)
+            elif status != 0:
+                raise BinaryError(f"Programming failed with error {status}")
+            done += 1
+            if progress:
+                progress(min(done * step, words), words)
+        self.transact(BIN_CMD_UFM_END, bytes([MAX10_IR_LEN]))
+        return failed
+
+    def erase_ufm(self) -> tuple:
+        """
+        Erase the MAX10 flash. Return (status, erased) where erased is the mask
+        of the chains whose flash reads erased in gang mode, else None.
+        """
+        self.send(BIN_CMD_UFM_ERASE, bytes([MAX10_IR_LEN]))
+        cmd, status, data = self.receive()
+        if cmd != BIN_CMD_UFM_ERASE:
+            raise BinaryError(f"Unexpected reply to command 0x{cmd:x}")
+        return status, data[0] if data else None
+
+    def crc_ufm_chains(self, start: int, words: int) -> list:
+        """The CRC-32 of a UFM range on every chain of the gang (a single one out of gang mode)"""
+        data = self.transact(BIN_CMD_UFM_CRC, struct.pack("<BII", MAX10_IR_LEN, start, words))
+        return list(struct.unpack(f"<{len(data) // 4}I", data))
+
+    def crc_ufm(self, start: int, words: int) -> int:
+        """CRC-32 (zlib's) of words 32 bit words of the MAX10 UFM from address start, computed on the Arduino"""
+        return self.crc_ufm_chains(start, words)[0]
+
+    def verify_ufm_chains(self, image: bytes, start: int, leaf: int = 1, progress=None) -> list:
+        """
+        Compare the MAX10 UFM from address start with an image, transferring only CRCs.
+        A range whose CRC differs on any chain is split in halves until the halves
+        are at most leaf words long. Return, for every chain of the gang (a single
+        one out of gang mode), the (address, words) ranges that differ, adjacent ones merged.
+        """
+        image += b"\xff" * (-len(image) % 4)
+        words = len(image) // 4
+        pending = [(0, words)] if words else []
+        differ = None
+        resolved = 0
+        while pending:
+            first, n = pending.pop()
+            expected = binascii.crc32(image[4 * first:4 * (first + n)])
+            same = [crc == expected for crc in self.crc_ufm_chains(start + 4 * first, n)]
+            if differ is None:
+                differ = [[] for _ in same]
+            if not all(same) and n > leaf:
+                # the lower half is checked first
+                half = n // 2
+                pending.append((first + half, n - half))
+                pending.append((first, half))
+                continue
+            for chain, ok in enumerate(same):
+                if not ok:
+                    differ[chain].append((first, n))
+            resolved += n
+            if progress:
+                progress(resolved, words)
+        self.transact(BIN_CMD_UFM_END, bytes([MAX10_IR_LEN]))
+
+        result = []
+        for ranges in differ or [[]]:
+            merged = []
+            for first, n in sorted(ranges):
+                if merged and merged[-1][0] + merged[-1][1] == first:
+                    merged[-1] = (merged[-1][0], merged[-1][1] + n)
+                else:
+                    merged.append((first, n))
+            result.append([(start + 4 * first, n) for first, n in merged])
+        return result
+
+    def verify_ufm(self, image: bytes, start: int, leaf: int = 1, progress=None) -> list:
+        """verify_ufm_chains() of a single chain: the (address, words) ranges that differ"""
+        return self.verify_ufm_chains(image, start, leaf, progress)[0]
+
+    def gang(self, chains: int) -> tuple:
+        """
+        Run the following commands on several chains at once (0 for the single chain,
+        BIN_GANG_QUERY to only ask). Return (chains in use, mask of the chains that
+        shifted out other bits than chain 0 since the last call, IDCODE of every chain).
+        """
+        data = self.transact(BIN_CMD_GANG, bytes([chains]))
+        return data[0], data[1], list(struct.unpack(f"<{(len(data) - 2) // 4}I", data[2:]))
+
+    def _dp_access(self, tap: int, flags: int, ap: int, addr: int, value: int = 0) -> int:
+        self.send(BIN_CMD_DP_ACCESS, struct.pack("<BBBBI", tap, flags, ap, addr, value))
+        cmd, status, data = self.receive()
+        if cmd != BIN_CMD_DP_ACCESS:
+            raise BinaryError(f"Unexpected reply to command 0x{cmd:x}")
+        if status != 0:
+            raise BinaryError(f"Debug port access failed with error {status}")
+        return struct.unpack("<I", data)[0]
+
+    def dp_read(self, tap: int, addr: int) -> int:
+        """Read a register of the JTAG-DP of a TAP"""
+        return self._dp_access(tap, BIN_DP_READ, 0, addr)
+
+    def dp_write(self, tap: int, addr: int, value: int) -> None:
+        """Write a register of the JTAG-DP of a TAP"""
+        self._dp_access(tap, 0, 0, addr, value)
+
+    def ap_read(self, tap: int, ap: int, addr: int) -> int:
+        """Read a register of an access port behind the JTAG-DP of a TAP"""
+        return self._dp_access(tap, BIN_DP_READ | BIN_DP_AP, ap, addr)
+
+    def ap_write(self, tap: int, ap: int, addr: int, value: int) -> None:
+        """Write a register of an access port behind the JTAG-DP of a TAP"""
+        self._dp_access(tap, BIN_DP_AP, ap, addr, value)
+
+    def read_mem(self, tap: int, addr: int, words: int, ap: int = 0, out=None, progress=None) -> bytes:
+        """
+        Read words 32 bit words of memory through a MEM-AP, from address addr.
+        The Arduino streams the words back in blocks while it keeps reading.
+        Every block is written to the file out as it arrives, if given.
+        Return the bytes read.
+        """
+        data = bytearray()
+        self.send(BIN_CMD_MEM_READ, struct.pack("<BBII", tap, ap, addr, words))
+        while True:
+            cmd, status, reply = self.receive()
+            if cmd == BIN_CMD_MEM_READ:
+                if status != 0:
+                    raise BinaryError(f"Memory read failed at 0x{addr + len(data):x} with error {status}")
+                break
+            if cmd != BIN_CMD_MEM_BLOCK:
+                raise BinaryError(f"Unexpected reply to command 0x{cmd:x}")
+            block_addr = struct.unpack_from("<I", reply)[0]
+            if block_addr != addr + len(data):
+                raise BinaryError(f"Block at 0x{block_addr:x}, expected 0x{addr + len(data):x}")
+            data += reply[4:]
+            if out:
+                out.write(reply[4:])
+            if progress:
+                progress(len(data) // 4, words)
+        return bytes(data)
+
+    def write_mem(self, tap: int, addr: int, image: bytes, ap: int = 0, window: int = 2,
+                  progress=None) -> None:
+        """
+        Write an image to memory through a MEM-AP, from address addr, block by block.
+        Up to window blocks are outstanding, so the next block is received while
+        the Arduino writes the current one.
+        """
+        image += b"\x00" * (-len(image) % 4)
+        words = len(image) // 4
+        step = block_words(self.max_payload, 6, MEM_WRITE_BLOCK_WORDS)
+        blocks = [(addr + 4 * i, image[4 * i:4 * (i + step)]) for i in range(0, words, step)]
+        sent = 0
+        done = 0
+        while done < len(blocks):
+            while sent < len(blocks) and sent - done < window:
+                block_addr, data = blocks[sent]
+                self.send(BIN_CMD_MEM_WRITE, struct.pack("<BBI", tap, ap, block_addr) + data)
+                sent += 1
+            cmd, status, data = self.receive()
+            if cmd != BIN_CMD_MEM_WRITE:
+                raise BinaryError(f"Unexpected reply to command 0x{cmd:x}")
+            if status != 0:
+                raise BinaryError(f"Memory write failed in the block at 0x{blocks[done][0]:x} with error {status}")
+            done += 1
+            if progress:
+                progress(min(done * step, words), words)
+
+    def discovery(self, ir_len: int, first: int, last: int, max_dr_len: int = 0,
+                  results: dict = None, progress=None, stop=None) -> int:
+        """
+        Measure the DR length of every instruction from first to last into results
+        (instruction -> DR length, 0 when none was found). stop() is checked after every
+        block, and when it returns True the sweep is stopped on the Arduino.
+        Return the first instruction that wasn't checked, to resume from (last + 1 when done).
+        """
+        if results is None:
+            results = dict()
+        self.send(BIN_CMD_DISCOVERY, struct.pack("<BIIH", ir_len, first, last, max_dr_len))
+        stopping = False
+        while True:
+            cmd, status, data = self.receive()
+            if cmd == BIN_CMD_DISC_BLOCK:
+                block_first = struct.unpack_from("<I", data)[0]
+                for i in range((len(data) - 4) // 2):
+                    results[block_first + i] = struct.unpack_from("<H", data, 4 + 2 * i)[0]
+                if progress:
+                    progress(block_first + (len(data) - 4) // 2 - first, last - first + 1)
+                if stop and not stopping and stop():
+                    # any frame stops the sweep, its reply follows the discovery reply
+                    self.send(BIN_CMD_PING)
+                    stopping = True
+            elif cmd == BIN_CMD_DISCOVERY:
+                break
+            else:
+                raise BinaryError(f"Unexpected reply to command 0x{cmd:x}")
+        if status != 0:
+            raise BinaryError(f"Discovery failed with error {status}")
+        if stopping:
+            self.receive()
+        return struct.unpack_from("<I", data)[0]
+
+    def load_bsdl(self, table: bytes, chunk: int = 256) -> tuple:
+        """Upload a table compiled by bsdl.py. Return (ir_len, boundary_len, pin count)"""
+        chunk = min(chunk, self.max_payload - 2)
+        for offset in range(0, len(table), chunk):
+            self.transact(BIN_CMD_BSDL_LOAD, struct.pack("<H", offset) + table[offset:offset + chunk])
+        return struct.unpack("<BHH", self.transact(BIN_CMD_BSDL_COMMIT, struct.pack("<H", len(table))))
+
+    def sample_pins(self) -> int:
+        """Capture the pins with SAMPLE. Return their values, bit n is pin n of the table"""
+        return int.from_bytes(self.transact(BIN_CMD_PINS_SAMPLE), "little")
+
+    def drive_pins(self, values: dict) -> int:
+        """
+        Drive pins with EXTEST, values maps a pin index to 0, 1 or BIN_PIN_Z.
+        Pins keep their values between calls. Return the pin values read back.
+        """
+        payload = struct.pack("<H", len(values))
+        for pin, value in values.items():
+            payload += struct.pack("<HB", pin, value)
+        return int.from_bytes(self.transact(BIN_CMD_PINS_DRIVE, payload), "little")
+
+    def watch_pins(self, samples: int = 0, on_change=None, progress=None, stop=None) -> tuple:
+        """
+        Capture the boundary register over and over (samples times, or until stop() returns True).
+        on_change(usec, cells) is called for every sample where cells toggled, usec counts from
+        the first sample, and the first call lists the cells at 1. progress(samples) follows
+        every block. Return (samples, elapsed usec) as measured by the Arduino.
+        """
+        self.send(BIN_CMD_PINS_WATCH, struct.pack("<I", samples))
+        stream = b""
+        usec = 0
+        stopping = False
+
+        def varint(pos):
+            value, shift = 0, 0
+            while True:
+                if pos >= len(stream):
+                    raise IndexError
+                value |= (stream[pos] & 0x7F) << shift
+                shift += 7
+                pos += 1
+                if not stream[pos - 1] & 0x80:
+                    return value, pos
+
+        while True:
+            cmd, status, data = self.receive()
+            if cmd == BIN_CMD_WATCH_BLOCK:
+                stream += data[4:]
+                # decode the complete records, a record may continue in the next block
+                pos = 0
+                try:
+                    while pos < len(stream):
+                        dt, p = varint(pos)
+                        count, p = varint(p)
+                        cells, cell = [], 0
+                        for _ in range(count):
+                            delta, p = varint(p)
+                            cell += delta
+                            cells.append(cell)
+                        usec += dt
+                        pos = p
+                        if on_change:
+                            on_change(usec, cells)
+                except IndexError:
+                    pass
+                stream = stream[pos:]
+                if progress:
+                    progress(struct.unpack_from("<I", data)[0])
+                if stop and not stopping and stop():
+                    # any frame stops the sampling, its reply follows the watch reply
+                    self.send(BIN_CMD_PING)
+                    stopping = True
+            elif cmd == BIN_CMD_PINS_WATCH:
+                break
+            else:
+                raise BinaryError(f"Unexpected reply to command 0x{cmd:x}")
+        if status != 0:
+            raise BinaryError(f"Sampling failed with error {status}")
+        if stopping:
+            self.receive()
+        return struct.unpack("<II", data)
+
+    def stats(self, clear: bool = False) -> dict:
+        """The performance counters of the Arduino since they were last cleared"""
+        data = self.transact(BIN_CMD_STATS, bytes([clear]))
+        return dict(zip(STATS_FIELDS, struct.unpack(f"<{len(STATS_FIELDS)}I", data)))
+
+    def trace(self, op: int) -> tuple:
+        """
+        Start, stop or dump the TAP trace of the Arduino.
+        Return (events recorded, TCK cycles, events) where the dumped events are
+        (cycle, state, tms, tdi, tdo, run) tuples, oldest first. A run event stands
+        for the cycles up to the next event, whose bits were not recorded.
+        """
+        data = self.transact(BIN_CMD_TRACE, bytes([op]))
+        count, cycles = struct.unpack("<II", data[:8])
+        raw = struct.unpack(f"<{(len(data) - 8) // 4}I", data[8:])
+        # once the ring wrapped, the oldest event is the next one to be overwritten
+        if count > len(raw):
+            raw = raw[count % len(raw):] + raw[:count % len(raw)]
+        # the events keep the low 24 bits of the cycle, counted back from the end
+        events = []
+        ref = cycles - 1
+        for e in reversed(raw):
+            cycle = ref - ((ref - (e >> 8)) & 0xFFFFFF)
+            events.append((cycle, e & 0xF, int(bool(e & TRACE_TMS)), int(bool(e & TRACE_TDI)),
+                           int(bool(e & TRACE_TDO)), bool(e & TRACE_RUN)))
+            ref = cycle - 1
+        events.reverse()
+        return count, cycles, events
+
+    def exit(self) -> None:
+        """Go back to the ASCII main menu"""
+        self.transact(BIN_CMD_EXIT)
+
+
+def print_stats(st: dict, wall: float) -> None:
+    """Throughput of a command from the counters of the Arduino and the host wall time"""
+    elapsed = max(st["elapsed_us"], 1) / 1e6
+    busy = max(st["elapsed_us"] - st["wait_us"] - st["flush_us"], 1) / 1e6
+    scans = st["ir_scans"] + st["dr_scans"]
+    print(f"\n{st['tck_cycles']} TCK cycles ({st['tms_cycles']} moving between states), "
+          f"{st['bits_shifted']} bits in {st['ir_scans']} IR and {st['dr_scans']} DR scans")
+    print(f"Arduino: {elapsed:.3f} s, {st['wait_us'] / 1e6:.3f} s waiting for the host, "
+          f"{st['flush_us'] / 1e6:.3f} s blocked on serial TX, {st['ready_us'] / 1e6:.3f} s waiting for the device; "
+          f"host wall time {wall:.3f} s")
+    print(f"{st['bits_shifted'] / elapsed:.0f} bits/s, {scans / elapsed:.0f} scans/s overall, "
+          f"{st['bits_shifted'] / busy:.0f} bits/s, {scans / busy:.0f} scans/s while busy, "
+          f"serial {st['serial_rx'] / elapsed:.0f} B/s in {st['serial_tx'] / elapsed:.0f} B/s out")
+
+
+def open_session(c: Communicator, args) -> BinaryClient:
+    """Enter binary mode for a command, clearing the counters for --stats"""
+    b = BinaryClient(c.s)
+    b.enter()
+    if args.stats:
+        b.stats(clear=True)
+        b.started = time.time()
+    if args.trace:
+        b.trace(BIN_TRACE_START)
+    if args.gang:
+        # gang mode drives whole chains
+        b.select_tap()
+        _, _, idcodes = b.gang(args.gang)
+        for chain, idcode in enumerate(idcodes):
+            print(f"Chain {chain}: IDCODE 0x{idcode:08x}")
+    return b
+
+
+def close_session(b: BinaryClient, args) -> None:
+    """Report the throughput of the command with --stats, save its --trace and go back to the menu"""
+    if args.stats:
+        print_stats(b.stats(), time.time() - b.started)
+    if args.trace:
+        save_trace(b, args.trace)
+        b.trace(BIN_TRACE_STOP)
+    if args.gang:
+        _, diff, _ = b.gang(0)
+        if diff:
+            print("Chains that shifted out other bits than chain 0: " +
+                  ", ".join(str(c) for c in range(args.gang) if diff >> c & 1))
+    b.exit()
+
+
+def print_progress(done: int, total: int, unit: str = "words") -> None:
+    sys.stdout.write(f"\r{done}/{total} {unit} ({100 * done // max(total, 1)}%)")
+    sys.stdout.flush()
+
+
+def calibrate(c: Communicator, args) -> None:
+    """Calibrate the TCK frequency against the detected chain, from the 'cmd >' prompt"""
+    b = open_session(c, args)
+    khz, rtck, taps = b.calibrate(rtck=not args.no_rtck)
+    print(f"TCK {khz} kHz{' with RTCK adaptive clocking' if rtck else ''}")
+    for i, tap_khz in enumerate(taps):
+        print(f"  TAP {i}: IDCODE intact up to {tap_khz} kHz")
+    close_session(b, args)
+
+
+def dump_ufm(c: Communicator, args) -> None:
+    """Stream a MAX10 UFM dump to a file, from the 'cmd >' prompt of the main menu"""
+    b = open_session(c, args)
+    start_time = time.time()
+    b.dump_ufm(args.dump_ufm, args.start, args.words, resume=args.resume, progress=print_progress)
+    elapsed = time.time() - start_time
+    print(f"\nDumped {args.words} words to {args.dump_ufm} in {elapsed:.2f} s")
+    close_session(b, args)
+
+
+def program_ufm(c: Communicator, args) -> None:
+    """Erase the MAX10 flash and program a raw image into the UFM, from the 'cmd >' prompt"""
+    with open(args.program_ufm, "rb") as f:
+        image = f.read()
+    b = open_session(c, args)
+    start_time = time.time()
+    failed = b.program_ufm(image, args.start, erase=not args.no_erase, progress=print_progress)
+    bad_chains = []
+    if args.gang:
+        # the readback of every block only checks chain 0, every chain is checked by CRC
+        padded = image + b"\xff" * (-len(image) % 4)
+        expected = binascii.crc32(padded)
+        crcs = b.crc_ufm_chains(args.start, len(padded) // 4)
+        b.transact(BIN_CMD_UFM_END, bytes([MAX10_IR_LEN]))
+        bad_chains = [chain for chain, crc in enumerate(crcs) if crc != expected]
+    elapsed = time.time() - start_time
+    for addr in failed:
+        print(f"\nVerify failed in the block at 0x{addr:x}")
+    for chain in bad_chains:
+        print(f"\nChain {chain} differs from the image")
+    print(f"\nProgrammed {(len(image) + 3) // 4} words from {args.program_ufm} in {elapsed:.2f} s, "
+          f"{'FAILED' if failed or bad_chains else 'verified'}")
+    close_session(b, args)
+
+
+def verify_ufm(c: Communicator, args) -> None:
+    """Compare the MAX10 UFM with a raw image by CRC32, from the 'cmd >' prompt of the main menu"""
+    with open(args.verify_ufm, "rb") as f:
+        image = f.read()
+    b = open_session(c, args)
+    start_time = time.time()
+    differ = b.verify_ufm_chains(image, args.start, progress=print_progress)
+    elapsed = time.time() - start_time
+    for chain, ranges in enumerate(differ):
+        for addr, words in ranges:
+            print(f"\n{f'Chain {chain}: d' if args.gang else 'D'}iffers at 0x{addr:x}, {words} word(s)")
+    print(f"\nCompared {(len(image) + 3) // 4} words with {args.verify_ufm} in {elapsed:.2f} s, "
+          f"{'FAILED' if any(differ) else 'identical'}")
+    close_session(b, args)
+
+
+def dump_mem(c: Communicator, args) -> None:
+    """Stream memory of an ARM core to a file through the JTAG-DP of a TAP, from the 'cmd >' prompt"""
+    b = open_session(c, args)
+    start_time = time.time()
+    with open(args.dump_mem, "wb") as f:
+        b.read_mem(args.tap or 0, args.start, args.words, ap=args.ap, out=f, progress=print_progress)
+    elapsed = time.time() - start_time
+    print(f"\nDumped {args.words} words from 0x{args.start:x} to {args.dump_mem} in {elapsed:.2f} s")
+    close_session(b, args)
+
+
+def write_mem(c: Communicator, args) -> None:
+    """Write a raw image to memory of an ARM core through the JTAG-DP of a TAP, from the 'cmd >' prompt"""
+    with open(args.write_mem, "rb") as f:
+        image = f.read()
+    b = open_session(c, args)
+    start_time = time.time()
+    b.write_mem(args.tap or 0, args.start, image, ap=args.ap, progress=print_progress)
+    elapsed = time.time() - start_time
+    print(f"\nWrote {(len(image) + 3) // 4} words from {args.write_mem} to 0x{args.start:x} in {elapsed:.2f} s")
+    close_session(b, args)
+
+
+def discover(c: Communicator, args) -> None:
+    """
+    Run an IR discovery sweep into a text file of "instruction dr_len" lines.
+    With --resume the sweep continues after the last instruction in the file,
+    and Ctrl-C stops it cleanly so it can be resumed later.
+    """
+    first, last = (int(x, 0) for x in args.discover.split(":"))
+    if args.resume and os.path.exists(args.out):
+        with open(args.out) as f:
+            lines = [line.split() for line in f if line.strip()]
+        if lines:
+            first = int(lines[-1][0], 0) + 1
+    b = open_session(c, args)
+    interrupted = []
+    results = dict()
+    previous = signal.signal(signal.SIGINT, lambda *_: interrupted.append(True))
+    start_time = time.time()
+    try:
+        nxt = b.discovery(args.ir_len, first, last, results=results,
+                          progress=lambda done, total: print_progress(done, total, "instructions"),
+                          stop=lambda: bool(interrupted))
+    finally:
+        signal.signal(signal.SIGINT, previous)
+    with open(args.out, "a") as f:
+        for ir in sorted(results):
+            f.write(f"0x{ir:x} {results[ir]}\n")
+    elapsed = time.time() - start_time
+    print(f"\n{len(results)} instructions in {elapsed:.2f} s, {sum(1 for v in results.values() if v)} with a DR")
+    if nxt <= last:
+        print(f"Stopped, resume from 0x{nxt:x} with --resume")
+    close_session(b, args)
+
+
+def play(c: Communicator, args) -> None:
+    """Play an SVF or XSVF file, from the 'cmd >' prompt of the main menu"""
+    if args.play.lower().endswith(".xsvf"):
+        with open(args.play, "rb") as f:
+            ops = svf.parse_xsvf(f.read())
+    else:
+        with open(args.play) as f:
+            ops = svf.parse_svf(f.read())
+    b = open_session(c, args)
+    start_time = time.time()
+    mismatches = b.play(ops)
+    elapsed = time.time() - start_time
+    for line, expected, mask, captured in mismatches:
+        print(f"TDO mismatch at line {line}: expected 0x{expected:x} mask 0x{mask:x}, got 0x{captured:x}")
+    print(f"{len(ops)} operations, {b.tx_bytes} bytes sent in {elapsed:.2f} s, "
+          f"{'FAILED' if mismatches else 'passed'}")
+    close_session(b, args)
+
+
+def vcd_id(n: int) -> str:
+    """Short VCD identifier of signal n"""
+    chars = ""
+    while True:
+        chars += chr(33 + n % 94)
+        n //= 94
+        if n == 0:
+            return chars
+
+
+def write_trace_vcd(f, events: list, cycles: int) -> None:
+    """
+    TAP trace as a waveform, one TCK cycle every 2 time units. The cycles of a
+    run event are not clocked out one by one, the run signal is high for them.
+    """
+    names = ["tck", "tms", "tdi", "tdo", "run"]
+    ids = {name: vcd_id(i) for i, name in enumerate(names)}
+    state_id = vcd_id(len(names))
+    f.write("$comment states: " + " ".join(f"{i}={name}" for i, name in enumerate(TAP_STATES)) + " $end\n")
+    f.write("$timescale 1ns $end\n$scope module tap $end\n")
+    for name in names:
+        f.write(f"$var wire 1 {ids[name]} {name} $end\n")
+    f.write(f"$var wire 4 {state_id} state $end\n")
+    f.write("$upscope $end\n$enddefinitions $end\n")
+    for cycle, state, tms, tdi, tdo, run in events:
+        f.write(f"#{2 * cycle}\n0{ids['tck']}\n{tms}{ids['tms']}\n{tdi}{ids['tdi']}\n{tdo}{ids['tdo']}\n"
+                f"{int(run)}{ids['run']}\nb{state:04b} {state_id}\n")
+        f.write(f"#{2 * cycle + 1}\n1{ids['tck']}\n")
+    f.write(f"#{2 * cycles}\n")
+
+
+def save_trace(b: BinaryClient, path: str) -> None:
+    """Dump the TAP trace into a VCD file (.vcd) or a transcript, one line per TCK cycle"""
+    count, cycles, events = b.trace(BIN_TRACE_DUMP)
+    with open(path, "w") as f:
+        if path.lower().endswith(".vcd"):
+            write_trace_vcd(f, events, cycles)
+        else:
+            f.write("     cycle state            TMS TDI TDO\n")
+            for i, (cycle, state, tms, tdi, tdo, run) in enumerate(events):
+                if run:
+                    end = events[i + 1][0] if i + 1 < len(events) else cycles
+                    f.write(f"{cycle:10} {TAP_STATES[state]:16} {tms}   {end - cycle} cycles not recorded\n")
+                else:
+                    f.write(f"{cycle:10} {TAP_STATES[state]:16} {tms}   {tdi}   {tdo}\n")
+    print(f"{len(events)} of {count} trace events, {cycles} TCK cycles, into {path}")
+
+
+def dump_trace(c: Communicator, args) -> None:
+    """Save the TAP trace recorded from the menu (option 'x'), without restarting it"""
+    b = BinaryClient(c.s)
+    b.enter()
+    save_trace(b, args.trace)
+    b.exit()
+
+
+def watch(b: BinaryClient, device: bsdl.Bsdl, args) -> None:
+    """
+    Sample the pins continuously into a VCD file, one signal per pin with an input cell.
+    Ctrl-C stops it, unless --samples was given.
+    """
+    pins = {p.input: (vcd_id(i), p.name) for i, p in enumerate(device.pins) if p.input is not None}
+    interrupted = []
+    previous = signal.signal(signal.SIGINT, lambda *_: interrupted.append(True))
+    with open(args.watch, "w") as f:
+        f.write("$timescale 1us $end\n")
+        f.write(f"$scope module {device.entity} $end\n")
+        for ident, name in pins.values():
+            f.write(f"$var wire 1 {ident} {name} $end\n")
+        f.write("$upscope $end\n$enddefinitions $end\n")
+        f.write("#0\n$dumpvars\n" + "".join(f"0{ident}\n" for ident, _ in pins.values()) + "$end\n")
+        values = dict()
+
+        def on_change(usec, cells):
+            lines = []
+            for cell in cells:
+                values[cell] = values.get(cell, 0) ^ 1
+                if cell in pins:
+                    lines.append(f"{values[cell]}{pins[cell][0]}\n")
+            if lines:
+                f.write(f"#{usec}\n" + "".join(lines))
+
+        try:
+            samples, usec = b.watch_pins(args.samples, on_change=on_change,
+                                         progress=lambda n: print_progress(n, args.samples, "samples") if args.samples
+                                         else print(f"\r{n} samples", end="", flush=True),
+                                         stop=lambda: bool(interrupted))
+        finally:
+            signal.signal(signal.SIGINT, previous)
+    print(f"\n{samples} samples in {usec / 1e6:.2f} s, {samples * 1e6 / max(usec, 1):.0f} samples/s "
+          f"of {device.boundary_len} cells into {args.watch}")
+
+
+def boundary_scan(c: Communicator, args) -> None:
+    """Sample the pins of a device, or drive some of them, with its BSDL file"""
+    device = bsdl.load_bsdl(args.bsdl)
+    drive = dict()
+    for d in args.drive:
+        name, value = d.split("=")
+        drive[device.pin(name)] = BIN_PIN_Z if value.upper() == "Z" else int(value, 0)
+    b = open_session(c, args)
+    if args.tap is not None:
+        b.select_tap(args.tap)
+    b.load_bsdl(device.compile())
+    if args.watch:
+        watch(b, device, args)
+        close_session(b, args)
         return
+    values = b.drive_pins(drive) if drive else b.sample_pins()
+    for i, p in enumerate(device.pins):
+        print(f"{p.name:10} {'-' if p.input is None else (values >> i) & 1}")
+    close_session(b, args)
+
 
-    port = get_user_port_selection(ports)
-    print(f"selected: {port}")
+def main():
+    parser = argparse.ArgumentParser(description="Jtagger host controller")
+    parser.add_argument("--port", help="serial port of the Arduino (asked for if omitted)")
+    parser.add_argument("--stats", action="store_true", help="report the throughput of the command")
+    parser.add_argument("--calibrate", action="store_true", help="find the fastest reliable TCK frequency")
+    parser.add_argument("--no-rtck", action="store_true", help="don't use RTCK adaptive clocking for --calibrate")
+    parser.add_argument("--dump-ufm", metavar="FILE", help="stream a MAX10 UFM dump into FILE")
+    parser.add_argument("--program-ufm", metavar="FILE", help="program a raw image into the MAX10 UFM")
+    parser.add_argument("--verify-ufm", metavar="FILE", help="compare the MAX10 UFM with a raw image by CRC32")
+    parser.add_argument("--no-erase", action="store_true", help="don't erase the flash before --program-ufm")
+    parser.add_argument("--dump-mem", metavar="FILE", help="stream ARM memory (JTAG-DP of --tap) into FILE")
+    parser.add_argument("--write-mem", metavar="FILE", help="write a raw image to ARM memory (JTAG-DP of --tap)")
+    parser.add_argument("--ap", type=int, default=0, help="MEM-AP of --dump-mem and --write-mem")
+    parser.add_argument("--start", type=lambda x: int(x, 0), default=0, help="first UFM or memory address")
+    parser.add_argument("--words", type=lambda x: int(x, 0), default=0, help="number of 32 bit words")
+    parser.add_argument("--resume", action="store_true", help="continue a partial dump or discovery")
+    parser.add_argument("--discover", metavar="FIRST:LAST", help="measure the DR length of IRs FIRST to LAST")
+    parser.add_argument("--ir-len", type=int, default=MAX10_IR_LEN, help="IR length for --discover")
+    parser.add_argument("--out", default="discovery.txt", help="results file of --discover")
+    parser.add_argument("--play", metavar="FILE", help="play an SVF (or .xsvf) file")
+    parser.add_argument("--bsdl", metavar="FILE", help="sample the pins of the device described by a BSDL file")
+    parser.add_argument("--drive", metavar="PIN=0|1|Z", action="append", default=[],
+                        help="with --bsdl, drive a pin with EXTEST (repeatable)")
+    parser.add_argument("--tap", type=int, help="TAP index for --bsdl and the memory commands (0 is nearest to TDO)")
+    parser.add_argument("--watch", metavar="VCD", help="with --bsdl, sample the pins continuously into a VCD file")
+    parser.add_argument("--samples", type=lambda x: int(x, 0), default=0,
+                        help="number of samples of --watch (0 until Ctrl-C)")
+    parser.add_argument("--gang", type=int, default=0, metavar="N",
+                        help="run the command on N chains of the gang port at once, results per chain")
+    parser.add_argument("--trace", metavar="FILE",
+                        help="save the TAP trace of the command into FILE (a VCD if it ends with .vcd, "
+                             "else a transcript); alone, save the trace recorded from the menu")
+    args = parser.parse_args()
+
+    port = args.port
     if not port:
-        return
+        ports = list_available_ports()
+        if not ports:
+            return
+
+        port = get_user_port_selection(ports)
+        print(f"selected: {port}")
+        if not port:
+            return
 
     c = Communicator(port)
+    if args.calibrate:
+        calibrate(c, args)
+        c.close()
+        return
+    if args.dump_ufm:
+        dump_ufm(c, args)
+        c.close()
+        return
+    if args.program_ufm:
+        program_ufm(c, args)
+        c.close()
+        return
+    if args.verify_ufm:
+        verify_ufm(c, args)
+        c.close()
+        return
+    if args.dump_mem:
+        dump_mem(c, args)
+        c.close()
+        return
+    if args.write_mem:
+        write_mem(c, args)
+        c.close()
+        return
+    if args.discover:
+        discover(c, args)
+        c.close()
+        return
+    if args.play:
+        play(c, args)
+        c.close()
+        return
+    if args.bsdl:
+        boundary_scan(c, args)
+        c.close()
+        return
+    if args.trace:
+        dump_trace(c, args)
+        c.close()
+        return
+
     while True:
         if not c.interact():
             break
@@ -0,0 +1,148 @@
+/* --------------------------------------------------------------------------------------- */
+/* ---------------------- Gang mode: several chains on a single port ----------------------*/
+/* --------------------------------------------------------------------------------------- */
+
+#include "gang.h"
+
+uint8_t gang_chains = 0;
+uint8_t gang_diff = 0;
+reg_t gang_tdo[GANG_SLOTS][GANG_CAPTURE_WORDS];
+
+uint32_t gang_tck_mask = 0;
+uint32_t gang_tms_mask = 0;
+uint32_t gang_tdi_mask = 0;
+uint32_t gang_out_mask = 0;
+
+#if GANG_MAX_CHAINS
+static const uint8_t gang_bits[GANG_MAX_CHAINS][4] = GANG_BITS;
+#endif
+static uint32_t gang_tdo_bit[GANG_SLOTS];
+static uint8_t gang_tdi = 1;    // TDI level of the last cycle, kept by the TMS moves
+
+/**
+ * @brief Drive the TCK/TMS/TDI bits of the chains in use, TDO bits are inputs
+ * with a pull up. With out_mask 0 every bit of the gang floats.
+ */
+static void gang_pins(uint32_t out_mask, uint32_t in_mask)
+{
+#if defined(ARDUINO_ARCH_SAM)
+    pmc_enable_periph_clk(ID_PIOC);
+    PIOC->PIO_PER = out_mask | in_mask;
+    PIOC->PIO_OWDR = 0xFFFFFFFF;
+    PIOC->PIO_ODR = in_mask | (gang_out_mask & ~out_mask);
+    PIOC->PIO_PUER = in_mask;
+    PIOC->PIO_OWER = out_mask;
+    PIOC->PIO_OER = out_mask;
+#elif defined(ARDUINO_AVR_MEGA2560)
+    DDRA = (DDRA & ~(in_mask | gang_out_mask)) | out_mask;
+    PORTA |= in_mask;
+#else
+    (void)out_mask;
+    (void)in_mask;
+#endif
+}
+
+int gang_begin(uint8_t chains, uint32_t* idcodes)
+{
+    uint32_t in_mask = 0;
+    reg_t zero[1] = {0};
+    reg_t captured[1] = {0};
+
+    if (chains == 0 || chains > GANG_MAX_CHAINS)
+        return -ERR_OUT_OF_BOUNDS;
+
+    gang_end();
+    gang_tck_mask = gang_tms_mask = gang_tdi_mask = 0;
+#if GANG_MAX_CHAINS
+    for (uint8_t c = 0; c < chains; c++)
+    {
+        gang_tck_mask |= (uint32_t)1 << gang_bits[c][0];
+        gang_tms_mask |= (uint32_t)1 << gang_bits[c][1];
+        gang_tdi_mask |= (uint32_t)1 << gang_bits[c][2];
+        gang_tdo_bit[c] = (uint32_t)1 << gang_bits[c][3];
+        in_mask |= gang_tdo_bit[c];
+    }
+#endif
+    gang_out_mask = gang_tck_mask | gang_tms_mask | gang_tdi_mask;
+    gang_pins(gang_out_mask, in_mask);
+
+    // TCK idles high, like the single chain
+    GANG_WRITE(gang_out_mask);
+    gang_tdi = 1;
+    gang_chains = chains;
+    tck_rtck = false;
+
+    // every chain starts in TEST_LOGIC_RESET, with IDCODE (or BYPASS) selected
+    reset_tap();
+    insert_dr(zero, 32, RUN_TEST_IDLE, captured);
+    for (uint8_t c = 0; idcodes != NULL && c < chains; c++)
+        idcodes[c] = gang_tdo[c][0];
+    gang_diff = 0;
+    return OK;
+}
+
+void gang_end()
+{
+    gang_chains = 0;
+    gang_pins(0, 0);
+    gang_out_mask = 0;
+}
+
+uint8_t gang_match(uint32_t value, uint32_t mask)
+{
+    uint8_t match = 0;
+
+    for (uint8_t c = 0; c < gang_chains; c++)
+        if ((gang_tdo[c][0] & mask) == value)
+            match |= 1 << c;
+    return match;
+}
+
+void gang_tms(uint16_t bits, uint8_t len)
+{
+    for (uint8_t i = 0; i < len; i++)
+    {
+        gang_cycle(bits & 1, gang_tdi);
+        bits >>= 1;
+    }
+}
+
+void gang_idle(uint8_t tms, uint32_t cycles)
+{
+    for (uint32_t i = 0; i < cycles; i++)
+        gang_cycle(tms, gang_tdi);
+}
+
+void gang_pad(uint16_t n, bool last)
+{
+    gang_tdi = 1;
+    for (uint16_t i = 0; i < n; i++)
+        gang_cycle(last && i == n - 1, 1);
+}
+
+reg_t gang_shift(reg_t tdi, uint8_t b, uint8_t bits, bool last, uint16_t w)
+{
+    reg_t tdo[GANG_SLOTS] = {0};
+    uint32_t port = 0;
+
+    for (; b < bits; b++)
+    {
+        gang_tdi = tdi & 1;
+        port = gang_cycle(last && b == bits - 1, gang_tdi);
+
+        // every TDO out of the same port read
+        for (uint8_t c = 0; c < gang_chains; c++)
+            if (port & gang_tdo_bit[c])
+                tdo[c] |= (reg_t)1 << b;
+        tdi >>= 1;
+    }
+
+    for (uint8_t c = 0; c < gang_chains; c++)
+    {
+        if (tdo[c] != tdo[0])
+            gang_diff |= 1 << c;
+        if (w < GANG_CAPTURE_WORDS)
+            gang_tdo[c][w] = tdo[c];
+    }
+    return tdo[0];
+}
@@ -0,0 +1,143 @@
+/** @file gang.h
+ *
+ * @brief Gang mode: the same scans on several identical chains at once.
+ *
+ * In gang mode the TAP primitives of the sketch (reset_tap, goto_state,
+ * insert_ir/insert_dr, clock_state, ...) drive up to GANG_MAX_CHAINS chains
+ * instead of the TCK/TMS/TDI/TDO pins of jtagger.h. The pins of all chains are
+ * on the same GPIO port: every TCK edge is a single write of the port, with
+ * TMS and TDI written together with the falling edge, and the TDO of every
+ * chain comes out of a single read of the port.
+ *
+ * All chains shift the same bits and move through the same states. The sketch
+ * sees chain 0 like a normal chain (dr_out, ir_out, dr_status_ready), and what
+ * every chain shifted out is kept:
+ *  - the first GANG_CAPTURE_BITS of its last scan in gang_tdo[chain]
+ *  - whether it ever differed from chain 0, in the gang_diff bit mask
+ * The SPI (HW_SHIFT) and RTCK adaptive clocking are not used in gang mode.
+ */
+#ifndef __GANG_H__
+#define __GANG_H__
+
+#include "Arduino.h"
+#include "jtagger.h"
+
+/*
+ * Port bits of every chain: TCK, TMS, TDI, TDO. A bit may be shared by several
+ * chains (e.g. a single TCK buffered to every board), except for TDO.
+ */
+#if defined(ARDUINO_ARCH_SAM)
+// PIOC: Due pins 33-36, 37-40, and 41, 6, 5, 4
+#define GANG_MAX_CHAINS 3
+#define GANG_BITS { {1, 2, 3, 4}, {5, 6, 7, 8}, {9, 24, 25, 26} }
+#define GANG_WRITE(val) (PIOC->PIO_ODSR = (val))    // only the bits enabled in PIO_OWSR change
+#define GANG_READ()     (PIOC->PIO_PDSR)
+#elif defined(ARDUINO_AVR_MEGA2560)
+// PORTA: Mega pins 22-25 and 26-29
+#define GANG_MAX_CHAINS 2
+#define GANG_BITS { {0, 1, 2, 3}, {4, 5, 6, 7} }
+#define GANG_WRITE(val) (PORTA = (PORTA & ~gang_out_mask) | (val))
+#define GANG_READ()     (PINA)
+#elif defined(JTAGGER_SIM)
+// the chains of sim_gang[] (see sim/tap_model.h)
+#define GANG_MAX_CHAINS 4
+#define GANG_BITS { {0, 1, 2, 3}, {4, 5, 6, 7}, {8, 9, 10, 11}, {12, 13, 14, 15} }
+void sim_gang_write(uint32_t val);
+uint32_t sim_gang_read();
+#define GANG_WRITE(val) sim_gang_write(val)
+#define GANG_READ()     sim_gang_read()
+#else
+// no gang port, gang_begin() always fails
+#define GANG_MAX_CHAINS 0
+#define GANG_WRITE(val) ((void)(val))
+#define GANG_READ()     0
+#endif
+
+#define GANG_SLOTS (GANG_MAX_CHAINS ? GANG_MAX_CHAINS : 1)
+#define GANG_CAPTURE_BITS 64
+#define GANG_CAPTURE_WORDS REG_WORDS(GANG_CAPTURE_BITS)
+
+extern uint8_t gang_chains;     // chains in use, 0 when gang mode is off
+extern uint8_t gang_diff;       // chains that shifted out other bits than chain 0, since gang_begin()
+extern reg_t gang_tdo[GANG_SLOTS][GANG_CAPTURE_WORDS];
+
+// port masks of the chains in use
+extern uint32_t gang_tck_mask;
+extern uint32_t gang_tms_mask;
+extern uint32_t gang_tdi_mask;
+extern uint32_t gang_out_mask;
+
+/**
+ * @brief Enter gang mode on the first chains of GANG_BITS, and read the
+ * IDCODE (or the BYPASS bit, then 0) of the first TAP of every chain.
+ * @param chains Number of chains, up to GANG_MAX_CHAINS.
+ * @param idcodes Receives an IDCODE per chain, may be NULL.
+ * @return OK or -ERR_OUT_OF_BOUNDS.
+ */
+int gang_begin(uint8_t chains, uint32_t* idcodes);
+
+/**
+ * @brief Leave gang mode, the pins of the chains float again.
+ */
+void gang_end();
+
+/**
+ * @return Mask of every chain in use.
+ */
+static inline uint8_t gang_all()
+{
+    return (1 << gang_chains) - 1;
+}
+
+/**
+ * @brief Chains whose last scan starts with the given bits.
+ * @param value Expected first 32 bits, under mask.
+ * @param mask Bits to compare.
+ * @return Mask of the matching chains.
+ */
+uint8_t gang_match(uint32_t value, uint32_t mask);
+
+/**
+ * @brief One TCK cycle on all the chains.
+ * @return The port, read after the rising edge.
+ */
+static inline uint32_t gang_cycle(uint8_t tms, uint8_t tdi)
+{
+    uint32_t val = (tms ? gang_tms_mask : 0) | (tdi ? gang_tdi_mask : 0);
+
+    GANG_WRITE(val); HC;
+    GANG_WRITE(val | gang_tck_mask); HC;
+    return GANG_READ();
+}
+
+/**
+ * @brief Clock a TMS sequence, TDI is left as is.
+ * @param bits TMS values, bit 0 is clocked first.
+ * @param len Number of TCK cycles.
+ */
+void gang_tms(uint16_t bits, uint8_t len);
+
+/**
+ * @brief Clock cycles with TMS held (e.g. in RUN_TEST_IDLE), TDI is left as is.
+ */
+void gang_idle(uint8_t tms, uint32_t cycles);
+
+/**
+ * @brief Shift n padding bits (ones) in the current shift state.
+ * @param last If true, exit the shift state together with the last bit.
+ */
+void gang_pad(uint16_t n, bool last);
+
+/**
+ * @brief Shift bits b to bits - 1 of a register word on all the chains,
+ * keeping what every chain shifted out.
+ * @param tdi The bits to shift in, starting with bit b.
+ * @param b First bit of the word.
+ * @param bits End of the bits in the word.
+ * @param last If true, exit the shift state together with the last bit.
+ * @param w Index of the word in the register.
+ * @return Bits shifted out of chain 0, at their position in the word.
+ */
+reg_t gang_shift(reg_t tdi, uint8_t b, uint8_t bits, bool last, uint16_t w);
+
+#endif /* __GANG_H__ */
@@ -0,0 +1,249 @@
+/** @file jtag_pins.h
+ *
+ * @brief Direct port register access to the JTAG pins.
+ *
+ * The TCK/TMS/TDI/TDO pin numbers from jtagger.h are resolved at compile time
+ * into a port and a bit, so every pin access is a single store to the
+ * set/clear registers (or a single load from the input register) instead of
+ * a call to digitalWrite/digitalRead.
+ *
+ * Supported boards: Arduino Due (SAM3X8E) and Arduino Mega 2560.
+ * The host simulation build (JTAGGER_SIM, see sim/) connects the pins to a
+ * software TAP model. Any other board falls back to digitalWrite/digitalRead.
+ * Only the pins listed in the tables below can be used for the JTAG signals.
+ */
+#ifndef __JTAG_PINS_H__
+#define __JTAG_PINS_H__
+
+#include "Arduino.h"
+
+#define PIN_CAT(a, b)  PIN_CAT_(a, b)
+#define PIN_CAT_(a, b) a##b
+
+#if defined(ARDUINO_ARCH_SAM)
+/*
+ * Arduino Due: digital pin -> PIO controller and bit.
+ */
+#define DUE_PORT_2  PIOB
+#define DUE_BIT_2   25
+#define DUE_PORT_3  PIOC
+#define DUE_BIT_3   28
+#define DUE_PORT_4  PIOC
+#define DUE_BIT_4   26
+#define DUE_PORT_5  PIOC
+#define DUE_BIT_5   25
+#define DUE_PORT_6  PIOC
+#define DUE_BIT_6   24
+#define DUE_PORT_7  PIOC
+#define DUE_BIT_7   23
+#define DUE_PORT_8  PIOC
+#define DUE_BIT_8   22
+#define DUE_PORT_9  PIOC
+#define DUE_BIT_9   21
+#define DUE_PORT_10 PIOC
+#define DUE_BIT_10  29
+#define DUE_PORT_11 PIOD
+#define DUE_BIT_11  7
+#define DUE_PORT_12 PIOD
+#define DUE_BIT_12  8
+#define DUE_PORT_13 PIOB
+#define DUE_BIT_13  27
+#define DUE_PORT_22 PIOB
+#define DUE_BIT_22  26
+#define DUE_PORT_23 PIOA
+#define DUE_BIT_23  14
+#define DUE_PORT_24 PIOA
+#define DUE_BIT_24  15
+#define DUE_PORT_25 PIOD
+#define DUE_BIT_25  0
+#define DUE_PORT_26 PIOD
+#define DUE_BIT_26  1
+#define DUE_PORT_27 PIOD
+#define DUE_BIT_27  2
+#define DUE_PORT_28 PIOD
+#define DUE_BIT_28  3
+#define DUE_PORT_29 PIOD
+#define DUE_BIT_29  6
+#define DUE_PORT_30 PIOD
+#define DUE_BIT_30  9
+#define DUE_PORT_31 PIOA
+#define DUE_BIT_31  7
+#define DUE_PORT_32 PIOD
+#define DUE_BIT_32  10
+#define DUE_PORT_33 PIOC
+#define DUE_BIT_33  1
+#define DUE_PORT_34 PIOC
+#define DUE_BIT_34  2
+#define DUE_PORT_35 PIOC
+#define DUE_BIT_35  3
+#define DUE_PORT_36 PIOC
+#define DUE_BIT_36  4
+#define DUE_PORT_37 PIOC
+#define DUE_BIT_37  5
+#define DUE_PORT_38 PIOC
+#define DUE_BIT_38  6
+#define DUE_PORT_39 PIOC
+#define DUE_BIT_39  7
+#define DUE_PORT_40 PIOC
+#define DUE_BIT_40  8
+#define DUE_PORT_41 PIOC
+#define DUE_BIT_41  9
+#define DUE_PORT_74 PIOA   // SPI header MISO
+#define DUE_BIT_74  25
+#define DUE_PORT_75 PIOA   // SPI header MOSI
+#define DUE_BIT_75  26
+#define DUE_PORT_76 PIOA   // SPI header SCK
+#define DUE_BIT_76  27
+
+#define PIN_PORT(pin) PIN_CAT(DUE_PORT_, pin)
+#define PIN_MASK(pin) (1u << PIN_CAT(DUE_BIT_, pin))
+
+#define PIN_SET(pin)  (PIN_PORT(pin)->PIO_SODR = PIN_MASK(pin))
+#define PIN_CLR(pin)  (PIN_PORT(pin)->PIO_CODR = PIN_MASK(pin))
+#define PIN_READ(pin) ((PIN_PORT(pin)->PIO_PDSR & PIN_MASK(pin)) != 0)
+#define PIN_LATCH(pin) ((PIN_PORT(pin)->PIO_ODSR & PIN_MASK(pin)) != 0)
+
+#define FAST_PINS 1
+
+#elif defined(ARDUINO_AVR_MEGA2560)
+/*
+ * Arduino Mega 2560: digital pin -> port letter and bit.
+ */
+#define MEGA_PORT_2  E
+#define MEGA_BIT_2   4
+#define MEGA_PORT_3  E
+#define MEGA_BIT_3   5
+#define MEGA_PORT_4  G
+#define MEGA_BIT_4   5
+#define MEGA_PORT_5  E
+#define MEGA_BIT_5   3
+#define MEGA_PORT_6  H
+#define MEGA_BIT_6   3
+#define MEGA_PORT_7  H
+#define MEGA_BIT_7   4
+#define MEGA_PORT_8  H
+#define MEGA_BIT_8   5
+#define MEGA_PORT_9  H
+#define MEGA_BIT_9   6
+#define MEGA_PORT_10 B
+#define MEGA_BIT_10  4
+#define MEGA_PORT_11 B
+#define MEGA_BIT_11  5
+#define MEGA_PORT_12 B
+#define MEGA_BIT_12  6
+#define MEGA_PORT_13 B
+#define MEGA_BIT_13  7
+#define MEGA_PORT_22 A
+#define MEGA_BIT_22  0
+#define MEGA_PORT_23 A
+#define MEGA_BIT_23  1
+#define MEGA_PORT_24 A
+#define MEGA_BIT_24  2
+#define MEGA_PORT_25 A
+#define MEGA_BIT_25  3
+#define MEGA_PORT_26 A
+#define MEGA_BIT_26  4
+#define MEGA_PORT_27 A
+#define MEGA_BIT_27  5
+#define MEGA_PORT_28 A
+#define MEGA_BIT_28  6
+#define MEGA_PORT_29 A
+#define MEGA_BIT_29  7
+#define MEGA_PORT_30 C
+#define MEGA_BIT_30  7
+#define MEGA_PORT_31 C
+#define MEGA_BIT_31  6
+#define MEGA_PORT_32 C
+#define MEGA_BIT_32  5
+#define MEGA_PORT_33 C
+#define MEGA_BIT_33  4
+#define MEGA_PORT_34 C
+#define MEGA_BIT_34  3
+#define MEGA_PORT_35 C
+#define MEGA_BIT_35  2
+#define MEGA_PORT_36 C
+#define MEGA_BIT_36  1
+#define MEGA_PORT_37 C
+#define MEGA_BIT_37  0
+#define MEGA_PORT_50 B    // MISO
+#define MEGA_BIT_50  3
+#define MEGA_PORT_51 B    // MOSI
+#define MEGA_BIT_51  2
+#define MEGA_PORT_52 B    // SCK
+#define MEGA_BIT_52  1
+
+#define PIN_OUT_REG(pin) PIN_CAT(PORT, PIN_CAT(MEGA_PORT_, pin))
+#define PIN_IN_REG(pin)  PIN_CAT(PIN, PIN_CAT(MEGA_PORT_, pin))
+#define PIN_MASK(pin)    (1 << PIN_CAT(MEGA_BIT_, pin))
+
+#define PIN_SET(pin)  (PIN_OUT_REG(pin) |= PIN_MASK(pin))
+#define PIN_CLR(pin)  (PIN_OUT_REG(pin) &= ~PIN_MASK(pin))
+#define PIN_READ(pin) ((PIN_IN_REG(pin) & PIN_MASK(pin)) != 0)
+#define PIN_LATCH(pin) ((PIN_OUT_REG(pin) & PIN_MASK(pin)) != 0)
+
+#define FAST_PINS 1
+
+#elif defined(JTAGGER_SIM)
+/*
+ * Host simulation build: the pins drive the TAP model of sim/tap_model.cpp.
+ */
+void sim_pin_write(uint8_t pin, uint8_t val);
+uint8_t sim_pin_read(uint8_t pin);
+
+#define PIN_WRITE(pin, val) sim_pin_write(pin, val)
+#define PIN_READ(pin)       sim_pin_read(pin)
+#define PIN_LATCH(pin)      sim_pin_read(pin)
+
+#define FAST_PINS 0
+
+#else
+#define FAST_PINS 0
+#endif
+
+#if FAST_PINS
+#define PIN_WRITE(pin, val) do { if (val) PIN_SET(pin); else PIN_CLR(pin); } while (0)
+#elif !defined(JTAGGER_SIM)
+#define PIN_WRITE(pin, val) digitalWrite(pin, val)
+#define PIN_READ(pin)       digitalRead(pin)
+#define PIN_LATCH(pin)      digitalRead(pin)
+#endif
+
+#define TCK_WRITE(val) PIN_WRITE(TCK, val)
+#define TMS_WRITE(val) PIN_WRITE(TMS, val)
+#define TDI_WRITE(val) PIN_WRITE(TDI, val)
+#define TDO_READ()     PIN_READ(TDO)
+
+/**
+ * Half TCK period, selected at runtime with set_tck_khz().
+ * Slow rates are delayed with delayMicroseconds, fast rates with a
+ * calibrated busy loop, and when both are 0 TCK runs as fast as the
+ * pin writes allow.
+ * With adaptive clocking (tck_rtck) every half period instead lasts until
+ * the target returns the TCK level on RTCK, or RTCK_MAX_LOOPS polls.
+ */
+extern uint32_t tck_delay_us;
+extern uint32_t tck_delay_loops;
+extern bool tck_rtck;
+extern uint32_t rtck_timeouts;
+
+static inline void tck_half_delay()
+{
+    if (tck_rtck) {
+        for (uint16_t i = 0; PIN_READ(RTCK) != PIN_LATCH(TCK); i++)
+        {
+            if (i == RTCK_MAX_LOOPS) {
+                rtck_timeouts++;
+                break;
+            }
+        }
+        return;
+    }
+    if (tck_delay_us) {
+        delayMicroseconds(tck_delay_us);
+        return;
+    }
+    for (uint32_t i = tck_delay_loops; i > 0; i--)
+        __asm__ __volatile__("nop");
+}
+
+#endif /* __JTAG_PINS_H__ */
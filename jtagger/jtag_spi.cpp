@@ -0,0 +1,202 @@
+/* --------------------------------------------------------------------------------------- */
+/* ---------------------- Hardware assisted shifting with the SPI peripheral --------------*/
+/* --------------------------------------------------------------------------------------- */
+
+#include "jtag_spi.h"
+#include "jtag_pins.h"
+
+uint32_t hw_shift_khz = 0;
+
+#if HW_SHIFT && defined(ARDUINO_ARCH_SAM)
+
+// fastest SPI clock, MCK / 8 = 10.5 MHz
+#define SPI_MIN_DIV 8
+
+// DMAC channels and hardware handshake interfaces of SPI0
+#define SPI_DMAC_TX_CH 0
+#define SPI_DMAC_RX_CH 1
+#define SPI_TX_IDX 1
+#define SPI_RX_IDX 2
+
+#define SPI_OUT_PINS (PIO_PA26A_SPI0_MOSI | PIO_PA27A_SPI0_SPCK)
+
+// the SPI shifts MSB first, the DMA works on mirrored copies
+static uint32_t tx_buf[HW_SHIFT_CHUNK / 4];
+static uint32_t rx_buf[HW_SHIFT_CHUNK / 4];
+
+void hw_shift_init()
+{
+    pmc_enable_periph_clk(ID_SPI0);
+    pmc_enable_periph_clk(ID_DMAC);
+
+    // MISO always belongs to the SPI, PIO_PDSR still reads TDO for the bit banging
+    PIOA->PIO_ABSR &= ~(PIO_PA25A_SPI0_MISO | SPI_OUT_PINS);
+    PIOA->PIO_PDR = PIO_PA25A_SPI0_MISO;
+
+    SPI0->SPI_CR = SPI_CR_SPIDIS;
+    SPI0->SPI_CR = SPI_CR_SWRST;
+    SPI0->SPI_MR = SPI_MR_MSTR | SPI_MR_MODFDIS | SPI_MR_PCS(0x0E);
+    SPI0->SPI_CSR[0] = SPI_CSR_CPOL | SPI_CSR_BITS_8_BIT | SPI_CSR_SCBR(SPI_MIN_DIV);
+    SPI0->SPI_CR = SPI_CR_SPIEN;
+
+    // the receive channel has the higher number, so the higher priority
+    DMAC->DMAC_EN = 0;
+    DMAC->DMAC_GCFG = DMAC_GCFG_ARB_CFG_FIXED;
+    DMAC->DMAC_EN = DMAC_EN_ENABLE;
+}
+
+uint32_t hw_shift_set_khz(uint32_t khz)
+{
+    uint32_t div = SPI_MIN_DIV;
+
+    if (khz != 0)
+        div = max((F_CPU / 1000 + khz - 1) / khz, (uint32_t)SPI_MIN_DIV);
+    if (div > 255)
+        return hw_shift_khz = 0;
+
+    SPI0->SPI_CSR[0] = SPI_CSR_CPOL | SPI_CSR_BITS_8_BIT | SPI_CSR_SCBR(div);
+    return hw_shift_khz = F_CPU / 1000 / div;
+}
+
+void hw_shift_bytes(const reg_t* in, reg_t* out, uint16_t n)
+{
+    uint16_t words = (n + 3) / 4;
+    uint16_t i = 0;
+
+    for (i = 0; i < words; i++)
+        tx_buf[i] = __REV(__RBIT(in[i]));
+
+    // a stale byte would be taken as the first TDO byte
+    (void)SPI0->SPI_RDR;
+
+    DMAC->DMAC_CHDR = DMAC_CHDR_DIS0 << SPI_DMAC_RX_CH;
+    DMAC->DMAC_CH_NUM[SPI_DMAC_RX_CH].DMAC_SADDR = (uint32_t)&SPI0->SPI_RDR;
+    DMAC->DMAC_CH_NUM[SPI_DMAC_RX_CH].DMAC_DADDR = (uint32_t)rx_buf;
+    DMAC->DMAC_CH_NUM[SPI_DMAC_RX_CH].DMAC_DSCR = 0;
+    DMAC->DMAC_CH_NUM[SPI_DMAC_RX_CH].DMAC_CTRLA = n | DMAC_CTRLA_SRC_WIDTH_BYTE | DMAC_CTRLA_DST_WIDTH_BYTE;
+    DMAC->DMAC_CH_NUM[SPI_DMAC_RX_CH].DMAC_CTRLB = DMAC_CTRLB_SRC_DSCR | DMAC_CTRLB_DST_DSCR |
+        DMAC_CTRLB_FC_PER2MEM_DMA_FC | DMAC_CTRLB_SRC_INCR_FIXED | DMAC_CTRLB_DST_INCR_INCREMENTING;
+    DMAC->DMAC_CH_NUM[SPI_DMAC_RX_CH].DMAC_CFG = DMAC_CFG_SRC_PER(SPI_RX_IDX) | DMAC_CFG_SRC_H2SEL |
+        DMAC_CFG_SOD | DMAC_CFG_FIFOCFG_ASAP_CFG;
+
+    DMAC->DMAC_CHDR = DMAC_CHDR_DIS0 << SPI_DMAC_TX_CH;
+    DMAC->DMAC_CH_NUM[SPI_DMAC_TX_CH].DMAC_SADDR = (uint32_t)tx_buf;
+    DMAC->DMAC_CH_NUM[SPI_DMAC_TX_CH].DMAC_DADDR = (uint32_t)&SPI0->SPI_TDR;
+    DMAC->DMAC_CH_NUM[SPI_DMAC_TX_CH].DMAC_DSCR = 0;
+    DMAC->DMAC_CH_NUM[SPI_DMAC_TX_CH].DMAC_CTRLA = n | DMAC_CTRLA_SRC_WIDTH_BYTE | DMAC_CTRLA_DST_WIDTH_BYTE;
+    DMAC->DMAC_CH_NUM[SPI_DMAC_TX_CH].DMAC_CTRLB = DMAC_CTRLB_SRC_DSCR | DMAC_CTRLB_DST_DSCR |
+        DMAC_CTRLB_FC_MEM2PER_DMA_FC | DMAC_CTRLB_SRC_INCR_INCREMENTING | DMAC_CTRLB_DST_INCR_FIXED;
+    DMAC->DMAC_CH_NUM[SPI_DMAC_TX_CH].DMAC_CFG = DMAC_CFG_DST_PER(SPI_TX_IDX) | DMAC_CFG_DST_H2SEL |
+        DMAC_CFG_SOD | DMAC_CFG_FIFOCFG_ALAP_CFG;
+
+    // TCK and TDI go to the SPI while it shifts. Both idle high, so there is no glitch
+    PIOA->PIO_PDR = SPI_OUT_PINS;
+    DMAC->DMAC_CHER = (DMAC_CHER_ENA0 << SPI_DMAC_RX_CH) | (DMAC_CHER_ENA0 << SPI_DMAC_TX_CH);
+
+    while (DMAC->DMAC_CHSR & (DMAC_CHSR_ENA0 << SPI_DMAC_RX_CH))
+        ;
+    while (!(SPI0->SPI_SR & SPI_SR_TXEMPTY))
+        ;
+    PIOA->PIO_PER = SPI_OUT_PINS;
+
+    for (i = 0; i < words; i++)
+        out[i] = __REV(__RBIT(rx_buf[i]));
+}
+
+#elif HW_SHIFT && defined(ARDUINO_AVR_MEGA2560)
+
+// SPI clock dividers of F_CPU, fastest first, with the SPI2X bit in bit 2
+static const uint8_t spi_rates[7] = { 0x4, 0x0, 0x5, 0x1, 0x6, 0x2, 0x3 };
+
+void hw_shift_init()
+{
+    // SS must be an output, or the SPI falls back to slave mode
+    pinMode(SS, OUTPUT);
+    SPCR = _BV(MSTR) | _BV(DORD) | _BV(CPOL) | _BV(CPHA);
+}
+
+uint32_t hw_shift_set_khz(uint32_t khz)
+{
+    uint8_t i = 0;
+
+    // F_CPU / 2, / 4 ... / 128
+    while (khz != 0 && i < 7 && F_CPU / 1000 / (2u << i) > khz)
+        i++;
+    if (i == 7)
+        return hw_shift_khz = 0;
+
+    SPCR = (SPCR & ~(_BV(SPR1) | _BV(SPR0))) | (spi_rates[i] & 0x3);
+    SPSR = (spi_rates[i] & 0x4) ? _BV(SPI2X) : 0;
+    return hw_shift_khz = F_CPU / 1000 / (2u << i);
+}
+
+void hw_shift_bytes(const reg_t* in, reg_t* out, uint16_t n)
+{
+    const uint8_t* tdi = (const uint8_t*)in;
+    uint8_t* tdo = (uint8_t*)out;
+    uint16_t i = 0;
+
+    // SCK and MOSI belong to the SPI while it is enabled, both idle high
+    SPCR |= _BV(SPE);
+    for (i = 0; i < n; i++)
+    {
+        SPDR = tdi[i];
+        while (!(SPSR & _BV(SPIF)))
+            ;
+        tdo[i] = SPDR;
+    }
+    SPCR &= ~_BV(SPE);
+}
+
+#elif HW_SHIFT && defined(JTAGGER_SIM)
+
+// rate reported for the simulated SPI
+#define SPI_SIM_KHZ 8000
+
+void hw_shift_init()
+{
+}
+
+uint32_t hw_shift_set_khz(uint32_t khz)
+{
+    return hw_shift_khz = (khz == 0 || khz > SPI_SIM_KHZ) ? SPI_SIM_KHZ : khz;
+}
+
+void hw_shift_bytes(const reg_t* in, reg_t* out, uint16_t n)
+{
+    const uint8_t* tdi = (const uint8_t*)in;
+    uint8_t* tdo = (uint8_t*)out;
+    uint8_t byte = 0;
+    uint16_t i = 0;
+
+    // SPI mode 3 at the pins, LSB first
+    for (i = 0; i < n; i++)
+    {
+        byte = 0;
+        for (uint8_t b = 0; b < 8; b++)
+        {
+            PIN_WRITE(TDI, (tdi[i] >> b) & 1);
+            PIN_WRITE(TCK, 0);
+            PIN_WRITE(TCK, 1);
+            byte |= PIN_READ(TDO) << b;
+        }
+        tdo[i] = byte;
+    }
+}
+
+#else
+
+void hw_shift_init()
+{
+}
+
+uint32_t hw_shift_set_khz(uint32_t /* khz */)
+{
+    return hw_shift_khz = 0;
+}
+
+void hw_shift_bytes(const reg_t* /* in */, reg_t* /* out */, uint16_t /* n */)
+{
+}
+
+#endif
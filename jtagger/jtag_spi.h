@@ -0,0 +1,60 @@
+/** @file jtag_spi.h
+ *
+ * @brief Hardware assisted shifting of long scans (HW_SHIFT).
+ *
+ * The byte aligned middle of a scan is handed to the SPI peripheral, which
+ * clocks TCK (SCK), TDI (MOSI) and TDO (MISO) in SPI mode 3: TCK idles high,
+ * TDI changes on the falling edge and TDO is sampled on the rising edge,
+ * the same timing as the bit banged shifts. TMS is not touched, so the bits
+ * where TMS changes (the last bit of a scan) are still bit banged.
+ *
+ * Arduino Due: SPI0 on the SPI header, fed by two DMAC channels. The SPI
+ * shifts MSB first, so the bytes are mirrored on the way in and out.
+ * Arduino Mega 2560: the SPI shifts LSB first, one byte at a time.
+ * Host simulation build: the bytes are clocked through the simulated pins.
+ */
+#ifndef __JTAG_SPI_H__
+#define __JTAG_SPI_H__
+
+#include "Arduino.h"
+#include "jtagger.h"
+
+// scans shorter than this are bit banged
+#define HW_SHIFT_MIN_BITS 64
+
+// bytes handed to the SPI at a time, scan_poll_hook runs in between
+#if defined(ARDUINO_AVR_MEGA2560)
+#define HW_SHIFT_CHUNK 128
+#else
+#define HW_SHIFT_CHUNK 256
+#endif
+
+/**
+ * SPI rate in kHz, or 0 when scans are bit banged
+ * (no HW_SHIFT, a rate below the slowest SPI clock, or adaptive clocking).
+ */
+extern uint32_t hw_shift_khz;
+
+/**
+ * @brief Set up the SPI peripheral (and its DMA), leaving the pins to the bit banging.
+ */
+void hw_shift_init();
+
+/**
+ * @brief Select the SPI clock for a TCK rate.
+ * @param khz Requested TCK frequency in kHz, 0 for the fastest the SPI is set up for.
+ * @return The SPI rate in kHz (at most khz), or 0 if the SPI can't go as slow.
+ */
+uint32_t hw_shift_set_khz(uint32_t khz);
+
+/**
+ * @brief Shift whole bytes in the current shift state, LSB first, with TMS low.
+ * TCK is left high, like after a bit banged cycle.
+ * @param in Bytes to shift into TDI. (word aligned)
+ * @param out Receives the TDO bytes. (word aligned, may be the same as in)
+ * The rest of the last word is undefined.
+ * @param n Number of bytes, at most HW_SHIFT_CHUNK.
+ */
+void hw_shift_bytes(const reg_t* in, reg_t* out, uint16_t n);
+
+#endif /* __JTAG_SPI_H__ */
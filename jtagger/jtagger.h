@@ -2,6 +2,7 @@
 #define __MAIN__H__
 
 #include "Arduino.h"
+#include "serial_io.h"
 
 /**
  * Error return code definitions
@@ -16,12 +17,13 @@
 #define ERR_UNVALID_IR_OR_DR_LEN 7
 #define ERR_TDO_STUCK_AT_0       8
 #define ERR_TDO_STUCK_AT_1       9
-
-/**  
-* If you don't wish to see debug info such as TAP state transitions put 0.
-* Otherwise assign 1.
-*/
-#define DEBUGTAP 0
+#define ERR_BAD_FRAME            10
+#define ERR_BAD_CRC              11
+#define ERR_TDO_MISMATCH         12
+#define ERR_VERIFY               13
+#define ERR_DP_WAIT              14
+#define ERR_DP_FAULT             15
+#define ERR_TIMEOUT              16
 
 /** 
 * If you don't wish to see debug info regarding user input via serial port put 0.
@@ -35,44 +37,98 @@
 #define PRINT_RESET_TAP 0
 
 
+/**
+ * If 1 then the byte aligned middle of long scans is shifted by the SPI
+ * peripheral (see jtag_spi.h), and TCK, TDI and TDO move to its pins:
+ * the SPI header of the Due (SCK, MOSI, MISO) or pins 52, 51, 50 of the Mega.
+ */
+#ifndef HW_SHIFT
+#define HW_SHIFT 0
+#endif
+
 // Define JTAG pins as you wish
+#if HW_SHIFT && defined(ARDUINO_ARCH_SAM)
+#define TCK 76
+#define TDI 75
+#define TDO 74
+#elif HW_SHIFT && defined(ARDUINO_AVR_MEGA2560)
+#define TCK 52
+#define TDI 51
+#define TDO 50
+#else
 #define TCK 7
-#define TMS 8
 #define TDI 9
 #define TDO 10
+#endif
+#define TMS 8
 #define TRST 11
+#define RTCK 12 // returned TCK of adaptive clocking targets, leave unconnected if unused
 
-#define MAX_DR_LEN 512
+/**
+ * Scan registers (IR/DR buffers) are packed bit vectors, 32 bits per word.
+ * Bit i of a register lives in word (i / 32) at bit position (i % 32),
+ * so bit 0 (the LSB of word 0) is the first bit shifted in and out.
+ */
+typedef uint32_t reg_t;
+
+#define REG_WORD_BITS 32
+#define REG_WORDS(bits) (((bits) + REG_WORD_BITS - 1) / REG_WORD_BITS)
+
+// The Mega has 8 KB of SRAM for everything, see "SRAM budget" in README.md
 #ifndef MAX_DR_LEN
-#define MAX_DR_LEN 1024 // usually the BSR and might be larger than that
+#if defined(ARDUINO_AVR_MEGA2560)
+#define MAX_DR_LEN 1024
+#else
+#define MAX_DR_LEN 4096 // usually the BSR and might be larger than that
+#endif
+#endif
+
+#ifndef MAX_IR_LEN
+#if defined(ARDUINO_AVR_MEGA2560)
+#define MAX_IR_LEN 64
+#else
+#define MAX_IR_LEN 128
+#endif
 #endif
 
 // The total number of exisitng TAPs/Devices in the system that
 // can be registered.
+#if defined(ARDUINO_AVR_MEGA2560)
+#define MAX_ALLOWED_TAPS 8
+#else
 #define MAX_ALLOWED_TAPS 16
+#endif
 
 #define MANY_ONES 100
 
+// Time to wait for the rest of a line typed by the user.
+#define INPUT_TIMEOUT_MS 500
+
 /*	Choose a half-clock cycle delay	*/
-// half clock cycle
-// #define HC delay(1);
-// or
+// The TCK frequency is selected at runtime with set_tck_khz().
+// DELAY_US is the power up half-clock cycle (HC) delay in microseconds.
 #define DELAY_US 100 // delay in microseonds for a half-clock cycle (HC) to drive TCK.
-#define HC delayMicroseconds(DELAY_US);
-
-// A more precise way to delay a half clock cycle:
-/*
-#define HC \
-{ \
-    __asm__ __volatile__("nop \n\t \
-                          nop \n\t \
-                          nop \n\t \
-                          nop \n\t \
-                          " : :);  \
-}
-Notice, that you also need to override the digitalWrite and digitalRead
-functions with an appropriate assembly in order to reach the desired JTAG speeds.
-*/
+#define HC tck_half_delay();
+
+// Number of TCK cycles clocked by measure_tck_khz().
+#define TCK_MEASURE_CYCLES 10000
+
+// Approximate CPU cycles per iteration of the HC busy loop.
+#define TCK_LOOP_CYCLES 4
+
+// Polls of RTCK before a TCK edge is given up on (with RTCK adaptive clocking).
+#define RTCK_MAX_LOOPS 1000
+
+// TCK cycles clocked in RUN_TEST_IDLE between two polls of wait_ready().
+#define WAIT_POLL_CYCLES 64
+
+// TCK calibration: first rate, each next step doubles it up to the board limit.
+// Every step must pass CAL_PASSES integrity checks of the chain.
+#define CAL_START_KHZ 10
+#define CAL_PASSES 4
+
+// Pin access is done directly on the port registers, see jtag_pins.h
+#include "jtag_pins.h"
  
 typedef enum TapState
 {
@@ -81,6 +137,27 @@ typedef enum TapState
     SELECT_IR, CAPTURE_IR, SHIFT_IR, EXIT1_IR, PAUSE_IR, EXIT2_IR, UPDATE_IR
 } tap_state;
 
+/**
+ * @brief Read a single bit of a packed register.
+ */
+static inline uint8_t reg_get_bit(const reg_t* reg, uint16_t bit)
+{
+    return (reg[bit / REG_WORD_BITS] >> (bit % REG_WORD_BITS)) & 1;
+}
+
+/**
+ * @brief Write a single bit of a packed register.
+ */
+static inline void reg_set_bit(reg_t* reg, uint16_t bit, uint8_t val)
+{
+    reg_t mask = (reg_t)1 << (bit % REG_WORD_BITS);
+
+    if (val)
+        reg[bit / REG_WORD_BITS] |= mask;
+    else
+        reg[bit / REG_WORD_BITS] &= ~mask;
+}
+
 typedef struct
 {
     uint32_t num;
@@ -89,15 +166,54 @@ typedef struct
     char name[32];
     bool is_jtag_swd;
 
+    // BYPASS padding of the other TAPs in the chain, computed once by detect_chain
+    uint16_t ir_prefix; // IR bits of the TAPs between this TAP and TDO
+    uint16_t ir_suffix; // IR bits of the TAPs between TDI and this TAP
+    uint16_t dr_prefix; // BYPASS bits between this TAP and TDO
+    uint16_t dr_suffix; // BYPASS bits between TDI and this TAP
+
+    // fastest TCK at which this TAP's IDCODE read back intact, 0 if not calibrated
+    uint32_t tck_khz;
+
+    // the last instruction shifted into this TAP and the IR bits it captured,
+    // ir_len bits each out of the arena (see arena.h)
+    reg_t* ir_in;
+    reg_t* ir_out;
+
 } tap_t;
 
+/**
+ * The TAPs found by detect_chain, taps[0] is the nearest to TDO.
+ */
+extern tap_t taps[];
+extern uint8_t tap_count;
+
+/**
+ * TAP addressed by the menu and binary scans, or NULL for the whole chain.
+ */
+extern tap_t* active_tap;
+
 /**
  * @brief Detects the the existence of a chain and checks the ir length.
- * @param out An integer that represents the length of the instructions.
- * Most certainly less than 255 bits.
+ * Every TAP in the chain is enumerated into taps[] with its IDCODE, IR length
+ * and the BYPASS padding needed to address it alone.
+ * @param out An integer that represents the length of the instructions
+ * of the whole chain. Most certainly less than 255 bits.
  */
 int detect_chain(uint8_t* out);
 
+/**
+ * @brief Compute the IR and DR BYPASS padding of every TAP in the chain.
+ * @param taps The TAPs array, nearest to TDO first, with ir_len set.
+ * @param count Number of TAPs.
+ */
+void taps_compute_padding(tap_t* taps, uint8_t count);
+
+/**
+ * @brief Print the IDCODE and IR length of every TAP in the chain.
+ */
+void print_chain(tap_t* taps, uint8_t count);
+
 /**
  * @brief Convert char into a hexadecimal number
  * @param ch Character to convert
@@ -110,7 +226,7 @@ int chr2hex(char ch);
  * Prior to loop, the function clears the rx serial buffer
  * and notifys the user that we are ready for input.
  */
-void notify_input_and_busy_wait_for_serial_input(const char* message);
+void notify_input_and_busy_wait_for_serial_input(const __FlashStringHelper* message);
 
 /**
  * @brief Used for various tasks where an input character needs to be received
@@ -118,159 +234,229 @@ void notify_input_and_busy_wait_for_serial_input(const char* message);
  * @param message Message for the user.
  * @return char input from user.
  */
-char getCharacter(const char* message);
+char getCharacter(const __FlashStringHelper* message);
 
 /**
- * @brief Get string from the user via the serial port.
- * @return String input from user.
+ * @brief Get a line of text from the user via the serial port.
+ * @param message Message for the user.
+ * @param buf Receives the line, without the line ending, null terminated.
+ * @param size Size of buf, longer lines are cut.
+ * @return Length of the line.
  */
-String getString(const char* message);
+uint16_t getLine(const __FlashStringHelper* message, char* buf, uint16_t size);
 
 /**
- * @brief Used for various tasks where a number needs to be received
- * from the user via the serial port.
+ * @brief Receive a number from the user in different formats: 0x, 0b, or decimal.
+ * The digits are converted as they arrive, straight into the destination register,
+ * so numbers of any length up to its size are accepted in every format.
+ * With an option to return the fetched number in a uint32 format.
+ * @param dest Destination register, or NULL for a number of up to 32 bits.
+ * @param size Size (in bits) of the destination register, or the largest number allowed.
+ * @param message A message for the user.
+ * @param out The first 32 bits of the number.
+ * @return OK, -ERR_BAD_CONVERSION for a bad digit or a number that doesn't fit,
+ * or -ERR_BAD_PREFIX_OR_SUFFIX without digits.
  */
-void fetchNumber(const char* message);
+int parseNumber(reg_t* dest, uint16_t size, const __FlashStringHelper* message, uint32_t* out);
 
 /**
- * @brief Used for various tasks where a hexadecimal number needs to be received
- * from the user via the serial port.
- * @param num_bytes The amount of hexadecimal characters to receive.
- * @param message Message for the user.
- * @return uint32_t representation of the hexadecimal number from user.
+ * @brief Convert the first len bits of a packed register into an integer number.
+ * Bit 0 of the register is the LSB.
+ * Max length of the given register is 32.
+ * @param arr Pointer to the packed register.
+ * @param len Number of bits to convert.
+ * @param out Pointer to result integer that represents the the value of the bits.
  */
-uint32_t getInteger(int num_bytes, const char* message);
+int binArrayToInt(reg_t* arr, int len, uint32_t* out);
 
 /**
- *
- * @brief Receive a number from the user in different formats: 0x, 0b, or decimal.
- * With an option to return the fetched number in a uint32 format.
- * @param message A message for the user.
- * @param dest Destination array. Will contain user's input value.
- * @param size Size (in bytes) of the destination array.
- * @param out The constructed number.
+ * @brief Convert an integer number n into a packed register arr that will represent
+ * the binary value of n. Bit 0 of arr is the LSB. Largest number is a 32 bit number.
+ * @param arr Pointer to the output register.
+ * @param len Length of the output register in bits. (max size 32)
+ * @param n The integer to convert.
  */
-int parseNumber(uint8_t* dest, uint16_t size, const char* message, uint32_t* out);
+int intToBinArray(reg_t* arr, uint32_t n, uint16_t len);
 
 /**
- * @brief Convert the content of a String object into an integer number,
- * where every byte (char) represents a single bit. 
- * Together the string represents a binary number.
- * First element of the string is the LSB.
- * Max length of the given string is 32.
- * @param str Pointer to the array of bits.
- * @param out An unsigned integer that represents the the value of the array bits.
+ * 
+ * @brief Return to TEST LOGIC RESET state of the TAP FSM.
+ * Apply 5 TCK cycles accompanied with TMS logic state 1.
  */
-int binStringToInt(String str, uint32_t* out);
+void reset_tap();
+
+/**
+*	@brief Insert data of length dr_len to DR, and end the interaction
+*	in the state end_state which can be any TAP state. The DR scan always
+*	starts with CAPTURE_DR. Ending in EXIT1_DR, PAUSE_DR or EXIT2_DR
+*	skips UPDATE_DR.
+*	@param dr_in Pointer to the input data register. (packed bits)
+*	@param dr_len Length of the register currently connected between tdi and tdo.
+*	@param end_state TAP state after dr inseration.
+*	@param dr_out Pointer to the output data register. (packed bits)
+*/
+void insert_dr(reg_t* dr_in, uint16_t dr_len, uint8_t end_state, reg_t* dr_out);
+
+/**
+*	@brief Insert data of length ir_len to IR, and end the interaction
+*	in the state end_state which can be any TAP state. The IR scan always
+*	starts with CAPTURE_IR. Ending in EXIT1_IR, PAUSE_IR or EXIT2_IR
+*	skips UPDATE_IR.
+*	@param ir_in Pointer to the input data register. (packed bits)
+*	@param ir_len Length of the register currently connected between tdi and tdo.
+*	@param end_state TAP state after dr inseration.
+*	@param ir_out Pointer to the output data register. (packed bits)
+*/
+void insert_ir(reg_t* ir_in, uint8_t ir_len, uint8_t end_state, reg_t* ir_out);
 
 /**
- * @brief Convert array of bytes into an integer number, where every byte
- * represents a single bit. Together the array represents a binary number.
- * First element of array is the LSB. 
- * Max length of the given array is 32.
- * @param arr Pointer to the array of bits.
- * @param len Integer that represents the length of the binary array.
- * @param out Pointer to result integer that represents the the value of the bits array.
+ * @brief Like insert_dr, but only for a single TAP of the chain.
+ * The other TAPs are expected to be in BYPASS, so a padding bit is shifted for each.
+ * @param tap The TAP to address.
  */
-int binArrayToInt(uint8_t* arr, int len, uint32_t* out);
+void insert_dr_tap(tap_t* tap, reg_t* dr_in, uint16_t dr_len, uint8_t end_state, reg_t* dr_out);
 
 /**
- * @brief Convert a binary string into a bytes array arr that will represent
- * the binary value just as string. each element (byte) in arr represents a bit.
- * First element is the LSB.
- * @param arr Pointer to the output array with the binary values.
- * @param arrSize Length of the output array in bytes.
- * @param str String that represents the binary digits. (LSB is the first char of string).
- * @param strSize Length of the string object.
- * @return ok or error code.
+ * @brief Like insert_ir, but only for a single TAP of the chain (tap->ir_len bits).
+ * The other TAPs get the BYPASS (all ones) instruction.
+ * @param tap The TAP to address.
  */
-int binStrToBinArray(uint8_t* arr, int arrSize, String str ,int strSize);
+void insert_ir_tap(tap_t* tap, reg_t* ir_in, uint8_t end_state, reg_t* ir_out);
 
 /**
- * @brief Convert a hexadecimal string into a bytes array arr that will represent
- * the binary value of the hexadecimal array. each element (byte) in arr represents a bit.
- * First element is the LSB.
- * @param arr Pointer to the output array with the binary values.
- * @param arrSize Length of the output array in bytes.
- * @param str String that represents the hexadecimal digits.
- * (LSB is the first char of string).
- * @param strSize Length of the string object.
- * @return ok or error code
+ * A scan that is shifted in chunks, longer than the scan registers. Between two
+ * chunks the TAP is parked in PAUSE_DR/PAUSE_IR, and goes back to SHIFT through EXIT2.
  */
-int hexStrToBinArray(uint8_t* arr, int arrSize, String str, int strSize);
+typedef struct
+{
+    uint32_t left;       // register bits still to shift, 0 when no scan is open
+    uint8_t shift_state; // SHIFT_DR or SHIFT_IR
+    uint8_t end_state;
+    uint16_t post;       // padding bits of the BYPASSed TAPs shifted after the last chunk
+} scan_stream_t;
+
+/**
+ * @brief Open a streamed scan: move through CAPTURE to the shift state,
+ * and shift the padding bits of the TAPs between the addressed TAP and TDO.
+ * @param s The scan.
+ * @param is_ir True for an IR scan, false for a DR scan.
+ * @param len Length of the scan in bits, not counting the padding.
+ * @param end_state TAP state after the last chunk.
+ * @param tap The TAP to address alone, or NULL for the whole chain.
+ * @return OK, -ERR_BAD_TAP_STATE or -ERR_UNVALID_IR_OR_DR_LEN.
+ */
+int scan_stream_begin(scan_stream_t* s, bool is_ir, uint32_t len, uint8_t end_state, tap_t* tap);
 
 /**
- * @brief Convert base 10 decimal string into a bytes array arr that will represent
- * the binary value of the decimal array. each element (byte) in arr represents a bit.
- * First element is the LSB.
- * @param arr Pointer to the output array with the binary values.
- * @param arrSize Length of the output array in bytes.
- * @param str String that represents the decimal digits.
- * (LSB is the first char of string).
- * @param strSize Length of the string object.
+ * @brief Shift the next chunk of an open streamed scan. Unless it is the last
+ * one, the TAP is left in PAUSE_DR/PAUSE_IR, otherwise it moves to the end state.
+ * @param s The scan.
+ * @param in Pointer to the chunk bits to shift in. (packed bits)
+ * @param len Number of bits of the chunk, at most the bits left.
+ * @param out Pointer to the register that receives the shifted out bits.
+ * @return OK or -ERR_UNVALID_IR_OR_DR_LEN if no scan is open or the chunk is too long.
  */
-int decStrToBinArray(uint8_t* arr, int arrSize, String str, int strSize);
+int scan_stream_shift(scan_stream_t* s, reg_t* in, uint16_t len, reg_t* out);
 
 /**
- * @brief Convert an integer number n into a bytes array arr that will represent
- * the binary value of n. each element (byte) in arr represent a bit.
- * First element is the LSB. Largest number is a 32 bit number.
- * @param arr Pointer to the output array with the binary values.
- * @param len Length of the output array in bytes. (max size 32)
- * @param n The integer to convert.
+ * @brief Move to RUN_TEST_IDLE and stay there for the given number of TCK cycles.
+ * @param cycles Number of TCK cycles to clock in RUN_TEST_IDLE.
  */
-int intToBinArray(uint8_t* arr, uint32_t n, uint16_t len);
+void run_test_idle(uint32_t cycles);
 
 /**
- * 
- * @brief Return to TEST LOGIC RESET state of the TAP FSM.
- * Apply 5 TCK cycles accompanied with TMS logic state 1.
+ * @brief Keep TCK running in the current stable state (TEST_LOGIC_RESET,
+ * RUN_TEST_IDLE, PAUSE_DR or PAUSE_IR) for at least the given number of
+ * cycles and at least the given time, whichever is longer.
+ * @param cycles Minimal number of TCK cycles.
+ * @param us Minimal time in microseconds.
+ * @return OK or -ERR_BAD_TAP_STATE if the current state isn't stable.
  */
-void reset_tap();
+int clock_state(uint32_t cycles, uint32_t us);
 
 /**
-*	@brief Insert data of length dr_len to DR, and end the interaction
-*	in the state end_state which can be one of the following:
-*	TLR, RTI.
-*	@param dr_in Pointer to the input data array. (bytes array)
-*	@param dr_len Length of the register currently connected between tdi and tdo.
-*	@param end_state TAP state after dr inseration.
-*	@param dr_out Pointer to the output data array. (bytes array)
-*/
-void insert_dr(uint8_t* dr_in, uint8_t dr_len, uint8_t end_state, uint8_t* dr_out);
+ * Completion condition polled by wait_ready(). It may scan, but must leave
+ * the TAP in RUN_TEST_IDLE.
+ * @param ctx The context given to wait_ready().
+ * @return true when the device is ready.
+ */
+typedef bool (*ready_cond_t)(void* ctx);
+
+/**
+ * @brief Wait for a device operation (erase, programming, ...) with TCK running in
+ * RUN_TEST_IDLE. After the minimal number of cycles the condition is polled every
+ * WAIT_POLL_CYCLES cycles, so the wait ends as soon as the device is ready.
+ * The time waited is added to stats.ready_us.
+ * @param ready The completion condition, or NULL if the device has none: then
+ * the wait takes min_cycles and max_us, as the device timing asks for.
+ * @param ctx Passed to the condition.
+ * @param min_cycles TCK cycles to clock before the first poll.
+ * @param max_us Upper bound of the wait in microseconds, from the device timing.
+ * @param waited_us Receives the time waited in microseconds, may be NULL.
+ * @return OK, or -ERR_TIMEOUT if the condition didn't hold within max_us.
+ */
+int wait_ready(ready_cond_t ready, void* ctx, uint32_t min_cycles, uint32_t max_us, uint32_t* waited_us);
 
 /**
-*	@brief Insert data of length ir_len to IR, and end the interaction
-*	in the state end_state which can be one of the following:
-*	TLR, RTI, SelectDR.
-*	@param ir_in Pointer to the input data array. Bytes array, where each
-*	@param ir_len Length of the register currently connected between tdi and tdo.
-*	@param end_state TAP state after dr inseration.
-*	@param ir_out Pointer to the output data array. (bytes array)
-*/
-void insert_ir(uint8_t* ir_in, uint8_t ir_len, uint8_t end_state, uint8_t* ir_out);
+ * A status register captured by dr_status_ready(): the DR selected by the current
+ * instruction is ready when its first len bits, under mask, equal value.
+ */
+typedef struct
+{
+    uint8_t len;     // up to 32 bits
+    uint32_t value;
+    uint32_t mask;
+} dr_status_t;
+
+/**
+ * @brief ready_cond_t that captures the DR selected by the current instruction
+ * (zeros are shifted in) and compares it with a dr_status_t.
+ * In gang mode (see gang.h) every chain must be ready.
+ * @param ctx Pointer to the dr_status_t.
+ */
+bool dr_status_ready(void* ctx);
 
 /**
  * @brief Fill the register with zeros
  * @param reg Pointer to the register to flush.
+ * @param len Length of the register in bits.
  */
-void clear_reg(uint8_t* reg, uint16_t len);
+void clear_reg(reg_t* reg, uint16_t len);
 
 /**
  * @brief Clean the IR and DR together
  */
-void flush_ir_dr(uint8_t* ir_reg, uint8_t* dr_reg, uint16_t ir_len, uint16_t dr_len);
+void flush_ir_dr(reg_t* ir_reg, reg_t* dr_reg, uint16_t ir_len, uint16_t dr_len);
+
+/**
+ * Marker shifted into a DR to measure its length in a single pass.
+ * The captured bits that come out before it may imitate it, so a match only
+ * counts when DR_MARKER_CONFIRM ones follow. After a fake match the real marker
+ * comes out instead, and its MSB (bit 31) is 0.
+ */
+#define DR_MARKER           0x5A3C96E0
+#define DR_MARKER_CONFIRM   8   // ones that must follow the marker out of TDO
+
+/**
+ * @brief Measure the length of the DR selected by the current instruction.
+ * The TAP moves to SHIFT_DR, and is left in RUN_TEST_IDLE.
+ * The register isn't flushed: a marker is shifted through it once.
+ * @param max_len Longest DR length to look for.
+ * @return The DR length, 0 if it wasn't found, or -ERR_TDO_STUCK_AT_1/0
+ * if TDO never changed.
+ */
+int measure_dr_len(uint16_t max_len);
 
 /**
  * @brief Find out the dr length of a specific instruction.
  * Make sure that current state is TLR prior this calling this function.
- * @param instruction Pointer to the bytes array that contains the instruction.
+ * @param instruction Pointer to the register that contains the instruction.
  * @param ir_len The length of the IR. (Needs to be know prior to function call).
- * @param process_ticks Number of TCK ticks to wait for the inserted instruction to "process in".
+ * @param process_ticks Number of TCK cycles in RUN_TEST_IDLE for the inserted instruction to "process in".
  * @return Counter that represents the size of the DR. Or 0 if didn't find
  * a valid size. (DR may not be implemented or some other reason).
  */
-uint32_t detect_dr_len(uint8_t* instruction, uint8_t ir_len, uint32_t process_ticks);
+uint32_t detect_dr_len(reg_t* instruction, uint8_t ir_len, uint32_t process_ticks);
 
 /**
  * @brief Similarly to discovery command in urjtag, performs a brute force search
@@ -280,15 +466,49 @@ uint32_t detect_dr_len(uint8_t* instruction, uint8_t ir_len, uint32_t process_ti
  * @param last Usually 2 to the power of (ir_len) - 1.
  * @param max_dr_len Maximum data register allowed.
  * @param ir_in Pointer to ir_in register.
- * @param ir_out Pointer to ir_out register.
 */
-int discovery(uint32_t first, uint32_t last, uint16_t max_dr_len, uint8_t* ir_in, uint8_t* ir_out);
+int discovery(uint32_t first, uint32_t last, uint16_t max_dr_len, reg_t* ir_in);
+
+/**
+ * Called by discovery_sweep with the DR length (0 if not found) of every instruction.
+ * Returns false to stop the sweep.
+ */
+typedef bool (*discovery_report_t)(uint32_t instruction, uint16_t dr_len);
+
+/**
+ * @brief The discovery engine: measure the DR length of every instruction
+ * from first to last and report it. The sweep can be stopped by the report
+ * callback and later resumed from *next.
+ * @param first ir value to begin with.
+ * @param last Last ir value to check.
+ * @param max_dr_len Maximum data register allowed (0 for MAX_DR_LEN).
+ * @param ir_len The length of the IR.
+ * @param ir_in Pointer to ir_in register.
+ * @param report Callback for every result.
+ * @param next First instruction that wasn't checked (last + 1 when done).
+ * @return OK or -ERR_TDO_STUCK_AT_1/0.
+ */
+int discovery_sweep(uint32_t first, uint32_t last, uint16_t max_dr_len, uint8_t ir_len,
+                    reg_t* ir_in, discovery_report_t report, uint32_t* next);
 
 /**
  * Initialize the TAPs array of tap_t structs.
  */
 void taps_init(tap_t* taps);
 
+/**
+ * Take the session IR and DR registers (ir_in, ir_out, dr_in, dr_out) out of the arena.
+ */
+void regs_init();
+
+/**
+ * @brief Take the IR registers of every detected TAP out of the arena,
+ * giving back the ones of a previous detection.
+ * @param taps Pointer to the TAPs array.
+ * @param count Number of TAPs in the chain.
+ */
+void taps_alloc_regs(tap_t* taps, uint8_t count);
+
 /**
  * Example of a system/board where 2 TAPs exist in a single SOC:
  * 
@@ -308,12 +528,122 @@ void taps_init(tap_t* taps);
  *          | tap  5-bit |     | tap  4-bit |
  *          |____________|     |____________|
  * 
+ * @return Pointer to the TAP of index which (0 is the nearest to TDO),
+ * or NULL if there's no such TAP.
  */
 tap_t* tap_selector(tap_t* taps, int which);
 
+/**
+ * @brief Check the integrity of the chain at the current TCK rate. The IDCODEs
+ * captured after a TAP reset are compared with the ones found by detect_chain,
+ * followed by a pattern that must come back out of TDO. Then all the TAPs are put
+ * in BYPASS and a pattern must come back delayed by one bit per TAP.
+ * @param seed Seed of the patterns, so successive checks shift different bits.
+ * @param bad Receives the index of the first TAP (from TDO) whose IDCODE came back
+ * wrong, or tap_count if they were all right.
+ * @return OK or -ERR_TDO_MISMATCH.
+ */
+int check_chain_integrity(uint32_t seed, uint8_t* bad);
+
+/**
+ * @brief Find the fastest TCK rate at which the chain passes check_chain_integrity().
+ * The rate starts at CAL_START_KHZ and doubles until a check fails or the board
+ * limit is reached, and the last rate that passed is kept. Every TAP records in
+ * tck_khz the fastest rate at which its own IDCODE came back intact.
+ * If use_rtck is set and RTCK follows TCK, adaptive clocking is used instead.
+ * @param use_rtck Allow RTCK adaptive clocking.
+ * @param out Receives the selected TCK rate in kHz (measured, also with RTCK).
+ * @return OK, or -ERR_TDO_MISMATCH if the chain fails even at the slowest rate
+ * (the power up rate is restored then).
+ */
+int calibrate_tck(bool use_rtck, uint32_t* out);
+
+/**
+ * @brief Check whether the target returns TCK on the RTCK pin. TCK is toggled
+ * in TEST_LOGIC_RESET and every edge must come back within RTCK_MAX_LOOPS polls.
+ * @return true if RTCK follows TCK.
+ */
+bool rtck_detect();
+
+/**
+ * Always on performance counters. They are updated once per call of the
+ * TAP primitives (not per bit), so they cost next to nothing on the hot paths.
+ */
+typedef struct
+{
+    uint32_t tck_cycles;    // every TCK cycle
+    uint32_t tms_cycles;    // TCK cycles spent moving between TAP states
+    uint32_t bits_shifted;  // register and BYPASS padding bits in SHIFT_DR/SHIFT_IR
+    uint32_t ir_scans;
+    uint32_t dr_scans;
+    uint32_t serial_rx;     // bytes of binary frames and menu input
+    uint32_t serial_tx;     // bytes of binary frames
+    uint32_t wait_us;       // time spent waiting for input from the host
+    uint32_t flush_us;      // time spent blocked until the serial TX buffer drained
+    uint32_t ready_us;      // time spent in wait_ready() for devices to finish an operation
+    uint32_t since_us;      // micros() when the counters were cleared
+} jtag_stats_t;
+
+#define STATS_FIELDS 10 // counters sent by BIN_CMD_STATS, followed by the elapsed time
+
+extern jtag_stats_t stats;
+
+/**
+ * @brief Zero the performance counters and restart their time base.
+ */
+void stats_clear();
+
+/**
+ * @brief Print the performance counters, and the bit and scan rates since they were cleared.
+ */
+void stats_print();
+
+/**
+ * Called after every word shifted by insert_dr/insert_ir when not NULL.
+ * Lets long scans service background work such as serial reception.
+ */
+extern void (*scan_poll_hook)();
+
+/**
+ * Fastest bit banged TCK rate of the board in kHz, measured by measure_tck_max().
+ */
+extern uint32_t tck_max_khz;
+
+/**
+ * @brief Measure tck_max_khz with no delay at all, once at boot. The TAP is reset.
+ */
+void measure_tck_max();
+
+/**
+ * @brief Select the TCK frequency. Rates that need a half period of at least
+ * 20us use delayMicroseconds, faster rates use a busy loop that is calibrated
+ * against tck_max_khz. Nothing is clocked, so the TAP state is kept.
+ * @param khz Requested TCK frequency in kHz. 0 selects the fastest possible rate.
+ * @return The TCK frequency in kHz that the delay gives.
+ */
+uint32_t set_tck_khz(uint32_t khz);
+
+/**
+ * @brief Measure the achieved TCK frequency by clocking TCK_MEASURE_CYCLES cycles
+ * in the current state, which must loop on itself: TEST_LOGIC_RESET, RUN_TEST_IDLE,
+ * PAUSE_DR or PAUSE_IR.
+ * @return The measured TCK frequency in kHz, 0 in any other state.
+ */
+uint32_t measure_tck_khz();
+
+/**
+ * @brief Move the TAP machine from the current state to any other state
+ * along the shortest path, clocked out as a single burst of TMS bits.
+ * The paths are looked up in the constant tables of tap_paths.h.
+ * Moving to the current state clocks nothing.
+ * @param target The state to move to.
+ */
+int goto_state(uint8_t target);
+
 /**
 *	@brief Advance the TAP machine 1 state ahead according to the current state 
-*	and next state of the IEEE 1149.1 standard.
+*	and next state of the IEEE 1149.1 standard. If next_state is not a legal
+*	successor of the current state nothing is clocked.
 *	@param next_state The next state to advance to.
 */
 int advance_tap_state(uint8_t next_state);
@@ -325,11 +655,11 @@ int advance_tap_state(uint8_t next_state);
 char serialEvent(char character);
 
 /**
- * @brief Prints the given array from last element to first.
- * @param arr Pointer to array.
- * @param len Number of cells to print from that array.
+ * @brief Prints the bits of the given register from last bit to first.
+ * @param arr Pointer to the packed register.
+ * @param len Number of bits to print from that register.
 */
-void printArray(uint8_t* arr, uint32_t len);
+void printArray(reg_t* arr, uint32_t len);
 
 /**
  * @brief Sends the bytes of an array/buffer via the serial port.
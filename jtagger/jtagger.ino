@@ -12,104 +12,261 @@
 #include "art.h"
 #include "jtagger.h"
 #include "max10_funcs.h"
+#include "binproto.h"
+#include "bsdl_table.h"
+#include "tap_paths.h"
+#include "jtag_spi.h"
+#include "arena.h"
+#include "arm_dp.h"
+#include "tap_trace.h"
+#include "gang.h"
 
 
 // Global Variables
 uint32_t idcode = 0;
-uint8_t dr_out[MAX_DR_LEN] = {0};  // TODO put these variables inside tap_t
-uint8_t dr_in[MAX_DR_LEN] = {0};
+reg_t* dr_out = NULL;   // session registers, out of the arena (see regs_init)
+reg_t* dr_in = NULL;
+reg_t* ir_out = NULL;
+reg_t* ir_in = NULL;
 uint8_t ir_len = 1;
-String digits = "";
 tap_state current_state;
 tap_t taps[MAX_ALLOWED_TAPS];
-
-int detect_chain(uint8_t* out)
+uint8_t tap_count = 0;
+tap_t* active_tap = NULL;
+uint32_t tck_delay_us = DELAY_US;
+uint32_t tck_delay_loops = 0;
+uint32_t tck_max_khz = 0;
+bool tck_rtck = false;
+uint32_t rtck_timeouts = 0;
+void (*scan_poll_hook)() = NULL;
+jtag_stats_t stats;
+
+/**
+ * IR lengths of known devices, used when the captured IR bits
+ * don't tell the boundaries between the TAPs of a chain.
+ */
+static const struct
 {
-    uint8_t id_arr[32] = {0};
-    uint32_t idcode = 0;
-    uint32_t i = 0;
-    uint8_t counter = 0;
-    int rc = OK;
+    uint32_t mask;
+    uint32_t idcode;
+    uint8_t ir_len;
+    const char* name;
+} known_taps[] = {
+    { 0x0FFFFFFF, 0x0BA00477, 4,  "Cortex-M JTAG-DP" },
+    { 0x0FFFFFFF, 0x06413041, 5,  "STM32F4 boundary scan" },
+    { 0x00000FFF, 0x000000DD, 10, "Intel/Altera FPGA" },
+};
+
+/**
+ * @brief Shift out the IDCODE (or 1 bit BYPASS) registers of all the TAPs in
+ * the chain, as loaded by a TAP reset. Ones are shifted in, so the end of the
+ * chain shows up as an all ones IDCODE.
+ * @param taps The TAPs array to fill, nearest to TDO first.
+ * @return Number of TAPs found.
+ */
+static uint8_t read_chain_idcodes(tap_t* taps)
+{
+    uint8_t count = 0;
+    uint32_t id = 0;
+    uint8_t i = 0;
 
     reset_tap();
+    goto_state(SHIFT_DR);
+    TDI_WRITE(1);
 
-    // try to read IDCODE first and then detect the IR length
-    advance_tap_state(RUN_TEST_IDLE);
-    advance_tap_state(SELECT_DR);
-    advance_tap_state(CAPTURE_DR);
-    advance_tap_state(SHIFT_DR);
-    
-    // shift out the IDCODE from the id code register
-    // assumed that the IDCODE IR is the default IR after power up.
-    // first bit to read out is the LSB of the IDCODE.
-    for (i = 0; i < 32; i++)
+    while (count < MAX_ALLOWED_TAPS)
     {
         advance_tap_state(SHIFT_DR);
-        id_arr[i] = digitalRead(TDO);
+
+        // a TAP without IDCODE captures a single 0 in its BYPASS register
+        if (TDO_READ() == 0) {
+            taps[count++].idcode = 0;
+            continue;
+        }
+
+        // LSB of IDCODE is 1, read the remaining 31 bits
+        id = 1;
+        for (i = 1; i < 32; i++)
+        {
+            advance_tap_state(SHIFT_DR);
+            id |= (uint32_t)TDO_READ() << i;
+        }
+
+        if (id == 0xFFFFFFFF)
+            break;
+        taps[count++].idcode = id;
     }
-    advance_tap_state(EXIT1_DR);
 
-    // LSB of IDCODE must be 1.
-    if (id_arr[0] != 1)
+    goto_state(RUN_TEST_IDLE);
+    return count;
+}
+
+/**
+ * @brief Split the total IR length among the TAPs of the chain.
+ * Known IDCODEs give their IR length directly. Otherwise a TAP's IR ends where
+ * the next captured "01" pattern (mandatory in the 2 LSBs of every IR capture) starts.
+ * @param taps The TAPs array, nearest to TDO first.
+ * @param count Number of TAPs.
+ * @param total Total IR length of the chain.
+ * @return OK or -ERR_UNVALID_IR_OR_DR_LEN if the lengths don't add up.
+ */
+static int split_chain_ir(tap_t* taps, uint8_t count, uint8_t total)
+{
+    reg_t capture[REG_WORDS(MAX_IR_LEN)] = {0};
+    reg_t ones[REG_WORDS(MAX_IR_LEN)];
+    uint8_t pos = 0;
+    uint8_t next = 0;
+    uint8_t k = 0;
+    uint8_t i = 0;
+
+    // read the captured IR bits while loading BYPASS into all the TAPs
+    for (i = 0; i < REG_WORDS(MAX_IR_LEN); i++)
+        ones[i] = 0xFFFFFFFF;
+    insert_ir(ones, total, RUN_TEST_IDLE, capture);
+
+    for (k = 0; k < count; k++)
     {
-        Serial.println("\n\nBad IDCODE or not implemented, LSB = 0");
-        return -ERR_BAD_IDCODE;
+        taps[k].ir_len = 0;
+        for (i = 0; i < sizeof(known_taps) / sizeof(known_taps[0]); i++)
+        {
+            if ((taps[k].idcode & known_taps[i].mask) == known_taps[i].idcode) {
+                taps[k].ir_len = known_taps[i].ir_len;
+                strncpy(taps[k].name, known_taps[i].name, sizeof(taps[k].name) - 1);
+                break;
+            }
+        }
+
+        if (taps[k].ir_len == 0)
+        {
+            if (k == count - 1) {
+                // the last TAP takes whatever is left
+                taps[k].ir_len = total - pos;
+            }
+            else {
+                next = pos + 2;
+                while (next + 1 < total &&
+                       !(reg_get_bit(capture, next) == 1 && reg_get_bit(capture, next + 1) == 0))
+                    next++;
+                taps[k].ir_len = next - pos;
+            }
+        }
+
+        pos += taps[k].ir_len;
+        if (pos > total)
+            return -ERR_UNVALID_IR_OR_DR_LEN;
     }
-    // turn IDCODE bits into unsigned integer
-    rc = binArrayToInt(id_arr, 32, &idcode);
-    if (rc != OK) {
-        return rc;
+
+    return pos == total ? OK : -ERR_UNVALID_IR_OR_DR_LEN;
+}
+
+void taps_compute_padding(tap_t* taps, uint8_t count)
+{
+    uint16_t ir_total = 0;
+    uint16_t ir_before = 0;
+    uint8_t k = 0;
+
+    for (k = 0; k < count; k++)
+        ir_total += taps[k].ir_len;
+
+    // bits shifted first end up in the TAP nearest to TDO
+    for (k = 0; k < count; k++)
+    {
+        taps[k].ir_prefix = ir_before;
+        taps[k].ir_suffix = ir_total - ir_before - taps[k].ir_len;
+        taps[k].dr_prefix = k;
+        taps[k].dr_suffix = count - 1 - k;
+        ir_before += taps[k].ir_len;
     }
+}
 
-    Serial.print("\nFound IDCODE: ");
-    printArray(id_arr, 32);
-    Serial.print(" (0x");
-    Serial.print(idcode, HEX);
-    Serial.print(")");
+void print_chain(tap_t* taps, uint8_t count)
+{
+    for (uint8_t k = 0; k < count; k++)
+    {
+        Host.print(F("\nTAP ")); Host.print(k);
+        Host.print(F(": IDCODE 0x")); Host.print(taps[k].idcode, HEX);
+        Host.print(F(", IR length ")); Host.print(taps[k].ir_len);
+        if (taps[k].name[0] != '\0') {
+            Host.print(F(" (")); Host.print(taps[k].name); Host.print(F(")"));
+        }
+        if (taps[k].tck_khz != 0) {
+            Host.print(F(", TCK up to ")); Host.print(taps[k].tck_khz); Host.print(F(" kHz"));
+        }
+    }
+    Host.print(F("\n(TAP 0 is nearest to TDO)"));
+}
+
+int detect_chain(uint8_t* out)
+{
+    uint32_t i = 0;
+    uint8_t counter = 0;
+    uint8_t count = 0;
+    int rc = OK;
+
+    // the IDCODEs of every TAP in the chain are read first
+    taps_init(taps);
+    active_tap = NULL;
+    tap_count = 0;
+
+    count = read_chain_idcodes(taps);
+    if (count == 0 || (count == 1 && taps[0].idcode == 0))
+    {
+        Host.println(F("\n\nBad IDCODE or not implemented, LSB = 0"));
+        return -ERR_BAD_IDCODE;
+    }
+
+    idcode = taps[0].idcode;
+    Host.print(F("\nFound ")); Host.print(count); Host.print(F(" TAP(s)"));
 
     // find ir length.
-    Serial.print("\nAttempting to find IR length of target ...\n");
+    Host.print(F("\nAttempting to find IR length of target ...\n"));
     reset_tap();
-    advance_tap_state(RUN_TEST_IDLE);
-    advance_tap_state(SELECT_DR);
-    advance_tap_state(SELECT_IR);
-    advance_tap_state(CAPTURE_IR);
-    advance_tap_state(SHIFT_IR);
+    goto_state(SHIFT_IR);
     
     // shift in about MANY_ONES amount of ones into TDI to clear the register
     // from its previos content. then shift a single zero followed by
     // a bunch of ones and cout the amount of clock cycles from inserting zero
     // till we read it in TDO.
 
-    digitalWrite(TDI, 1);
+    TDI_WRITE(1);
     for (i = 0; i < MANY_ONES; ++i) 
     {
         advance_tap_state(SHIFT_IR);
     }
 
-    digitalWrite(TDI, 0);
+    TDI_WRITE(0);
     advance_tap_state(SHIFT_IR);
 
-    digitalWrite(TDI, 1);
+    TDI_WRITE(1);
     for (i = 0; i < MANY_ONES; ++i)
     {
         advance_tap_state(SHIFT_IR);
-
-        if (digitalRead(TDO) == 0)
-        {
-            counter++;
-            *out = counter;
-            return OK;
-        }
         counter++;
+
+        if (TDO_READ() == 0)
+            break;
     }
 
-    advance_tap_state(EXIT1_IR);
-    advance_tap_state(UPDATE_IR);
-    advance_tap_state(RUN_TEST_IDLE);
+    goto_state(RUN_TEST_IDLE);
 
-    Serial.println("\nDidn't find valid IR length");
-    return -ERR_UNVALID_IR_OR_DR_LEN;
+    if (i == MANY_ONES || counter > MAX_IR_LEN)
+    {
+        Host.println(F("\nDidn't find valid IR length"));
+        return -ERR_UNVALID_IR_OR_DR_LEN;
+    }
+    *out = counter;
+
+    // split the IR among the TAPs and cache their BYPASS padding
+    rc = split_chain_ir(taps, count, counter);
+    if (rc != OK)
+        Host.print(F("\nCould not split the IR among the TAPs, set the IR lengths manually"));
+
+    tap_count = count;
+    taps_compute_padding(taps, count);
+    taps_alloc_regs(taps, count);
+    print_chain(taps, count);
+
+    return OK;
 }
 
 int chr2hex(char ch)
@@ -126,928 +283,1131 @@ int chr2hex(char ch)
     return -ERR_OUT_OF_BOUNDS;
 }
 
-int binArrayToInt(uint8_t* arr, int len, uint32_t* out)
+int binArrayToInt(reg_t* arr, int len, uint32_t* out)
 {	
-    uint32_t integer = 0;
-    uint32_t mask = 1;
-
     if (len > 32){
-        Serial.print("\nbinArrayToInt: array size too large");
-        Serial.println("\nBad conversion.");
-        Serial.flush();
+        Host.print(F("\nbinArrayToInt: array size too large"));
+        Host.println(F("\nBad conversion."));
         return -ERR_BAD_CONVERSION;
     }
 
-    for (int i = 0; i < len; i++) {
-        if (arr[i]) {
-            integer |= mask;
-        }
-        mask = mask << 1;
-    }
+    // the first 32 bits of a packed register are its first word
+    if (len == 32)
+        *out = arr[0];
+    else
+        *out = arr[0] & (((uint32_t)1 << len) - 1);
 
-    *out = integer;
     return OK;
 }
 
-int binStringToInt(String str, uint32_t* out)
-{
-    uint32_t integer = 0;
-    uint32_t mask = 1;
-
-    if (str.length() > 32){
-        Serial.println("\nbinStrToInt: string length too large");
-        Serial.println("Bad conversion.");
-        return -ERR_BAD_CONVERSION;
+void clear_serial_rx_buf() {
+    while (Host.available())
+    {
+        Host.read();
     }
+}
 
-    for (int i = str.length() - 1; i >= 0; i--)
+int intToBinArray(reg_t* arr, uint32_t n, uint16_t len)
+{
+    if (len > 32) // TODO: increase this to 64 or 256 or max_dr_len actually ?
     {
-        if (str[i] == '1')
-            integer |= mask;
-
-        mask = mask << 1;
+        Host.print(F("\nintToBinArray: array size is larger than 32"));
+        Host.println(F("\nBad Conversion"));
+        return -ERR_BAD_CONVERSION;
     }
 
-    *out = integer;
+    // a number of up to 32 bits occupies the first word of the register
+    if (len == 32)
+        arr[0] = n;
+    else
+        arr[0] = n & (((uint32_t)1 << len) - 1);
+
     return OK;
 }
 
-void clear_serial_rx_buf() {
-    while (Serial.available())
+void notify_input_and_busy_wait_for_serial_input(const __FlashStringHelper* message)
+{
+    uint32_t start = 0;
+
+    clear_serial_rx_buf(); // first, clean the input buffer
+    Host.print(message); // notify user to input a value
+
+    // the prompt must be on the wire before waiting for the answer
+    Host.flush();
+
+    start = micros();
+    while (Host.available() == 0) {}
+    stats.wait_us += micros() - start;
+    stats.serial_rx += Host.available();
+}
+
+char getCharacter(const __FlashStringHelper* message)
+{
+    char inChar[1] = {0};
+
+    notify_input_and_busy_wait_for_serial_input(message);
+    Host.readBytesUntil('\n', inChar, 1);
+    char chr = inChar[0];
+
+#if DEBUGSERIAL
+    Host.print(F("\nchar: ")); Host.println(chr);
+#endif
+    return chr;
+}
+
+
+uint16_t getLine(const __FlashStringHelper* message, char* buf, uint16_t size)
+{
+    uint16_t n = 0;
+
+    notify_input_and_busy_wait_for_serial_input(message);
+    n = Host.readBytesUntil('\n', buf, size - 1);
+    if (n > 0 && buf[n - 1] == '\r')
+        n--;
+    buf[n] = '\0';
+
+#if DEBUGSERIAL
+    Host.print(F("\nstring: ")); Host.println(buf);
+    Host.print(F("string length = ")); Host.println(n);
+#endif
+    return n;
+}
+
+/**
+ * @brief Next character of the line typed by the user, without the '\r' of a line ending.
+ * @return The character, or -1 at the end of the line (or if the rest of it doesn't arrive).
+ */
+static int next_input_char()
+{
+    uint32_t start = millis();
+    int c = -1;
+
+    while (millis() - start < INPUT_TIMEOUT_MS)
     {
-        Serial.read();
+        c = Host.read();
+        if (c == '\n')
+            return -1;
+        if (c >= 0 && c != '\r')
+            return c;
     }
+    return -1;
 }
 
-int binStrToBinArray(uint8_t* arr, int arrSize, String str ,int strSize)
+/**
+ * @brief r = r * base + digit, over the first used words of a register of size bits.
+ * @param used Words that may be non zero, grows with the number.
+ * @return false if the result doesn't fit in size bits.
+ */
+static bool reg_mul_add(reg_t* r, uint16_t size, uint16_t* used, uint8_t base, uint8_t digit)
 {
-    int i = 0;
+    uint64_t acc = digit;
 
-    if (strSize > arrSize)
+    for (uint16_t w = 0; w < *used; w++)
     {
-        Serial.print("\nbinStrToBinArray: size of string is larger than destination array.");
-        Serial.print("\nDestination array size: "); Serial.print(arrSize);
-        Serial.print("\nString requires: "); Serial.print(strSize);
-        Serial.println("\nBad Conversion");
-        Serial.flush();
-        return -ERR_BAD_CONVERSION;
+        acc += (uint64_t)r[w] * base;
+        r[w] = (reg_t)acc;
+        acc >>= REG_WORD_BITS;
     }
 
-    clear_reg(arr, arrSize);
-
-    // last digit in received string is the least significant
-    for (i = strSize - 1; i >= 0; i--)
-        arr[strSize - 1 - i] = str[i] - 0x30; // ascii to unsigned int    
+    if (acc != 0) {
+        if (*used == REG_WORDS(size))
+            return false;
+        r[(*used)++] = (reg_t)acc;
+    }
 
-    // fill the remaining array elements with zeros
-    for (i = strSize; i < arrSize; i++)
-        arr[i] = 0;
+    // the last word may be partially used
+    if (*used == REG_WORDS(size) && size % REG_WORD_BITS)
+        return (r[*used - 1] >> (size % REG_WORD_BITS)) == 0;
 
-    return OK;
+    return true;
 }
 
-int hexStrToBinArray(uint8_t* arr, int arrSize, String str, int strSize)
+int parseNumber(reg_t* dest, uint16_t size, const __FlashStringHelper* message, uint32_t* out)
 {
-    int i = 0;
-    int j = 0;
-    int vacantBits = 0;
-    uint8_t n = 0;
-    
-    if (strSize * 4 > arrSize)
-    {
-        // check how many bits left on arr that can be populated with bits from the last digit.
-        vacantBits = 4 - ((strSize * 4) - arrSize);  // nibble size in bits - (str digit * nibble size) - arr size in bits
+    reg_t word[1] = {0};
+    reg_t* r = dest != NULL ? dest : word;
+    uint16_t bits = dest != NULL || size < 32 ? size : 32;
+    uint16_t used = 0;
+    uint16_t digits = 0;
+    uint8_t base = 10;
+    int c = 0;
+    int d = 0;
+    int rc = OK;
 
-        // maybe the last digit can fit in the 1,2, or 3 bits of the last digit
-        if (vacantBits <= 0)
-        {
-            Serial.print("\nhexStrToBinArray: destination array not large enough, ");
-            Serial.print("size: "); Serial.print(arrSize);
-            Serial.print("\nString requires size: "); Serial.print(strSize * 4);
-            Serial.print("\nVacant bits: "); Serial.print(vacantBits);
-            Serial.println("\nBad Conversion");
-            Serial.flush();
-            return -ERR_BAD_CONVERSION;
+    // set a default parsed value
+    *out = 0;
+    clear_reg(r, bits);
+
+    notify_input_and_busy_wait_for_serial_input(message);
+
+    // hex or bin number with prefix, or a decimal without
+    c = next_input_char();
+    if (c == '0') {
+        c = next_input_char();
+        if (c == 'x' || c == 'X') {
+            base = 16;
+            c = next_input_char();
+        }
+        else if (c == 'b' || c == 'B') {
+            base = 2;
+            c = next_input_char();
         }
+        else {
+            digits++; // just a leading zero
+        }
+    }
 
-        if (vacantBits == 3 && chr2hex(str[0]) > 7)
-            Serial.print("\nWarning, last digit is to large to fit register. Expect bad conversion.");
-        if (vacantBits == 2 && chr2hex(str[0]) > 3)
-            Serial.print("\nWarning, last digit is to large to fit register. Expect bad conversion.");
-        if (vacantBits == 1 && chr2hex(str[0]) > 1)
-            Serial.print("\nWarning, last digit is to large to fit register. Expect bad conversion.");
+    // MSB first: every digit multiplies the digits before it by the base
+    for (; c >= 0; c = next_input_char())
+    {
+        d = chr2hex(c);
+        if (d < 0 || d >= base) {
+            Host.print(F("\nBad digit: ")); Host.print((char)c);
+            rc = -ERR_BAD_CONVERSION;
+            break;
+        }
+        if (!reg_mul_add(r, bits, &used, base, d)) {
+            Host.print(F("\nNumber doesn't fit in ")); Host.print(bits); Host.print(F(" bits"));
+            rc = -ERR_BAD_CONVERSION;
+            break;
+        }
+        digits++;
     }
 
-    clear_reg(arr, arrSize);
+    // drop the rest of a rejected line
+    while (c >= 0)
+        c = next_input_char();
 
-    // last digit in received string is the least significant
-    for (i = strSize - 1; i >= 0; i--)
-    {
-        n = chr2hex(str[i]);
+    if (rc == OK && digits == 0) {
+        Host.println(F("\nBad prefix, didn't get number"));
+        rc = -ERR_BAD_PREFIX_OR_SUFFIX;
+    }
+    if (rc != OK)
+        clear_reg(r, bits);
+    else if (bits > 0)
+        *out = r[0];
 
-        if (n == -1)
-        {
-            Serial.println("\nhexStrToHexArray: bad digit type");
-            Serial.println("Bad Conversion");
-            return -ERR_BAD_CONVERSION;
-        }
+#if DEBUGSERIAL
+    Host.print(F("\ndigits: ")); Host.println(digits);
+#endif
+    return rc;
+}
 
-        // do this if we reached the last digit and arrSize < strSize * 4
-        if (i == 0 && vacantBits > 0)
+void reset_tap()
+{
+#if PRINT_RESET_TAP
+    Host.print(F("\nResetting TAP\n"));
+#endif
+    if (gang_chains)
+        gang_tms(0x1F, 5);
+    else
+        for (uint8_t i = 0; i < 5; ++i)
         {
-            switch (vacantBits)
-            {
-            case 3: // only hex digits [0, 7] may be written to last 3 bits of arr
-                if (n & 0x04)
-                    arr[j + 2] = 1;
-
-            case 2: // only hex digits [0, 3] may be written to last 2 bits of arr
-                if (n & 0x02)
-                    arr[j + 1] = 1;
-
-            case 1: // only hex digits [0, 1] may be written to last 1 bit of arr
-                if (n & 0x01)
-                    arr[j] = 1;
-            default:
-                break;  // break out of switch statement
-            }
-            break;  // break out of for loop
+            TMS_WRITE(1);
+            TCK_WRITE(0); HC;
+            TCK_WRITE(1); HC;
         }
+    if (trace_on)
+        trace_tms(current_state, 0x1F, 5);
+    current_state = TEST_LOGIC_RESET;
+    stats.tck_cycles += 5;
+    stats.tms_cycles += 5;
+}
+
+/**
+ * @brief Clock out a TMS sequence, one TCK cycle per bit. TDI is left as is.
+ * @param bits TMS values, bit 0 is clocked first.
+ * @param len Number of TCK cycles.
+ */
+static void clock_tms(uint16_t bits, uint8_t len)
+{
+    stats.tck_cycles += len;
+    stats.tms_cycles += len;
+
+    // the callers move current_state once the path is clocked
+    if (trace_on)
+        trace_tms(current_state, bits, len);
 
-        // copy nibble bits to destination array (LSB first)
-        if (n & 0x01)
-            arr[j] = 1;
-        if (n & 0x02)
-            arr[j + 1] = 1;
-        if (n & 0x04)
-            arr[j + 2] = 1;
-        if (n & 0x08)
-            arr[j + 3] = 1;
-
-        j += 4; // update destination array index
+    if (gang_chains) {
+        gang_tms(bits, len);
+        return;
     }
+    for (uint8_t i = 0; i < len; i++)
+    {
+        TMS_WRITE(bits & 1);
+        TCK_WRITE(0); HC;
+        TCK_WRITE(1); HC;
+        bits >>= 1;
+    }
+}
 
-    return OK;
+/**
+ * @brief Move to CAPTURE_DR or CAPTURE_IR and one step further into the
+ * corresponding shift state, in a single burst of TMS bits.
+ * TMS is left low, ready for shifting.
+ * @param capture_state CAPTURE_DR or CAPTURE_IR.
+ */
+static void goto_shift_state(uint8_t capture_state)
+{
+    uint16_t path = tms_paths[current_state][capture_state];
+
+    // the extra step from capture to shift is a TMS 0 bit
+    clock_tms(TMS_PATH_BITS(path), TMS_PATH_LEN(path) + 1);
+    current_state = (tap_state)(capture_state + 1);
+
+    if (capture_state == CAPTURE_IR)
+        stats.ir_scans++;
+    else
+        stats.dr_scans++;
 }
 
-int decStrToBinArray(uint8_t* arr, int arrSize, String str, int strSize)
+/**
+ * @brief Background work between the words of a scan: the serial rings drain
+ * and fill, then scan_poll_hook runs.
+ */
+static inline void scan_poll()
 {
-    int i = 0;
-    int j = 0;
-    int vacantBits = 0;
-    uint8_t n = 0;
-    
-    if (strSize * 4 > arrSize)
-    {
-        // check how many bits left on arr that can be populated with bits from the last digit.
-        vacantBits = 4 - ((strSize * 4) - arrSize);  // nibble size in bits - (str digit * nibble size) - arr size in bits
+    Host.pump();
+    if (scan_poll_hook != NULL)
+        scan_poll_hook();
+}
 
-        // maybe the last digit can fit in the 1,2, or 3 bits of the last digit
-        if (vacantBits <= 0)
+/**
+ * @brief Shift n padding bits (ones) in the current shift state.
+ * @param n Number of bits.
+ * @param last If true, exit the shift state together with the last bit.
+ */
+static void shift_pad(uint16_t n, bool last)
+{
+    if (gang_chains)
+        gang_pad(n, last);
+    else {
+        TDI_WRITE(1);
+        for (uint16_t i = 0; i < n; i++)
         {
-            Serial.print("\ndecStrToBinArray: destination array not large enough");
-            Serial.print("\nDestination array size in bits: "); Serial.print(arrSize);
-            Serial.print("\nString requires size: "); Serial.print(strSize * 4);
-            Serial.print("\nVacant bits: "); Serial.print(vacantBits);
-            Serial.println("\nBad Conversion");
-            Serial.flush();
-            return -ERR_BAD_CONVERSION;
+            if (last && i == n - 1)
+                TMS_WRITE(1);
+            TCK_WRITE(0); HC;
+            TCK_WRITE(1); HC;
         }
-        if (vacantBits == 3 && chr2hex(str[0]) > 7)
-            Serial.print("\nWarning, last digit is to large to fit register. Expect bad conversion.");
-        if (vacantBits == 2 && chr2hex(str[0]) > 3)
-            Serial.print("\nWarning, last digit is to large to fit register. Expect bad conversion.");
-        if (vacantBits == 1 && chr2hex(str[0]) > 1)
-            Serial.print("\nWarning, last digit is to large to fit register. Expect bad conversion.");
     }
 
-    clear_reg(arr, arrSize);
+    for (uint16_t i = 0; trace_on && i < n; i += REG_WORD_BITS)
+        trace_shift(current_state, ~(reg_t)0, 0, n - i < REG_WORD_BITS ? n - i : REG_WORD_BITS,
+                    last && n - i <= REG_WORD_BITS);
+}
 
-    // last digit in received string is the least significant
-    for (i = strSize - 1; i >= 0; i--)
-    {
-        n = chr2hex(str[i]);
+/**
+ * @brief Shift len bits of a packed register through the currently selected
+ * register (current state must be SHIFT_DR or SHIFT_IR). TDI and TDO are
+ * handled a whole word at a time. The last bit is shifted together with
+ * TMS = 1, so the TAP leaves the shift state to the corresponding EXIT1 state.
+ * Padding bits for the BYPASSed TAPs of a chain may surround the register
+ * bits, their TDO bits are dropped.
+ * @param in Pointer to the bits to shift in. (packed bits)
+ * @param len Number of bits to shift.
+ * @param out Pointer to the register that receives the shifted out bits.
+ * @param pre Number of padding bits (ones) shifted before the register bits.
+ * @param post Number of padding bits (ones) shifted after the register bits.
+ */
+static void shift_reg(reg_t* in, uint16_t len, reg_t* out, uint16_t pre, uint16_t post)
+{
+    uint16_t words = REG_WORDS(len);
+    uint16_t w = 0;
+    uint8_t b = 0;
+    uint8_t bits = REG_WORD_BITS;
+    reg_t tdi = 0;
+    reg_t tdo = 0;
+    reg_t head = 0;
+    reg_t tdi_first = 0;
+    uint8_t b_first = 0;
+    uint16_t start = 0;
+#if HW_SHIFT
+    uint16_t n = 0;
+#endif
+
+    stats.tck_cycles += pre + len + post;
+    stats.bits_shifted += pre + len + post;
+
+    shift_pad(pre, false);
 
-        if (n == -1)
+#if HW_SHIFT
+    // the SPI shifts the whole bytes, except the one with the last bit (TMS = 1)
+    if (hw_shift_khz != 0 && !tck_rtck && !gang_chains && len >= HW_SHIFT_MIN_BITS) {
+        start = (post ? len : len - 1) & ~7;
+        if (start % REG_WORD_BITS)
+            head = in[start / REG_WORD_BITS];   // in and out may be the same register
+
+        for (w = 0; w < start / 8; w += n)
         {
-            Serial.println("\nhexStrToHexArray: bad digit type");
-            Serial.println("Bad Conversion");
-            return -ERR_BAD_CONVERSION;
+            n = start / 8 - w;
+            if (n > HW_SHIFT_CHUNK)
+                n = HW_SHIFT_CHUNK;
+            hw_shift_bytes(in + w / 4, out + w / 4, n);
+            scan_poll();
+        }
+        if (trace_on)
+            trace_run(current_state, 0, start);
+    }
+#endif
+
+    for (w = start / REG_WORD_BITS; w < words; w++)
+    {
+        tdi = in[w];
+        tdo = 0;
+        b = 0;
+
+        // the first bits of this word were shifted by the SPI
+        if (w == start / REG_WORD_BITS && start % REG_WORD_BITS) {
+            b = start % REG_WORD_BITS;
+            tdi = head >> b;
+            tdo = out[w] & (((reg_t)1 << b) - 1);
+        }
+
+        // the last word may be partially used
+        if (w == words - 1)
+            bits = len - w * REG_WORD_BITS;
+        tdi_first = tdi;
+        b_first = b;
+
+        // every chain of the gang shifts the word at once
+        if (gang_chains) {
+            tdo |= gang_shift(tdi, b, bits, w == words - 1 && post == 0, w);
+            b = bits;
         }
 
-        // do this if we reached the last digit and arrSize < strSize * 4
-        if (i == 0 && vacantBits > 0)
+        for (; b < bits; b++)
         {
-            switch (vacantBits)
-            {
-            case 3: // only hex digits [0, 7] may be written to last 3 bits of arr
-                if (n & 0x04)
-                    arr[j + 2] = 1;
-
-            case 2: // only hex digits [0, 3] may be written to last 2 bits of arr
-                if (n & 0x02)
-                    arr[j + 1] = 1;
-
-            case 1: // only hex digits [0, 1] may be written to last 1 bit of arr
-                if (n & 0x01)
-                    arr[j] = 1;
-            default:
-                break;  // break out of switch statement
-            }
-            break;  // break out of for loop
+            // exit the shift state together with the last bit
+            if (w == words - 1 && b == bits - 1 && post == 0)
+                TMS_WRITE(1);
+
+            TDI_WRITE(tdi & 1);
+            TCK_WRITE(0); HC;
+            TCK_WRITE(1); HC;
+            tdo |= (reg_t)TDO_READ() << b;  // read the shifted out bits. LSB first
+            tdi >>= 1;
         }
+        out[w] = tdo;
+
+        if (trace_on)
+            trace_shift(current_state, tdi_first, tdo >> b_first, bits - b_first, w == words - 1 && post == 0);
+
+        // let background work (e.g. serial reception) run during long scans
+        scan_poll();
+    }
+
+    shift_pad(post, true);
+}
+
+void insert_dr(reg_t* dr_in, uint16_t dr_len, uint8_t end_state, reg_t* dr_out)
+{
+    // pass through CAPTURE_DR on the way to SHIFT_DR
+    goto_shift_state(CAPTURE_DR);
+
+    // shift data bits into DR. make sure that first bit is LSB.
+    // the last DR bit is shifted while moving to EXIT1_DR.
+    shift_reg(dr_in, dr_len, dr_out, 0, 0);
+    current_state = EXIT1_DR;
+
+    goto_state(end_state);
+}
+
+void insert_ir(reg_t* ir_in, uint8_t ir_len, uint8_t end_state, reg_t* ir_out)
+{
+    // pass through CAPTURE_IR on the way to SHIFT_IR
+    goto_shift_state(CAPTURE_IR);
+
+    // shift data bits into the IR. make sure that first bit is LSB.
+    // the last IR bit is shifted while moving to EXIT1_IR.
+    shift_reg(ir_in, ir_len, ir_out, 0, 0);
+    current_state = EXIT1_IR;
+
+    goto_state(end_state);
+}
 
-        // copy nibble bits to destination array (LSB first)
-        if (n & 0x01)
-            arr[j] = 1;
-        if (n & 0x02)
-            arr[j + 1] = 1;
-        if (n & 0x04)
-            arr[j + 2] = 1;
-        if (n & 0x08)
-            arr[j + 3] = 1;
-
-        j += 4;  // update destination array index
+int scan_stream_begin(scan_stream_t* s, bool is_ir, uint32_t len, uint8_t end_state, tap_t* tap)
+{
+    s->left = 0;
+    if (end_state > UPDATE_IR)
+        return -ERR_BAD_TAP_STATE;
+    if (len == 0)
+        return -ERR_UNVALID_IR_OR_DR_LEN;
+
+    goto_shift_state(is_ir ? CAPTURE_IR : CAPTURE_DR);
+    s->left = len;
+    s->shift_state = is_ir ? SHIFT_IR : SHIFT_DR;
+    s->end_state = end_state;
+    s->post = 0;
+
+    // the padding of the other TAPs goes around the whole scan, not every chunk
+    if (tap != NULL) {
+        s->post = is_ir ? tap->ir_suffix : tap->dr_suffix;
+        shift_pad(is_ir ? tap->ir_prefix : tap->dr_prefix, false);
+        stats.tck_cycles += is_ir ? tap->ir_prefix : tap->dr_prefix;
+        stats.bits_shifted += is_ir ? tap->ir_prefix : tap->dr_prefix;
     }
+    return OK;
+}
+
+int scan_stream_shift(scan_stream_t* s, reg_t* in, uint16_t len, reg_t* out)
+{
+    bool last = len == s->left;
 
+    if (s->left == 0 || len == 0 || len > s->left)
+        return -ERR_UNVALID_IR_OR_DR_LEN;
+
+    // back from PAUSE through EXIT2, nothing is clocked for the first chunk
+    goto_state(s->shift_state);
+
+    // every chunk but the last leaves SHIFT with its last bit, to EXIT1 and PAUSE
+    shift_reg(in, len, out, 0, last ? s->post : 0);
+    current_state = (tap_state)(s->shift_state + 1);
+    s->left -= len;
+
+    goto_state(last ? s->end_state : s->shift_state + 2);
     return OK;
 }
 
-int intToBinArray(uint8_t* arr, uint32_t n, uint16_t len)
+void run_test_idle(uint32_t cycles)
 {
-    if (len > 32) // TODO: increase this to 64 or 256 or max_dr_len actually ?
-    {
-        Serial.print("\nintToBinArray: array size is larger than 32");
-        Serial.println("\nBad Conversion");
-        return -ERR_BAD_CONVERSION;
+    goto_state(RUN_TEST_IDLE);
+    if (trace_on)
+        trace_run(RUN_TEST_IDLE, 0, cycles);
+
+    if (gang_chains)
+        gang_idle(0, cycles);
+    else {
+        TMS_WRITE(0);
+        for (uint32_t i = 0; i < cycles; i++)
+        {
+            TCK_WRITE(0); HC;
+            TCK_WRITE(1); HC;
+        }
     }
-    uint32_t mask = 1;
+    stats.tck_cycles += cycles;
+}
+
+int clock_state(uint32_t cycles, uint32_t us)
+{
+    uint32_t start = micros();
+    uint32_t i = 0;
+
+    // only the stable states can be held while TCK runs
+    if (current_state != TEST_LOGIC_RESET && current_state != RUN_TEST_IDLE &&
+        current_state != PAUSE_DR && current_state != PAUSE_IR)
+        return -ERR_BAD_TAP_STATE;
 
-    clear_reg(arr, len);
+    TMS_WRITE(current_state == TEST_LOGIC_RESET ? 1 : 0);
+    while (i < cycles || (uint32_t)(micros() - start) < us)
+    {
+        if (gang_chains)
+            gang_idle(current_state == TEST_LOGIC_RESET, 1);
+        else {
+            TCK_WRITE(0); HC;
+            TCK_WRITE(1); HC;
+        }
+        i++;
 
-    for (int i = 0; i < len; i++) {
-        if (n & mask)
-            arr[i] = 1;
-        else
-            arr[i] = 0;
-        mask <<= 1;
+        // long waits (e.g. flash programming) keep the serial reception going
+        if ((i & 0x1F) == 0)
+            scan_poll();
     }
+    stats.tck_cycles += i;
+    if (trace_on)
+        trace_run(current_state, current_state == TEST_LOGIC_RESET, i);
 
     return OK;
 }
 
-void notify_input_and_busy_wait_for_serial_input(const char* message)
+int wait_ready(ready_cond_t ready, void* ctx, uint32_t min_cycles, uint32_t max_us, uint32_t* waited_us)
 {
-    clear_serial_rx_buf(); // first, clean the input buffer
-    Serial.print(message); // notify user to input a value
-    Serial.flush();
-    while (Serial.available() == 0) {}
+    uint32_t start = micros();
+    uint32_t elapsed = 0;
+    int rc = OK;
+
+    goto_state(RUN_TEST_IDLE);
+    clock_state(min_cycles, ready == NULL ? max_us : 0);
+
+    // the condition is checked once more after the bound, the device may just have finished
+    while (ready != NULL && !ready(ctx))
+    {
+        if ((uint32_t)(micros() - start) >= max_us) {
+            rc = -ERR_TIMEOUT;
+            break;
+        }
+        clock_state(WAIT_POLL_CYCLES, 0);
+    }
+
+    elapsed = micros() - start;
+    stats.ready_us += elapsed;
+    if (waited_us != NULL)
+        *waited_us = elapsed;
+    return rc;
 }
 
-char getCharacter(const char* message)
+bool dr_status_ready(void* ctx)
 {
-    char inChar[1] = {0};
+    dr_status_t* status = (dr_status_t*)ctx;
+    reg_t zero[1] = {0};
+    reg_t captured[1] = {0};
+
+    insert_dr(zero, status->len, RUN_TEST_IDLE, captured);
+    if (gang_chains)
+        return gang_match(status->value, status->mask) == gang_all();
+    return (captured[0] & status->mask) == status->value;
+}
 
-    notify_input_and_busy_wait_for_serial_input(message);
-    Serial.readBytesUntil('\n', inChar, 1);
-    char chr = inChar[0];
+void insert_dr_tap(tap_t* tap, reg_t* dr_in, uint16_t dr_len, uint8_t end_state, reg_t* dr_out)
+{
+    goto_shift_state(CAPTURE_DR);
 
-#if DEBUGSERIAL
-    Serial.print("\nchar: "); Serial.println(chr);
-    Serial.flush();
-#endif
-    return chr;
-}
+    // the other TAPs are in BYPASS, one padding bit each
+    shift_reg(dr_in, dr_len, dr_out, tap->dr_prefix, tap->dr_suffix);
+    current_state = EXIT1_DR;
 
+    goto_state(end_state);
+}
 
-String getString(const char* message)
+void insert_ir_tap(tap_t* tap, reg_t* ir_in, uint8_t end_state, reg_t* ir_out)
 {
-    String str;
+    goto_shift_state(CAPTURE_IR);
 
-    notify_input_and_busy_wait_for_serial_input(message);
-    str = Serial.readStringUntil('\n');
+    // the other TAPs get the all ones BYPASS instruction
+    shift_reg(ir_in, tap->ir_len, ir_out, tap->ir_prefix, tap->ir_suffix);
+    current_state = EXIT1_IR;
 
-#if DEBUGSERIAL
-    Serial.print("\nstring: ");	Serial.println(str);
-    Serial.print("string length = "); Serial.println(str.length());
-    Serial.flush();
-#endif
-    return str;
+    goto_state(end_state);
 }
 
-void fetchNumber(const char* message)
+void clear_reg(reg_t* reg, uint16_t len)
 {
-    notify_input_and_busy_wait_for_serial_input(message);
-    digits = Serial.readStringUntil('\n');
+    for (uint16_t i = 0; i < REG_WORDS(len); i++)
+        reg[i] = 0;
+}
 
-#if DEBUGSERIAL
-    Serial.print("\ndigits: ");	Serial.println(digits);
-    Serial.print("digits length = "); Serial.println(digits.length());
-    Serial.flush();
-#endif
+void flush_ir_dr(reg_t* ir_reg, reg_t* dr_reg, uint16_t ir_len, uint16_t dr_len)
+{
+    clear_reg(ir_reg, ir_len);
+    clear_reg(dr_reg, dr_len);
 }
 
-uint32_t getInteger(int num_bytes, const char* message)
+int measure_dr_len(uint16_t max_len)
 {
-    char myData[num_bytes];
+    uint32_t window = 0;
+    uint32_t seen_ones = 0;
+    uint32_t seen_zeros = 0;
+    uint32_t t = 0;
+    uint32_t candidate = 0;
+    uint8_t confirm = 0;
+    uint8_t tdo = 0;
+    int rc = 0;
+
+    /*
+        no flush: the marker is shifted in right away, followed by ones,
+        while the last 32 TDO bits are compared against it. the captured
+        content may imitate the marker, but then it is followed by the
+        real marker bits and not by DR_MARKER_CONFIRM ones.
+    */
+    goto_state(SHIFT_DR);
 
-    size_t m = Serial.readBytesUntil('\n', myData, num_bytes);
-    myData[m] = '\0';  // insert null charcater
+    for (t = 0; t < (uint32_t)max_len + 32 + DR_MARKER_CONFIRM; t++)
+    {
+        TDI_WRITE(t < 32 ? (DR_MARKER >> t) & 1 : 1);
+        advance_tap_state(SHIFT_DR);
 
-#if DEBUGSERIAL
-    // shows: the hexadecimal string from user
-    Serial.print("myData: "); Serial.println(myData);
-#endif
-    // convert string to hexadeciaml value
-    uint32_t z = strtol(myData, NULL, 16);
+        tdo = TDO_READ();
+        window = (window >> 1) | ((uint32_t)tdo << 31);
+        if (tdo) seen_ones++; else seen_zeros++;
+
+        if (t >= 31 && window == DR_MARKER) {
+            // the marker entered at t = 0 left the register at t = len
+            candidate = t - 31;
+            confirm = 0;
+        }
+        else if (candidate != 0) {
+            if (tdo == 0)
+                candidate = 0;
+            else if (++confirm == DR_MARKER_CONFIRM)
+                break;
+        }
+    }
+
+    goto_state(RUN_TEST_IDLE);
+
+    if (candidate != 0 && confirm == DR_MARKER_CONFIRM && candidate <= max_len)
+        rc = candidate;
+    else if (seen_zeros == 0)
+        rc = -ERR_TDO_STUCK_AT_1;
+    else if (seen_ones == 0)
+        rc = -ERR_TDO_STUCK_AT_0;
+
+    return rc;
+}
+
+uint32_t detect_dr_len(reg_t* instruction, uint8_t ir_len, uint32_t process_ticks)
+{	
+    // make sure that current state is TLR prior this calling this function.
+
+    // temporary register to strore the shifted out bits from IR
+    reg_t tmp[REG_WORDS(MAX_IR_LEN)];
+    int len = 0;
+
+    // insert the instruction we wish to check into ir
+    insert_ir(instruction, ir_len, RUN_TEST_IDLE, tmp);
+    
+    // a couple of clock cycles to process the instruction, no status to poll
+    wait_ready(NULL, NULL, process_ticks, 0, NULL);
 
-#if DEBUGSERIAL
-    Serial.print("received: 0x");
-    Serial.println(z, HEX); // shows 12A3
-    Serial.flush();
-#endif
-    return z;
+    len = measure_dr_len(MAX_DR_LEN);
+    return len > 0 ? len : 0;
 }
 
-int parseNumber(uint8_t* dest, uint16_t size, const char* message, uint32_t* out)
+int discovery_sweep(uint32_t first, uint32_t last, uint16_t max_dr_len, uint8_t ir_len,
+                    reg_t* ir_in, discovery_report_t report, uint32_t* next)
 {
+    reg_t tmp[REG_WORDS(MAX_IR_LEN)];
+    uint32_t instruction = first;
+    bool done = false;
+    int len = 0;
     int rc = OK;
-    char prefix = '0';
-    
-    // set a default parsed value
-    *out = 0;
 
-    // fetch the digits from the Serial interface
-    fetchNumber(message);
-    
-    // received hex or bin number with prefix or a decimal witout prefix
-    if (digits.length() >= 2)
-        prefix = digits[1];	
-    // else, no prefix, just a decimal number with 1 digit
+    if (max_dr_len == 0 || max_dr_len > MAX_DR_LEN)
+        max_dr_len = MAX_DR_LEN;
+
+    reset_tap();
 
-    switch (prefix)
+    for (instruction = first; instruction <= last; instruction++)
     {
-    // user sent hexadecimal format
-    case 'x':
-        // cut out the digits without the prefix
-        digits = digits.substring(2);
-
-        if (dest != NULL) {
-            rc = hexStrToBinArray(dest, size, digits, digits.length());
-            if (rc != OK)
-                goto exit;
-        }
+        // reset tap, some instructions don't like to be left behind
+        reset_tap();
+
+        intToBinArray(ir_in, instruction, ir_len);
+        insert_ir(ir_in, ir_len, RUN_TEST_IDLE, tmp);
+        run_test_idle(4);
 
-        // Prepare the character array (the buffer)
-        char tmp[digits.length() + 1];  // with 1 extra char for '/0'
-        // convert String to char array
-        digits.toCharArray(tmp, digits.length() + 1);
-        // add null terminator
-        tmp[digits.length()] = '\0';
-        // convert to unsigned int
-        *out = strtoul(tmp, NULL, 16);
-        break;
-
-    // user sent binary format
-    case 'b':
-        // cut out the digits without the prefix
-        digits = digits.substring(2);
-
-        // convert binary to integer
-        if (dest != NULL) {
-            rc = binStrToBinArray(dest, size, digits, digits.length());
-            if (rc != OK)
-                goto exit;
+        len = measure_dr_len(max_dr_len);
+        if (len == -ERR_TDO_STUCK_AT_1 || len == -ERR_TDO_STUCK_AT_0) {
+            rc = len;
+            break;
         }
 
-        rc = binStringToInt(digits, out);
-        break;
+        if (!report(instruction, len)) {
+            instruction++;
+            break;
+        }
 
-    // user sent decimal format
-    default:
-        if (isDigit(prefix) && digits.length() > 0)
-        {
-            // construct a whole decimal from the string
-            char tmp[digits.length() + 1];
-            digits.toCharArray(tmp, digits.length() + 1);
-            tmp[digits.length()] = '\0';
-            *out = strtoul(tmp, NULL, 10);
-
-            if (dest != NULL) {
-                rc = intToBinArray(dest, *out, size);
-            }
-        } else {
-            Serial.println("\nBad prefix, didn't get number");
-            rc = -ERR_BAD_PREFIX_OR_SUFFIX;
+        // last may be 0xFFFFFFFF, the loop can't step past it
+        if (instruction == last) {
+            done = true;
+            break;
         }
-        break;
     }
 
-exit:
+    reset_tap();
+
+    if (done)
+        instruction++;
+    *next = instruction;
     return rc;
 }
 
-void reset_tap()
+/**
+ * @brief Print a discovery result, stop when the user hits a key.
+ */
+static bool discovery_print(uint32_t instruction, uint16_t len)
 {
-#if PRINT_RESET_TAP
-    Serial.print("\nResetting TAP\n");
-#endif
-    for (uint8_t i = 0; i < 5; ++i)
-    {
-        digitalWrite(TMS, 1);
-        digitalWrite(TCK, 0); HC;
-        digitalWrite(TCK, 1); HC;
-    }
-    current_state = TEST_LOGIC_RESET;
+    Host.print(F("\nIR 0x")); Host.print(instruction, HEX);
+    Host.print(F(" ... ")); Host.print(len, DEC);
+
+    return Host.available() == 0;
 }
 
-void insert_dr(uint8_t* dr_in, uint8_t dr_len, uint8_t end_state, uint8_t* dr_out)
+int discovery(uint32_t first, uint32_t last, uint16_t max_dr_len, reg_t* ir_in)
 {
-    // make sure that current state is TLR
-    uint16_t i = 0;
-
-    advance_tap_state(RUN_TEST_IDLE);
-    advance_tap_state(SELECT_DR);
-    advance_tap_state(CAPTURE_DR);
-    advance_tap_state(SHIFT_DR);
+    uint32_t next = 0;
+    int rc = OK;
 
-    // shift data bits into DR. make sure that first bit is LSB
-    for (i = 0; i < dr_len - 1; i++)
-    {
-        digitalWrite(TDI, dr_in[i]);
-        digitalWrite(TCK, 0); HC;
-        digitalWrite(TCK, 1); HC;
-        dr_out[i] = digitalRead(TDO);  // read the shifted out bits . LSB first
-    }
+    // discover all dr lengths corresponding to their ir.
+    Host.print(F("\n\nDiscovery of instructions from 0x")); Host.print(first, HEX);
+    Host.print(F(" to 0x")); Host.println(last, HEX);
+    Host.print(F("(hit any key to stop)\n"));
 
-    // read and write the last DR bit and continue to the end state
-    digitalWrite(TDI, dr_in[i]);
-    advance_tap_state(EXIT1_DR);
-    dr_out[i] = digitalRead(TDO); 
+    rc = discovery_sweep(first, last, max_dr_len, ir_len, ir_in, discovery_print, &next);
 
-    advance_tap_state(UPDATE_DR);
+    if (rc == -ERR_TDO_STUCK_AT_1)
+        Host.println(F("\nDiscovery: TDO is stuck at 1"));
+    else if (rc == -ERR_TDO_STUCK_AT_0)
+        Host.println(F("\nDiscovery: TDO is stuck at 0"));
 
-    if (end_state == RUN_TEST_IDLE){	
-        advance_tap_state(RUN_TEST_IDLE);
-    }
-    else if (end_state == SELECT_DR){
-        advance_tap_state(SELECT_DR);
-    }
-    else if (end_state == TEST_LOGIC_RESET){
-        reset_tap();
+    if (next <= last) {
+        while (Host.available() > 0)
+            Host.read();
+        Host.print(F("\nStopped, resume from 0x")); Host.print(next, HEX);
     }
+
+    Host.println(F("\n\n   Done"));
+    return rc;
 }
 
-void insert_ir(uint8_t* ir_in, uint8_t ir_len, uint8_t end_state, uint8_t* ir_out)
+void taps_init(tap_t* taps)
 {
-    // Make sure that current state is TLR
-    uint8_t i = 0;
-
-    advance_tap_state(RUN_TEST_IDLE);
-    advance_tap_state(SELECT_DR);
-    advance_tap_state(SELECT_IR);
-    advance_tap_state(CAPTURE_IR);
-    advance_tap_state(SHIFT_IR);
-
-    // shift data bits into the IR. make sure that first bit is LSB
-    for (i = 0; i < ir_len - 1; i++)
+    for (size_t i = 0; i < MAX_ALLOWED_TAPS; i++)
     {
-        digitalWrite(TDI, ir_in[i]);
-        digitalWrite(TCK, 0); HC;
-        digitalWrite(TCK, 1); HC;
-        ir_out[i] = digitalRead(TDO);  // read the shifted out bits. LSB first
+        taps[i].num = i;
+        taps[i].idcode = 0;
+        taps[i].ir_len = 0;
+        taps[i].ir_prefix = 0;
+        taps[i].ir_suffix = 0;
+        taps[i].dr_prefix = 0;
+        taps[i].dr_suffix = 0;
+        taps[i].name[0] = '\0';
+        taps[i].is_jtag_swd = 0; // jtag=0, swd=1
+        taps[i].tck_khz = 0;
+        taps[i].ir_in = NULL;
+        taps[i].ir_out = NULL;
     }
+}
 
-    // read and write the last IR bit and continue to the end state
-    digitalWrite(TDI, ir_in[i]);
-    advance_tap_state(EXIT1_IR);
-    ir_out[i] = digitalRead(TDO);
+// the arena up to here holds the session registers, the TAP registers follow
+static uint16_t taps_mark = 0;
 
-    advance_tap_state(UPDATE_IR);
+void regs_init()
+{
+    arena_release(0);
+    dr_in = arena_alloc(MAX_DR_LEN);
+    dr_out = arena_alloc(MAX_DR_LEN);
+    ir_in = arena_alloc(MAX_IR_LEN);
+    ir_out = arena_alloc(MAX_IR_LEN);
+    taps_mark = arena_mark();
+}
 
-    if (end_state == RUN_TEST_IDLE){	
-        advance_tap_state(RUN_TEST_IDLE);
-    }
-    else if (end_state == SELECT_IR){
-        advance_tap_state(SELECT_IR);
-    }
-    else if (end_state == TEST_LOGIC_RESET){
-        reset_tap();
+void taps_alloc_regs(tap_t* taps, uint8_t count)
+{
+    // the registers of a previous detection are given back first
+    arena_release(taps_mark);
+    for (uint8_t k = 0; k < count; k++)
+    {
+        taps[k].ir_in = arena_alloc(taps[k].ir_len);
+        taps[k].ir_out = arena_alloc(taps[k].ir_len);
     }
 }
 
-void clear_reg(uint8_t* reg, uint16_t len)
+tap_t* tap_selector(tap_t* taps, int which)
 {
-    for (uint16_t i = 0; i < len; i++)
-        reg[i] = 0;
+    if (which < 0 || which >= tap_count || taps[which].ir_len == 0)
+        return NULL;
+
+    return &taps[which];
 }
 
-void flush_ir_dr(uint8_t* ir_reg, uint8_t* dr_reg, uint16_t ir_len, uint16_t dr_len)
+int goto_state(uint8_t target)
 {
-    clear_reg(ir_reg, ir_len);
-    clear_reg(dr_reg, dr_len);
-}
+    uint16_t path = 0;
 
-uint32_t detect_dr_len(uint8_t* instruction, uint8_t ir_len, uint32_t process_ticks)
-{	
-    // make sure that current state is TLR prior this calling this function.
+    if (current_state > UPDATE_IR || target > UPDATE_IR) {
+        Host.println(F("Error: incorrent TAP state !"));
+        return -ERR_BAD_TAP_STATE;
+    }
 
-    // temporary array to strore the shifted out bits from IR
-    uint8_t tmp[ir_len];
-    uint32_t i = 0;
-    uint32_t counter = 0;
+    path = tms_paths[current_state][target];
+    clock_tms(TMS_PATH_BITS(path), TMS_PATH_LEN(path));
+    current_state = (tap_state)target;
+    return OK;
+}
 
-    // insert the instruction we wish to check into ir
-    insert_ir(instruction, ir_len, RUN_TEST_IDLE, tmp);
-    
-    // a couple of clock cycles to process the instruction
-    for (i = 0; i < process_ticks; i++)
-    {
-        HC; HC;
+int advance_tap_state(uint8_t next_state)
+{
+    uint8_t tms = 0;
+
+    if (current_state > UPDATE_IR) {
+        Host.println(F("Error: incorrent TAP state !"));
+        return -ERR_BAD_TAP_STATE;
     }
 
-    /* 
-        check the length of the DR register between TDI and TDO
-        by inserting many ones (MAX_DR_LEN) to clean the register.
-        afterwards, insert a single zero and start counting the amount
-        of TCK clock cycles till the appearence of that zero in TDO.
-    */
-    advance_tap_state(SELECT_DR);
-    advance_tap_state(CAPTURE_DR);
-    advance_tap_state(SHIFT_DR);
+    // only a single legal step is taken, otherwise stay in place
+    if (next_state == tap_transitions[current_state][0])
+        tms = 0;
+    else if (next_state == tap_transitions[current_state][1])
+        tms = 1;
+    else
+        return -ERR_BAD_TAP_STATE;
+
+    clock_tms(tms, 1);
+    current_state = (tap_state)next_state;
+    return OK;
+}
 
-    digitalWrite(TDI, 1);
-    for (i = 0; i < MAX_DR_LEN; ++i)
+uint32_t measure_tck_khz()
+{
+    uint32_t start = 0;
+    uint32_t elapsed = 0;
+    uint8_t tms = 0;
+
+    // clock in a state that loops on itself so nothing is shifted
+    if (current_state == TEST_LOGIC_RESET)
+        tms = 1;
+    else if (current_state != RUN_TEST_IDLE && current_state != PAUSE_DR && current_state != PAUSE_IR)
+        return 0;
+    TMS_WRITE(tms);
+
+    start = micros();
+    for (uint32_t i = 0; i < TCK_MEASURE_CYCLES; i++)
     {
-        advance_tap_state(SHIFT_DR);
+        TCK_WRITE(0); HC;
+        TCK_WRITE(1); HC;
     }
+    elapsed = micros() - start;
+    stats.tck_cycles += TCK_MEASURE_CYCLES;
+    if (trace_on)
+        trace_run(current_state, tms, TCK_MEASURE_CYCLES);
 
-    digitalWrite(TDI, 0);
-    advance_tap_state(SHIFT_DR);
+    if (elapsed == 0)
+        elapsed = 1;
 
-    digitalWrite(TDI, 1);
-    for (i = 0; i < MAX_DR_LEN; ++i)
-    {
-        advance_tap_state(SHIFT_DR);
+    return (uint32_t)((uint64_t)TCK_MEASURE_CYCLES * 1000 / elapsed);
+}
 
-        if (digitalRead(TDO) == 0){
-            ++counter;
-            return counter;
-        }
-        counter++;
-    }
+void measure_tck_max()
+{
+    uint32_t delay_us = tck_delay_us;
+    uint32_t delay_loops = tck_delay_loops;
 
-    return 0;
+    tck_delay_us = 0;
+    tck_delay_loops = 0;
+    reset_tap();
+    tck_max_khz = measure_tck_khz();
+    tck_delay_us = delay_us;
+    tck_delay_loops = delay_loops;
 }
 
-int discovery(uint32_t first, uint32_t last, uint16_t max_dr_len, uint8_t* ir_in, uint8_t* ir_out)
+uint32_t set_tck_khz(uint32_t khz)
 {
-    uint32_t instruction, len = 0;
-    int rc = OK;
-
-    // discover all dr lengths corresponding to their ir.
-    Serial.print("\n\nDiscovery of instructions from 0x"); Serial.print(first, HEX);
-    Serial.print(" to 0x"); Serial.println(last, HEX);
+    uint32_t half_ns = 0;
+    uint32_t max_half_ns = 0;
 
-    for (instruction=first; instruction <= last; instruction++)
-    {
-        // reset tap
-        reset_tap();
-        len = 0;
+    // a fixed rate replaces adaptive clocking
+    tck_rtck = false;
+    hw_shift_set_khz(khz);
 
-        // prepare to shift instruction
-        intToBinArray(ir_in, instruction, ir_len);
+    tck_delay_us = 0;
+    tck_delay_loops = 0;
 
-        Serial.print("\nDetecting DR length for IR: ");
-        printArray(ir_in, ir_len);
-        Serial.print(" (0x"); Serial.print(instruction, HEX); Serial.print(")");
-        Serial.flush();
+    if (khz == 0 || khz >= tck_max_khz)
+        return tck_max_khz;
 
-        len = detect_dr_len(ir_in, ir_len, 4);
-        if (len == max_dr_len) {
-            Serial.println("\nDiscovery: TDO is stuck at 1");
-            rc = -ERR_TDO_STUCK_AT_1;
-            break;
-        }
+    // the pin writes alone take the half period of the boot measurement
+    half_ns = 500000 / khz;
+    max_half_ns = 500000 / tck_max_khz;
 
-        Serial.print(" ... "); Serial.print(len, DEC);
-        Serial.flush();
+    if (half_ns >= 20000) {
+        tck_delay_us = half_ns / 1000;
+        half_ns = tck_delay_us * 1000 + max_half_ns;
+    }
+    else {
+        // busy loop for the time that the pin writes alone don't take
+        tck_delay_loops = ((uint64_t)(half_ns - max_half_ns) * (F_CPU / 1000000)
+                           + 500 * TCK_LOOP_CYCLES) / (1000 * TCK_LOOP_CYCLES);
+        half_ns = max_half_ns + (uint64_t)tck_delay_loops * TCK_LOOP_CYCLES * 1000
+                  / (F_CPU / 1000000);
     }
 
-    reset_tap();
-    Serial.println("\n\n   Done");
-    return rc;
+    return (500000 + half_ns / 2) / half_ns;
 }
 
-void taps_init(tap_t* taps)
+int check_chain_integrity(uint32_t seed, uint8_t* bad)
 {
-    for (size_t i = 0; i < MAX_ALLOWED_TAPS; i++)
-    {
-        taps[i].num = i;
-        taps[i].idcode = 0;
-        taps[i].ir_len = 0;
-        taps[i].name = {0};
-        taps[i].is_jtag_swd = 0; // jtag=0, swd=1
-    }
-}
+    reg_t in[REG_WORDS(MAX_ALLOWED_TAPS * 32 + 64)];
+    reg_t out[REG_WORDS(MAX_ALLOWED_TAPS * 32 + 64)];
+    uint32_t x = seed | 1;
+    uint16_t len = 0;
+    uint16_t ir_total = 0;
+    uint16_t pos = 0;
+    uint16_t i = 0;
+    uint8_t k = 0;
 
-tap_t* tap_selector(tap_t* taps, int which)
-{
+    *bad = tap_count;
+    if (tap_count == 0)
+        return -ERR_BAD_IDCODE;
 
-}
+    // a different pattern for every check (xorshift32)
+    for (i = 0; i < REG_WORDS(MAX_ALLOWED_TAPS * 32 + 64); i++)
+    {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        in[i] = x;
+    }
 
-int advance_tap_state(uint8_t next_state)
-{
-    int rc = OK;
+    // the IDCODE (or BYPASS) registers loaded by the reset, then the pattern
+    for (k = 0; k < tap_count; k++)
+    {
+        len += taps[k].idcode ? 32 : 1;
+        ir_total += taps[k].ir_len;
+    }
+    reset_tap();
+    insert_dr(in, len + 32, RUN_TEST_IDLE, out);
 
-    switch ( current_state )
+    for (k = 0; k < tap_count; k++)
     {
-        case TEST_LOGIC_RESET:
-            if (next_state == RUN_TEST_IDLE) {
-                // go to run test idle
-                digitalWrite(TMS, 0);
-                digitalWrite(TCK, 0); HC;
-                digitalWrite(TCK, 1); HC;
-                current_state = RUN_TEST_IDLE;
-            }
-            else if (next_state == TEST_LOGIC_RESET) {
-                // stay in test logic reset
-                digitalWrite(TMS, 1);
-                digitalWrite(TCK, 0); HC;
-                digitalWrite(TCK, 1); HC;
+        for (i = 0; i < (taps[k].idcode ? 32 : 1); i++)
+        {
+            if (reg_get_bit(out, pos + i) != ((taps[k].idcode >> i) & 1)) {
+                *bad = k;
+                return -ERR_TDO_MISMATCH;
             }
-            break;
+        }
+        pos += i;
+    }
+    for (i = 0; i < 32; i++)
+        if (reg_get_bit(out, len + i) != reg_get_bit(in, i))
+            return -ERR_TDO_MISMATCH;
 
-        case RUN_TEST_IDLE:
-            if (next_state == SELECT_DR) {
-                // go to select dr
-                digitalWrite(TMS, 1);
-                digitalWrite(TCK, 0); HC;
-                digitalWrite(TCK, 1); HC;
-                current_state = SELECT_DR;
-            }
-            else if (next_state == RUN_TEST_IDLE) {
-                // stay in run test idle
-                digitalWrite(TMS, 0);
-                digitalWrite(TCK, 0); HC;
-                digitalWrite(TCK, 1); HC;
-            }
-            break;
+    // every TAP in BYPASS delays the pattern by a single (captured 0) bit
+    for (i = 0; i < REG_WORDS(MAX_IR_LEN); i++)
+        out[i] = 0xFFFFFFFF;
+    insert_ir(out, ir_total, RUN_TEST_IDLE, out + REG_WORDS(MAX_IR_LEN));
+    insert_dr(in, tap_count + 64, RUN_TEST_IDLE, out);
 
-        case SELECT_DR:
-            if (next_state == CAPTURE_DR) {
-                // go to capture dr
-                digitalWrite(TMS, 0);
-                digitalWrite(TCK, 0); HC;
-                digitalWrite(TCK, 1); HC;
-                current_state = CAPTURE_DR;
-            }
-            else if (next_state == SELECT_IR) { 
-                // go to select ir
-                digitalWrite(TMS, 1);
-                digitalWrite(TCK, 0); HC;
-                digitalWrite(TCK, 1); HC;
-                current_state = SELECT_IR;
-            }
-            break;
+    for (i = 0; i < tap_count + 64; i++)
+        if (reg_get_bit(out, i) != (i < tap_count ? 0 : reg_get_bit(in, i - tap_count)))
+            return -ERR_TDO_MISMATCH;
 
-        case CAPTURE_DR:
-            if (next_state == SHIFT_DR) {
-                // go to shift dr
-                digitalWrite(TMS, 0);
-                digitalWrite(TCK, 0); HC;
-                digitalWrite(TCK, 1); HC;
-                current_state = SHIFT_DR;
-            }
-            else if (next_state == EXIT1_DR) { 
-                // go to exit1 dr
-                digitalWrite(TMS, 1);
-                digitalWrite(TCK, 0); HC;
-                digitalWrite(TCK, 1); HC;
-                current_state = EXIT1_DR;
-            }
-            break;
+    return OK;
+}
 
-        case SHIFT_DR:
-            if (next_state == SHIFT_DR) {
-                // stay in shift dr
-                digitalWrite(TMS, 0);
-                digitalWrite(TCK, 0); HC;
-                digitalWrite(TCK, 1); HC;
-            }
-            else if (next_state == EXIT1_DR) {
-                // go to exit1 dr
-                digitalWrite(TMS, 1);
-                digitalWrite(TCK, 0); HC;
-                digitalWrite(TCK, 1); HC;
-                current_state = EXIT1_DR;
-            }
-            break;
+bool rtck_detect()
+{
+    uint16_t i = 0;
+    uint8_t edge = 0;
+    bool found = true;
 
-        case EXIT1_DR:
-            if (next_state == PAUSE_DR) {
-                // go to pause dr
-                digitalWrite(TMS, 0);
-                digitalWrite(TCK, 0); HC;
-                digitalWrite(TCK, 1); HC;
-                current_state = PAUSE_DR;
-            }
-            else if (next_state == UPDATE_DR) {
-                // go to update dr
-                digitalWrite(TMS, 1);
-                digitalWrite(TCK, 0); HC;
-                digitalWrite(TCK, 1); HC;
-                current_state = UPDATE_DR;
+    // TMS stays high, so the TAPs stay in TEST_LOGIC_RESET
+    reset_tap();
+    for (edge = 0; edge < 8 && found; edge++)
+    {
+        // TCK idles high, the first edge is a falling one
+        TCK_WRITE(edge & 1);
+        for (i = 0; PIN_READ(RTCK) != (edge & 1); i++)
+        {
+            if (i == RTCK_MAX_LOOPS) {
+                found = false;
+                break;
             }
-            break;
+        }
+    }
 
-        case PAUSE_DR:
-            if (next_state == PAUSE_DR) {
-                // stay in pause dr
-                digitalWrite(TMS, 0);
-                digitalWrite(TCK, 0); HC;
-                digitalWrite(TCK, 1); HC;
-            }
-            else if (next_state == EXIT2_DR) {
-                // go to exit2 dr
-                digitalWrite(TMS, 1);
-                digitalWrite(TCK, 0); HC;
-                digitalWrite(TCK, 1); HC;
-                current_state = EXIT2_DR;
-            }
-            break;
+    TCK_WRITE(1);
+    stats.tck_cycles += (edge + 1) / 2;
+    if (trace_on)
+        trace_run(TEST_LOGIC_RESET, 1, (edge + 1) / 2);
+    return found;
+}
 
-        case EXIT2_DR:
-            if (next_state == SHIFT_DR) {
-                // go to shift dr
-                digitalWrite(TMS, 0);
-                digitalWrite(TCK, 0); HC;
-                digitalWrite(TCK, 1); HC;
-                current_state = SHIFT_DR;
-            }
-            else if (next_state == UPDATE_DR) {
-                // go to update dr
-                digitalWrite(TMS, 1);
-                digitalWrite(TCK, 0); HC;
-                digitalWrite(TCK, 1); HC;
-                current_state = UPDATE_DR;
-            }
-            break;
+int calibrate_tck(bool use_rtck, uint32_t* out)
+{
+    uint32_t max_khz = set_tck_khz(0);
+    uint32_t khz = CAL_START_KHZ;
+    uint32_t best = 0;
+    uint32_t measured = 0;
+    uint8_t pass = 0;
+    uint8_t bad = 0;
+    uint8_t k = 0;
+    int rc = OK;
 
-        case UPDATE_DR:
-            if (next_state == RUN_TEST_IDLE) {
-                // go to run test idle
-                digitalWrite(TMS, 0);
-                digitalWrite(TCK, 0); HC;
-                digitalWrite(TCK, 1); HC;
-                current_state = RUN_TEST_IDLE;
-            }
-            else if (next_state == SELECT_DR) {
-                // go to select dr
-                digitalWrite(TMS, 1);
-                digitalWrite(TCK, 0); HC;
-                digitalWrite(TCK, 1); HC;
-                current_state = SELECT_DR;
-            }
-            break;
+    for (k = 0; k < tap_count; k++)
+        taps[k].tck_khz = 0;
 
-        case SELECT_IR:
-            if (next_state == CAPTURE_IR) {
-                // go to capture ir
-                digitalWrite(TMS, 0);
-                digitalWrite(TCK, 0); HC;
-                digitalWrite(TCK, 1); HC;
-                current_state = CAPTURE_IR;
-            }
-            else if (next_state == TEST_LOGIC_RESET) {
-                // go to test logic reset
-                digitalWrite(TMS, 1);
-                digitalWrite(TCK, 0); HC;
-                digitalWrite(TCK, 1); HC;
-                current_state = TEST_LOGIC_RESET;
-            }
-            break;
+    // adaptive clocking runs as fast as the target returns the edges
+    if (use_rtck && rtck_detect()) {
+        tck_rtck = true;
+        for (pass = 0; pass < CAL_PASSES && rc == OK; pass++)
+            rc = check_chain_integrity(pass + 1, &bad);
+        if (rc == OK) {
+            reset_tap();
+            *out = measure_tck_khz();
+            for (k = 0; k < tap_count; k++)
+                taps[k].tck_khz = *out;
+            return OK;
+        }
+        tck_rtck = false;
+    }
 
-        case CAPTURE_IR:
-            if (next_state == SHIFT_IR) {
-                // go to shift ir
-                digitalWrite(TMS, 0);
-                digitalWrite(TCK, 0); HC;
-                digitalWrite(TCK, 1); HC;
-                current_state = SHIFT_IR;
-            }
-            else if (next_state == EXIT1_IR) {
-                // go to exit1 ir
-                digitalWrite(TMS, 1);
-                digitalWrite(TCK, 0); HC;
-                digitalWrite(TCK, 1); HC;
-                current_state = EXIT1_IR;
-            }
-            break;
+    while (true)
+    {
+        if (khz > max_khz)
+            khz = max_khz;
+        measured = set_tck_khz(khz);
 
-        case SHIFT_IR:
-            if (next_state == SHIFT_IR) {
-                // stay in shift ir
-                digitalWrite(TMS, 0);
-                digitalWrite(TCK, 0); HC;
-                digitalWrite(TCK, 1); HC;
-            }
-            else if (next_state == EXIT1_IR) {
-                // go to exit1 ir
-                digitalWrite(TMS, 1);
-                digitalWrite(TCK, 0); HC;
-                digitalWrite(TCK, 1); HC;
-                current_state = EXIT1_IR;
-            }
-            break;
+        rc = OK;
+        for (pass = 0; pass < CAL_PASSES && rc == OK; pass++)
+            rc = check_chain_integrity(khz + pass, &bad);
 
-        case EXIT1_IR:
-            if (next_state == PAUSE_IR) {
-                // go to pause ir
-                digitalWrite(TMS, 0);
-                digitalWrite(TCK, 0); HC;
-                digitalWrite(TCK, 1); HC;
-                current_state = PAUSE_IR;
-            }
-            else if (next_state == UPDATE_IR) {
-                // go to update ir
-                digitalWrite(TMS, 1);
-                digitalWrite(TCK, 0); HC;
-                digitalWrite(TCK, 1); HC;
-                current_state = UPDATE_IR;
-            }
-            break;
+        // the TAPs before the first wrong IDCODE still came back intact
+        for (k = 0; k < bad; k++)
+            taps[k].tck_khz = measured;
 
-        case PAUSE_IR:
-            if (next_state == PAUSE_IR) {
-                // stay in pause ir
-                digitalWrite(TMS, 0);
-                digitalWrite(TCK, 0); HC;
-                digitalWrite(TCK, 1); HC;
-            }
-            else if (next_state == EXIT2_IR) {
-                // go to exit2 dr
-                digitalWrite(TMS, 1);
-                digitalWrite(TCK, 0); HC;
-                digitalWrite(TCK, 1); HC;
-                current_state = EXIT2_IR;
-            }
+        if (rc != OK || khz == max_khz)
             break;
+        best = khz;
+        khz *= 2;
+    }
+    if (rc == OK)
+        best = khz;
 
-        case EXIT2_IR:
-            if (next_state == SHIFT_IR) {
-                // go to shift ir
-                digitalWrite(TMS, 0);
-                digitalWrite(TCK, 0); HC;
-                digitalWrite(TCK, 1); HC;
-                current_state = SHIFT_IR;
-            }
-            else if (next_state == UPDATE_IR) {
-                // go to update ir
-                digitalWrite(TMS, 1);
-                digitalWrite(TCK, 0); HC;
-                digitalWrite(TCK, 1); HC;
-                current_state = UPDATE_IR;
-            }
-            break;
+    if (best == 0) {
+        // back to the power up rate
+        tck_delay_us = DELAY_US;
+        tck_delay_loops = 0;
+        reset_tap();
+        return -ERR_TDO_MISMATCH;
+    }
 
-        case UPDATE_IR:
-            if (next_state == RUN_TEST_IDLE) {
-                // go to run test idle
-                digitalWrite(TMS, 0);
-                digitalWrite(TCK, 0); HC;
-                digitalWrite(TCK, 1); HC;
-                current_state = RUN_TEST_IDLE;
-            }
-            else if (next_state == SELECT_DR) {
-                // go to select dr
-                digitalWrite(TMS, 1);
-                digitalWrite(TCK, 0); HC;
-                digitalWrite(TCK, 1); HC;
-                current_state = SELECT_DR;
-            }
-            break;
+    *out = set_tck_khz(best);
+    reset_tap();
+    return OK;
+}
 
-        default:
-            Serial.println("Error: incorrent TAP state !");
-            rc = -ERR_BAD_TAP_STATE;
-            break;
-    }
-#if DEBUGTAP
-    Serial.print("\ntap state: ");
-    Serial.print(current_state, HEX);
-#endif
-    return rc;
+void stats_clear()
+{
+    memset(&stats, 0, sizeof(stats));
+    stats.since_us = micros();
+}
+
+void stats_print()
+{
+    uint32_t elapsed = micros() - stats.since_us;
+    uint32_t idle = stats.wait_us + stats.flush_us;
+    uint32_t busy = elapsed > idle ? elapsed - idle : 1;
+
+    Host.print(F("\nTCK cycles:      ")); Host.print(stats.tck_cycles);
+    Host.print(F("\nTMS moves:       ")); Host.print(stats.tms_cycles);
+    Host.print(F("\nBits shifted:    ")); Host.print(stats.bits_shifted);
+    Host.print(F("\nIR/DR scans:     ")); Host.print(stats.ir_scans);
+    Host.print(F(" / ")); Host.print(stats.dr_scans);
+    Host.print(F("\nSerial rx/tx:    ")); Host.print(stats.serial_rx);
+    Host.print(F(" / ")); Host.print(stats.serial_tx);
+    Host.print(F("\nWaiting input:   ")); Host.print(stats.wait_us / 1000); Host.print(F(" ms"));
+    Host.print(F("\nBlocked flush:   ")); Host.print(stats.flush_us / 1000); Host.print(F(" ms"));
+    Host.print(F("\nDevice ready:    ")); Host.print(stats.ready_us / 1000); Host.print(F(" ms"));
+    Host.print(F("\nArena:           ")); Host.print(arena_used() * sizeof(reg_t));
+    Host.print(F(" / ")); Host.print(ARENA_WORDS * sizeof(reg_t)); Host.print(F(" bytes"));
+    Host.print(F("\nElapsed:         ")); Host.print(elapsed / 1000); Host.print(F(" ms"));
+
+    // rates over the time that wasn't spent waiting for the host
+    Host.print(F("\nBits/s (busy):   ")); Host.print((uint32_t)((uint64_t)stats.bits_shifted * 1000000 / busy));
+    Host.print(F("\nScans/s (busy):  "));
+    Host.print((uint32_t)((uint64_t)(stats.ir_scans + stats.dr_scans) * 1000000 / busy));
 }
 
 char serialEvent(char character)
 {
   char inChar = '\0';
 
-  while (Serial.available() == 0)
+  while (Host.available() == 0)
   {
     // get the new byte:
-    inChar = (char)Serial.read();
+    inChar = (char)Host.read();
     // if the incoming character equals to the argument, 
     // break from while and proceed to main loop
     // do something about it:
@@ -1056,56 +1416,79 @@ char serialEvent(char character)
     }
   }
 
-  Serial.flush();
   return inChar;
 }
 
-void printArray(uint8_t* arr, uint32_t len)
+void printArray(reg_t* arr, uint32_t len)
 {
-    for (int16_t i = len - 1; i >= 0; i--)
-        Serial.print(arr[i], HEX);
+    char buf[64];
+    uint8_t n = 0;
+
+    // print MSB first, in chunks instead of a single print per bit
+    for (int32_t i = len - 1; i >= 0; i--)
+    {
+        buf[n++] = '0' + reg_get_bit(arr, i);
+        if (n == sizeof(buf)) {
+            Host.write(buf, n);
+            n = 0;
+        }
+    }
+    Host.write(buf, n);
 
-    Serial.flush();
 }
 
 void sendDataToHost(uint8_t* buf, uint16_t chunk_size)
 {
     for (int i = 0; i < chunk_size; ++i)
-        Serial.write(buf[i]);
+        Host.write(buf[i]);
+
+}
 
-    Serial.flush();
+/**
+ * @brief Write bytes kept in flash (PROGMEM).
+ */
+static void write_flash(const char* p, uint16_t len)
+{
+    for (uint16_t i = 0; i < len; i++)
+        Host.write(pgm_read_byte(p + i));
 }
 
 void print_welcome()
 {
-    Serial.println();
-    Serial.write(art0, sizeof(art0)); Serial.flush();
-    Serial.write(art1, sizeof(art1)); Serial.flush();
-    Serial.write(art2, sizeof(art2)); Serial.flush();
-    Serial.write(art3, sizeof(art3)); Serial.flush();
-    Serial.write(art4, sizeof(art4)); Serial.flush();
-    Serial.write(art5, sizeof(art5)); Serial.flush();
-    Serial.write(art6, sizeof(art6)); Serial.flush();
-    Serial.write(art7, sizeof(art7)); Serial.flush();
-    Serial.write(art8, sizeof(art8)); Serial.flush();
+    Host.println();
+    write_flash(art0, sizeof(art0));
+    write_flash(art1, sizeof(art1));
+    write_flash(art2, sizeof(art2));
+    write_flash(art3, sizeof(art3));
+    write_flash(art4, sizeof(art4));
+    write_flash(art5, sizeof(art5));
+    write_flash(art6, sizeof(art6));
+    write_flash(art7, sizeof(art7));
+    write_flash(art8, sizeof(art8));
 }
 
 void print_main_menu()
 {
-    Serial.flush();	
-    Serial.print("\n---------\nMain Menu\n\n");
-    Serial.print("\tAll numerical parameters should be passed in the format: {0x || 0b || decimal}\n\n");
-    Serial.print("c - Connect to chain\n");
-    Serial.print("d - Discovery\n");
-    Serial.print("i - Insert IR\n");
-    Serial.print("l - Detect DR length\n");
-    Serial.print("r - Insert DR\n");
-    Serial.print("t - Reset TAP state machine\n");
-    Serial.print("q - Toggle TRST line\n");
-    Serial.print("m - MAX10 FPGA commands\n");
-    Serial.print("h - Show this menu\n");
-    Serial.print("z - Exit\n");
-    Serial.flush();
+    Host.print(F("\n---------\nMain Menu\n\n"));
+    Host.print(F("\tAll numerical parameters should be passed in the format: {0x || 0b || decimal}\n\n"));
+    Host.print(F("b - Binary command mode\n"));
+    Host.print(F("c - Connect to chain\n"));
+    Host.print(F("d - Discovery\n"));
+    Host.print(F("i - Insert IR\n"));
+    Host.print(F("l - Detect DR length\n"));
+    Host.print(F("r - Insert DR\n"));
+    Host.print(F("p - Sample boundary scan pins\n"));
+    Host.print(F("s - Select a TAP of the chain\n"));
+    Host.print(F("a - Performance counters (then cleared)\n"));
+    Host.print(F("f - Set TCK frequency\n"));
+    Host.print(F("k - Calibrate TCK frequency (and detect RTCK)\n"));
+    Host.print(F("t - Reset TAP state machine\n"));
+    Host.print(F("x - Start/stop the TAP trace (dump it with controller.py --trace)\n"));
+    Host.print(F("q - Toggle TRST line\n"));
+    Host.print(F("m - MAX10 FPGA commands\n"));
+    Host.print(F("g - ARM debug port memory access (selected TAP)\n"));
+    Host.print(F("h - Show this menu\n"));
+    Host.print(F("z - Exit\n"));
 }
 
 void setup()
@@ -1116,20 +1499,25 @@ void setup()
     pinMode(TDI, OUTPUT);
     pinMode(TDO, INPUT_PULLUP);
     pinMode(TRST, OUTPUT);
+    pinMode(RTCK, INPUT_PULLUP);
 
     // initialize pins state
-    digitalWrite(TCK, 0);
-    digitalWrite(TMS, 1);
-    digitalWrite(TDI, 1);
+    TCK_WRITE(0);
+    TMS_WRITE(1);
+    TDI_WRITE(1);
     digitalWrite(TRST, 1);
+    hw_shift_init();
+    measure_tck_max();
 
     // initialize possible TAPs in chain
-    taps_init();
+    taps_init(taps);
+    regs_init();
+    stats_clear();
 
     // initialize serial communication
-    Serial.begin(115200);
-    while (!Serial) { }
-    Serial.setTimeout(500); // set timeout for various serial R/W funcs
+    Host.begin(115200);
+    while (!Host) { }
+    Host.setTimeout(500); // set timeout for various serial R/W funcs
 }
 
 void loop()
@@ -1140,35 +1528,36 @@ void loop()
     uint32_t dr_len = 0;
     uint32_t nbits, first_ir, final_ir = 0;
     uint32_t max_dr_len = 0;
+    uint8_t sel_ir_len = 0;
+    reg_t* sel_ir_in = NULL;
+    reg_t* sel_ir_out = NULL;
+    char start[8];
     current_state = TEST_LOGIC_RESET;
 
     // to begin session
-    String start = getString("Insert 'start' > ");
-    if (start != "start") {
-        Serial.println("Invalid, reset the Arduino and try again");
+    getLine(F("Insert 'start' > "), start, sizeof(start));
+    if (strcmp(start, "start") != 0) {
+        Host.println(F("Invalid, reset the Arduino and try again"));
         while(1);
     }
     
     print_welcome();
 
     // detect chain and read idcode
-    Serial.println("Attempting to connect to chain");
+    Host.println(F("Attempting to connect to chain"));
     rc = detect_chain(&ir_len);
     if (rc != OK) {
-        Serial.print("Could not detect valid IR length\n");
+        Host.print(F("Could not detect valid IR length\n"));
         goto inf_loop;
     }
-    Serial.print("IR length: "); Serial.println(ir_len, DEC);
+    Host.print(F("IR length: ")); Host.println(ir_len, DEC);
 
     if (ir_len <= 0) {
-        Serial.print("IR length must be > 0 to perform any useful JTAG operations\n");
-        Serial.println("You must reset the Arduino to retry");
+        Host.print(F("IR length must be > 0 to perform any useful JTAG operations\n"));
+        Host.println(F("You must reset the Arduino to retry"));
         goto inf_loop;
     }
 
-    // define ir register according to ir length
-    uint8_t ir_in[ir_len];
-    uint8_t ir_out[ir_len];
     reset_tap();
 
     print_main_menu();
@@ -1176,50 +1565,61 @@ void loop()
     while (true)
     {
         num = 0;
-        command = getCharacter("\ncmd > ");
+        command = getCharacter(F("\ncmd > "));
 
         switch (command)
         {
+        case 'b':
+            // serve binary frames from the host until it exits
+            Host.print(F("\nEntering binary mode\n"));
+            binproto_main(ir_in, ir_out, dr_in, dr_out);
+            break;
+
         case 'c':
             // attempt to connect to chain and read idcode
             rc = detect_chain(&ir_len);
-            Serial.print("IR length: "); Serial.print(ir_len);
+            Host.print(F("IR length: ")); Host.print(ir_len);
             break;
 
         case 'd':
             // discovery of existing IRs
-            rc = parseNumber(NULL, 20, "First IR > ", &first_ir);
+            rc = parseNumber(NULL, 20, F("First IR > "), &first_ir);
             if (rc != OK) break;
-            rc = parseNumber(NULL, 20, "Final IR > ", &final_ir);
+            rc = parseNumber(NULL, 20, F("Final IR > "), &final_ir);
             if (rc != OK) break;
-            rc = parseNumber(NULL, 20, "Max allowed DR length > ", &max_dr_len);
+            rc = parseNumber(NULL, 20, F("Max allowed DR length > "), &max_dr_len);
             if (rc != OK) break;
 
-            discovery(first_ir, final_ir, max_dr_len, ir_in, ir_out);
+            discovery(first_ir, final_ir, max_dr_len, ir_in);
             break;
 
         case 'i':
-            // insert ir
-            rc = parseNumber(ir_in, ir_len, "\nShift IR > ", &num);
+            // insert ir, to the selected TAP (into its own IR registers) only if there is one
+            sel_ir_len = active_tap != NULL ? active_tap->ir_len : ir_len;
+            sel_ir_in = active_tap != NULL ? active_tap->ir_in : ir_in;
+            sel_ir_out = active_tap != NULL ? active_tap->ir_out : ir_out;
+            rc = parseNumber(sel_ir_in, sel_ir_len, F("\nShift IR > "), &num);
             if (rc != OK) break;
-            insert_ir(ir_in, ir_len, RUN_TEST_IDLE, ir_out);
+            if (active_tap != NULL)
+                insert_ir_tap(active_tap, sel_ir_in, RUN_TEST_IDLE, sel_ir_out);
+            else
+                insert_ir(sel_ir_in, ir_len, RUN_TEST_IDLE, sel_ir_out);
 
-            Serial.print("\nIR  in: ");
-            printArray(ir_in, ir_len);
+            Host.print(F("\nIR  in: "));
+            printArray(sel_ir_in, sel_ir_len);
             
             // print the hex value if length is not to large
-            if (ir_len <= 32) {
-                binArrayToInt(ir_in, ir_len, &num); // TODO: do I need this aftwr parseNumber ?
-                Serial.print(" | 0x"); Serial.print(num, HEX);
+            if (sel_ir_len <= 32) {
+                Host.print(F(" | 0x")); Host.print(num, HEX);
             }
 
-            Serial.print("\nIR out: ");
-            printArray(ir_out, ir_len);
+            Host.print(F("\nIR out: "));
+            printArray(sel_ir_out, sel_ir_len);
 
             // print the hex value if length is not to large
-            if (ir_len <= 32) {
-                binArrayToInt(ir_out, ir_len, &num);
-                Serial.print(" | 0x"); Serial.print(num, HEX);
+            if (sel_ir_len <= 32) {
+                binArrayToInt(sel_ir_out, sel_ir_len, &num);
+                Host.print(F(" | 0x")); Host.print(num, HEX);
             }
             break;
 
@@ -1227,11 +1627,11 @@ void loop()
             // detect current dr length
             dr_len = detect_dr_len(ir_in, ir_len, 4);
             if (dr_len == 0) {
-                Serial.println("\nDidn't find the current DR length, TDO is stuck");
+                Host.println(F("\nDidn't find the current DR length, TDO is stuck"));
             }
             else {
-                Serial.print("\nDR length: ");
-                Serial.print(dr_len);
+                Host.print(F("\nDR length: "));
+                Host.print(dr_len);
             }
             break;
 
@@ -1242,43 +1642,137 @@ void loop()
             max10_main(ir_len, ir_in, ir_out, dr_in, dr_out);
             break;
 
+        case 'g':
+            // memory of an ARM core through its JTAG-DP, the selected TAP or the single one
+            arm_main(active_tap != NULL ? active_tap : (tap_count == 1 ? &taps[0] : NULL));
+            break;
+
         case 'r':
             // insert dr
-            rc = parseNumber(NULL, 32, "Enter amount of bits to shift > ", &nbits);
+            rc = parseNumber(NULL, 32, F("Enter amount of bits to shift > "), &nbits);
             if (nbits == 0 || rc != OK)
                 break;
+            if (nbits > MAX_DR_LEN) {
+                Host.print(F("\nDR length must not exceed ")); Host.print(MAX_DR_LEN);
+                break;
+            }
 
-            rc = parseNumber(dr_in, nbits, "\nShift DR > ", &nbits);
+            rc = parseNumber(dr_in, nbits, F("\nShift DR > "), &num);
             if (rc != OK) break;
 
-            insert_dr(dr_in, nbits, RUN_TEST_IDLE, dr_out);
+            if (active_tap != NULL)
+                insert_dr_tap(active_tap, dr_in, nbits, RUN_TEST_IDLE, dr_out);
+            else
+                insert_dr(dr_in, nbits, RUN_TEST_IDLE, dr_out);
 
-            Serial.print("\nDR  in: ");
+            Host.print(F("\nDR  in: "));
             printArray(dr_in, nbits);
             
             // print the hex value if lenght is not large enough
             if (nbits <= 32) {
                 binArrayToInt(dr_in, nbits, &num); // TODO needed after parseNum ?
-                Serial.print(" | 0x"); Serial.print(num, HEX);
+                Host.print(F(" | 0x")); Host.print(num, HEX);
             }
             
-            Serial.print("\nDR out: ");
+            Host.print(F("\nDR out: "));
             printArray(dr_out, nbits);
             
             // print the hex value if lenght is not large enough
             if (nbits <= 32) {
                 binArrayToInt(dr_out, nbits, &num);  // TODO same as above
-                Serial.print(" | 0x"); Serial.print(num, HEX);
+                Host.print(F(" | 0x")); Host.print(num, HEX);
+            }
+            break;
+
+        case 'p':
+            // sample the pins with the BSDL table loaded in binary mode
+            if (!bsdl_ready()) {
+                Host.print(F("\nNo BSDL table, load one with controller.py --bsdl"));
+                break;
+            }
+            rc = bsdl_sample(ir_in, ir_out, dr_out);
+            if (rc != OK) {
+                Host.print(F("\nThe BSDL table doesn't match the selected TAP"));
+                break;
+            }
+            for (num = 0; num < bsdl.pin_count; num++)
+            {
+                Host.print(num % 16 == 0 ? "\n" : " ");
+                Host.print(num); Host.print(':');
+                rc = bsdl_pin_value(dr_out, num);
+                Host.print(rc == BSDL_Z ? '-' : (char)('0' + rc));
+            }
+            rc = OK;
+            break;
+
+        case 'a':
+            // show the performance counters since the last time
+            stats_print();
+            stats_clear();
+            break;
+
+        case 'f':
+            // select TCK frequency
+            rc = parseNumber(NULL, 32, F("\nTCK frequency in kHz (0 for max) > "), &num);
+            if (rc != OK) break;
+            num = set_tck_khz(num);
+            Host.print(F("\nTCK frequency: ")); Host.print(num); Host.print(F(" kHz"));
+            if (hw_shift_khz != 0) {
+                Host.print(F(", ")); Host.print(hw_shift_khz); Host.print(F(" kHz in long scans (SPI)"));
+            }
+            break;
+
+        case 's':
+            // select a single TAP of the chain for the IR/DR commands
+            print_chain(taps, tap_count);
+            rc = parseNumber(NULL, 8, F("\nTAP index (255 for the whole chain) > "), &num);
+            if (rc != OK) break;
+            if (num == 255) {
+                active_tap = NULL;
+                Host.print(F("\nWhole chain selected"));
+                break;
+            }
+            if (tap_selector(taps, num) == NULL) {
+                Host.print(F("\nNo such TAP"));
+                break;
+            }
+            active_tap = tap_selector(taps, num);
+            Host.print(F("\nTAP ")); Host.print(num); Host.print(F(" selected"));
+            break;
+
+        case 'k':
+            // fastest TCK that the chain passes the integrity checks at
+            rc = calibrate_tck(true, &num);
+            if (rc != OK) {
+                Host.print(F("\nThe chain fails even at ")); Host.print(CAL_START_KHZ);
+                Host.print(F(" kHz, back to the power up rate"));
+                break;
+            }
+            Host.print(F("\nTCK frequency: ")); Host.print(num); Host.print(F(" kHz"));
+            if (tck_rtck)
+                Host.print(F(" (RTCK adaptive clocking)"));
+            print_chain(taps, tap_count);
+            break;
+
+        case 'x':
+            // recording starts over, the ring is kept when stopped
+            if (trace_on) {
+                trace_stop();
+                Host.print(F("\nTAP trace stopped, ")); Host.print(trace_count); Host.print(F(" events"));
+            }
+            else {
+                trace_start();
+                Host.print(F("\nTAP trace started"));
             }
             break;
 
         case 't':
-            Serial.println("Resetting TAP");
+            Host.println(F("Resetting TAP"));
             reset_tap();
             break;
         
         case 'q':
-            Serial.println("Toggling TRST line");
+            Host.println(F("Toggling TRST line"));
             digitalWrite(TRST, 0);
             HC; HC; HC; HC; HC; HC; HC; HC;
             digitalWrite(TRST, 1);
@@ -1289,19 +1783,19 @@ void loop()
             break;
 
         case 'z':
-            Serial.print("\nExiting...\nReset Arduino to start again");
+            Host.print(F("\nExiting...\nReset Arduino to start again"));
             reset_tap();
             goto inf_loop;
 
         default:
-            Serial.println("Invalid Command");
+            Host.println(F("Invalid Command"));
             break;
         }
     }
 
     reset_tap();
 inf_loop:
-    Serial.end();
+    Host.end();
     while(1); // loop in place
 }
 
@@ -4,6 +4,9 @@
 
 #include "jtagger.h"
 #include "max10_ir.h"
+#include "max10_funcs.h"
+#include "binproto.h"
+#include "gang.h"
 
 /**
  * @brief Read user defined 32 bit code of MAX10 FPGA.
@@ -13,7 +16,7 @@
  * @param dr_out dr_out
  * @return 32 bit integer that represents the user code.
  */
-uint32_t max10_read_user_code(const uint8_t ir_len, uint8_t* ir_in, uint8_t* ir_out, uint8_t* dr_in, uint8_t* dr_out)
+uint32_t max10_read_user_code(const uint8_t ir_len, reg_t* ir_in, reg_t* ir_out, reg_t* dr_in, reg_t* dr_out)
 {
     uint32_t res = 0;
     clear_reg(dr_out, MAX_DR_LEN);
@@ -29,28 +32,29 @@ uint32_t max10_read_user_code(const uint8_t ir_len, uint8_t* ir_in, uint8_t* ir_
 /**
  * @brief Perform read flash operation on the MAX10 FPGA, by getting an address range and 
  * incrementing the given address in each iteration with ISC_ADDRESS_SHIFT, before invoking ISC_READ.
- * @param ir_in Pointer to the input data array. Bytes array, where each
- * @param ir_out Pointer to the output data array. (bytes array)
- * @param dr_in Pointer to the input data array. (bytes array)
- * @param dr_out Pointer to the output data array. (bytes array)
+ * @param ir_in Pointer to the input data array. (packed bits)
+ * @param ir_out Pointer to the output data array. (packed bits)
+ * @param dr_in Pointer to the input data array. (packed bits)
+ * @param dr_out Pointer to the output data array. (packed bits)
  * @param start Address from which to start the flash reading.
  * @param num Amount of 32 bit words to read, starting from the start address.
 */
-void max10_read_ufm_range(const uint8_t ir_len, uint8_t* ir_in, uint8_t* ir_out, uint8_t* dr_in, uint8_t* dr_out, const uint32_t start, const uint32_t num)
+void max10_read_ufm_range(const uint8_t ir_len, reg_t* ir_in, reg_t* ir_out, reg_t* dr_in, reg_t* dr_out, const uint32_t start, const uint32_t num)
 {
     uint32_t res = 0;
 
-    if (num < 0){
-        Serial.println("\nNumber of words to read must be positive. Exiting...");
+    if (num == 0){
+        Host.println(F("\nNumber of words to read must be positive. Exiting..."));
         return;
     }
 
-    Serial.println("\nReading flash in address iteration fashion");
+    Host.println(F("\nReading flash in address iteration fashion"));
     
     intToBinArray(ir_in, ISC_ENABLE, ir_len);
     insert_ir(ir_in, ir_len, RUN_TEST_IDLE, ir_out);
 
-    delay(15); // delay between ISC_Enable and read attenpt.(may be shortened)
+    // ISC_ENABLE has no status, wait as long as the BSDL asks before reading
+    wait_ready(NULL, NULL, MAX10_ENABLE_TCK, MAX10_ENABLE_US, NULL);
     
     for (uint32_t j=start ; j < (start + num); j += 4){
         // shift address instruction
@@ -72,9 +76,8 @@ void max10_read_ufm_range(const uint8_t ir_len, uint8_t* ir_in, uint8_t* ir_out,
 
         // print address and corresponding data
         binArrayToInt(dr_out, 32, &res);
-        Serial.print("\n0x"); Serial.print(j, HEX);
-        Serial.print(": 0x"); Serial.print(res, HEX);
-        Serial.flush();
+        Host.print(F("\n0x")); Host.print(j, HEX);
+        Host.print(F(": 0x")); Host.print(res, HEX);
     }
 }
 
@@ -82,29 +85,30 @@ void max10_read_ufm_range(const uint8_t ir_len, uint8_t* ir_in, uint8_t* ir_out,
 /**
  * @brief Perform read flash operation on the MAX10 FPGA, by getting an address range and 
  * incrementing the given address in each iteration with ISC_ADDRESS_SHIFT, before invoking ISC_READ.
- * @param ir_in Pointer to the input data array.  (bytes array)
- * @param ir_out Pointer to the output data array. (bytes array)
- * @param dr_in Pointer to the input data array. (bytes array)
- * @param dr_out Pointer to the output data array. (bytes array)
+ * @param ir_in Pointer to the input data array.  (packed bits)
+ * @param ir_out Pointer to the output data array. (packed bits)
+ * @param dr_in Pointer to the input data array. (packed bits)
+ * @param dr_out Pointer to the output data array. (packed bits)
  * @param start Address from which to start the flash reading.
  * @param num Amount of 32 bit words to read, starting from the start address.
 */
-void max10_read_ufm_range_burst(const uint8_t ir_len, uint8_t* ir_in, uint8_t* ir_out, uint8_t* dr_in, uint8_t* dr_out, const uint32_t start, const uint32_t num)
+void max10_read_ufm_range_burst(const uint8_t ir_len, reg_t* ir_in, reg_t* ir_out, reg_t* dr_in, reg_t* dr_out, const uint32_t start, const uint32_t num)
 {
     uint32_t res = 0;
 
-    if (num < 0){
-        Serial.println("\nNumber of words to read must be positive. Exiting...");
+    if (num == 0){
+        Host.println(F("\nNumber of words to read must be positive. Exiting..."));
         return;
     }
 
-    Serial.println("\nReading flash in burst fashion");
+    Host.println(F("\nReading flash in burst fashion"));
     
     
     intToBinArray(ir_in, ISC_ENABLE, ir_len);
     insert_ir(ir_in, ir_len, RUN_TEST_IDLE, ir_out);
 
-    delay(15); // delay between ISC_Enable and read attenpt.(may be shortened)
+    // ISC_ENABLE has no status, wait as long as the BSDL asks before reading
+    wait_ready(NULL, NULL, MAX10_ENABLE_TCK, MAX10_ENABLE_US, NULL);
 
     // shift address instruction
     intToBinArray(ir_in, ISC_ADDRESS_SHIFT, ir_len);
@@ -127,26 +131,79 @@ void max10_read_ufm_range_burst(const uint8_t ir_len, uint8_t* ir_in, uint8_t* i
 
         // print address and corresponding data
         binArrayToInt(dr_out, 32, &res);
-        Serial.print("\n0x"); Serial.print(j, HEX);
-        Serial.print(": 0x"); Serial.print(res, HEX);
-        Serial.flush();
+        Host.print(F("\n0x")); Host.print(j, HEX);
+        Host.print(F(": 0x")); Host.print(res, HEX);
     }
 }
 
 
+/**
+ * @brief Stream a range of the UFM to the host as binary BIN_CMD_UFM_BLOCK frames,
+ * reading in burst fashion like max10_read_ufm_range_burst.
+ * Words are packed into two alternating blocks (see binproto_blocks_t): while
+ * one block is being sent, the next one is shifted out of the FPGA. The stream ends with a BIN_CMD_UFM_DUMP reply
+ * that holds the number of words sent.
+ * @param ir_in Pointer to the input data array.  (packed bits)
+ * @param ir_out Pointer to the output data array. (packed bits)
+ * @param dr_in Pointer to the input data array. (packed bits)
+ * @param dr_out Pointer to the output data array. (packed bits)
+ * @param start Address from which to start the flash reading.
+ * @param num Amount of 32 bit words to read, starting from the start address.
+*/
+void max10_dump_ufm_stream(const uint8_t ir_len, reg_t* ir_in, reg_t* ir_out, reg_t* dr_in, reg_t* dr_out, const uint32_t start, const uint32_t num)
+{
+    binproto_blocks_t blocks;
+    uint32_t i = 0;
+
+    intToBinArray(ir_in, ISC_ENABLE, ir_len);
+    insert_ir(ir_in, ir_len, RUN_TEST_IDLE, ir_out);
+
+    // ISC_ENABLE has no status, wait as long as the BSDL asks before reading
+    wait_ready(NULL, NULL, MAX10_ENABLE_TCK, MAX10_ENABLE_US, NULL);
+
+    // shift address instruction
+    intToBinArray(ir_in, ISC_ADDRESS_SHIFT, ir_len);
+    insert_ir(ir_in, ir_len, RUN_TEST_IDLE, ir_out);
+
+    // shift address value
+    clear_reg(dr_in, 32);
+    intToBinArray(dr_in, start, 23);
+    insert_dr(dr_in, 23, RUN_TEST_IDLE, dr_out);
+
+    // shift read instruction
+    intToBinArray(ir_in, ISC_READ, ir_len);
+    insert_ir(ir_in, ir_len, RUN_TEST_IDLE, ir_out);
+
+    clear_reg(dr_in, 32);
+    binproto_blocks_begin(&blocks, BIN_CMD_UFM_BLOCK, start);
+
+    for (i = 0; i < num; i++)
+    {
+        // read data in burst fashion
+        insert_dr(dr_in, 32, RUN_TEST_IDLE, dr_out);
+        *binproto_blocks_buf(&blocks) = dr_out[0];
+        binproto_blocks_add(&blocks, 1);
+    }
+
+    binproto_blocks_end(&blocks);
+
+    binproto_send_reply(BIN_CMD_UFM_DUMP, OK, (uint8_t*)&num, 4);
+}
+
+
 /**
  * @brief User interface with the various flash reading functions.
- * @param ir_in  Pointer to the input data array.  (bytes array)
- * @param ir_out Pointer to the output data array. (bytes array)
- * @param dr_in Pointer to the input data array. (bytes array)
- * @param dr_out Pointer to the output data array. (bytes array)
+ * @param ir_in  Pointer to the input data array.  (packed bits)
+ * @param ir_out Pointer to the output data array. (packed bits)
+ * @param dr_in Pointer to the input data array. (packed bits)
+ * @param dr_out Pointer to the output data array. (packed bits)
 */
-void max10_readFlashSession(const uint8_t ir_len, uint8_t* ir_in, uint8_t* ir_out, uint8_t* dr_in, uint8_t* dr_out)
+void max10_readFlashSession(const uint8_t ir_len, reg_t* ir_in, reg_t* ir_out, reg_t* dr_in, reg_t* dr_out)
 {
     uint32_t startAddr = 0;
     uint32_t numToRead = 0;
 
-    Serial.print("\nReading flash address range");
+    Host.print(F("\nReading flash address range"));
     
     while (1){
         clear_reg(dr_in, MAX_DR_LEN);
@@ -154,18 +211,191 @@ void max10_readFlashSession(const uint8_t ir_len, uint8_t* ir_in, uint8_t* ir_ou
         
         reset_tap();
         
-        parseNumber(NULL, 16, "\nInsert start addr > ", &startAddr);
-        parseNumber(NULL, 16, "\nInsert amount of words to read > ", &numToRead);
+        parseNumber(NULL, 16, F("\nInsert start addr > "), &startAddr);
+        parseNumber(NULL, 16, F("\nInsert amount of words to read > "), &numToRead);
         max10_read_ufm_range_burst(ir_len, ir_in, ir_out, dr_in, dr_out, startAddr, numToRead);
             
-        if (getCharacter("\nInput 'q' to quit loop, else to continue > ") == 'q'){
-            Serial.println("Exiting...");
+        if (getCharacter(F("\nInput 'q' to quit loop, else to continue > ")) == 'q'){
+            Host.println(F("Exiting..."));
             break;
         }
     }
 }
 
 
+// ISC_ENABLE was shifted and ISC_DISABLE wasn't yet
+static bool max10_isc_on = false;
+
+/**
+ * @brief Enter ISC mode, unless a previous block of the session already did.
+ * @param ir_in Pointer to ir_in register.
+ * @param ir_out Pointer to ir_out register.
+ */
+static void max10_isc_enable(const uint8_t ir_len, reg_t* ir_in, reg_t* ir_out)
+{
+    if (max10_isc_on)
+        return;
+
+    intToBinArray(ir_in, ISC_ENABLE, ir_len);
+    insert_ir(ir_in, ir_len, RUN_TEST_IDLE, ir_out);
+
+    // ISC_ENABLE has no status, wait as long as the BSDL asks before the first flash access
+    wait_ready(NULL, NULL, MAX10_ENABLE_TCK, MAX10_ENABLE_US, NULL);
+    max10_isc_on = true;
+}
+
+/**
+ * @brief Leave ISC mode, the FPGA goes back to user mode.
+ * @param ir_in Pointer to ir_in register.
+ * @param ir_out Pointer to ir_out register.
+ */
+void max10_isc_disable(const uint8_t ir_len, reg_t* ir_in, reg_t* ir_out)
+{
+    intToBinArray(ir_in, ISC_DISABLE, ir_len);
+    insert_ir(ir_in, ir_len, RUN_TEST_IDLE, ir_out);
+
+    wait_ready(NULL, NULL, MAX10_DISABLE_TCK, MAX10_DISABLE_US, NULL);
+    max10_isc_on = false;
+}
+
+/**
+ * @brief Shift a flash address with ISC_ADDRESS_SHIFT.
+ */
+static void max10_shift_address(const uint8_t ir_len, reg_t* ir_in, reg_t* ir_out, reg_t* dr_in, reg_t* dr_out, const uint32_t addr)
+{
+    intToBinArray(ir_in, ISC_ADDRESS_SHIFT, ir_len);
+    insert_ir(ir_in, ir_len, RUN_TEST_IDLE, ir_out);
+
+    clear_reg(dr_in, 32);
+    intToBinArray(dr_in, addr, 23);
+    insert_dr(dr_in, 23, RUN_TEST_IDLE, dr_out);
+}
+
+
+/**
+ * @brief CRC-32 of a range of the UFM, read in burst fashion like max10_read_ufm_range_burst.
+ * Every word is folded into the CRC right after it is shifted out, so nothing but
+ * the digest leaves the Arduino. The CRC is the one of zlib over the little endian
+ * bytes of the words, like a raw image file of the range. ISC mode is entered if needed.
+ * @param ir_in Pointer to the input data array.  (packed bits)
+ * @param ir_out Pointer to the output data array. (packed bits)
+ * @param dr_in Pointer to the input data array. (packed bits)
+ * @param dr_out Pointer to the output data array. (packed bits)
+ * @param start Address from which to start the flash reading.
+ * @param num Amount of 32 bit words, starting from the start address.
+ * @param gang_crcs In gang mode, receives the CRC-32 of every chain, may be NULL.
+ * @return The CRC-32 of the range (of chain 0 in gang mode).
+*/
+uint32_t max10_crc_ufm_range(const uint8_t ir_len, reg_t* ir_in, reg_t* ir_out, reg_t* dr_in, reg_t* dr_out, const uint32_t start, const uint32_t num, uint32_t* gang_crcs)
+{
+    uint32_t crc = 0xFFFFFFFF;
+    uint8_t c = 0;
+
+    for (c = 0; gang_crcs != NULL && c < gang_chains; c++)
+        gang_crcs[c] = 0xFFFFFFFF;
+
+    max10_isc_enable(ir_len, ir_in, ir_out);
+
+    max10_shift_address(ir_len, ir_in, ir_out, dr_in, dr_out, start);
+    intToBinArray(ir_in, ISC_READ, ir_len);
+    insert_ir(ir_in, ir_len, RUN_TEST_IDLE, ir_out);
+
+    clear_reg(dr_in, 32);
+    for (uint32_t i = 0; i < num; i++)
+    {
+        // read data in burst fashion, the word is little endian like the image
+        insert_dr(dr_in, 32, RUN_TEST_IDLE, dr_out);
+        crc = crc32_update(crc, (uint8_t*)dr_out, 4);
+        for (c = 0; gang_crcs != NULL && c < gang_chains; c++)
+            gang_crcs[c] = crc32_update(gang_crcs[c], (uint8_t*)gang_tdo[c], 4);
+    }
+
+    for (c = 0; gang_crcs != NULL && c < gang_chains; c++)
+        gang_crcs[c] = ~gang_crcs[c];
+    return ~crc;
+}
+
+
+/**
+ * @brief Program a block of UFM words in burst fashion with ISC_PROGRAM, then
+ * verify it by reading it back with ISC_READ. ISC mode is entered on the first
+ * block and kept until max10_isc_disable(), and the flash must be erased before.
+ * @param ir_in Pointer to the input data array.  (packed bits)
+ * @param ir_out Pointer to the output data array. (packed bits)
+ * @param dr_in Pointer to the input data array. (packed bits)
+ * @param dr_out Pointer to the output data array. (packed bits)
+ * @param addr Address of the first word.
+ * @param data The words, 4 little endian bytes each.
+ * @param num Amount of 32 bit words to program.
+ * @return OK or -ERR_VERIFY if a word reads back different.
+*/
+int max10_program_block(const uint8_t ir_len, reg_t* ir_in, reg_t* ir_out, reg_t* dr_in, reg_t* dr_out, const uint32_t addr, const uint8_t* data, const uint16_t num)
+{
+    uint32_t word = 0;
+    uint16_t i = 0;
+
+    max10_isc_enable(ir_len, ir_in, ir_out);
+
+    max10_shift_address(ir_len, ir_in, ir_out, dr_in, dr_out, addr);
+    intToBinArray(ir_in, ISC_PROGRAM, ir_len);
+    insert_ir(ir_in, ir_len, RUN_TEST_IDLE, ir_out);
+
+    // the address advances by itself after every word
+    for (i = 0; i < num; i++)
+    {
+        memcpy(&word, &data[i * 4], 4);
+        dr_in[0] = word;
+        insert_dr(dr_in, 32, RUN_TEST_IDLE, dr_out);
+        clock_state(MAX10_PROGRAM_TCK, MAX10_PROGRAM_US);
+    }
+
+    // verify by reading the block back in burst fashion
+    max10_shift_address(ir_len, ir_in, ir_out, dr_in, dr_out, addr);
+    intToBinArray(ir_in, ISC_READ, ir_len);
+    insert_ir(ir_in, ir_len, RUN_TEST_IDLE, ir_out);
+
+    clear_reg(dr_in, 32);
+    for (i = 0; i < num; i++)
+    {
+        memcpy(&word, &data[i * 4], 4);
+        insert_dr(dr_in, 32, RUN_TEST_IDLE, dr_out);
+        if (dr_out[0] != word)
+            return -ERR_VERIFY;
+    }
+
+    return OK;
+}
+
+
+/**
+ * Registers used by max10_erased() while it polls.
+ */
+typedef struct
+{
+    uint8_t ir_len;
+    reg_t* ir_in;
+    reg_t* ir_out;
+    reg_t* dr_in;
+    reg_t* dr_out;
+} max10_regs_t;
+
+/**
+ * @brief Check an erase: the first UFM word reads back erased.
+ * @param ctx Pointer to the max10_regs_t.
+ */
+static bool max10_erased(void* ctx)
+{
+    max10_regs_t* r = (max10_regs_t*)ctx;
+    dr_status_t erased = { 32, 0xFFFFFFFF, 0xFFFFFFFF };
+
+    max10_shift_address(r->ir_len, r->ir_in, r->ir_out, r->dr_in, r->dr_out, 0);
+    intToBinArray(r->ir_in, ISC_READ, r->ir_len);
+    insert_ir(r->ir_in, r->ir_len, RUN_TEST_IDLE, r->ir_out);
+
+    return dr_status_ready(&erased);
+}
+
+
 /**
  * According to MAX10 BSDL
  * 
@@ -174,13 +404,19 @@ void max10_readFlashSession(const uint8_t ir_len, uint8_t* ir_in, uint8_t* ir_ou
         "(ISC_ADDRESS_SHIFT 23:000000 WAIT TCK 1)" &
       "(DSM_CLEAR                   WAIT 350.0e-3)," &
  *
- * @brief Erase the entire flash
+ * @brief Erase the entire flash, without any output so it can run in binary mode.
+ * The MAX10 has no erase status to poll, and reading the flash would replace
+ * DSM_CLEAR: it stays loaded with TCK running for the 350 ms of the BSDL, then
+ * the flash is checked once. The FPGA is left in ISC mode. In gang mode the flash of every chain must read
+ * erased, gang_match(0xFFFFFFFF, 0xFFFFFFFF) then tells which ones do.
  * @param ir_in Pointer to ir_in register.
  * @param ir_out Pointer to ir_out register.
+ * @param waited_us Receives the time the erase took in microseconds, may be NULL.
+ * @return OK or -ERR_VERIFY if the flash doesn't read erased.
  */
-void max10_erase_device(const uint8_t ir_len, uint8_t* ir_in, uint8_t * ir_out, uint8_t* dr_in, uint8_t* dr_out)
+int max10_erase(const uint8_t ir_len, reg_t* ir_in, reg_t* ir_out, reg_t* dr_in, reg_t* dr_out, uint32_t* waited_us)
 {
-    Serial.println("\nErasing device ...");
+    max10_regs_t regs = { ir_len, ir_in, ir_out, dr_in, dr_out };
 
     clear_reg(ir_in, ir_len);
     clear_reg(dr_in, 32);
@@ -188,7 +424,8 @@ void max10_erase_device(const uint8_t ir_len, uint8_t* ir_in, uint8_t * ir_out,
     intToBinArray(ir_in, ISC_ENABLE, ir_len);
     insert_ir(ir_in, ir_len, RUN_TEST_IDLE, ir_out);
 
-    delay(1);
+    wait_ready(NULL, NULL, MAX10_ENABLE_TCK, MAX10_ENABLE_US, NULL);
+    max10_isc_on = true;
 
     intToBinArray(ir_in, ISC_ADDRESS_SHIFT, ir_len);
     insert_ir(ir_in, ir_len, RUN_TEST_IDLE, ir_out);
@@ -196,26 +433,44 @@ void max10_erase_device(const uint8_t ir_len, uint8_t* ir_in, uint8_t * ir_out,
     intToBinArray(dr_in, 0x00, 23);
     insert_dr(dr_in, 23, RUN_TEST_IDLE, dr_out);
 
-    delay(1);
+    wait_ready(NULL, NULL, 1, 0, NULL);
 
     intToBinArray(ir_in, DSM_CLEAR, ir_len);
     insert_ir(ir_in, ir_len, RUN_TEST_IDLE, ir_out);
 
-    delay(400);
+    wait_ready(NULL, NULL, 1, MAX10_ERASE_US, waited_us);
+
+    return max10_erased(&regs) ? OK : -ERR_VERIFY;
+}
+
+
+/**
+ * @brief Erase the entire flash
+ * @param ir_in Pointer to ir_in register.
+ * @param ir_out Pointer to ir_out register.
+ */
+void max10_erase_device(const uint8_t ir_len, reg_t* ir_in, reg_t* ir_out, reg_t* dr_in, reg_t* dr_out)
+{
+    uint32_t us = 0;
+
+    Host.println(F("\nErasing device ..."));
 
-    Serial.println("\nDone");
+    if (max10_erase(ir_len, ir_in, ir_out, dr_in, dr_out, &us) != OK)
+        Host.print(F("\nThe flash doesn't read erased after "));
+    else
+        Host.print(F("\nDone in "));
+    Host.print(us / 1000); Host.println(F(" ms"));
 }
 
 
 void max10_print_menu()
 {
-    Serial.flush();	
-    Serial.print("\n\nMAX10 FPGA Menu:\n");
-    Serial.print("a - Read flash\n");
-    Serial.print("b - Read user code\n");
-    Serial.print("c - Erase flash\n");
-    Serial.print("z - Exit\n");
-    Serial.flush();
+    Host.print(F("\n\nMAX10 FPGA Menu:\n"));
+    Host.print(F("a - Read flash\n"));
+    Host.print(F("b - Read user code\n"));
+    Host.print(F("c - Erase flash\n"));
+    Host.print(F("d - CRC32 of flash range\n"));
+    Host.print(F("z - Exit\n"));
 }
 
 
@@ -223,10 +478,14 @@ void max10_print_menu()
  * @brief Prompts the user to choose what to execute
  * from the available menu of max10 commands.
  */
-void max10_main(const uint8_t ir_len, uint8_t* ir_in, uint8_t* ir_out, uint8_t* dr_in, uint8_t* dr_out)
+void max10_main(const uint8_t ir_len, reg_t* ir_in, reg_t* ir_out, reg_t* dr_in, reg_t* dr_out)
 {
+    uint32_t start = 0;
+    uint32_t num = 0;
+    uint32_t crc = 0;
+
     max10_print_menu();
-    char command = getCharacter("\nmax10 > ");
+    char command = getCharacter(F("\nmax10 > "));
 
     switch (command)
     {
@@ -237,8 +496,8 @@ void max10_main(const uint8_t ir_len, uint8_t* ir_in, uint8_t* ir_out, uint8_t*
 
     case 'b':
         // read user code
-        Serial.print("\nUser Code: 0x"); 
-        Serial.print(max10_read_user_code(ir_len, ir_in, ir_out, dr_in, dr_out), HEX);
+        Host.print(F("\nUser Code: 0x")); 
+        Host.print(max10_read_user_code(ir_len, ir_in, ir_out, dr_in, dr_out), HEX);
         flush_ir_dr(ir_in, dr_out, ir_len, MAX_DR_LEN);
         break;
 
@@ -247,9 +506,18 @@ void max10_main(const uint8_t ir_len, uint8_t* ir_in, uint8_t* ir_out, uint8_t*
         max10_erase_device(ir_len, ir_in, ir_out, dr_in, dr_out);
         break;
 
+    case 'd':
+        // digest of an address range, to compare with the CRC32 of an image
+        parseNumber(NULL, 23, F("\nInsert start addr > "), &start);
+        parseNumber(NULL, 23, F("\nInsert amount of words > "), &num);
+        crc = max10_crc_ufm_range(ir_len, ir_in, ir_out, dr_in, dr_out, start, num, NULL);
+        max10_isc_disable(ir_len, ir_in, ir_out);
+        Host.print(F("\nCRC32: 0x")); Host.print(crc, HEX);
+        break;
+
     case 'z':
         // quit max10 commands menu
-        Serial.print("\nGoing back to main menu...");
+        Host.print(F("\nGoing back to main menu..."));
         break;
 
     default:
@@ -2,12 +2,29 @@
 #define __MAX10_FUNCS_H__
 
 #include "Arduino.h"
+#include "jtagger.h"
 
-uint32_t max10_read_user_code(const uint8_t ir_len, uint8_t* ir_in, uint8_t* ir_out, uint8_t* dr_in, uint8_t* dr_out);
-void max10_read_ufm_range(const uint8_t ir_len, uint8_t* ir_in, uint8_t* ir_out, uint8_t* dr_in, uint8_t* dr_out, const uint32_t start, const uint32_t num);
-void max10_read_ufm_range_burst(const uint8_t ir_len, uint8_t* ir_in, uint8_t* ir_out, uint8_t* dr_in, uint8_t* dr_out, const uint32_t start, const uint32_t num);
-void max10_readFlashSession(const uint8_t ir_len, uint8_t* ir_in, uint8_t* ir_out, uint8_t* dr_in, uint8_t* dr_out);
-void max10_erase_device(const uint8_t ir_len, uint8_t* ir_in, uint8_t * ir_out, uint8_t* dr_in, uint8_t* dr_out);
-void max10_main(const uint8_t ir_len, uint8_t* ir_in, uint8_t* ir_out, uint8_t* dr_in, uint8_t* dr_out);
+// Program time of a single UFM word, TCK cycles and microseconds in RUN_TEST_IDLE
+#define MAX10_PROGRAM_TCK 350
+#define MAX10_PROGRAM_US  0
+
+// Timing of the BSDL flows: least TCK cycles in RUN_TEST_IDLE, and the upper bound in microseconds
+#define MAX10_ENABLE_TCK  3
+#define MAX10_ENABLE_US   20000   // ISC_ENABLE WAIT TCK 3 20.0e-3, there is no status to poll
+#define MAX10_DISABLE_TCK 3
+#define MAX10_DISABLE_US  1000
+#define MAX10_ERASE_US    350000  // DSM_CLEAR WAIT 350.0e-3, there is no status to poll either
+
+uint32_t max10_read_user_code(const uint8_t ir_len, reg_t* ir_in, reg_t* ir_out, reg_t* dr_in, reg_t* dr_out);
+void max10_read_ufm_range(const uint8_t ir_len, reg_t* ir_in, reg_t* ir_out, reg_t* dr_in, reg_t* dr_out, const uint32_t start, const uint32_t num);
+void max10_read_ufm_range_burst(const uint8_t ir_len, reg_t* ir_in, reg_t* ir_out, reg_t* dr_in, reg_t* dr_out, const uint32_t start, const uint32_t num);
+void max10_dump_ufm_stream(const uint8_t ir_len, reg_t* ir_in, reg_t* ir_out, reg_t* dr_in, reg_t* dr_out, const uint32_t start, const uint32_t num);
+uint32_t max10_crc_ufm_range(const uint8_t ir_len, reg_t* ir_in, reg_t* ir_out, reg_t* dr_in, reg_t* dr_out, const uint32_t start, const uint32_t num, uint32_t* gang_crcs);
+void max10_readFlashSession(const uint8_t ir_len, reg_t* ir_in, reg_t* ir_out, reg_t* dr_in, reg_t* dr_out);
+int max10_erase(const uint8_t ir_len, reg_t* ir_in, reg_t* ir_out, reg_t* dr_in, reg_t* dr_out, uint32_t* waited_us);
+void max10_erase_device(const uint8_t ir_len, reg_t* ir_in, reg_t* ir_out, reg_t* dr_in, reg_t* dr_out);
+int max10_program_block(const uint8_t ir_len, reg_t* ir_in, reg_t* ir_out, reg_t* dr_in, reg_t* dr_out, const uint32_t addr, const uint8_t* data, const uint16_t num);
+void max10_isc_disable(const uint8_t ir_len, reg_t* ir_in, reg_t* ir_out);
+void max10_main(const uint8_t ir_len, reg_t* ir_in, reg_t* ir_out, reg_t* dr_in, reg_t* dr_out);
 
 #endif /* __MAX10_FUNCS_H__ */
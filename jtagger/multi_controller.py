@@ -0,0 +1,467 @@
+"""
+@file multi_controller.py
+
+@brief Drive several Jtagger adapters in parallel, with asyncio.
+        Every adapter gets its own reader task and a window of outstanding
+        requests, and a slow or hung adapter only fails its own job. The
+        progress of all the adapters is shown on a single line, followed by
+        a combined report.
+
+    python3 multi_controller.py --port /dev/ttyACM0 --port /dev/ttyACM1 --verify-ufm image.bin
+
+@author Michael Vigdorchik
+"""
+
+import argparse
+import asyncio
+import binascii
+import collections
+import os
+import struct
+import sys
+import termios
+import time
+from controller import (BAUD, BIN_SOF, BIN_REPLY, BIN_BANNER, BIN_CMD_PING, BIN_CMD_SELECT_TAP,
+                        BIN_CMD_CHAIN_INFO, BIN_CMD_UFM_DUMP, BIN_CMD_UFM_BLOCK, BIN_CMD_UFM_PROGRAM,
+                        BIN_CMD_UFM_ERASE, BIN_CMD_UFM_END, BIN_CMD_UFM_CRC, BIN_CMD_EXIT, BIN_TAP_CHAIN,
+                        BIN_MAX_PAYLOAD, ERR_VERIFY, MAX10_IR_LEN, MAX10_PROGRAM_BLOCK_WORDS, BinaryError,
+                        block_words, crc16)
+
+
+# seconds an adapter may stay silent while a request is outstanding
+TIMEOUT = 2.0
+# requests outstanding per adapter: the Arduino runs one frame while it
+# receives the next, any more wait in its RX ring (256 bytes on a Mega)
+WINDOW = 2
+
+
+class AsyncPort():
+    """
+    A serial port (or a pseudo terminal standing in for a board) read and
+    written through the event loop: incoming bytes are fed to a StreamReader,
+    writes never block the other adapters.
+    """
+    def __init__(self, path: str, baud: int = BAUD) -> None:
+        self.path = path
+        self.fd = os.open(path, os.O_RDWR | os.O_NOCTTY | os.O_NONBLOCK)
+        # raw 8N1. TCSANOW, so a prompt the Arduino already sent is kept
+        attrs = termios.tcgetattr(self.fd)
+        attrs[0] = 0
+        attrs[1] = 0
+        attrs[2] = termios.CS8 | termios.CREAD | termios.CLOCAL
+        attrs[3] = 0
+        attrs[4] = attrs[5] = getattr(termios, f"B{baud}")
+        attrs[6][termios.VMIN] = 0
+        attrs[6][termios.VTIME] = 0
+        termios.tcsetattr(self.fd, termios.TCSANOW, attrs)
+
+        self.loop = asyncio.get_running_loop()
+        self.reader = asyncio.StreamReader()
+        self.out = bytearray()
+        self.writing = False
+        self.loop.add_reader(self.fd, self._readable)
+
+    def _readable(self) -> None:
+        try:
+            data = os.read(self.fd, 4096)
+        except BlockingIOError:
+            return
+        except OSError:
+            data = b""
+        if data:
+            self.reader.feed_data(data)
+        else:
+            self.loop.remove_reader(self.fd)
+            self.reader.feed_eof()
+
+    def _writable(self) -> None:
+        try:
+            del self.out[:os.write(self.fd, self.out)]
+        except BlockingIOError:
+            pass
+        if self.out and not self.writing:
+            self.loop.add_writer(self.fd, self._writable)
+        elif not self.out and self.writing:
+            self.loop.remove_writer(self.fd)
+        self.writing = bool(self.out)
+
+    def write(self, data: bytes) -> None:
+        self.out += data
+        if not self.writing:
+            self._writable()
+
+    def close(self) -> None:
+        self.loop.remove_reader(self.fd)
+        self.loop.remove_writer(self.fd)
+        os.close(self.fd)
+
+
+class AsyncBinaryClient():
+    """
+    The binary protocol of BinaryClient over an AsyncPort.
+    A reader task parses every frame of the adapter: a reply completes the oldest
+    outstanding request (the Arduino answers in order), a streamed block goes to
+    the block handler of that request. Up to window requests are outstanding.
+    When the adapter stays silent for timeout seconds with a request outstanding,
+    it is considered hung: every outstanding request fails, and so do later ones.
+    """
+    def __init__(self, port: AsyncPort, window: int = WINDOW, timeout: float = TIMEOUT) -> None:
+        self.port = port
+        self.window = asyncio.Semaphore(window)
+        self.timeout = timeout
+        self.pending = collections.deque()  # (cmd, future, block handler) in the order sent
+        self.error = None
+        self.reader_task = None
+        self.last_rx = time.monotonic()
+        self.rx_bytes = 0
+        self.tx_bytes = 0
+        self.max_payload = BIN_MAX_PAYLOAD
+
+    async def enter(self) -> None:
+        """Switch to binary mode, from the 'Insert start' prompt after a reset or from the 'cmd >' prompt"""
+        reader = self.port.reader
+        try:
+            seen = await asyncio.wait_for(reader.readuntil(b">"), self.timeout)
+        except asyncio.TimeoutError:
+            # the 'cmd >' prompt was printed before the port was opened
+            seen = b""
+        if b"start" in seen:
+            self.port.write(b"start\n")
+            await asyncio.wait_for(reader.readuntil(b"cmd >"), self.timeout)
+        self.port.write(b"b\n")
+        try:
+            await asyncio.wait_for(reader.readuntil(BIN_BANNER), self.timeout)
+        except asyncio.TimeoutError:
+            raise BinaryError("Arduino did not enter binary mode")
+        self.reader_task = asyncio.create_task(self._read_frames())
+        await self.ping()
+
+    async def close(self) -> None:
+        if self.reader_task:
+            self.reader_task.cancel()
+            try:
+                await self.reader_task
+            except asyncio.CancelledError:
+                pass
+        self.port.close()
+
+    def _fail(self, error: BinaryError) -> None:
+        self.error = error
+        while self.pending:
+            _, future, _ = self.pending.popleft()
+            if not future.done():
+                future.set_exception(error)
+
+    async def _read_frames(self) -> None:
+        reader = self.port.reader
+        try:
+            while True:
+                await reader.readuntil(bytes([BIN_SOF]))
+                hdr = await reader.readexactly(3)
+                cmd, length = struct.unpack("<BH", hdr)
+                payload = await reader.readexactly(length)
+                tail = await reader.readexactly(2)
+                self.last_rx = time.monotonic()
+                self.rx_bytes += length + 6
+                if struct.unpack("<H", tail)[0] != crc16(hdr + payload):
+                    raise BinaryError("Bad reply CRC")
+                self._dispatch(cmd & ~BIN_REPLY, payload[0], payload[1:])
+        except (asyncio.IncompleteReadError, asyncio.LimitOverrunError):
+            self._fail(BinaryError("Adapter closed the port"))
+        except BinaryError as error:
+            self._fail(error)
+
+    def _dispatch(self, cmd: int, status: int, data: bytes) -> None:
+        if not self.pending:
+            raise BinaryError(f"Unexpected frame of command 0x{cmd:x}")
+        req_cmd, future, on_block = self.pending[0]
+        if cmd != req_cmd:
+            if on_block is None:
+                raise BinaryError(f"Reply to command 0x{cmd:x} while waiting for 0x{req_cmd:x}")
+            on_block(cmd, status, data)
+            return
+        self.pending.popleft()
+        if not future.done():
+            future.set_result((status, data))
+
+    async def request(self, cmd: int, payload: bytes = b"", on_block=None) -> tuple:
+        """
+        Send a request once fewer than window are outstanding, and wait for its reply.
+        on_block(cmd, status, data) receives the frames streamed before the reply.
+        Return (status, data).
+        """
+        async with self.window:
+            if self.error:
+                raise self.error
+            future = asyncio.get_running_loop().create_future()
+            if not self.pending:
+                # the adapter had nothing to answer until now
+                self.last_rx = time.monotonic()
+            self.pending.append((cmd, future, on_block))
+            body = struct.pack("<BH", cmd, len(payload)) + payload
+            self.port.write(bytes([BIN_SOF]) + body + struct.pack("<H", crc16(body)))
+            self.tx_bytes += len(body) + 3
+
+            while not future.done():
+                await asyncio.wait({future}, timeout=self.timeout)
+                if not future.done() and time.monotonic() - self.last_rx >= self.timeout:
+                    self._fail(BinaryError(f"No reply for {self.timeout:g} s, adapter hung"))
+            return future.result()
+
+    async def transact(self, cmd: int, payload: bytes = b"") -> bytes:
+        """Send a request and return the data of its reply"""
+        status, data = await self.request(cmd, payload)
+        if status != 0:
+            raise BinaryError(f"Command 0x{cmd:x} failed with error {status}")
+        return data
+
+    async def ping(self) -> int:
+        """Return the protocol version, and learn the largest payload the Arduino takes"""
+        data = await self.transact(BIN_CMD_PING)
+        if len(data) >= 3:
+            self.max_payload = struct.unpack_from("<H", data, 1)[0]
+        return data[0]
+
+    async def select_tap(self, index=None) -> None:
+        await self.transact(BIN_CMD_SELECT_TAP, bytes([BIN_TAP_CHAIN if index is None else index]))
+
+    async def chain_info(self) -> list:
+        """List of (idcode, ir_len) of the TAPs found by the Arduino, nearest to TDO first."""
+        data = await self.transact(BIN_CMD_CHAIN_INFO)
+        return [struct.unpack_from("<IB", data, 1 + i * 5) for i in range(data[0])]
+
+    async def crc_ufm(self, start: int, words: int) -> int:
+        data = await self.transact(BIN_CMD_UFM_CRC, struct.pack("<BII", MAX10_IR_LEN, start, words))
+        return struct.unpack_from("<I", data)[0]
+
+    async def verify_ufm(self, image: bytes, start: int, leaf: int = 1, progress=None) -> list:
+        """
+        BinaryClient.verify_ufm(), with the CRCs of all the ranges of a bisection
+        level outstanding together. Return the (address, words) ranges that differ.
+        """
+        image += b"\xff" * (-len(image) % 4)
+        words = len(image) // 4
+        level = [(0, words)] if words else []
+        differ = []
+        resolved = 0
+        while level:
+            crcs = await asyncio.gather(*(self.crc_ufm(start + 4 * first, n) for first, n in level))
+            split = []
+            for (first, n), crc in zip(level, crcs):
+                same = crc == binascii.crc32(image[4 * first:4 * (first + n)])
+                if not same and n > leaf:
+                    half = n // 2
+                    split += [(first, half), (first + half, n - half)]
+                    continue
+                if not same:
+                    differ.append((first, n))
+                resolved += n
+                if progress:
+                    progress(resolved, words)
+            level = split
+        await self.transact(BIN_CMD_UFM_END, bytes([MAX10_IR_LEN]))
+
+        merged = []
+        for first, n in sorted(differ):
+            if merged and merged[-1][0] + merged[-1][1] == first:
+                merged[-1] = (merged[-1][0], merged[-1][1] + n)
+            else:
+                merged.append((first, n))
+        return [(start + 4 * first, n) for first, n in merged]
+
+    async def program_ufm(self, image: bytes, start: int, erase: bool = True, progress=None) -> list:
+        """
+        BinaryClient.program_ufm(): erase, then program block by block with up to
+        window blocks outstanding. Return the addresses of the blocks that failed verification.
+        """
+        image += b"\xff" * (-len(image) % 4)
+        words = len(image) // 4
+        done = 0
+
+        async def program_block(addr: int, data: bytes) -> bool:
+            nonlocal done
+            status, reply = await self.request(BIN_CMD_UFM_PROGRAM, struct.pack("<BI", MAX10_IR_LEN, addr) + data)
+            if status not in (0, ERR_VERIFY):
+                raise BinaryError(f"Programming failed with error {status}")
+            if struct.unpack_from("<I", reply)[0] != addr:
+                raise BinaryError(f"Reply for block 0x{struct.unpack_from('<I', reply)[0]:x}, expected 0x{addr:x}")
+            done += len(data) // 4
+            if progress:
+                progress(done, words)
+            return status == 0
+
+        if erase:
+            status, _ = await self.request(BIN_CMD_UFM_ERASE, bytes([MAX10_IR_LEN]))
+            if status != 0:
+                raise BinaryError(f"Erase failed with error {status}")
+        step = block_words(self.max_payload, 5, MAX10_PROGRAM_BLOCK_WORDS)
+        blocks = [(start + 4 * i, image[4 * i:4 * (i + step)]) for i in range(0, words, step)]
+        passed = await asyncio.gather(*(program_block(addr, data) for addr, data in blocks))
+        await self.transact(BIN_CMD_UFM_END, bytes([MAX10_IR_LEN]))
+        return [addr for (addr, _), ok in zip(blocks, passed) if not ok]
+
+    async def dump_ufm(self, path: str, start: int, words: int, progress=None) -> None:
+        """Stream words 32 bit words of the MAX10 UFM, from address start, into the file path"""
+        done = 0
+
+        def on_block(cmd: int, status: int, data: bytes) -> None:
+            nonlocal done
+            if cmd != BIN_CMD_UFM_BLOCK or status != 0:
+                raise BinaryError(f"UFM dump failed with error {status} (command 0x{cmd:x})")
+            block_addr = struct.unpack_from("<I", data)[0]
+            if block_addr != start + 4 * done:
+                raise BinaryError(f"Block at 0x{block_addr:x}, expected 0x{start + 4 * done:x}")
+            f.write(data[4:])
+            done += (len(data) - 4) // 4
+            if progress:
+                progress(done, words)
+
+        with open(path, "wb") as f:
+            status, _ = await self.request(BIN_CMD_UFM_DUMP, struct.pack("<BII", MAX10_IR_LEN, start, words),
+                                           on_block)
+        if status != 0 or done != words:
+            raise BinaryError(f"UFM dump failed with error {status} after {done} words")
+
+    async def exit(self) -> None:
+        """Go back to the ASCII main menu"""
+        await self.transact(BIN_CMD_EXIT)
+
+
+class Adapter():
+    """State of one adapter of the run, for the progress line and the report"""
+    def __init__(self, path: str) -> None:
+        self.path = path
+        self.name = os.path.basename(path)
+        self.state = "waiting"
+        self.done = 0
+        self.total = 0
+        self.result = ""
+        self.elapsed = 0.0
+        self.rx_bytes = 0
+        self.tx_bytes = 0
+
+    def progress(self, done: int, total: int) -> None:
+        self.done, self.total = done, total
+
+    def status(self) -> str:
+        if self.state == "running" and self.total:
+            return f"{self.name} {100 * self.done // self.total}%"
+        return f"{self.name} {self.state}"
+
+
+async def identify(b: AsyncBinaryClient, a: Adapter, args) -> tuple:
+    await b.ping()
+    taps = await b.chain_info()
+    return True, ", ".join(f"0x{idcode:08x} (IR {ir_len})" for idcode, ir_len in taps) or "no TAPs"
+
+
+async def verify_ufm(b: AsyncBinaryClient, a: Adapter, args) -> tuple:
+    ranges = await b.verify_ufm(args.image, args.start, progress=a.progress)
+    if not ranges:
+        return True, f"{len(args.image) // 4} words match"
+    shown = ", ".join(f"0x{addr:x} ({n} words)" for addr, n in ranges[:4])
+    return False, f"{len(ranges)} ranges differ: {shown}{', ...' if len(ranges) > 4 else ''}"
+
+
+async def program_ufm(b: AsyncBinaryClient, a: Adapter, args) -> tuple:
+    failed = await b.program_ufm(args.image, args.start, erase=not args.no_erase, progress=a.progress)
+    if not failed:
+        return True, f"{(len(args.image) + 3) // 4} words programmed"
+    return False, f"{len(failed)} blocks failed verification: " + ", ".join(f"0x{addr:x}" for addr in failed[:4])
+
+
+async def dump_ufm(b: AsyncBinaryClient, a: Adapter, args) -> tuple:
+    path = args.dump_ufm.replace("{port}", a.name)
+    await b.dump_ufm(path, args.start, args.words, progress=a.progress)
+    return True, f"{args.words} words in {path}"
+
+
+async def run_adapter(a: Adapter, job, args) -> None:
+    """Run a job on one adapter. Every failure is recorded in the adapter, never raised"""
+    started = time.monotonic()
+    port = None
+    b = None
+    try:
+        a.state = "connecting"
+        port = AsyncPort(a.path, args.baud)
+        b = AsyncBinaryClient(port, args.window, args.timeout)
+        await b.enter()
+        a.state = "running"
+        ok, a.result = await job(b, a, args)
+        await b.exit()
+        a.state = "ok" if ok else "MISMATCH"
+    except (BinaryError, OSError, asyncio.TimeoutError, asyncio.IncompleteReadError,
+            asyncio.LimitOverrunError) as error:
+        a.state = "FAILED"
+        a.result = str(error) or type(error).__name__
+    finally:
+        if b:
+            a.rx_bytes, a.tx_bytes = b.rx_bytes, b.tx_bytes
+            await b.close()
+        elif port:
+            port.close()
+        a.elapsed = time.monotonic() - started
+
+
+async def show_progress(adapters: list) -> None:
+    """Progress of all the adapters on a single line, until cancelled"""
+    while True:
+        sys.stdout.write("\r" + " | ".join(a.status() for a in adapters) + "\033[K")
+        sys.stdout.flush()
+        await asyncio.sleep(0.2)
+
+
+def print_report(adapters: list, wall: float) -> None:
+    width = max(len(a.path) for a in adapters)
+    print(f"\r\033[K{'port':<{width}}  {'state':<9} {'time':>7} {'rx':>8} {'tx':>8}  result")
+    for a in adapters:
+        print(f"{a.path:<{width}}  {a.state:<9} {a.elapsed:6.2f}s {a.rx_bytes:8} {a.tx_bytes:8}  {a.result}")
+    ok = sum(a.state == "ok" for a in adapters)
+    print(f"{ok}/{len(adapters)} adapters ok in {wall:.2f} s")
+
+
+async def run_all(paths: list, job, args) -> bool:
+    adapters = [Adapter(path) for path in paths]
+    started = time.monotonic()
+    progress = asyncio.create_task(show_progress(adapters))
+    await asyncio.gather(*(run_adapter(a, job, args) for a in adapters))
+    progress.cancel()
+    print_report(adapters, time.monotonic() - started)
+    return all(a.state == "ok" for a in adapters)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Run the same command on several Jtagger adapters at once")
+    parser.add_argument("--port", action="append", required=True,
+                        help="serial port of an Arduino (or a sim/jtagger_pty terminal), repeat for every adapter")
+    command = parser.add_mutually_exclusive_group()
+    command.add_argument("--identify", action="store_true", help="list the TAPs of every chain (default)")
+    command.add_argument("--verify-ufm", metavar="FILE", help="compare the MAX10 UFM with a raw image by CRC32")
+    command.add_argument("--program-ufm", metavar="FILE", help="program a raw image into the MAX10 UFM")
+    command.add_argument("--dump-ufm", metavar="FILE",
+                         help="dump the MAX10 UFM into FILE, where {port} is replaced by the port name")
+    parser.add_argument("--no-erase", action="store_true", help="don't erase the flash before --program-ufm")
+    parser.add_argument("--start", type=lambda x: int(x, 0), default=0, help="first UFM address")
+    parser.add_argument("--words", type=lambda x: int(x, 0), default=0, help="number of 32 bit words")
+    parser.add_argument("--baud", type=int, default=BAUD)
+    parser.add_argument("--window", type=int, default=WINDOW, help="requests outstanding per adapter")
+    parser.add_argument("--timeout", type=float, default=TIMEOUT,
+                        help="seconds of silence after which an adapter is considered hung")
+    args = parser.parse_args()
+
+    job = identify
+    if args.verify_ufm or args.program_ufm:
+        with open(args.verify_ufm or args.program_ufm, "rb") as f:
+            args.image = f.read()
+        job = verify_ufm if args.verify_ufm else program_ufm
+    elif args.dump_ufm:
+        if len(args.port) > 1 and "{port}" not in args.dump_ufm:
+            parser.error("--dump-ufm needs {port} in the file name with several ports")
+        job = dump_ufm
+
+    if not asyncio.run(run_all(args.port, job, args)):
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,119 @@
+/* --------------------------------------------------------------------------------------- */
+/* ----------------------------- Ring buffered serial port --------------------------------*/
+/* --------------------------------------------------------------------------------------- */
+
+#include "serial_io.h"
+#include "jtagger.h"
+
+SerialRing Host;
+
+void SerialRing::begin(unsigned long baud)
+{
+    Serial.begin(baud);
+}
+
+void SerialRing::end()
+{
+    flush();
+    Serial.end();
+}
+
+SerialRing::operator bool()
+{
+    return (bool)Serial;
+}
+
+void SerialRing::pump()
+{
+    uint16_t n = 0;
+    int room = 0;
+
+    // keep the core RX buffer empty, the host may stream ahead
+    while (rx_count() < SERIAL_RX_RING - 1 && Serial.available() > 0)
+    {
+        rx_buf[rx_head] = Serial.read();
+        rx_head = (rx_head + 1) & (SERIAL_RX_RING - 1);
+    }
+
+    // as much as fits, the core buffer drains from its interrupt
+    room = Serial.availableForWrite();
+    while (room > 0 && tx_tail != tx_head)
+    {
+        // the ring may wrap, write up to its end first
+        n = (tx_head > tx_tail ? tx_head : SERIAL_TX_RING) - tx_tail;
+        if (n > room)
+            n = room;
+        Serial.write(&tx_buf[tx_tail], n);
+        tx_tail = (tx_tail + n) & (SERIAL_TX_RING - 1);
+        room -= n;
+    }
+}
+
+int SerialRing::available()
+{
+    pump();
+    return rx_count();
+}
+
+int SerialRing::read()
+{
+    int c = 0;
+
+    pump();
+    if (rx_count() == 0)
+        return -1;
+
+    c = rx_buf[rx_tail];
+    rx_tail = (rx_tail + 1) & (SERIAL_RX_RING - 1);
+    return c;
+}
+
+int SerialRing::peek()
+{
+    pump();
+    return rx_count() ? rx_buf[rx_tail] : -1;
+}
+
+int SerialRing::availableForWrite()
+{
+    pump();
+    return tx_free();
+}
+
+size_t SerialRing::write(uint8_t c)
+{
+    return write(&c, 1);
+}
+
+size_t SerialRing::write(const uint8_t* buf, size_t len)
+{
+    uint32_t start = 0;
+    size_t i = 0;
+
+    for (i = 0; i < len; i++)
+    {
+        // a full ring blocks the sketch until the wire makes room
+        if (tx_free() == 0) {
+            start = micros();
+            while (tx_free() == 0)
+                pump();
+            stats.flush_us += micros() - start;
+        }
+        tx_buf[tx_head] = buf[i];
+        tx_head = (tx_head + 1) & (SERIAL_TX_RING - 1);
+    }
+
+    pump();
+    return len;
+}
+
+void SerialRing::flush()
+{
+    uint32_t start = micros();
+
+    while (tx_tail != tx_head)
+        pump();
+    Serial.flush();
+
+    stats.flush_us += micros() - start;
+}
@@ -0,0 +1,70 @@
+/** @file serial_io.h
+ *
+ * @brief Ring buffered serial port to the host.
+ *
+ * Everything the sketch prints goes into a TX ring, and pump() moves it into
+ * the core's (small, interrupt driven) serial buffer whenever there is room.
+ * The scan engine pumps between the words of a scan, so output drains while
+ * the TAPs keep shifting and a print only blocks when the ring is full.
+ * pump() also empties the core's RX buffer into an RX ring, so a host that
+ * streams ahead doesn't overflow it during a long scan.
+ *
+ * flush() waits until every byte is on the wire. Call it only at protocol
+ * boundaries: before waiting for user input or leaving the binary mode.
+ */
+#ifndef __SERIAL_IO_H__
+#define __SERIAL_IO_H__
+
+#include "Arduino.h"
+
+// ring sizes, powers of 2
+#if defined(ARDUINO_AVR_MEGA2560)
+#define SERIAL_TX_RING 256
+#define SERIAL_RX_RING 256
+#else
+#define SERIAL_TX_RING 4096
+#define SERIAL_RX_RING 1024
+#endif
+
+class SerialRing : public Stream
+{
+public:
+    void begin(unsigned long baud);
+    void end();
+    operator bool();
+
+    int available();
+    int read();
+    int peek();
+    void flush();
+
+    size_t write(uint8_t c);
+    size_t write(const uint8_t* buf, size_t len);
+    using Print::write;
+
+    /**
+     * @return Bytes that can be written without blocking.
+     */
+    int availableForWrite();
+
+    /**
+     * @brief Move bytes between the rings and the core serial buffers. Never blocks.
+     */
+    void pump();
+
+private:
+    uint16_t tx_free() { return (tx_tail - tx_head - 1) & (SERIAL_TX_RING - 1); }
+    uint16_t rx_count() { return (rx_head - rx_tail) & (SERIAL_RX_RING - 1); }
+
+    uint8_t tx_buf[SERIAL_TX_RING];
+    uint8_t rx_buf[SERIAL_RX_RING];
+    uint16_t tx_head = 0;
+    uint16_t tx_tail = 0;
+    uint16_t rx_head = 0;
+    uint16_t rx_tail = 0;
+};
+
+// the serial port to the host, used instead of Serial
+extern SerialRing Host;
+
+#endif /* __SERIAL_IO_H__ */
@@ -0,0 +1,283 @@
+"""
+SVF and XSVF parsers for the jtagger player.
+
+Both formats are reduced to the same list of simple operations, which
+controller.py packs into BIN_CMD_QUEUE batches:
+
+    ("scan", is_ir, length, tdi, tdo, mask, end_state, line)
+        tdo is None when the captured bits are not checked
+    ("state", state, line)
+    ("clock", cycles, usec, line)   keep TCK running in the current stable state
+    ("tck", khz, line)              0 selects the fastest rate
+    ("trst", level, line)
+
+Vectors are python integers, bit 0 is the first bit shifted.
+States are names from TAP_STATES of controller.py.
+line is the SVF line number (or the XSVF byte offset) for error reports.
+"""
+import re
+
+
+class SvfError(Exception):
+    pass
+
+
+SVF_STATES = {
+    "RESET": "TEST_LOGIC_RESET", "IDLE": "RUN_TEST_IDLE",
+    "DRSELECT": "SELECT_DR", "DRCAPTURE": "CAPTURE_DR", "DRSHIFT": "SHIFT_DR",
+    "DREXIT1": "EXIT1_DR", "DRPAUSE": "PAUSE_DR", "DREXIT2": "EXIT2_DR", "DRUPDATE": "UPDATE_DR",
+    "IRSELECT": "SELECT_IR", "IRCAPTURE": "CAPTURE_IR", "IRSHIFT": "SHIFT_IR",
+    "IREXIT1": "EXIT1_IR", "IRPAUSE": "PAUSE_IR", "IREXIT2": "EXIT2_IR", "IRUPDATE": "UPDATE_IR",
+}
+
+STABLE_STATES = ("TEST_LOGIC_RESET", "RUN_TEST_IDLE", "PAUSE_DR", "PAUSE_IR")
+
+
+class _Register():
+    """Sticky TDI/TDO/MASK values of one of SIR, SDR, HIR, HDR, TIR and TDR"""
+    def __init__(self) -> None:
+        self.length = 0
+        self.tdi = 0
+        self.tdo = None
+        self.mask = 0
+
+    def update(self, length: int, fields: dict, line: int) -> None:
+        full = (1 << length) - 1
+        if length != self.length:
+            # a new length drops the previous values
+            if length and "TDI" not in fields:
+                raise SvfError(f"line {line}: TDI is required when the length changes")
+            self.length = length
+            self.tdi = 0
+            self.mask = full
+        self.tdo = None
+        for name, value in fields.items():
+            if value > full:
+                raise SvfError(f"line {line}: {name} is longer than {length} bits")
+            if name == "TDI":
+                self.tdi = value
+            elif name == "TDO":
+                self.tdo = value
+            elif name == "MASK":
+                self.mask = value
+            # SMASK only marks don't care TDI bits, nothing to do with it
+
+
+def _tokens(text: str):
+    """Yield (line, [words]) for every ';' terminated SVF command"""
+    words = []
+    start = None
+    for number, raw in enumerate(text.splitlines(), 1):
+        line = re.split(r"!|//", raw, 1)[0]
+        for word in re.findall(r"\(|\)|;|[^\s();]+", line):
+            if start is None:
+                start = number
+            if word == ";":
+                yield start, words
+                words = []
+                start = None
+            else:
+                words.append(word.upper())
+    if words:
+        raise SvfError(f"line {start}: missing ';'")
+
+
+def _vector_fields(words, line: int) -> dict:
+    """Parse 'TDI (hex) TDO (hex) ...' into a dict of integers"""
+    fields = dict()
+    i = 0
+    while i < len(words):
+        name = words[i]
+        if name not in ("TDI", "TDO", "MASK", "SMASK") or i + 1 >= len(words) or words[i + 1] != "(":
+            raise SvfError(f"line {line}: bad field {name}")
+        end = words.index(")", i)
+        fields[name] = int("".join(words[i + 2:end]) or "0", 16)
+        i = end + 1
+    return fields
+
+
+def _state(name: str, line: int) -> str:
+    if name not in SVF_STATES:
+        raise SvfError(f"line {line}: unknown state {name}")
+    return SVF_STATES[name]
+
+
+def parse_svf(text: str) -> list:
+    """Parse the text of an SVF file into a list of operations"""
+    ops = []
+    regs = {name: _Register() for name in ("SIR", "SDR", "HIR", "HDR", "TIR", "TDR")}
+    end_ir = "RUN_TEST_IDLE"
+    end_dr = "RUN_TEST_IDLE"
+    run_state = "RUN_TEST_IDLE"
+    run_end = "RUN_TEST_IDLE"
+
+    for line, words in _tokens(text):
+        cmd, args = words[0], words[1:]
+
+        if cmd in regs:
+            if not args:
+                raise SvfError(f"line {line}: {cmd} without a length")
+            regs[cmd].update(int(args[0]), _vector_fields(args[1:], line), line)
+            if cmd not in ("SIR", "SDR"):
+                continue
+
+            # the header is shifted first, so it lands in the TAPs nearest to TDO
+            is_ir = cmd == "SIR"
+            parts = [regs["HIR"], regs["SIR"], regs["TIR"]] if is_ir else [regs["HDR"], regs["SDR"], regs["TDR"]]
+            length = tdi = tdo = mask = 0
+            check = any(p.tdo is not None for p in parts)
+            for p in parts:
+                tdi |= p.tdi << length
+                if p.tdo is not None:
+                    tdo |= p.tdo << length
+                    mask |= p.mask << length
+                length += p.length
+            ops.append(("scan", is_ir, length, tdi, tdo if check else None, mask,
+                        end_ir if is_ir else end_dr, line))
+
+        elif cmd in ("ENDIR", "ENDDR"):
+            state = _state(args[0], line)
+            if state not in STABLE_STATES:
+                raise SvfError(f"line {line}: {cmd} to a state that is not stable")
+            if cmd == "ENDIR":
+                end_ir = state
+            else:
+                end_dr = state
+
+        elif cmd == "STATE":
+            # each state of the path is reached with the shortest path to it
+            for name in args:
+                ops.append(("state", _state(name, line), line))
+
+        elif cmd == "RUNTEST":
+            if args and args[0] in SVF_STATES:
+                run_state = _state(args.pop(0), line)
+            cycles = 0
+            usec = 0
+            i = 0
+            while i < len(args):
+                if i + 1 < len(args) and args[i + 1] == "TCK":
+                    cycles = int(float(args[i]))
+                    i += 2
+                elif i + 1 < len(args) and args[i + 1] == "SEC":
+                    usec = int(float(args[i]) * 1e6 + 0.5)
+                    i += 2
+                elif args[i] == "MAXIMUM":
+                    i += 3
+                elif args[i] == "ENDSTATE" and i + 1 < len(args):
+                    run_end = _state(args[i + 1], line)
+                    i += 2
+                else:
+                    raise SvfError(f"line {line}: unsupported RUNTEST argument {args[i]}")
+            ops.append(("state", run_state, line))
+            ops.append(("clock", cycles, usec, line))
+            if run_end != run_state:
+                ops.append(("state", run_end, line))
+
+        elif cmd == "FREQUENCY":
+            # a bare FREQUENCY is the full speed (0), slow rates don't round down to it
+            khz = max(1, int(float(args[0]) // 1000)) if args else 0
+            ops.append(("tck", khz, line))
+
+        elif cmd == "TRST":
+            if args[0] in ("ON", "OFF"):
+                # TRST is active low
+                ops.append(("trst", 0 if args[0] == "ON" else 1, line))
+
+        else:
+            raise SvfError(f"line {line}: unsupported command {cmd}")
+
+    return ops
+
+
+# XSVF commands
+XCOMPLETE, XTDOMASK, XSIR, XSDR, XRUNTEST = 0x00, 0x01, 0x02, 0x03, 0x04
+XREPEAT, XSDRSIZE, XSDRTDO = 0x07, 0x08, 0x09
+XSTATE, XENDIR, XENDDR, XSIR2, XCOMMENT, XWAIT = 0x12, 0x13, 0x14, 0x15, 0x16, 0x17
+
+# XSVF states use the same order as TAP_STATES
+XSVF_STATES = [
+    "TEST_LOGIC_RESET", "RUN_TEST_IDLE",
+    "SELECT_DR", "CAPTURE_DR", "SHIFT_DR", "EXIT1_DR", "PAUSE_DR", "EXIT2_DR", "UPDATE_DR",
+    "SELECT_IR", "CAPTURE_IR", "SHIFT_IR", "EXIT1_IR", "PAUSE_IR", "EXIT2_IR", "UPDATE_IR",
+]
+
+
+def parse_xsvf(data: bytes) -> list:
+    """
+    Parse an XSVF file into a list of operations.
+    XREPEAT retries are not done, a mismatch is reported on the first attempt.
+    """
+    ops = []
+    pos = 0
+    sdr_size = 0
+    tdo_mask = 0
+    tdo_expected = 0
+    run_usec = 0
+    end_ir = "RUN_TEST_IDLE"
+    end_dr = "RUN_TEST_IDLE"
+
+    def take(n: int) -> bytes:
+        nonlocal pos
+        if pos + n > len(data):
+            raise SvfError(f"offset {pos}: truncated XSVF")
+        pos += n
+        return data[pos - n:pos]
+
+    def vector(bits: int) -> int:
+        # vectors are stored MSB first, the last bit of the last byte is shifted first
+        return int.from_bytes(take((bits + 7) // 8), "big")
+
+    def scan(is_ir: bool, length: int, tdi: int, tdo, mask: int, at: int) -> None:
+        # with a run test time the scan ends in RUN_TEST_IDLE and waits there
+        end = "RUN_TEST_IDLE" if run_usec else (end_ir if is_ir else end_dr)
+        ops.append(("scan", is_ir, length, tdi, tdo, mask, end, at))
+        if run_usec:
+            ops.append(("clock", 0, run_usec, at))
+
+    while pos < len(data):
+        at = pos
+        cmd = take(1)[0]
+
+        if cmd == XCOMPLETE:
+            break
+        elif cmd == XTDOMASK:
+            tdo_mask = vector(sdr_size)
+        elif cmd == XSIR:
+            length = take(1)[0]
+            scan(True, length, vector(length), None, 0, at)
+        elif cmd == XSIR2:
+            length = int.from_bytes(take(2), "big")
+            scan(True, length, vector(length), None, 0, at)
+        elif cmd == XSDR:
+            # checked against the expected value of the last XSDRTDO
+            scan(False, sdr_size, vector(sdr_size), tdo_expected if tdo_mask else None, tdo_mask, at)
+        elif cmd == XSDRTDO:
+            tdi = vector(sdr_size)
+            tdo_expected = vector(sdr_size)
+            scan(False, sdr_size, tdi, tdo_expected, tdo_mask, at)
+        elif cmd == XRUNTEST:
+            run_usec = int.from_bytes(take(4), "big")
+        elif cmd == XREPEAT:
+            take(1)
+        elif cmd == XSDRSIZE:
+            sdr_size = int.from_bytes(take(4), "big")
+        elif cmd == XSTATE:
+            ops.append(("state", XSVF_STATES[take(1)[0] & 0x0F], at))
+        elif cmd == XENDIR:
+            end_ir = "PAUSE_IR" if take(1)[0] else "RUN_TEST_IDLE"
+        elif cmd == XENDDR:
+            end_dr = "PAUSE_DR" if take(1)[0] else "RUN_TEST_IDLE"
+        elif cmd == XCOMMENT:
+            end = data.find(b"\0", pos)
+            pos = len(data) if end < 0 else end + 1
+        elif cmd == XWAIT:
+            wait_state, end_state = take(1)[0], take(1)[0]
+            usec = int.from_bytes(take(4), "big")
+            ops.append(("state", XSVF_STATES[wait_state & 0x0F], at))
+            ops.append(("clock", 0, usec, at))
+            ops.append(("state", XSVF_STATES[end_state & 0x0F], at))
+        else:
+            raise SvfError(f"offset {at}: unsupported XSVF command 0x{cmd:02x}")
+
+    return ops
@@ -0,0 +1,60 @@
+/** @file tap_paths.h
+ *
+ * @brief Constant tables of the IEEE 1149.1 TAP state machine.
+ *
+ * tap_transitions[state][tms] is the state that follows state
+ * after a single TCK cycle with the given TMS value.
+ *
+ * tms_paths[from][to] is the shortest TMS sequence that moves the TAP
+ * from one state to another. The high byte holds the number of TCK
+ * cycles and the low byte the TMS bits, where bit 0 is clocked first.
+ * A path from a state to itself is empty.
+ */
+#ifndef __TAP_PATHS_H__
+#define __TAP_PATHS_H__
+
+#include "jtagger.h"
+
+#define TMS_PATH_LEN(path)  ((path) >> 8)
+#define TMS_PATH_BITS(path) ((path) & 0xff)
+
+static constexpr uint8_t tap_transitions[16][2] = {
+    /* TEST_LOGIC_RESET */ {RUN_TEST_IDLE, TEST_LOGIC_RESET},
+    /* RUN_TEST_IDLE    */ {RUN_TEST_IDLE, SELECT_DR},
+    /* SELECT_DR        */ {CAPTURE_DR, SELECT_IR},
+    /* CAPTURE_DR       */ {SHIFT_DR, EXIT1_DR},
+    /* SHIFT_DR         */ {SHIFT_DR, EXIT1_DR},
+    /* EXIT1_DR         */ {PAUSE_DR, UPDATE_DR},
+    /* PAUSE_DR         */ {PAUSE_DR, EXIT2_DR},
+    /* EXIT2_DR         */ {SHIFT_DR, UPDATE_DR},
+    /* UPDATE_DR        */ {RUN_TEST_IDLE, SELECT_DR},
+    /* SELECT_IR        */ {CAPTURE_IR, TEST_LOGIC_RESET},
+    /* CAPTURE_IR       */ {SHIFT_IR, EXIT1_IR},
+    /* SHIFT_IR         */ {SHIFT_IR, EXIT1_IR},
+    /* EXIT1_IR         */ {PAUSE_IR, UPDATE_IR},
+    /* PAUSE_IR         */ {PAUSE_IR, EXIT2_IR},
+    /* EXIT2_IR         */ {SHIFT_IR, UPDATE_IR},
+    /* UPDATE_IR        */ {RUN_TEST_IDLE, SELECT_DR},
+};
+
+static constexpr uint16_t tms_paths[16][16] = {
+    /*                        TLR     RTI     SELDR   CAPDR   SHDR    EX1DR   PSDR    EX2DR   UPDDR   SELIR   CAPIR   SHIR    EX1IR   PSIR    EX2IR   UPDIR */
+    /* TEST_LOGIC_RESET */ {0x0000, 0x0100, 0x0202, 0x0302, 0x0402, 0x040a, 0x050a, 0x062a, 0x051a, 0x0306, 0x0406, 0x0506, 0x0516, 0x0616, 0x0756, 0x0636},
+    /* RUN_TEST_IDLE    */ {0x0307, 0x0000, 0x0101, 0x0201, 0x0301, 0x0305, 0x0405, 0x0515, 0x040d, 0x0203, 0x0303, 0x0403, 0x040b, 0x050b, 0x062b, 0x051b},
+    /* SELECT_DR        */ {0x0203, 0x0303, 0x0000, 0x0100, 0x0200, 0x0202, 0x0302, 0x040a, 0x0306, 0x0101, 0x0201, 0x0301, 0x0305, 0x0405, 0x0515, 0x040d},
+    /* CAPTURE_DR       */ {0x051f, 0x0303, 0x0307, 0x0000, 0x0100, 0x0101, 0x0201, 0x0305, 0x0203, 0x040f, 0x050f, 0x060f, 0x062f, 0x072f, 0x08af, 0x076f},
+    /* SHIFT_DR         */ {0x051f, 0x0303, 0x0307, 0x0407, 0x0000, 0x0101, 0x0201, 0x0305, 0x0203, 0x040f, 0x050f, 0x060f, 0x062f, 0x072f, 0x08af, 0x076f},
+    /* EXIT1_DR         */ {0x040f, 0x0201, 0x0203, 0x0303, 0x0302, 0x0000, 0x0100, 0x0202, 0x0101, 0x0307, 0x0407, 0x0507, 0x0517, 0x0617, 0x0757, 0x0637},
+    /* PAUSE_DR         */ {0x051f, 0x0303, 0x0307, 0x0407, 0x0201, 0x0305, 0x0000, 0x0101, 0x0203, 0x040f, 0x050f, 0x060f, 0x062f, 0x072f, 0x08af, 0x076f},
+    /* EXIT2_DR         */ {0x040f, 0x0201, 0x0203, 0x0303, 0x0100, 0x0202, 0x0302, 0x0000, 0x0101, 0x0307, 0x0407, 0x0507, 0x0517, 0x0617, 0x0757, 0x0637},
+    /* UPDATE_DR        */ {0x0307, 0x0100, 0x0101, 0x0201, 0x0301, 0x0305, 0x0405, 0x0515, 0x0000, 0x0203, 0x0303, 0x0403, 0x040b, 0x050b, 0x062b, 0x051b},
+    /* SELECT_IR        */ {0x0101, 0x0201, 0x0305, 0x0405, 0x0505, 0x0515, 0x0615, 0x0755, 0x0635, 0x0000, 0x0100, 0x0200, 0x0202, 0x0302, 0x040a, 0x0306},
+    /* CAPTURE_IR       */ {0x051f, 0x0303, 0x0307, 0x0407, 0x0507, 0x0517, 0x0617, 0x0757, 0x0637, 0x040f, 0x0000, 0x0100, 0x0101, 0x0201, 0x0305, 0x0203},
+    /* SHIFT_IR         */ {0x051f, 0x0303, 0x0307, 0x0407, 0x0507, 0x0517, 0x0617, 0x0757, 0x0637, 0x040f, 0x050f, 0x0000, 0x0101, 0x0201, 0x0305, 0x0203},
+    /* EXIT1_IR         */ {0x040f, 0x0201, 0x0203, 0x0303, 0x0403, 0x040b, 0x050b, 0x062b, 0x051b, 0x0307, 0x0407, 0x0302, 0x0000, 0x0100, 0x0202, 0x0101},
+    /* PAUSE_IR         */ {0x051f, 0x0303, 0x0307, 0x0407, 0x0507, 0x0517, 0x0617, 0x0757, 0x0637, 0x040f, 0x050f, 0x0201, 0x0305, 0x0000, 0x0101, 0x0203},
+    /* EXIT2_IR         */ {0x040f, 0x0201, 0x0203, 0x0303, 0x0403, 0x040b, 0x050b, 0x062b, 0x051b, 0x0307, 0x0407, 0x0100, 0x0202, 0x0302, 0x0000, 0x0101},
+    /* UPDATE_IR        */ {0x0307, 0x0100, 0x0101, 0x0201, 0x0301, 0x0305, 0x0405, 0x0515, 0x040d, 0x0203, 0x0303, 0x0403, 0x040b, 0x050b, 0x062b, 0x0000},
+};
+
+#endif /* __TAP_PATHS_H__ */
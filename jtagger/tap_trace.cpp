@@ -0,0 +1,56 @@
+/* --------------------------------------------------------------------------------------- */
+/* ---------------------------- In-RAM binary trace of the TAP ----------------------------*/
+/* --------------------------------------------------------------------------------------- */
+
+#include "tap_trace.h"
+#include "tap_paths.h"
+
+bool trace_on = false;
+trace_event_t trace_ring[TRACE_EVENTS];
+uint32_t trace_count = 0;
+uint32_t trace_cycle = 0;
+
+void trace_start()
+{
+    trace_count = 0;
+    trace_cycle = 0;
+    trace_on = true;
+}
+
+void trace_stop()
+{
+    trace_on = false;
+}
+
+void trace_tms(uint8_t state, uint16_t bits, uint8_t len)
+{
+    uint8_t tdi = PIN_LATCH(TDI) ? TRACE_TDI : 0;
+
+    for (uint8_t i = 0; i < len; i++)
+    {
+        trace_event(state, tdi | ((bits & 1) ? TRACE_TMS : 0));
+        state = tap_transitions[state][bits & 1];
+        bits >>= 1;
+    }
+}
+
+void trace_shift(uint8_t state, reg_t tdi, reg_t tdo, uint8_t bits, bool exit)
+{
+    for (uint8_t b = 0; b < bits; b++)
+    {
+        trace_event(state, ((tdi & 1) ? TRACE_TDI : 0) | ((tdo & 1) ? TRACE_TDO : 0) |
+                           ((exit && b == bits - 1) ? TRACE_TMS : 0));
+        tdi >>= 1;
+        tdo >>= 1;
+    }
+}
+
+void trace_run(uint8_t state, uint8_t tms, uint32_t cycles)
+{
+    if (cycles == 0)
+        return;
+
+    trace_ring[trace_count++ & (TRACE_EVENTS - 1)] = (trace_cycle << 8) | TRACE_RUN |
+                                                     (tms ? TRACE_TMS : 0) | state;
+    trace_cycle += cycles;
+}
@@ -0,0 +1,92 @@
+/** @file tap_trace.h
+ *
+ * @brief In-RAM binary trace of the TAP signals.
+ *
+ * Every TCK cycle clocked by the scan engine can be recorded as one 32 bit
+ * event in a fixed ring, which keeps the last TRACE_EVENTS cycles. Nothing is
+ * printed while tracing, so the trace doesn't disturb the timing of the scans;
+ * the ring is dumped afterwards (BIN_CMD_TRACE, controller.py --trace) and
+ * decoded on the host into a transcript or a VCD file.
+ *
+ * The trace is always compiled in. While it is off a recording site costs a
+ * single test of trace_on, while it is on an event costs a few instructions.
+ * Events are written a whole TMS path or register word at a time, never
+ * between the TCK edges.
+ *
+ * Event layout:
+ *   bits 0..3  TAP state during the cycle (before the rising edge)
+ *   bit  4     TMS
+ *   bit  5     TDI
+ *   bit  6     TDO, only sampled for register bits (not the BYPASS padding)
+ *   bit  7     TRACE_RUN: the first cycle of a run whose bits were not
+ *              recorded (idle clocking or SPI shifted bytes), the run lasts
+ *              until the cycle of the next event
+ *   bits 8..31 low 24 bits of the trace cycle counter
+ */
+#ifndef __TAP_TRACE_H__
+#define __TAP_TRACE_H__
+
+#include "Arduino.h"
+#include "jtagger.h"
+
+// ring size, a power of 2
+#if defined(ARDUINO_AVR_MEGA2560)
+#define TRACE_EVENTS 64
+#else
+#define TRACE_EVENTS 512
+#endif
+
+#define TRACE_TMS   0x10
+#define TRACE_TDI   0x20
+#define TRACE_TDO   0x40
+#define TRACE_RUN   0x80
+
+typedef uint32_t trace_event_t;
+
+extern bool trace_on;
+extern trace_event_t trace_ring[TRACE_EVENTS];
+extern uint32_t trace_count;    // events recorded since trace_start(), the ring keeps the last ones
+extern uint32_t trace_cycle;    // TCK cycles since trace_start()
+
+static inline void trace_event(uint8_t state, uint8_t pins)
+{
+    trace_ring[trace_count++ & (TRACE_EVENTS - 1)] = (trace_cycle++ << 8) | pins | state;
+}
+
+/**
+ * @brief Empty the ring, restart the cycle counter and start recording.
+ */
+void trace_start();
+
+/**
+ * @brief Stop recording, the ring is kept for the dump.
+ */
+void trace_stop();
+
+/**
+ * @brief Record a TMS sequence clocked from a state, TDI held at its current level.
+ * @param state The TAP state before the first cycle.
+ * @param bits TMS values, bit 0 is clocked first.
+ * @param len Number of TCK cycles.
+ */
+void trace_tms(uint8_t state, uint16_t bits, uint8_t len);
+
+/**
+ * @brief Record the bits of a register word shifted in a shift state.
+ * @param state SHIFT_DR or SHIFT_IR.
+ * @param tdi Shifted in bits, LSB first.
+ * @param tdo Shifted out bits, LSB first.
+ * @param bits Number of bits.
+ * @param exit If true, the last bit was clocked with TMS = 1.
+ */
+void trace_shift(uint8_t state, reg_t tdi, reg_t tdo, uint8_t bits, bool exit);
+
+/**
+ * @brief Record cycles whose bits are not known, as a single TRACE_RUN event.
+ * @param state The TAP state during the run.
+ * @param tms TMS level during the run.
+ * @param cycles Number of TCK cycles.
+ */
+void trace_run(uint8_t state, uint8_t tms, uint32_t cycles);
+
+#endif /* __TAP_TRACE_H__ */
@@ -0,0 +1,162 @@
+/** @file Arduino.h
+ *
+ * @brief Minimal Arduino core for the host simulation build of jtagger.
+ *
+ * Only what the sketch uses is provided. Serial is backed by two byte queues,
+ * so a benchmark or a host script can feed it and collect its output, and it
+ * counts the bytes in both directions. Time is the host's real time.
+ */
+#ifndef __SIM_ARDUINO_H__
+#define __SIM_ARDUINO_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <deque>
+#include <string>
+
+#define HEX 16
+#define DEC 10
+#define OCT 8
+#define BIN 2
+
+#define LOW          0
+#define HIGH         1
+#define INPUT        0
+#define OUTPUT       1
+#define INPUT_PULLUP 2
+
+// the busy loop of set_tck_khz() is calibrated as if running on the Due
+#define F_CPU 84000000UL
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+// strings in flash: the host has a single address space
+#define PROGMEM
+#define pgm_read_byte(addr) (*(const uint8_t*)(addr))
+class __FlashStringHelper;
+#define F(str) (reinterpret_cast<const __FlashStringHelper*>(str))
+
+class String
+{
+public:
+    String() {}
+    String(const char* str) : s(str) {}
+    String(const std::string& str) : s(str) {}
+
+    unsigned int length() const { return s.size(); }
+    char operator[](unsigned int i) const { return i < s.size() ? s[i] : 0; }
+    String substring(unsigned int from) const { return from < s.size() ? String(s.substr(from)) : String(); }
+    void toCharArray(char* buf, unsigned int size) const
+    {
+        if (size == 0)
+            return;
+        strncpy(buf, s.c_str(), size - 1);
+        buf[size - 1] = '\0';
+    }
+    const char* c_str() const { return s.c_str(); }
+    bool operator==(const char* other) const { return s == other; }
+    bool operator!=(const char* other) const { return s != other; }
+
+private:
+    std::string s;
+};
+
+class Print
+{
+public:
+    virtual ~Print() {}
+
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t* buf, size_t len);
+    size_t write(const char* buf, size_t len) { return write((const uint8_t*)buf, len); }
+
+    size_t print(const char* str) { return write(str, strlen(str)); }
+    size_t print(const __FlashStringHelper* str) { return print(reinterpret_cast<const char*>(str)); }
+    size_t print(const String& str) { return print(str.c_str()); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(unsigned char n, int base = DEC) { return print((unsigned long)n, base); }
+    size_t print(int n, int base = DEC) { return print((long)n, base); }
+    size_t print(unsigned int n, int base = DEC) { return print((unsigned long)n, base); }
+    size_t print(long n, int base = DEC);
+    size_t print(unsigned long n, int base = DEC);
+    size_t print(double n, int digits = 2);
+
+    template <class T> size_t println(T value) { return print(value) + println(); }
+    template <class T> size_t println(T value, int base) { return print(value, base) + println(); }
+    size_t println() { return print("\r\n"); }
+};
+
+class Stream : public Print
+{
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+    virtual void flush() {}
+
+    void setTimeout(unsigned long ms) { timeout_ms = ms; }
+    size_t readBytesUntil(char terminator, char* buf, size_t len);
+    String readStringUntil(char terminator);
+
+protected:
+    unsigned long timeout_ms = 1000;
+};
+
+class HardwareSerial : public Stream
+{
+public:
+    void begin(unsigned long) {}
+    void end() {}
+    operator bool() { return true; }
+
+    int available()
+    {
+        if (rx.empty() && on_starve != NULL)
+            on_starve();
+        return rx.size();
+    }
+    int availableForWrite() { return tx_room; }
+    int read();
+    int peek() { return rx.empty() ? -1 : rx.front(); }
+
+    size_t write(uint8_t c);
+    size_t write(const uint8_t* buf, size_t len);
+    using Print::write;
+
+    // host side of the simulated port
+    void host_write(const uint8_t* buf, size_t len) { rx.insert(rx.end(), buf, buf + len); }
+    void host_write(const char* str) { host_write((const uint8_t*)str, strlen(str)); }
+    std::string host_read() { std::string out = tx; tx.clear(); return out; }
+
+    uint64_t rx_bytes = 0;      // bytes read by the sketch
+    uint64_t tx_bytes = 0;      // bytes written by the sketch
+    int tx_room = 64;           // reported by availableForWrite()
+    bool keep_output = false;   // keep the written bytes for host_read()
+
+    // called while the sketch waits for input, may feed more bytes
+    void (*on_starve)() = NULL;
+
+private:
+    std::deque<uint8_t> rx;
+    std::string tx;
+};
+
+extern HardwareSerial Serial;
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+unsigned long micros();
+unsigned long millis();
+
+inline bool isDigit(char c) { return c >= '0' && c <= '9'; }
+inline void noInterrupts() {}
+inline void interrupts() {}
+
+#endif /* __SIM_ARDUINO_H__ */
@@ -0,0 +1,150 @@
+/* --------------------------------------------------------------------------------------- */
+/* -------------------- Minimal Arduino core for the simulation build ---------------------*/
+/* --------------------------------------------------------------------------------------- */
+
+#include "Arduino.h"
+
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+HardwareSerial Serial;
+
+// pins go to the TAP model, see jtag_pins.h
+void sim_pin_write(uint8_t pin, uint8_t val);
+uint8_t sim_pin_read(uint8_t pin);
+
+int HardwareSerial::read()
+{
+    if (available() == 0)
+        return -1;
+
+    uint8_t c = rx.front();
+    rx.pop_front();
+    rx_bytes++;
+    return c;
+}
+
+size_t Stream::readBytesUntil(char terminator, char* buf, size_t len)
+{
+    size_t n = 0;
+    unsigned long start = millis();
+
+    while (n < len && millis() - start < timeout_ms)
+    {
+        int c = read();
+        if (c < 0)
+            continue;
+        if (c == terminator)
+            break;
+        buf[n++] = c;
+    }
+    return n;
+}
+
+String Stream::readStringUntil(char terminator)
+{
+    std::string str;
+    unsigned long start = millis();
+
+    while (millis() - start < timeout_ms)
+    {
+        int c = read();
+        if (c < 0)
+            continue;
+        if (c == terminator)
+            break;
+        str += (char)c;
+    }
+    return String(str);
+}
+
+size_t HardwareSerial::write(uint8_t c)
+{
+    return write(&c, 1);
+}
+
+size_t HardwareSerial::write(const uint8_t* buf, size_t len)
+{
+    tx_bytes += len;
+    if (keep_output)
+        tx.append((const char*)buf, len);
+    return len;
+}
+
+size_t Print::write(const uint8_t* buf, size_t len)
+{
+    size_t n = 0;
+
+    while (len--)
+        n += write(*buf++);
+    return n;
+}
+
+size_t Print::print(long n, int base)
+{
+    if (n < 0 && base == DEC)
+        return print('-') + print((unsigned long)-n, base);
+    return print((unsigned long)n, base);
+}
+
+size_t Print::print(unsigned long n, int base)
+{
+    char buf[8 * sizeof(long) + 1];
+    char* p = &buf[sizeof(buf) - 1];
+
+    *p = '\0';
+    do {
+        uint8_t digit = n % base;
+        *--p = digit < 10 ? '0' + digit : 'A' + digit - 10;
+        n /= base;
+    } while (n > 0);
+
+    return print(p);
+}
+
+size_t Print::print(double n, int digits)
+{
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.*f", digits, n);
+    return print(buf);
+}
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+    (void)pin;
+    (void)mode;
+}
+
+void digitalWrite(uint8_t pin, uint8_t val)
+{
+    sim_pin_write(pin, val);
+}
+
+int digitalRead(uint8_t pin)
+{
+    return sim_pin_read(pin);
+}
+
+static const std::chrono::steady_clock::time_point boot = std::chrono::steady_clock::now();
+
+unsigned long micros()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - boot).count();
+}
+
+unsigned long millis()
+{
+    return micros() / 1000;
+}
+
+void delay(unsigned long ms)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void delayMicroseconds(unsigned int us)
+{
+    unsigned long start = micros();
+    while (micros() - start < us) {}
+}
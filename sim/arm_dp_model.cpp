@@ -0,0 +1,180 @@
+/* --------------------------------------------------------------------------------------- */
+/* ----------------------- ARM JTAG-DP and MEM-AP model for the simulation build ----------*/
+/* --------------------------------------------------------------------------------------- */
+
+#include "arm_dp_model.h"
+#include "arm_dp.h"
+
+ArmDpModel::ArmDpModel()
+    : TapModel("Cortex-M4 JTAG-DP", 4, ARM_DP_MODEL_IDCODE)
+{
+    add_register("DEVICE_ID", 32, { DP_IR_IDCODE });
+    add_register("DPACC", DP_ACC_LEN, { DP_IR_DPACC });
+    add_register("APACC", DP_ACC_LEN, { DP_IR_APACC });
+    add_register("ABORT", DP_ACC_LEN, { DP_IR_ABORT });
+    reset_instruction = DP_IR_IDCODE;
+    on_reset();
+}
+
+ArmDpModel::Region& ArmDpModel::add_region(uint32_t base, uint32_t bytes, bool writable)
+{
+    regions.push_back(Region{ base, std::vector<uint32_t>(bytes / 4, 0xFFFFFFFF), writable });
+    return regions.back();
+}
+
+ArmDpModel::Region* ArmDpModel::region(uint32_t addr)
+{
+    for (Region& r : regions)
+        if (addr >= r.base && (addr - r.base) / 4 < r.words.size())
+            return &r;
+    return NULL;
+}
+
+uint32_t* ArmDpModel::word(uint32_t addr)
+{
+    Region* r = region(addr);
+
+    return r != NULL ? &r->words[(addr - r->base) / 4] : NULL;
+}
+
+uint32_t ArmDpModel::ap_read(uint8_t addr)
+{
+    uint32_t* w = NULL;
+    uint32_t value = 0;
+
+    // only AP 0 exists
+    if ((select >> 24) != 0)
+        return 0;
+
+    switch (addr)
+    {
+    case AP_CSW:
+        return csw;
+    case AP_TAR:
+        return tar;
+    case AP_DRW:
+        w = word(tar & ~3u);
+        if (w == NULL)
+            ctrl_stat |= DP_STICKYERR;
+        else
+            value = *w;
+        // single auto-increment within the 1 KB block
+        if (((csw >> 4) & 3) == 1)
+            tar = (tar & ~(AP_TAR_WRAP - 1)) | ((tar + 4) & (AP_TAR_WRAP - 1));
+        return value;
+    case 0xF8: // BASE
+        return 0xE00FF003;
+    case AP_IDR:
+        return ARM_AHB_AP_IDR;
+    default:
+        return 0;
+    }
+}
+
+void ArmDpModel::ap_write(uint8_t addr, uint32_t value)
+{
+    Region* r = region(tar & ~3u);
+
+    if ((select >> 24) != 0)
+        return;
+
+    switch (addr)
+    {
+    case AP_CSW:
+        csw = value;
+        break;
+    case AP_TAR:
+        tar = value;
+        break;
+    case AP_DRW:
+        if (r == NULL || !r->writable)
+            ctrl_stat |= DP_STICKYERR;
+        else
+            *word(tar & ~3u) = value;
+        if (((csw >> 4) & 3) == 1)
+            tar = (tar & ~(AP_TAR_WRAP - 1)) | ((tar + 4) & (AP_TAR_WRAP - 1));
+        break;
+    default:
+        break;
+    }
+}
+
+void ArmDpModel::on_capture_dr(Register& reg)
+{
+    if (reg.name == "DPACC" || reg.name == "APACC") {
+        // the AP is still busy: WAIT, and the scan is ignored
+        ignore = busy != 0;
+        if (ignore) {
+            waits++;
+            reg.value = to_bits(DP_ACK_WAIT, DP_ACC_LEN);
+        }
+        else {
+            reg.value = to_bits(DP_ACK_OK_FAULT | ((uint64_t)read_result << 3), DP_ACC_LEN);
+        }
+    }
+    else if (reg.name == "ABORT") {
+        reg.value = to_bits(0, DP_ACC_LEN);
+    }
+    else {
+        TapModel::on_capture_dr(reg);
+    }
+}
+
+void ArmDpModel::on_update_dr(Register& reg)
+{
+    uint64_t scan = from_bits(reg.value);
+    bool read = scan & 1;
+    uint8_t addr = (scan & 0x6) << 1;
+    uint32_t value = scan >> 3;
+    const uint32_t sticky = DP_STICKYORUN | DP_STICKYCMP | DP_STICKYERR | DP_WDATAERR;
+
+    if (reg.name == "ABORT") {
+        if (value & 1)
+            busy = 0;
+        return;
+    }
+    if ((reg.name != "DPACC" && reg.name != "APACC") || ignore) {
+        ignore = false;
+        return;
+    }
+
+    if (reg.name == "DPACC") {
+        if (read) {
+            // RDBUFF leaves the last result to be captured again
+            if (addr == DP_CTRL_STAT)
+                read_result = ctrl_stat;
+            else if (addr == DP_SELECT)
+                read_result = select;
+            else if (addr != DP_RDBUFF)
+                read_result = 0;
+        }
+        else if (addr == DP_CTRL_STAT) {
+            // the power domains come up at once, sticky flags are cleared by writing 1
+            ctrl_stat &= ~(value & sticky);
+            ctrl_stat &= ~(DP_CDBGPWRUPREQ | DP_CDBGPWRUPACK | DP_CSYSPWRUPREQ | DP_CSYSPWRUPACK);
+            ctrl_stat |= value & (DP_CDBGPWRUPREQ | DP_CSYSPWRUPREQ);
+            ctrl_stat |= (value & (DP_CDBGPWRUPREQ | DP_CSYSPWRUPREQ)) << 1;
+        }
+        else if (addr == DP_SELECT) {
+            select = value;
+        }
+        return;
+    }
+
+    addr |= select & 0xF0;
+    if (read) {
+        read_result = ap_read(addr);
+        ap_reads++;
+    }
+    else {
+        ap_write(addr, value);
+        ap_writes++;
+    }
+    busy = ap_cycles;
+}
+
+void ArmDpModel::on_idle_clock()
+{
+    if (busy != 0)
+        busy--;
+}
@@ -0,0 +1,73 @@
+/** @file arm_dp_model.h
+ *
+ * @brief Model of an ARM JTAG-DP with a MEM-AP (AHB-AP) for the simulation build.
+ *
+ * DPACC and APACC scans are pipelined like on a real DP: the data captured by
+ * a scan is the result of the previous read. An AP access keeps the AP busy
+ * for ap_cycles TCK cycles in RUN_TEST_IDLE, and a DPACC/APACC scan captured
+ * meanwhile answers WAIT and is ignored.
+ *
+ * Memory is a list of word regions. An access outside of them, or a write to
+ * a read only region, sets STICKYERR in CTRL/STAT. TAR auto-increments within
+ * 1 KB blocks only, like the AHB-AP of the Cortex-M cores.
+ */
+#ifndef __ARM_DP_MODEL_H__
+#define __ARM_DP_MODEL_H__
+
+#include "tap_model.h"
+
+#define ARM_DP_MODEL_IDCODE 0x4BA00477 // Cortex-M4 JTAG-DP
+#define ARM_AHB_AP_IDR      0x24770011
+
+class ArmDpModel : public TapModel
+{
+public:
+    struct Region
+    {
+        uint32_t base;
+        std::vector<uint32_t> words;
+        bool writable;
+    };
+
+    ArmDpModel();
+
+    /**
+     * @brief Add memory at base, filled with 0xFFFFFFFF.
+     */
+    Region& add_region(uint32_t base, uint32_t bytes, bool writable);
+
+    /**
+     * @brief The word at an address, NULL if there is no memory there.
+     */
+    uint32_t* word(uint32_t addr);
+
+    std::vector<Region> regions;
+
+    // TCK cycles in RUN_TEST_IDLE that an AP access takes
+    uint32_t ap_cycles = 0;
+
+    uint32_t ctrl_stat = 0;
+    uint32_t select = 0;
+    uint32_t csw = 0;
+    uint32_t tar = 0;
+
+    // statistics
+    uint32_t waits = 0;
+    uint32_t ap_reads = 0;
+    uint32_t ap_writes = 0;
+
+    void on_capture_dr(Register& reg) override;
+    void on_update_dr(Register& reg) override;
+    void on_idle_clock() override;
+
+private:
+    Region* region(uint32_t addr);
+    uint32_t ap_read(uint8_t addr);
+    void ap_write(uint8_t addr, uint32_t value);
+
+    uint32_t read_result = 0;  // captured by the next DPACC/APACC scan
+    uint32_t busy = 0;         // cycles until the AP access is done
+    bool ignore = false;       // the scan answered WAIT, its update does nothing
+};
+
+#endif /* __ARM_DP_MODEL_H__ */
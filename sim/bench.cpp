@@ -0,0 +1,414 @@
+/* --------------------------------------------------------------------------------------- */
+/* ------------------- Benchmark of the sketch against the simulated TAPs -----------------*/
+/* --------------------------------------------------------------------------------------- */
+
+/*
+ * Runs the hot paths of the sketch against software TAPs and reports, for
+ * every operation, the TCK cycles, the serial bytes and the wall time.
+ * The chains of a gang run in lockstep, they count as one.
+ * The serial output is flushed at the end of every operation.
+ * Wall time is the host's, so only compare it between runs on the same machine.
+ * TCK cycles and serial bytes are exact and machine independent.
+ *
+ *   ./jtagger_bench [--bsdl FILE] [--words N] [--csv]
+ */
+
+#include "Arduino.h"
+#include "jtagger.h"
+#include "max10_funcs.h"
+#include "binproto.h"
+#include "arm_dp.h"
+#include "tap_trace.h"
+#include "gang.h"
+#include "tap_model.h"
+#include "max10_model.h"
+#include "arm_dp_model.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+// globals of jtagger.ino
+extern reg_t* dr_in;
+extern reg_t* dr_out;
+extern uint8_t ir_len;
+
+#define STM32_SAMPLE 0x02
+#define STM32_SRAM   0x20000000
+#define STM32_FLASH  0x08000000
+
+typedef struct
+{
+    std::string name;
+    uint32_t reps;
+    uint64_t tck;
+    uint64_t shift;
+    uint64_t bytes;
+    double ms;
+    bool ok;
+} bench_result_t;
+
+static std::vector<bench_result_t> results;
+
+/**
+ * @brief Run fn reps times and record its cost. fn returns false if the sketch got a wrong result.
+ */
+template <class F>
+static void measure(const std::string& name, uint32_t reps, F fn)
+{
+    uint64_t tck = sim_chain.tck_cycles + sim_gang[0].tck_cycles;
+    uint64_t shift = sim_chain.shift_cycles + sim_gang[0].shift_cycles;
+    uint64_t bytes = Serial.tx_bytes + Serial.rx_bytes;
+    bool ok = true;
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < reps; i++)
+        ok &= fn();
+    Host.flush();
+    auto end = std::chrono::steady_clock::now();
+
+    results.push_back(bench_result_t{
+        name, reps,
+        sim_chain.tck_cycles + sim_gang[0].tck_cycles - tck,
+        sim_chain.shift_cycles + sim_gang[0].shift_cycles - shift,
+        Serial.tx_bytes + Serial.rx_bytes - bytes,
+        std::chrono::duration<double, std::milli>(end - start).count(),
+        ok });
+}
+
+static ArmDpModel* stm32_dp = NULL;
+
+/**
+ * @brief STM32F4 chain: the boundary scan TAP from its BSDL, then the Cortex-M4 JTAG-DP nearest to TDO.
+ */
+static bool build_stm32_chain(const std::string& bsdl)
+{
+    TapModel* bsc = TapModel::from_bsdl(bsdl);
+    if (bsc == NULL) {
+        fprintf(stderr, "Cannot read %s\n", bsdl.c_str());
+        return false;
+    }
+
+    // 128 KB SRAM and 1 MB flash, the AHB takes a couple of TCK cycles per access
+    ArmDpModel* dp = new ArmDpModel();
+    dp->add_region(STM32_SRAM, 128 * 1024, true);
+    dp->add_region(STM32_FLASH, 1024 * 1024, false);
+    dp->ap_cycles = 2;
+    stm32_dp = dp;
+
+    sim_chain.clear();
+    sim_chain.add(dp);
+    sim_chain.add(bsc);
+    return true;
+}
+
+static Max10Model* build_max10_chain()
+{
+    Max10Model* max10 = new Max10Model();
+
+    for (size_t i = 0; i < max10->ufm.size(); i++)
+        max10->ufm[i] = 0x9E3779B9 * (uint32_t)(i + 1);
+
+    sim_chain.clear();
+    sim_chain.add(max10);
+    return max10;
+}
+
+static std::vector<uint16_t> discovered;
+
+static bool record_dr_len(uint32_t instruction, uint16_t len)
+{
+    discovered[instruction] = len;
+    return true;
+}
+
+/**
+ * @brief Check the block frames of a streamed dump (UFM_BLOCK or MEM_BLOCK) against a model.
+ * @param expect The word at an address.
+ */
+static bool check_block_frames(const std::string& out, uint8_t block_cmd, uint32_t words,
+                               std::function<uint32_t(uint32_t)> expect)
+{
+    size_t pos = 0;
+    uint32_t seen = 0;
+
+    while (pos + 4 <= out.size())
+    {
+        uint8_t cmd = out[pos + 1];
+        uint16_t len = (uint8_t)out[pos + 2] | ((uint8_t)out[pos + 3] << 8);
+        const uint8_t* payload = (const uint8_t*)&out[pos + 4];
+
+        if ((uint8_t)out[pos] != BIN_SOF || pos + 6 + len > out.size())
+            return false;
+
+        if ((cmd & ~BIN_REPLY) == block_cmd) {
+            uint32_t addr = 0;
+            memcpy(&addr, &payload[1], 4);
+            for (uint16_t i = 0; i + 5 < len; i += 4)
+            {
+                uint32_t word = 0;
+                memcpy(&word, &payload[5 + i], 4);
+                if (word != expect(addr + i))
+                    return false;
+                seen++;
+            }
+        }
+        pos += 6 + len;
+    }
+    return seen == words;
+}
+
+/**
+ * @brief Bitwise CRC-32 (zlib's) of little endian words, the reference for max10_crc_ufm_range.
+ */
+static uint32_t reference_crc32(const uint32_t* words, uint32_t num)
+{
+    uint32_t crc = 0xFFFFFFFF;
+
+    for (uint32_t i = 0; i < num * 4; i++)
+    {
+        crc ^= (words[i / 4] >> (8 * (i % 4))) & 0xFF;
+        for (int b = 0; b < 8; b++)
+            crc = (crc >> 1) ^ (crc & 1 ? 0xEDB88320 : 0);
+    }
+    return ~crc;
+}
+
+int main(int argc, char** argv)
+{
+    std::string bsdl = "../jtagger/stm32f405_lqfp64.bsdl";
+    uint32_t words = 4096;
+    bool csv = false;
+    reg_t ir_in[REG_WORDS(MAX_IR_LEN)] = {0};
+    reg_t ir_out[REG_WORDS(MAX_IR_LEN)] = {0};
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--bsdl" && i + 1 < argc)
+            bsdl = argv[++i];
+        else if (arg == "--words" && i + 1 < argc)
+            words = strtoul(argv[++i], NULL, 0);
+        else if (arg == "--csv")
+            csv = true;
+        else {
+            fprintf(stderr, "usage: %s [--bsdl FILE] [--words N] [--csv]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    // the pins are as fast as the host allows
+    regs_init();
+    TCK_WRITE(0);
+    measure_tck_max();
+    set_tck_khz(0);
+
+    // chain enumeration of the STM32F4 (2 TAPs)
+    if (!build_stm32_chain(bsdl))
+        return 1;
+    measure("detect_chain (STM32F4, 2 TAPs)", 1, [&]() {
+        return detect_chain(&ir_len) == OK && tap_count == 2 &&
+               taps[0].idcode == 0x4BA00477 && taps[1].ir_len == 5;
+    });
+
+    // boundary scan register of the STM32F4, with the Cortex-M4 TAP in BYPASS
+    active_tap = tap_selector(taps, 1);
+    measure("insert_dr 406 bits (SAMPLE)", 100, [&]() {
+        if (active_tap == NULL)
+            return false;
+        intToBinArray(ir_in, STM32_SAMPLE, 5);
+        insert_ir_tap(active_tap, ir_in, RUN_TEST_IDLE, ir_out);
+        insert_dr_tap(active_tap, dr_in, 406, RUN_TEST_IDLE, dr_out);
+        return true;
+    });
+
+    // the same scans with the TAP trace on: every cycle is accounted for, in order,
+    // and the ring ends with the way from EXIT1_DR back to RUN_TEST_IDLE
+    uint64_t traced_tck = sim_chain.tck_cycles;
+    trace_start();
+    measure("insert_dr 406 bits (SAMPLE, traced)", 100, [&]() {
+        intToBinArray(ir_in, STM32_SAMPLE, 5);
+        insert_ir_tap(active_tap, ir_in, RUN_TEST_IDLE, ir_out);
+        insert_dr_tap(active_tap, dr_in, 406, RUN_TEST_IDLE, dr_out);
+        return true;
+    });
+    trace_stop();
+    measure("TAP trace check", 1, [&]() {
+        bool ok = trace_cycle == sim_chain.tck_cycles - traced_tck && trace_count > TRACE_EVENTS;
+        for (uint32_t i = trace_count - TRACE_EVENTS + 1; i < trace_count && ok; i++)
+            ok &= ((trace_ring[i % TRACE_EVENTS] >> 8) - (trace_ring[(i - 1) % TRACE_EVENTS] >> 8)) >= 1;
+        trace_event_t exit1 = trace_ring[(trace_count - 2) % TRACE_EVENTS];
+        trace_event_t update = trace_ring[(trace_count - 1) % TRACE_EVENTS];
+        return ok && (exit1 & 0x1F) == (EXIT1_DR | TRACE_TMS) && (update & 0x1F) == UPDATE_DR &&
+               (update >> 8) == ((trace_cycle - 1) & 0xFFFFFF);
+    });
+    active_tap = NULL;
+
+    // a scan far longer than the registers, streamed through PAUSE_DR in chunks.
+    // With both TAPs in BYPASS it comes back delayed by 2 (captured 0) bits
+    const uint32_t stream_bits = 16 * MAX_DR_LEN + 5;
+    std::vector<reg_t> stream_in(REG_WORDS(stream_bits)), stream_out(REG_WORDS(stream_bits));
+    for (size_t i = 0; i < stream_in.size(); i++)
+        stream_in[i] = 0x9E3779B9 * (uint32_t)(i + 5);
+    measure("streamed DR " + std::to_string(stream_bits) + " bits", 1, [&]() {
+        scan_stream_t stream;
+        bool ok = true;
+        for (uint16_t i = 0; i < REG_WORDS(MAX_IR_LEN); i++)
+            ir_in[i] = 0xFFFFFFFF;
+        insert_ir(ir_in, ir_len, RUN_TEST_IDLE, ir_out);
+        ok &= scan_stream_begin(&stream, false, stream_bits, RUN_TEST_IDLE, NULL) == OK;
+        for (uint32_t bit = 0; bit < stream_bits && ok; bit += BIN_STREAM_CHUNK)
+        {
+            uint16_t n = std::min<uint32_t>(BIN_STREAM_CHUNK, stream_bits - bit);
+            ok &= scan_stream_shift(&stream, &stream_in[bit / 32], n, &stream_out[bit / 32]) == OK;
+        }
+        for (uint32_t i = 0; i < stream_bits && ok; i++)
+            ok &= reg_get_bit(stream_out.data(), i) == (i < 2 ? 0 : reg_get_bit(stream_in.data(), i - 2));
+        return ok && stream.left == 0 && sim_chain.state == RUN_TEST_IDLE;
+    });
+
+    // SRAM of the STM32F4 through the MEM-AP, streamed as binary frames
+    for (uint32_t i = 0; i < words; i++)
+        *stm32_dp->word(STM32_SRAM + 4 * i) = 0x9E3779B9 * (i + 3);
+    Serial.keep_output = true;
+    Serial.host_read();
+    measure("MEM-AP read (" + std::to_string(words) + " words)", 1, [&]() {
+        if (dp_attach(&taps[0]) != OK || dp_power_up() != OK)
+            return false;
+        mem_dump_stream(0, STM32_SRAM, words);
+        Host.flush();
+        return check_block_frames(Serial.host_read(), BIN_CMD_MEM_BLOCK, words,
+                                  [&](uint32_t addr) { return *stm32_dp->word(addr); });
+    });
+    Serial.keep_output = false;
+
+    // blocks of the size that controller.py sends with BIN_CMD_MEM_WRITE
+    std::vector<uint32_t> sram(words);
+    for (uint32_t i = 0; i < words; i++)
+        sram[i] = 0x01000193 * (i + 11);
+    measure("MEM-AP write (" + std::to_string(words) + " words)", 1, [&]() {
+        bool ok = dp_attach(&taps[0]) == OK;
+        for (uint32_t i = 0; i < words && ok; i += BIN_BLOCK_WORDS)
+        {
+            uint32_t n = std::min<uint32_t>(BIN_BLOCK_WORDS, words - i);
+            ok &= mem_write(0, STM32_SRAM + 4 * i, (uint8_t*)&sram[i], n) == OK;
+        }
+        for (uint32_t i = 0; i < words && ok; i++)
+            ok &= *stm32_dp->word(STM32_SRAM + 4 * i) == sram[i];
+        return ok;
+    });
+
+    // every instruction of the MAX10
+    Max10Model* max10 = build_max10_chain();
+    reset_tap();
+    discovered.assign(1 << 10, 0);
+    measure("discovery (MAX10, 1024 IRs)", 1, [&]() {
+        uint32_t next = 0;
+        int rc = discovery_sweep(0, 0x3FF, MAX_DR_LEN, 10, ir_in, record_dr_len, &next);
+        return rc == OK && next == 0x400 && discovered[0x203] == 23 &&
+               discovered[0x205] == 32 && discovered[0x3FF] == 1 && discovered[0x006] == 32;
+    });
+
+    // UFM dump streamed as binary frames
+    Serial.keep_output = true;
+    Serial.host_read();
+    measure("UFM burst read (" + std::to_string(words) + " words)", 1, [&]() {
+        max10_dump_ufm_stream(10, ir_in, ir_out, dr_in, dr_out, 0, words);
+        Host.flush();
+        return check_block_frames(Serial.host_read(), BIN_CMD_UFM_BLOCK, words,
+                                  [&](uint32_t addr) { return max10->ufm[addr / 4]; });
+    });
+    Serial.keep_output = false;
+
+    // UFM range digest, only the CRC would go back to the host
+    measure("UFM CRC32 (" + std::to_string(words) + " words)", 1, [&]() {
+        uint32_t crc = max10_crc_ufm_range(10, ir_in, ir_out, dr_in, dr_out, 0, words, NULL);
+        max10_isc_disable(10, ir_in, ir_out);
+        return crc == reference_crc32(max10->ufm.data(), words);
+    });
+
+    // UFM programming with readback verify, block by block like BIN_CMD_UFM_PROGRAM
+    std::vector<uint32_t> image(words);
+    for (uint32_t i = 0; i < words; i++)
+        image[i] = 0x01000193 * (i + 7);
+    // the 350 ms of the BSDL with DSM_CLEAR loaded, then the flash must read erased
+    measure("UFM erase", 1, [&]() {
+        uint32_t erases = max10->erases;
+        uint32_t us = 0;
+        int rc = max10_erase(10, ir_in, ir_out, dr_in, dr_out, &us);
+        return rc == OK && max10->erases == erases + 1 && us >= MAX10_ERASE_US;
+    });
+    measure("UFM program + verify (" + std::to_string(words) + " words)", 1, [&]() {
+        bool ok = true;
+        for (uint32_t i = 0; i < words; i += BIN_BLOCK_WORDS)
+        {
+            uint16_t n = std::min<uint32_t>(BIN_BLOCK_WORDS, words - i);
+            ok &= max10_program_block(10, ir_in, ir_out, dr_in, dr_out, 4 * i, (uint8_t*)&image[i], n) == OK;
+        }
+        max10_isc_disable(10, ir_in, ir_out);
+        return ok && std::equal(image.begin(), image.end(), max10->ufm.begin());
+    });
+
+    // the same MAX10 sequences on a gang of 3 boards at once. Board 1 has a
+    // corrupted word, and board 2 takes the longest to erase
+    Max10Model* boards[3];
+    for (int c = 0; c < 3; c++)
+    {
+        boards[c] = new Max10Model();
+        std::copy(image.begin(), image.end(), boards[c]->ufm.begin());
+        sim_gang[c].add(boards[c]);
+    }
+    boards[1]->ufm[words / 2] ^= 0x10;
+    boards[2]->erase_cycles *= 2;
+    measure("gang begin (3 MAX10)", 1, [&]() {
+        uint32_t idcodes[GANG_MAX_CHAINS] = {0};
+        bool ok = gang_begin(3, idcodes) == OK;
+        for (int c = 0; c < 3; c++)
+            ok &= idcodes[c] == boards[c]->idcode;
+        return ok;
+    });
+    measure("gang UFM CRC32 (3 x " + std::to_string(words) + " words)", 1, [&]() {
+        uint32_t crcs[GANG_MAX_CHAINS] = {0};
+        uint32_t expected = reference_crc32(image.data(), words);
+        uint32_t crc = max10_crc_ufm_range(10, ir_in, ir_out, dr_in, dr_out, 0, words, crcs);
+        max10_isc_disable(10, ir_in, ir_out);
+        return crc == crcs[0] && crcs[0] == expected && crcs[1] != expected && crcs[2] == expected &&
+               gang_diff == 0x02;
+    });
+    measure("gang UFM erase", 1, [&]() {
+        bool ok = max10_erase(10, ir_in, ir_out, dr_in, dr_out, NULL) == OK &&
+                  gang_match(0xFFFFFFFF, 0xFFFFFFFF) == gang_all();
+        max10_isc_disable(10, ir_in, ir_out);
+        for (int c = 0; c < 3; c++)
+            ok &= boards[c]->erases == 1 &&
+                  std::all_of(boards[c]->ufm.begin(), boards[c]->ufm.end(), [](uint32_t w) { return w == 0xFFFFFFFF; });
+        return ok;
+    });
+    gang_end();
+
+    if (csv)
+        printf("operation,reps,tck_cycles,shift_cycles,serial_bytes,wall_ms,ok\n");
+    else
+        printf("%-34s %6s %12s %12s %10s %10s %s\n",
+               "operation", "reps", "TCK cycles", "shift", "serial B", "wall ms", "result");
+
+    for (const bench_result_t& r : results)
+    {
+        if (csv)
+            printf("%s,%u,%llu,%llu,%llu,%.3f,%d\n", r.name.c_str(), r.reps,
+                   (unsigned long long)r.tck, (unsigned long long)r.shift,
+                   (unsigned long long)r.bytes, r.ms, r.ok);
+        else
+            printf("%-34s %6u %12llu %12llu %10llu %10.3f %s\n", r.name.c_str(), r.reps,
+                   (unsigned long long)r.tck, (unsigned long long)r.shift,
+                   (unsigned long long)r.bytes, r.ms, r.ok ? "ok" : "WRONG");
+    }
+
+    for (const bench_result_t& r : results)
+        if (!r.ok)
+            return 1;
+    return 0;
+}
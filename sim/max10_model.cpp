@@ -0,0 +1,95 @@
+/* --------------------------------------------------------------------------------------- */
+/* ----------------------- MAX10 FPGA model for the simulation build ----------------------*/
+/* --------------------------------------------------------------------------------------- */
+
+#include "max10_model.h"
+#include "max10_ir.h"
+
+#include <algorithm>
+#include <fstream>
+
+Max10Model::Max10Model(uint32_t words)
+    : TapModel("MAX10", 10, MAX10_MODEL_IDCODE), ufm(words, 0xFFFFFFFF)
+{
+    ir_capture = 0x1;
+    add_register("DEVICE_ID", 32, { IDCODE });
+    add_register("USERCODE", 32, { USERCODE });
+    add_register("ISC_ADDRESS", 23, { ISC_ADDRESS_SHIFT });
+    add_register("ISC_READ", 32, { ISC_READ });
+    add_register("ISC_PROGRAM", 32, { ISC_PROGRAM });
+
+    // found by discovery on a real device, see max10_ir.h
+    add_register("UNKNOWN_4", 4, { 0x90 });
+    add_register("UNKNOWN_32", 32, { 0x206, 0x207 });
+    add_register("UNKNOWN_16", 16, { 0x303 });
+    on_reset();
+}
+
+bool Max10Model::load_ufm(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+
+    std::fill(ufm.begin(), ufm.end(), 0xFFFFFFFF);
+    file.read((char*)ufm.data(), ufm.size() * 4);
+    return true;
+}
+
+void Max10Model::on_capture_dr(Register& reg)
+{
+    uint32_t index = address / 4;
+
+    if (reg.name == "USERCODE")
+        reg.value = to_bits(usercode, 32);
+    else if (reg.name == "ISC_READ")
+        reg.value = to_bits(isc_enabled && !erase_busy && index < ufm.size() ? ufm[index] : 0, 32);
+    else
+        TapModel::on_capture_dr(reg);
+}
+
+void Max10Model::on_update_dr(Register& reg)
+{
+    uint32_t index = address / 4;
+
+    if (reg.name == "ISC_ADDRESS") {
+        address = from_bits(reg.value);
+    }
+    else if (reg.name == "ISC_READ") {
+        words_read++;
+        address += 4;
+    }
+    else if (reg.name == "ISC_PROGRAM") {
+        // flash bits can only be cleared by programming
+        if (isc_enabled && index < ufm.size()) {
+            ufm[index] &= from_bits(reg.value);
+            words_programmed++;
+        }
+        address += 4;
+    }
+}
+
+void Max10Model::on_update_ir()
+{
+    if (instruction == ISC_ENABLE)
+        isc_enabled = true;
+    else if (instruction == ISC_DISABLE)
+        isc_enabled = false;
+    else if ((instruction == ISC_ERASE || instruction == DSM_CLEAR) && isc_enabled && !erase_busy) {
+        erase_busy = erase_cycles + 1;
+        on_idle_clock();
+    }
+
+    if (on_instruction)
+        on_instruction(*this, instruction);
+}
+
+void Max10Model::on_idle_clock()
+{
+    // the flash is erased on the last cycle of an erase
+    if (erase_busy == 0 || --erase_busy > 0)
+        return;
+
+    std::fill(ufm.begin(), ufm.end(), 0xFFFFFFFF);
+    erases++;
+}
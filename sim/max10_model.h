@@ -0,0 +1,56 @@
+/** @file max10_model.h
+ *
+ * @brief Model of the MAX10 FPGA TAP and its user flash (UFM) for the simulation build.
+ *
+ * The UFM content is a plain word array that a benchmark or a script fills,
+ * loads or inspects. Word i lives at address 4 * i, like the addresses
+ * used by max10_funcs.cpp. ISC_READ and ISC_PROGRAM advance the address by
+ * 4 on every UPDATE_DR, which is what the burst reads rely on.
+ * An erase runs for erase_cycles TCK cycles in RUN_TEST_IDLE, so an erase
+ * that doesn't wait long enough reads back unerased.
+ */
+#ifndef __MAX10_MODEL_H__
+#define __MAX10_MODEL_H__
+
+#include "tap_model.h"
+
+#include <functional>
+
+#define MAX10_MODEL_IDCODE     0x031820DD // 10M08
+#define MAX10_MODEL_UFM_WORDS  8192
+
+class Max10Model : public TapModel
+{
+public:
+    Max10Model(uint32_t words = MAX10_MODEL_UFM_WORDS);
+
+    /**
+     * @brief Load the UFM from a raw little endian image.
+     * @return false if the file can't be read.
+     */
+    bool load_ufm(const std::string& path);
+
+    std::vector<uint32_t> ufm;
+    uint32_t usercode = 0;
+    uint32_t address = 0;
+    bool isc_enabled = false;
+
+    // TCK cycles in RUN_TEST_IDLE an erase takes, the flash reads 0 until it is done
+    uint32_t erase_cycles = 20000;
+    uint32_t erase_busy = 0;
+
+    // statistics
+    uint32_t words_read = 0;
+    uint32_t words_programmed = 0;
+    uint32_t erases = 0;
+
+    // called with every instruction latched on UPDATE_IR
+    std::function<void(Max10Model&, uint32_t)> on_instruction;
+
+    void on_capture_dr(Register& reg) override;
+    void on_update_dr(Register& reg) override;
+    void on_update_ir() override;
+    void on_idle_clock() override;
+};
+
+#endif /* __MAX10_MODEL_H__ */
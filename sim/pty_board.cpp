@@ -0,0 +1,168 @@
+/* --------------------------------------------------------------------------------------- */
+/* ------------------ Stand-in board: the sketch behind a pseudo terminal -----------------*/
+/* --------------------------------------------------------------------------------------- */
+
+/*
+ * Runs the whole sketch (setup() and loop(), the ASCII menu and binary mode)
+ * against a simulated MAX10, with Serial backed by a pseudo terminal instead
+ * of a USB port. The host tools open the printed /dev/pts path like the port
+ * of a real Arduino, e.g. to test multi_controller.py with several boards.
+ *
+ *   ./jtagger_pty [--link PATH] [--corrupt WORD] [--hang-after BYTES]
+ *
+ *   --link PATH         also make PATH a symlink to the terminal
+ *   --corrupt WORD      flip a bit of this UFM word, to tell the boards apart
+ *   --hang-after BYTES  stop answering once the host sent this many bytes, the
+ *                       terminal stays open like the port of a hung board
+ */
+
+#include "Arduino.h"
+#include "jtagger.h"
+#include "tap_model.h"
+#include "max10_model.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <poll.h>
+#include <string>
+#include <termios.h>
+#include <unistd.h>
+
+// entry points of jtagger.ino
+void setup();
+void loop();
+
+static int pty_master = -1;
+static uint64_t pty_received = 0;
+static uint64_t hang_after = 0;
+static uint64_t pump_tck = 0;     // TCK cycles at the last activity
+static unsigned long idle_since = 0;
+
+/**
+ * @brief Serial.on_starve: send what the sketch wrote to the host, then check
+ * for more input. The sketch also polls the host in the middle of long scans
+ * and while it queues its replies, so the pump only waits for input once
+ * nothing was clocked, received or sent for a few milliseconds, i.e. while
+ * the sketch is idle.
+ */
+static void pty_pump()
+{
+    std::string out = Serial.host_read();
+    uint8_t buf[256];
+    unsigned long now = micros();
+    struct pollfd pfd = {pty_master, POLLIN, 0};
+
+    for (size_t n = 0; n < out.size(); )
+    {
+        ssize_t w = write(pty_master, out.data() + n, out.size() - n);
+        if (w > 0)
+            n += w;
+        else if (w < 0 && errno != EINTR && errno != EAGAIN)
+            exit(0);
+    }
+
+    if (hang_after && pty_received >= hang_after)
+    {
+        while (true)
+            pause();
+    }
+
+    if (!out.empty() || sim_chain.tck_cycles != pump_tck)
+    {
+        pump_tck = sim_chain.tck_cycles;
+        idle_since = now;
+    }
+    if (poll(&pfd, 1, now - idle_since > 2000 ? 1 : 0) > 0)
+    {
+        ssize_t n = read(pty_master, buf, sizeof(buf));
+        if (n > 0)
+        {
+            idle_since = micros();
+            Serial.host_write(buf, n);
+            pty_received += n;
+        }
+    }
+}
+
+/**
+ * @brief Open a raw pseudo terminal, keeping its slave side open so the
+ * master doesn't hang up between two host sessions.
+ * @return The path of the slave side, empty on failure.
+ */
+static std::string pty_open()
+{
+    struct termios tio;
+    const char* name = NULL;
+    int slave = -1;
+
+    pty_master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (pty_master < 0 || grantpt(pty_master) != 0 || unlockpt(pty_master) != 0)
+        return "";
+    name = ptsname(pty_master);
+    if (name == NULL || (slave = open(name, O_RDWR | O_NOCTTY)) < 0)
+        return "";
+    if (tcgetattr(slave, &tio) == 0)
+    {
+        cfmakeraw(&tio);
+        tcsetattr(slave, TCSANOW, &tio);
+    }
+    return name;
+}
+
+int main(int argc, char** argv)
+{
+    std::string link;
+    long corrupt = -1;
+    std::string path;
+    Max10Model* max10 = new Max10Model();
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--link" && i + 1 < argc)
+            link = argv[++i];
+        else if (arg == "--corrupt" && i + 1 < argc)
+            corrupt = strtol(argv[++i], NULL, 0);
+        else if (arg == "--hang-after" && i + 1 < argc)
+            hang_after = strtoull(argv[++i], NULL, 0);
+        else {
+            fprintf(stderr, "usage: %s [--link PATH] [--corrupt WORD] [--hang-after BYTES]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    // the same UFM contents as the bench
+    for (size_t i = 0; i < max10->ufm.size(); i++)
+        max10->ufm[i] = 0x9E3779B9 * (uint32_t)(i + 1);
+    if (corrupt >= 0 && (size_t)corrupt < max10->ufm.size())
+        max10->ufm[corrupt] ^= 0x10;
+    sim_chain.add(max10);
+
+    path = pty_open();
+    if (path.empty())
+    {
+        perror("pseudo terminal");
+        return 1;
+    }
+    if (!link.empty())
+    {
+        unlink(link.c_str());
+        if (symlink(path.c_str(), link.c_str()) != 0)
+        {
+            perror(link.c_str());
+            return 1;
+        }
+    }
+    printf("%s\n", path.c_str());
+    fflush(stdout);
+
+    Serial.keep_output = true;
+    Serial.on_starve = pty_pump;
+    setup();
+    // the pins are as fast as the host allows
+    set_tck_khz(0);
+    while (true)
+        loop();
+}
@@ -0,0 +1,398 @@
+/* --------------------------------------------------------------------------------------- */
+/* ------------------------ Software TAPs for the simulation build ------------------------*/
+/* --------------------------------------------------------------------------------------- */
+
+#include "tap_model.h"
+#include "jtagger.h"
+#include "gang.h"
+
+#include <fstream>
+#include <regex>
+#include <sstream>
+
+ChainModel sim_chain;
+ChainModel sim_gang[GANG_MAX_CHAINS];
+static const uint8_t sim_gang_bits[GANG_MAX_CHAINS][4] = GANG_BITS;
+
+// next state for TMS = 0 and TMS = 1, in the order of the tap_state enum
+static const uint8_t next_state[16][2] = {
+    { RUN_TEST_IDLE, TEST_LOGIC_RESET },    // TEST_LOGIC_RESET
+    { RUN_TEST_IDLE, SELECT_DR },           // RUN_TEST_IDLE
+    { CAPTURE_DR, SELECT_IR },              // SELECT_DR
+    { SHIFT_DR, EXIT1_DR },                 // CAPTURE_DR
+    { SHIFT_DR, EXIT1_DR },                 // SHIFT_DR
+    { PAUSE_DR, UPDATE_DR },                // EXIT1_DR
+    { PAUSE_DR, EXIT2_DR },                 // PAUSE_DR
+    { SHIFT_DR, UPDATE_DR },                // EXIT2_DR
+    { RUN_TEST_IDLE, SELECT_DR },           // UPDATE_DR
+    { CAPTURE_IR, TEST_LOGIC_RESET },       // SELECT_IR
+    { SHIFT_IR, EXIT1_IR },                 // CAPTURE_IR
+    { SHIFT_IR, EXIT1_IR },                 // SHIFT_IR
+    { PAUSE_IR, UPDATE_IR },                // EXIT1_IR
+    { PAUSE_IR, EXIT2_IR },                 // PAUSE_IR
+    { SHIFT_IR, UPDATE_IR },                // EXIT2_IR
+    { RUN_TEST_IDLE, SELECT_DR },           // UPDATE_IR
+};
+
+bits_t to_bits(uint64_t value, uint16_t len)
+{
+    bits_t bits(len);
+    for (uint16_t i = 0; i < len; i++)
+        bits[i] = i < 64 ? (value >> i) & 1 : 0;
+    return bits;
+}
+
+uint64_t from_bits(const bits_t& bits)
+{
+    uint64_t value = 0;
+    for (size_t i = 0; i < bits.size() && i < 64; i++)
+        value |= (uint64_t)bits[i] << i;
+    return value;
+}
+
+TapModel::TapModel(const std::string& name, uint8_t ir_len, uint32_t idcode)
+    : name(name), ir_len(ir_len), idcode(idcode), ir_capture(0x1), instruction(0),
+      reset_instruction((1u << ir_len) - 1)
+{
+    add_register("BYPASS", 1, std::vector<uint32_t>{ (1u << ir_len) - 1 });
+    instruction = reset_instruction;
+}
+
+TapModel::Register& TapModel::add_register(const std::string& name, uint16_t len, const std::vector<uint32_t>& opcodes)
+{
+    Register* reg = find(name);
+
+    if (reg == NULL) {
+        registers.push_back(Register{ name, len, bits_t(len, 0) });
+        reg = &registers.back();
+    }
+    for (uint32_t opcode : opcodes)
+        by_opcode[opcode] = reg - &registers[0];
+
+    // the IDCODE instruction is loaded by a TAP reset
+    if (name == "DEVICE_ID" && !opcodes.empty())
+        instruction = reset_instruction = opcodes[0];
+
+    return *reg;
+}
+
+TapModel::Register& TapModel::selected(uint32_t opcode)
+{
+    auto it = by_opcode.find(opcode);
+    return it == by_opcode.end() ? registers[0] : registers[it->second];
+}
+
+TapModel::Register* TapModel::find(const std::string& name)
+{
+    for (Register& reg : registers)
+        if (reg.name == name)
+            return &reg;
+    return NULL;
+}
+
+void TapModel::on_reset()
+{
+    instruction = reset_instruction;
+}
+
+void TapModel::on_capture_dr(Register& reg)
+{
+    if (reg.name == "BYPASS")
+        reg.value = to_bits(0, 1);
+    else if (reg.name == "DEVICE_ID")
+        reg.value = to_bits(idcode, 32);
+}
+
+void TapModel::on_update_dr(Register& reg)
+{
+    (void)reg;
+}
+
+/**
+ * @brief Value of a BSDL attribute: its strings concatenated, or the bare value.
+ */
+static std::string bsdl_attribute(const std::string& text, const std::string& name)
+{
+    std::regex attr("attribute\\s+" + name + "\\s+of\\s+\\w+\\s*:\\s*entity\\s+is\\s+([^;]*);",
+                    std::regex::icase);
+    std::regex str("\"([^\"]*)\"");
+    std::smatch m;
+    std::string value;
+
+    if (!std::regex_search(text, m, attr))
+        return "";
+
+    std::string raw = m[1];
+    for (auto it = std::sregex_iterator(raw.begin(), raw.end(), str); it != std::sregex_iterator(); ++it)
+        value += (*it)[1];
+
+    return value.empty() ? std::regex_replace(raw, std::regex("\\s+"), "") : value;
+}
+
+/**
+ * @brief Parse a binary pattern written MSB first, X bits read as 0.
+ */
+static uint32_t bsdl_pattern(const std::string& pattern)
+{
+    uint32_t value = 0;
+    for (char c : pattern)
+    {
+        if (c == '0' || c == '1' || c == 'X' || c == 'x')
+            value = (value << 1) | (c == '1');
+    }
+    return value;
+}
+
+TapModel* TapModel::from_bsdl(const std::string& path)
+{
+    std::ifstream file(path);
+    std::stringstream text;
+    std::string line;
+    std::map<std::string, std::vector<uint32_t>> opcodes;
+    std::smatch m;
+
+    if (!file)
+        return NULL;
+
+    // drop the comments
+    while (std::getline(file, line))
+        text << line.substr(0, line.find("--")) << "\n";
+    std::string bsdl = text.str();
+
+    std::string ir_len = bsdl_attribute(bsdl, "INSTRUCTION_LENGTH");
+    std::string entity;
+    if (ir_len.empty() || !std::regex_search(bsdl, m, std::regex("entity\\s+(\\w+)\\s+is", std::regex::icase)))
+        return NULL;
+    entity = m[1];
+
+    TapModel* tap = new TapModel(entity, atoi(ir_len.c_str()), 0);
+
+    // instruction name (opcode, opcode, ...)
+    std::string list = bsdl_attribute(bsdl, "INSTRUCTION_OPCODE");
+    std::regex entry("(\\w+)\\s*\\(([^)]*)\\)");
+    for (auto it = std::sregex_iterator(list.begin(), list.end(), entry); it != std::sregex_iterator(); ++it)
+    {
+        std::stringstream codes((*it)[2].str());
+        std::string code;
+        while (std::getline(codes, code, ','))
+            opcodes[(*it)[1]].push_back(bsdl_pattern(code));
+    }
+
+    std::string capture = bsdl_attribute(bsdl, "INSTRUCTION_CAPTURE");
+    if (!capture.empty())
+        tap->ir_capture = bsdl_pattern(capture);
+
+    std::string id = bsdl_attribute(bsdl, "IDCODE_REGISTER");
+    if (!id.empty())
+        tap->idcode = bsdl_pattern(id);
+
+    uint16_t boundary_len = atoi(bsdl_attribute(bsdl, "BOUNDARY_LENGTH").c_str());
+
+    // register[length] (instruction, instruction, ...)
+    list = bsdl_attribute(bsdl, "REGISTER_ACCESS");
+    std::regex access("(\\w+)\\s*(\\[(\\d+)\\])?\\s*\\(([^)]*)\\)");
+    for (auto it = std::sregex_iterator(list.begin(), list.end(), access); it != std::sregex_iterator(); ++it)
+    {
+        std::string name = (*it)[1];
+        uint16_t len = (*it)[3].matched ? atoi((*it)[3].str().c_str()) : 1;
+        std::vector<uint32_t> codes;
+        std::stringstream names((*it)[4].str());
+        std::string instr;
+
+        if (name == "BOUNDARY")
+            len = boundary_len;
+        else if (name == "DEVICE_ID")
+            len = 32;
+
+        while (std::getline(names, instr, ','))
+        {
+            instr = std::regex_replace(instr, std::regex("\\s+"), "");
+            codes.insert(codes.end(), opcodes[instr].begin(), opcodes[instr].end());
+        }
+        tap->add_register(name, len, codes);
+    }
+
+    tap->on_reset();
+    return tap;
+}
+
+ChainModel::~ChainModel()
+{
+    clear();
+}
+
+void ChainModel::clear()
+{
+    for (TapModel* tap : devices)
+        delete tap;
+    devices.clear();
+    state = TEST_LOGIC_RESET;
+}
+
+void ChainModel::reset()
+{
+    state = TEST_LOGIC_RESET;
+    for (TapModel* tap : devices)
+        tap->on_reset();
+}
+
+void ChainModel::rising_edge()
+{
+    uint8_t carry = 0;
+
+    tck_cycles++;
+
+    switch (state)
+    {
+    case CAPTURE_DR:
+        for (TapModel* tap : devices)
+        {
+            TapModel::Register& reg = tap->selected(tap->instruction);
+            tap->on_capture_dr(reg);
+            tap->shift.assign(reg.value.begin(), reg.value.end());
+        }
+        break;
+
+    case CAPTURE_IR:
+        for (TapModel* tap : devices)
+        {
+            bits_t bits = to_bits(tap->ir_capture, tap->ir_len);
+            tap->shift.assign(bits.begin(), bits.end());
+        }
+        break;
+
+    case SHIFT_DR:
+    case SHIFT_IR:
+        // TDI enters the TAP farthest from TDO
+        shift_cycles++;
+        carry = tdi;
+        for (size_t i = devices.size(); i > 0; i--)
+        {
+            TapModel* tap = devices[i - 1];
+            tap->shift.push_back(carry);
+            carry = tap->shift.front();
+            tap->shift.pop_front();
+        }
+        break;
+
+    case RUN_TEST_IDLE:
+        for (TapModel* tap : devices)
+            tap->on_idle_clock();
+        break;
+
+    default:
+        break;
+    }
+
+    uint8_t next = next_state[state][tms ? 1 : 0];
+    if (next == TEST_LOGIC_RESET && state != TEST_LOGIC_RESET)
+        reset();
+    state = next;
+}
+
+void ChainModel::falling_edge()
+{
+    switch (state)
+    {
+    case UPDATE_DR:
+        for (TapModel* tap : devices)
+        {
+            TapModel::Register& reg = tap->selected(tap->instruction);
+            reg.value.assign(tap->shift.begin(), tap->shift.end());
+            reg.value.resize(reg.len, 0);
+            tap->on_update_dr(reg);
+        }
+        break;
+
+    case UPDATE_IR:
+        for (TapModel* tap : devices)
+        {
+            tap->instruction = from_bits(bits_t(tap->shift.begin(), tap->shift.end()));
+            tap->on_update_ir();
+        }
+        break;
+
+    default:
+        break;
+    }
+
+    // TDO is only driven in the shift states, the pull up reads 1 otherwise
+    if ((state == SHIFT_DR || state == SHIFT_IR) && !devices.empty() && !devices[0]->shift.empty())
+        tdo = devices[0]->shift.front();
+    else
+        tdo = 1;
+}
+
+void ChainModel::pin_write(uint8_t pin, uint8_t val)
+{
+    val = val ? 1 : 0;
+
+    switch (pin)
+    {
+    case TCK:
+        if (val && !tck)
+            rising_edge();
+        else if (!val && tck)
+            falling_edge();
+        tck = val;
+        break;
+    case TMS:
+        tms = val;
+        break;
+    case TDI:
+        tdi = val;
+        break;
+    case TRST:
+        // active low
+        if (!val)
+            reset();
+        break;
+    default:
+        break;
+    }
+}
+
+uint8_t ChainModel::pin_read(uint8_t pin)
+{
+    switch (pin)
+    {
+    case TDO:
+        return tdo;
+    case TCK:
+        return tck;
+    case RTCK:
+        return rtck ? tck : 1;
+    default:
+        return 0;
+    }
+}
+
+void sim_pin_write(uint8_t pin, uint8_t val)
+{
+    sim_chain.pin_write(pin, val);
+}
+
+uint8_t sim_pin_read(uint8_t pin)
+{
+    return sim_chain.pin_read(pin);
+}
+
+void sim_gang_write(uint32_t val)
+{
+    // TMS and TDI settle before the TCK edge of the same write
+    for (int c = 0; c < GANG_MAX_CHAINS; c++)
+    {
+        sim_gang[c].pin_write(TMS, (val >> sim_gang_bits[c][1]) & 1);
+        sim_gang[c].pin_write(TDI, (val >> sim_gang_bits[c][2]) & 1);
+        sim_gang[c].pin_write(TCK, (val >> sim_gang_bits[c][0]) & 1);
+    }
+}
+
+uint32_t sim_gang_read()
+{
+    uint32_t val = 0;
+
+    for (int c = 0; c < GANG_MAX_CHAINS; c++)
+        val |= (uint32_t)sim_gang[c].pin_read(TDO) << sim_gang_bits[c][3];
+    return val;
+}
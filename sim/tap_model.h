@@ -0,0 +1,133 @@
+/** @file tap_model.h
+ *
+ * @brief Software IEEE 1149.1 TAPs for the host simulation build.
+ *
+ * The sketch drives the pins through sim_pin_write()/sim_pin_read()
+ * (see jtag_pins.h), and the pins drive a chain of TapModel devices that
+ * share TCK and TMS. In gang mode sim_gang_write()/sim_gang_read() (see gang.h)
+ * drive the chains of sim_gang[] instead, 4 port bits per chain. TDO changes on the falling edge of TCK, TDI is sampled
+ * on the rising edge, like on real devices.
+ */
+#ifndef __TAP_MODEL_H__
+#define __TAP_MODEL_H__
+
+#include <stdint.h>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+typedef std::vector<uint8_t> bits_t; // one bit per entry, bit 0 is shifted first
+
+/**
+ * A single TAP: an IR and the data registers selected by its instructions.
+ */
+class TapModel
+{
+public:
+    struct Register
+    {
+        std::string name;
+        uint16_t len;
+        bits_t value; // captured on CAPTURE_DR, replaced on UPDATE_DR
+    };
+
+    TapModel(const std::string& name, uint8_t ir_len, uint32_t idcode);
+    virtual ~TapModel() {}
+
+    /**
+     * @brief Build a TAP from a BSDL file: IR length, opcodes, IR capture,
+     * IDCODE and the data registers with their lengths.
+     * @return The TAP, or NULL if a mandatory attribute is missing.
+     */
+    static TapModel* from_bsdl(const std::string& path);
+
+    /**
+     * @brief Add a data register, selected by the given opcodes.
+     */
+    Register& add_register(const std::string& name, uint16_t len, const std::vector<uint32_t>& opcodes);
+
+    /**
+     * @brief The register selected by an opcode, BYPASS for unknown opcodes.
+     */
+    Register& selected(uint32_t opcode);
+
+    Register* find(const std::string& name);
+
+    std::string name;
+    uint8_t ir_len;
+    uint32_t idcode;
+    uint32_t ir_capture;
+    uint32_t instruction;   // latched on UPDATE_IR
+    uint32_t reset_instruction;
+
+    // TAP controller hooks, a device model overrides them to react to scans
+    virtual void on_reset();
+    virtual void on_capture_dr(Register& reg);
+    virtual void on_update_dr(Register& reg);
+    virtual void on_update_ir() {}
+    virtual void on_idle_clock() {}
+
+    std::deque<uint8_t> shift; // the register between TDI and TDO of this TAP
+
+protected:
+    std::vector<Register> registers;
+    std::map<uint32_t, size_t> by_opcode;
+};
+
+/**
+ * The chain behind the pins. devices[0] is the nearest to TDO, like taps[0]
+ * of the sketch.
+ */
+class ChainModel
+{
+public:
+    ~ChainModel();
+
+    void add(TapModel* tap) { devices.push_back(tap); }
+    void clear();
+
+    void pin_write(uint8_t pin, uint8_t val);
+    uint8_t pin_read(uint8_t pin);
+
+    std::vector<TapModel*> devices;
+    uint8_t state = 0; // tap_state of the sketch
+    uint8_t tck = 0;
+    uint8_t tms = 1;
+    uint8_t tdi = 1;
+    uint8_t tdo = 1;
+
+    // RTCK follows TCK (adaptive clocking target), otherwise it is pulled up
+    bool rtck = false;
+
+    // statistics
+    uint64_t tck_cycles = 0;
+    uint64_t shift_cycles = 0;
+
+private:
+    void rising_edge();
+    void falling_edge();
+    void reset();
+};
+
+/**
+ * The chain the simulated pins are connected to.
+ */
+extern ChainModel sim_chain;
+
+/**
+ * The chains of the simulated gang port, GANG_MAX_CHAINS of them.
+ */
+extern ChainModel sim_gang[];
+
+/**
+ * @brief Turn a register value into bits, LSB first.
+ */
+bits_t to_bits(uint64_t value, uint16_t len);
+
+/**
+ * @brief Turn up to 64 bits into a value, bit 0 is the LSB.
+ */
+uint64_t from_bits(const bits_t& bits);
+
+#endif /* __TAP_MODEL_H__ */